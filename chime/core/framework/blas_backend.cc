@@ -0,0 +1,328 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/blas_backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#ifdef CHIME_WITH_EIGEN
+#include <Eigen/Core>
+#endif  // CHIME_WITH_EIGEN
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/packed_matrix.h"
+#include "chime/core/platform/logging.hpp"
+
+namespace chime {
+
+namespace {
+
+// ---------------------------------------------------------------- OpenBLAS
+
+void openblas_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                   utens_t n, utens_t k, float32 alpha, const float32 *A,
+                   utens_t lda, const float32 *B, utens_t ldb, float32 beta,
+                   float32 *C, utens_t ldc) {
+  cblas_sgemm(CblasRowMajor, transA, transB, static_cast<blasint>(m),
+              static_cast<blasint>(n), static_cast<blasint>(k), alpha, A,
+              static_cast<blasint>(lda), B, static_cast<blasint>(ldb), beta, C,
+              static_cast<blasint>(ldc));
+}
+
+void openblas_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                   utens_t n, utens_t k, float64 alpha, const float64 *A,
+                   utens_t lda, const float64 *B, utens_t ldb, float64 beta,
+                   float64 *C, utens_t ldc) {
+  cblas_dgemm(CblasRowMajor, transA, transB, static_cast<blasint>(m),
+              static_cast<blasint>(n), static_cast<blasint>(k), alpha, A,
+              static_cast<blasint>(lda), B, static_cast<blasint>(ldb), beta, C,
+              static_cast<blasint>(ldc));
+}
+
+void openblas_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, float32 alpha,
+                   const float32 *A, utens_t lda, const float32 *x,
+                   utens_t incx, float32 beta, float32 *y, utens_t incy) {
+  cblas_sgemv(CblasRowMajor, transA, static_cast<blasint>(m),
+              static_cast<blasint>(n), alpha, A, static_cast<blasint>(lda), x,
+              static_cast<blasint>(incx), beta, y, static_cast<blasint>(incy));
+}
+
+void openblas_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, float64 alpha,
+                   const float64 *A, utens_t lda, const float64 *x,
+                   utens_t incx, float64 beta, float64 *y, utens_t incy) {
+  cblas_dgemv(CblasRowMajor, transA, static_cast<blasint>(m),
+              static_cast<blasint>(n), alpha, A, static_cast<blasint>(lda), x,
+              static_cast<blasint>(incx), beta, y, static_cast<blasint>(incy));
+}
+
+// ----------------------------------------------------------------- Built-in
+
+template<typename Dtype>
+void builtin_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                  utens_t n, utens_t k, Dtype alpha, const Dtype *A,
+                  utens_t lda, const Dtype *B, utens_t ldb, Dtype beta,
+                  Dtype *C, utens_t ldc) {
+  // Packed B goes to a buffer that is kept around, sparing an allocation and
+  // its page faults on every call.
+  static thread_local std::vector<Dtype> packed_b;
+  const kernels::GemmKernels<Dtype> &gemm = kernels::GetGemmKernels<Dtype>();
+  const utens_t nr = static_cast<utens_t>(gemm.nr);
+  const utens_t size = (n + nr - 1) / nr * nr * k;
+  if (packed_b.size() < size) packed_b.resize(size);
+  internal::PackGemmB(transB, k, n, B, ldb, nr, packed_b.data());
+  internal::GemmPackedB(transA, m, n, k, alpha, A, lda, packed_b.data(), gemm,
+                        beta, C, ldc);
+}
+
+template<typename Dtype>
+void builtin_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Dtype alpha,
+                  const Dtype *A, utens_t lda, const Dtype *x, utens_t incx,
+                  Dtype beta, Dtype *y, utens_t incy) {
+  const utens_t y_size = transA == CblasNoTrans ? m : n;
+  const utens_t x_size = transA == CblasNoTrans ? n : m;
+  const int64_t row_size = static_cast<int64_t>(std::max<utens_t>(x_size, 1));
+  const int64_t grain_size = std::max<int64_t>(1, kIntraOpGrainSize / row_size);
+  auto store = [=](utens_t i, Dtype sum) {
+    Dtype &out = y[i * incy];
+    out = beta == Dtype(0) ? alpha * sum : alpha * sum + beta * out;
+  };
+
+  if (transA == CblasNoTrans) {
+    // One dot product per row of A.
+    ParallelFor(static_cast<int64_t>(y_size), grain_size,
+                [&](int64_t begin, int64_t end) {
+                  for (utens_t i = begin; i < static_cast<utens_t>(end); i++) {
+                    const Dtype *row = A + i * lda;
+                    Dtype sum = Dtype(0);
+                    for (utens_t j = 0; j < x_size; j++) {
+                      sum += row[j] * x[j * incx];
+                    }
+                    store(i, sum);
+                  }
+                });
+    return;
+  }
+
+  // Rows of A scaled by x are added up, a block of columns per shard.
+  ParallelFor(static_cast<int64_t>(y_size), grain_size,
+              [&](int64_t begin, int64_t end) {
+                std::vector<Dtype> sum(end - begin, Dtype(0));
+                for (utens_t i = 0; i < x_size; i++) {
+                  const Dtype *row = A + i * lda + begin;
+                  const Dtype xi = x[i * incx];
+                  for (utens_t j = 0; j < sum.size(); j++) {
+                    sum[j] += row[j] * xi;
+                  }
+                }
+                for (utens_t j = 0; j < sum.size(); j++) {
+                  store(begin + j, sum[j]);
+                }
+              });
+}
+
+// -------------------------------------------------------------------- Eigen
+
+#ifdef CHIME_WITH_EIGEN
+
+template<typename Dtype>
+using EigenMatrix =
+    Eigen::Matrix<Dtype, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+template<typename Dtype>
+using EigenConstMap =
+    Eigen::Map<const EigenMatrix<Dtype>, 0, Eigen::OuterStride<>>;
+
+template<typename Dtype>
+using EigenMap =
+    Eigen::Map<EigenMatrix<Dtype>, 0, Eigen::OuterStride<>>;
+
+// C = alpha * a * b + beta * C. C is not read when beta is zero, as in BLAS,
+// so that garbage or NaNs in an output buffer do not leak into the result.
+template<typename Dtype, typename LhsExpr, typename RhsExpr>
+void eigen_product(Dtype alpha, const LhsExpr &a, const RhsExpr &b,
+                   Dtype beta, EigenMap<Dtype> *c) {
+  if (beta == Dtype(0)) {
+    c->noalias() = alpha * a * b;
+  } else {
+    *c *= beta;
+    c->noalias() += alpha * a * b;
+  }
+}
+
+template<typename Dtype>
+void eigen_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                utens_t n, utens_t k, Dtype alpha, const Dtype *A, utens_t lda,
+                const Dtype *B, utens_t ldb, Dtype beta, Dtype *C,
+                utens_t ldc) {
+  const bool ta = transA != CblasNoTrans;
+  const bool tb = transB != CblasNoTrans;
+  const EigenConstMap<Dtype> a(A, ta ? k : m, ta ? m : k,
+                               Eigen::OuterStride<>(lda));
+  const EigenConstMap<Dtype> b(B, tb ? n : k, tb ? k : n,
+                               Eigen::OuterStride<>(ldb));
+  EigenMap<Dtype> c(C, m, n, Eigen::OuterStride<>(ldc));
+  if (!ta && !tb) {
+    eigen_product(alpha, a, b, beta, &c);
+  } else if (!ta) {
+    eigen_product(alpha, a, b.transpose(), beta, &c);
+  } else if (!tb) {
+    eigen_product(alpha, a.transpose(), b, beta, &c);
+  } else {
+    eigen_product(alpha, a.transpose(), b.transpose(), beta, &c);
+  }
+}
+
+template<typename Dtype>
+void eigen_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Dtype alpha,
+                const Dtype *A, utens_t lda, const Dtype *x, utens_t incx,
+                Dtype beta, Dtype *y, utens_t incy) {
+  const bool ta = transA != CblasNoTrans;
+  const EigenConstMap<Dtype> a(A, m, n, Eigen::OuterStride<>(lda));
+  // Vectors are mapped as one-column matrices with rows `inc` apart.
+  const EigenConstMap<Dtype> xv(x, ta ? m : n, 1, Eigen::OuterStride<>(incx));
+  EigenMap<Dtype> yv(y, ta ? n : m, 1, Eigen::OuterStride<>(incy));
+  if (ta) {
+    eigen_product(alpha, a.transpose(), xv, beta, &yv);
+  } else {
+    eigen_product(alpha, a, xv, beta, &yv);
+  }
+}
+
+#endif  // CHIME_WITH_EIGEN
+
+template<typename Dtype>
+const BlasRoutines<Dtype> &openblas_routines() {
+  static const BlasRoutines<Dtype> routines = {&openblas_gemm,
+                                               &openblas_gemv};
+  return routines;
+}
+
+template<typename Dtype>
+const BlasRoutines<Dtype> &builtin_routines() {
+  static const BlasRoutines<Dtype> routines = {&builtin_gemm<Dtype>,
+                                               &builtin_gemv<Dtype>};
+  return routines;
+}
+
+#ifdef CHIME_WITH_EIGEN
+template<typename Dtype>
+const BlasRoutines<Dtype> &eigen_routines() {
+  static const BlasRoutines<Dtype> routines = {&eigen_gemm<Dtype>,
+                                               &eigen_gemv<Dtype>};
+  return routines;
+}
+#endif  // CHIME_WITH_EIGEN
+
+BlasBackend DefaultBlasBackend() {
+  const char *env = std::getenv("CE_BLAS_BACKEND");
+  if (env == nullptr || env[0] == '\0') return BlasBackend::OPEN_BLAS;
+  BlasBackend requested;
+  if (!BlasBackendFromString(env, &requested)) {
+    LOG(WARNING) << "Unknown CE_BLAS_BACKEND `" << env << "`, using openblas";
+    return BlasBackend::OPEN_BLAS;
+  }
+  if (!BlasBackendAvailable(requested)) {
+    LOG(WARNING) << "CE_BLAS_BACKEND `" << env
+                 << "` is not compiled in, using openblas";
+    return BlasBackend::OPEN_BLAS;
+  }
+  return requested;
+}
+
+std::atomic<int> current_backend(-1);
+
+}  // namespace
+
+bool BlasBackendAvailable(BlasBackend backend) {
+  switch (backend) {
+    case BlasBackend::BUILTIN:
+    case BlasBackend::OPEN_BLAS:
+      return true;
+    case BlasBackend::EIGEN:
+#ifdef CHIME_WITH_EIGEN
+      return true;
+#else
+      return false;
+#endif  // CHIME_WITH_EIGEN
+    default:
+      return false;
+  }
+}
+
+template<typename Dtype>
+const BlasRoutines<Dtype> &GetBlasRoutines(BlasBackend backend) {
+  CHECK(BlasBackendAvailable(backend))
+      << "BLAS backend " << BlasBackendToString(backend)
+      << " is not compiled in";
+  switch (backend) {
+    case BlasBackend::BUILTIN:
+      return builtin_routines<Dtype>();
+#ifdef CHIME_WITH_EIGEN
+    case BlasBackend::EIGEN:
+      return eigen_routines<Dtype>();
+#endif  // CHIME_WITH_EIGEN
+    default:
+      return openblas_routines<Dtype>();
+  }
+}
+
+template const BlasRoutines<float32> &GetBlasRoutines<float32>(
+    BlasBackend backend);
+template const BlasRoutines<float64> &GetBlasRoutines<float64>(
+    BlasBackend backend);
+
+// Only the built-in kernels handle long double.
+template<>
+const BlasRoutines<float128> &GetBlasRoutines<float128>(BlasBackend backend) {
+  CHECK(backend == BlasBackend::BUILTIN)
+      << "float128 is only supported by the builtin BLAS backend";
+  return builtin_routines<float128>();
+}
+
+BlasBackend GetBlasBackend() {
+  int backend = current_backend.load(std::memory_order_acquire);
+  if (backend < 0) {
+    // Racing first calls compute the same default.
+    int expected = -1;
+    current_backend.compare_exchange_strong(
+        expected, static_cast<int>(DefaultBlasBackend()));
+    backend = current_backend.load(std::memory_order_acquire);
+  }
+  return static_cast<BlasBackend>(backend);
+}
+
+void SetBlasBackend(BlasBackend backend) {
+  CHECK(BlasBackendAvailable(backend))
+      << "BLAS backend " << BlasBackendToString(backend)
+      << " is not compiled in";
+  current_backend.store(static_cast<int>(backend), std::memory_order_release);
+}
+
+std::string BlasBackendToString(BlasBackend backend) {
+  switch (backend) {
+    case BlasBackend::BUILTIN:
+      return "builtin";
+    case BlasBackend::OPEN_BLAS:
+      return "openblas";
+    case BlasBackend::EIGEN:
+      return "eigen";
+    default:
+      return "unknown";
+  }
+}
+
+bool BlasBackendFromString(const std::string &name, BlasBackend *backend) {
+  for (int i = 0; i < static_cast<int>(BlasBackend::NUM_OPTIONS); i++) {
+    BlasBackend b = static_cast<BlasBackend>(i);
+    if (name == BlasBackendToString(b)) {
+      *backend = b;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace chime
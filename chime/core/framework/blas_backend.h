@@ -0,0 +1,74 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_BLAS_BACKEND_H_
+#define CHIME_CORE_FRAMEWORK_BLAS_BACKEND_H_
+
+#include <openblas/cblas.h>
+
+#include <string>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Libraries that `chime_cpu_gemm` and `chime_cpu_gemv` can run on. All the
+/// ones compiled in are registered side by side and one of them is picked per
+/// process, so they can be compared on a machine without rebuilding.
+enum class BlasBackend {
+  BUILTIN = 0,    // the register-tiled kernels of math_kernels.h
+  OPEN_BLAS = 1,
+  EIGEN = 2,      // only when built with CHIME_WITH_EIGEN
+  NUM_OPTIONS
+};
+
+/// Function-pointer table of one backend for one dtype, with the arguments
+/// of the full forms of `chime_cpu_gemm` and `chime_cpu_gemv`. Arguments are
+/// checked by the callers.
+template<typename Dtype>
+struct BlasRoutines {
+  typedef void (*GemmFn)(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                         utens_t m, utens_t n, utens_t k, Dtype alpha,
+                         const Dtype *A, utens_t lda, const Dtype *B,
+                         utens_t ldb, Dtype beta, Dtype *C, utens_t ldc);
+  typedef void (*GemvFn)(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
+                         Dtype alpha, const Dtype *A, utens_t lda,
+                         const Dtype *x, utens_t incx, Dtype beta, Dtype *y,
+                         utens_t incy);
+
+  GemmFn gemm;
+  GemvFn gemv;
+};
+
+/// Whether `backend` is compiled into this binary.
+bool BlasBackendAvailable(BlasBackend backend);
+
+/// Returns the routines of `backend` for float32 or float64. float128 only
+/// has the BUILTIN routines, which `chime_cpu_gemm` and `chime_cpu_gemv`
+/// always use for it.
+/// REQUIRES: BlasBackendAvailable(backend)
+template<typename Dtype>
+const BlasRoutines<Dtype> &GetBlasRoutines(BlasBackend backend);
+
+template<>
+const BlasRoutines<float128> &GetBlasRoutines<float128>(BlasBackend backend);
+
+/// Returns the backend that BLAS calls go to. It starts out as the value of
+/// the `CE_BLAS_BACKEND` environment variable ("builtin", "openblas" or
+/// "eigen") when that names an available backend, and OpenBLAS otherwise.
+BlasBackend GetBlasBackend();
+
+/// Switches every later BLAS call to `backend`. Calls running concurrently
+/// finish on the backend they started with.
+/// REQUIRES: BlasBackendAvailable(backend)
+void SetBlasBackend(BlasBackend backend);
+
+std::string BlasBackendToString(BlasBackend backend);
+
+/// Parses the names accepted by `CE_BLAS_BACKEND`. Returns false if `name`
+/// is not one of them.
+bool BlasBackendFromString(const std::string &name, BlasBackend *backend);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_BLAS_BACKEND_H_
@@ -0,0 +1,152 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/blas_backend.h"
+
+#include <limits>
+#include <vector>
+
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+class BlasBackendTest : public ::testing::Test {
+ protected:
+  void SetUp() override { saved_backend = GetBlasBackend(); }
+  void TearDown() override { SetBlasBackend(saved_backend); }
+
+  std::vector<BlasBackend> AvailableBackends() {
+    std::vector<BlasBackend> backends;
+    for (int i = 0; i < static_cast<int>(BlasBackend::NUM_OPTIONS); i++) {
+      BlasBackend b = static_cast<BlasBackend>(i);
+      if (BlasBackendAvailable(b)) backends.push_back(b);
+    }
+    return backends;
+  }
+
+  BlasBackend saved_backend;
+};
+
+TEST_F(BlasBackendTest, Names) {
+  for (int i = 0; i < static_cast<int>(BlasBackend::NUM_OPTIONS); i++) {
+    BlasBackend b = static_cast<BlasBackend>(i), parsed;
+    EXPECT_TRUE(BlasBackendFromString(BlasBackendToString(b), &parsed));
+    EXPECT_EQ(parsed, b);
+  }
+  BlasBackend parsed;
+  EXPECT_FALSE(BlasBackendFromString("mkl", &parsed));
+  EXPECT_TRUE(BlasBackendAvailable(BlasBackend::BUILTIN));
+  EXPECT_TRUE(BlasBackendAvailable(BlasBackend::OPEN_BLAS));
+#ifdef CHIME_WITH_EIGEN
+  EXPECT_TRUE(BlasBackendAvailable(BlasBackend::EIGEN));
+#else
+  EXPECT_FALSE(BlasBackendAvailable(BlasBackend::EIGEN));
+#endif  // CHIME_WITH_EIGEN
+}
+
+// Every backend computes the same products, with strided operands and NaNs
+// in outputs that beta = 0 must ignore. Inputs are small multiples of 1/4,
+// so results are exact whatever the order of the additions. Built with
+// `--define with_eigen=true`, the Eigen backend is compared as well.
+TEST_F(BlasBackendTest, BackendsAgree) {
+  ASSERT_EQ(AvailableBackends().size(),
+            BlasBackendAvailable(BlasBackend::EIGEN) ? 3u : 2u);
+  const utens_t m = 37, n = 29, k = 300, pad = 3;
+  std::vector<float64> a((k + pad) * (k + pad)), b((k + pad) * (k + pad));
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<float64>(static_cast<int>(i % 9) - 4) * 0.25;
+    b[i] = static_cast<float64>(static_cast<int>(i % 5) - 2) * 0.5;
+  }
+  const float64 nan = std::numeric_limits<float64>::quiet_NaN();
+
+  for (CBLAS_TRANSPOSE ta : {CblasNoTrans, CblasTrans}) {
+    for (CBLAS_TRANSPOSE tb : {CblasNoTrans, CblasTrans}) {
+      const utens_t lda = (ta == CblasNoTrans ? k : m) + pad;
+      const utens_t ldb = (tb == CblasNoTrans ? n : k) + pad;
+      const utens_t ldc = n + pad;
+      std::vector<float64> ref;
+      for (BlasBackend backend : AvailableBackends()) {
+        SetBlasBackend(backend);
+        std::vector<float64> c(m * ldc, nan), c2(m * ldc, 1.);
+        chime_cpu_gemm<float64>(ta, tb, m, n, k, 2., a.data(), lda, b.data(),
+                                ldb, 0., c.data(), ldc);
+        chime_cpu_gemm<float64>(ta, tb, m, n, k, 2., a.data(), lda, b.data(),
+                                ldb, -1., c2.data(), ldc);
+        for (utens_t i = 0; i < m; i++) {
+          for (utens_t j = 0; j < n; j++) {
+            ASSERT_EQ(c2[i * ldc + j], c[i * ldc + j] - 1.);
+          }
+          for (utens_t j = n; j < ldc; j++) ASSERT_EQ(c2[i * ldc + j], 1.);
+        }
+        if (ref.empty()) {
+          ref = c2;
+        } else {
+          EXPECT_EQ(c2, ref) << BlasBackendToString(backend);
+        }
+      }
+    }
+
+    // y = op(A) * x, with x and y strided.
+    const utens_t lda = k + pad, inc = 2;
+    const utens_t y_size = ta == CblasNoTrans ? m : k;
+    std::vector<float64> ref;
+    for (BlasBackend backend : AvailableBackends()) {
+      SetBlasBackend(backend);
+      std::vector<float64> y(y_size * inc, nan), y2(y_size * inc, 3.);
+      chime_cpu_gemv<float64>(ta, m, k, 1.5, a.data(), lda, b.data(), inc, 0.,
+                              y.data(), inc);
+      chime_cpu_gemv<float64>(ta, m, k, 1.5, a.data(), lda, b.data(), inc, 2.,
+                              y2.data(), inc);
+      for (utens_t i = 0; i < y_size; i++) {
+        ASSERT_EQ(y2[i * inc], y[i * inc] + 6.);
+        ASSERT_EQ(y2[i * inc + 1], 3.);
+      }
+      if (ref.empty()) {
+        ref = y2;
+      } else {
+        EXPECT_EQ(y2, ref) << BlasBackendToString(backend);
+      }
+    }
+  }
+}
+
+// float128 runs on the builtin kernels whatever the selected backend.
+TEST_F(BlasBackendTest, Float128) {
+  const utens_t m = 19, n = 23, k = 70;
+  std::vector<float128> a(m * k), b(k * n), c(m * n, 1.L), y(m, 1.L);
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<float128>(static_cast<int>(i % 7) - 3) * 0.25L;
+  }
+  for (utens_t i = 0; i < b.size(); i++) {
+    b[i] = static_cast<float128>(static_cast<int>(i % 5) - 2);
+  }
+  SetBlasBackend(BlasBackend::OPEN_BLAS);
+  chime_cpu_gemm<float128>(CblasNoTrans, CblasNoTrans, m, n, k, 2.L, a.data(),
+                           b.data(), 1.L, c.data());
+  chime_cpu_gemv<float128>(CblasNoTrans, m, k, 2.L, a.data(), b.data(), 1.L,
+                           y.data());
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      float128 sum = 0.L;
+      for (utens_t p = 0; p < k; p++) sum += a[i * k + p] * b[p * n + j];
+      ASSERT_EQ(c[i * n + j], 2.L * sum + 1.L);
+    }
+    float128 dot = 0.L;
+    for (utens_t p = 0; p < k; p++) dot += a[i * k + p] * b[p];
+    ASSERT_EQ(y[i], 2.L * dot + 1.L);
+  }
+}
+
+TEST_F(BlasBackendTest, SwitchAtRuntime) {
+  for (BlasBackend backend : AvailableBackends()) {
+    SetBlasBackend(backend);
+    EXPECT_EQ(GetBlasBackend(), backend);
+    std::vector<float32> a(6, 1.f), b(6, 2.f), c(4);
+    chime_cpu_gemm<float32>(CblasNoTrans, CblasNoTrans, 2, 2, 3, 1.f,
+                            a.data(), b.data(), 0.f, c.data());
+    EXPECT_EQ(c, std::vector<float32>(4, 6.f)) << BlasBackendToString(backend);
+  }
+}
+
+}  // namespace chime
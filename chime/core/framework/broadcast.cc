@@ -0,0 +1,272 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/broadcast.h"
+
+#include <algorithm>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+
+namespace {
+
+enum class BinaryOp { kAdd, kSub, kMul, kDiv };
+
+// Dimension k counted from the end, 1 for the missing leading ones.
+utens_t DimFromEnd(const std::vector<utens_t> &dims, size_t k) {
+  return k < dims.size() ? dims[dims.size() - 1 - k] : 1;
+}
+
+// The dimensions of y with unit ones dropped and neighbours merged, and the
+// strides of a and b along them, 0 where they are broadcast. The innermost
+// dimension has strides 0 or 1. A scalar result is a single dimension of 1
+// with a stride of 1 for a and 0 for b.
+struct BroadcastPlan {
+  BroadcastPlan(const std::vector<utens_t> &a_dims,
+                const std::vector<utens_t> &b_dims);
+
+  std::vector<utens_t> dims;
+  std::vector<utens_t> a_strides;
+  std::vector<utens_t> b_strides;
+  utens_t num_elements;
+};
+
+BroadcastPlan::BroadcastPlan(const std::vector<utens_t> &a_dims,
+                             const std::vector<utens_t> &b_dims)
+    : num_elements(1) {
+  const std::vector<utens_t> y_dims = BroadcastDims(a_dims, b_dims);
+  const size_t rank = y_dims.size();
+  utens_t a_stride = 1, b_stride = 1;
+  // Innermost first: a dimension joins the one inside it when both operands
+  // step over it as one block, contiguous or broadcast.
+  for (size_t k = 0; k < rank; k++) {
+    const utens_t size = y_dims[rank - 1 - k];
+    const utens_t a_size = DimFromEnd(a_dims, k);
+    const utens_t b_size = DimFromEnd(b_dims, k);
+    const utens_t sa = a_size == 1 ? 0 : a_stride;
+    const utens_t sb = b_size == 1 ? 0 : b_stride;
+    a_stride *= a_size;
+    b_stride *= b_size;
+    num_elements *= size;
+    if (size == 1) continue;
+    if (!dims.empty() && sa == a_strides.back() * dims.back() &&
+        sb == b_strides.back() * dims.back()) {
+      dims.back() *= size;
+    } else {
+      dims.push_back(size);
+      a_strides.push_back(sa);
+      b_strides.push_back(sb);
+    }
+  }
+  if (dims.empty()) {
+    dims.push_back(1);
+    a_strides.push_back(1);
+    b_strides.push_back(0);
+  }
+  std::reverse(dims.begin(), dims.end());
+  std::reverse(a_strides.begin(), a_strides.end());
+  std::reverse(b_strides.begin(), b_strides.end());
+}
+
+// Offsets in a and b of the start of a row of y, a row being the innermost
+// dimension of a plan. `Next` moves to the following row.
+struct RowOffsets {
+  RowOffsets(const BroadcastPlan &plan, utens_t row)
+      : plan(plan), index(plan.dims.size() - 1), a(0), b(0) {
+    for (size_t d = index.size(); d-- > 0;) {
+      index[d] = row % plan.dims[d];
+      row /= plan.dims[d];
+      a += index[d] * plan.a_strides[d];
+      b += index[d] * plan.b_strides[d];
+    }
+  }
+
+  void Next() {
+    for (size_t d = index.size(); d-- > 0;) {
+      a += plan.a_strides[d];
+      b += plan.b_strides[d];
+      if (++index[d] < plan.dims[d]) return;
+      a -= plan.dims[d] * plan.a_strides[d];
+      b -= plan.dims[d] * plan.b_strides[d];
+      index[d] = 0;
+    }
+  }
+
+  const BroadcastPlan &plan;
+  std::vector<utens_t> index;
+  utens_t a;
+  utens_t b;
+};
+
+template<typename Dtype>
+typename kernels::ElementwiseKernels<Dtype>::BinaryFn ElementwiseKernel(
+    BinaryOp op) {
+  const kernels::ElementwiseKernels<Dtype> &k =
+      kernels::GetElementwiseKernels<Dtype>();
+  switch (op) {
+    case BinaryOp::kAdd:
+      return k.add;
+    case BinaryOp::kSub:
+      return k.sub;
+    case BinaryOp::kMul:
+      return k.mul;
+    default:
+      return k.div;
+  }
+}
+
+template<typename Dtype>
+typename kernels::BroadcastKernels<Dtype>::RhsFn RhsKernel(BinaryOp op) {
+  const kernels::BroadcastKernels<Dtype> &k =
+      kernels::GetBroadcastKernels<Dtype>();
+  switch (op) {
+    case BinaryOp::kAdd:
+      return k.add_rhs;
+    case BinaryOp::kSub:
+      return k.sub_rhs;
+    case BinaryOp::kMul:
+      return k.mul_rhs;
+    default:
+      return k.div_rhs;
+  }
+}
+
+template<typename Dtype>
+typename kernels::BroadcastKernels<Dtype>::LhsFn LhsKernel(BinaryOp op) {
+  const kernels::BroadcastKernels<Dtype> &k =
+      kernels::GetBroadcastKernels<Dtype>();
+  switch (op) {
+    case BinaryOp::kAdd:
+      return k.add_lhs;
+    case BinaryOp::kSub:
+      return k.sub_lhs;
+    case BinaryOp::kMul:
+      return k.mul_lhs;
+    default:
+      return k.div_lhs;
+  }
+}
+
+template<typename Dtype>
+void Broadcast(BinaryOp op, const std::vector<utens_t> &a_dims,
+               const Dtype *a, const std::vector<utens_t> &b_dims,
+               const Dtype *b, Dtype *y) {
+  DCHECK(a);
+  DCHECK(b);
+  DCHECK(y);
+  const BroadcastPlan plan(a_dims, b_dims);
+  if (plan.num_elements == 0) return;
+  const utens_t n = plan.dims.back();
+  const bool a_row = plan.a_strides.back() != 0;
+  const bool b_row = plan.b_strides.back() != 0;
+  const auto elementwise = ElementwiseKernel<Dtype>(op);
+  const auto rhs = RhsKernel<Dtype>(op);
+  const auto lhs = LhsKernel<Dtype>(op);
+
+  // Rows longer than a shard are cut in pieces, so that equal shapes, which
+  // make a single row, are still split over the threads.
+  const utens_t piece = std::min<utens_t>(n, kIntraOpGrainSize);
+  const utens_t pieces = (n + piece - 1) / piece;
+  const utens_t num_rows = plan.num_elements / n;
+  const int64_t grain =
+      std::max<int64_t>(1, kIntraOpGrainSize / static_cast<int64_t>(piece));
+  ParallelFor(
+      static_cast<int64_t>(num_rows * pieces), grain,
+      [&](int64_t first, int64_t last) {
+        RowOffsets row(plan, first / pieces);
+        for (int64_t item = first; item < last; item++) {
+          if (item > first && item % pieces == 0) row.Next();
+          const utens_t begin = item % pieces * piece;
+          const utens_t len = std::min(piece, n - begin);
+          const Dtype *pa = a + row.a + (a_row ? begin : 0);
+          const Dtype *pb = b + row.b + (b_row ? begin : 0);
+          Dtype *py = y + item / pieces * n + begin;
+          if (a_row && b_row) {
+            elementwise(len, pa, pb, py);
+          } else if (a_row) {
+            rhs(len, pa, *pb, py);
+          } else {
+            lhs(len, *pa, pb, py);
+          }
+        }
+      });
+}
+
+}  // namespace
+
+std::vector<utens_t> BroadcastDims(const std::vector<utens_t> &a_dims,
+                                   const std::vector<utens_t> &b_dims) {
+  const size_t rank = std::max(a_dims.size(), b_dims.size());
+  std::vector<utens_t> y_dims(rank);
+  for (size_t k = 0; k < rank; k++) {
+    const utens_t a = DimFromEnd(a_dims, k);
+    const utens_t b = DimFromEnd(b_dims, k);
+    CHECK(a == b || a == 1 || b == 1)
+        << "Dimensions " << a << " and " << b << ", " << k
+        << " from the end, do not broadcast";
+    y_dims[rank - 1 - k] = a == 1 ? b : a;
+  }
+  return y_dims;
+}
+
+template<typename Dtype>
+void chime_cpu_broadcast_add(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y) {
+  Broadcast(BinaryOp::kAdd, a_dims, a, b_dims, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_broadcast_sub(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y) {
+  Broadcast(BinaryOp::kSub, a_dims, a, b_dims, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_broadcast_mul(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y) {
+  Broadcast(BinaryOp::kMul, a_dims, a, b_dims, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_broadcast_div(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y) {
+  Broadcast(BinaryOp::kDiv, a_dims, a, b_dims, b, y);
+}
+
+#define INSTANTIATE_BROADCAST(Dtype)                                          \
+  template void chime_cpu_broadcast_add<Dtype>(                               \
+      const std::vector<utens_t> &, const Dtype *,                            \
+      const std::vector<utens_t> &, const Dtype *, Dtype *);                  \
+  template void chime_cpu_broadcast_sub<Dtype>(                               \
+      const std::vector<utens_t> &, const Dtype *,                            \
+      const std::vector<utens_t> &, const Dtype *, Dtype *);                  \
+  template void chime_cpu_broadcast_mul<Dtype>(                               \
+      const std::vector<utens_t> &, const Dtype *,                            \
+      const std::vector<utens_t> &, const Dtype *, Dtype *);                  \
+  template void chime_cpu_broadcast_div<Dtype>(                               \
+      const std::vector<utens_t> &, const Dtype *,                            \
+      const std::vector<utens_t> &, const Dtype *, Dtype *)
+
+INSTANTIATE_BROADCAST(int8);
+INSTANTIATE_BROADCAST(int16);
+INSTANTIATE_BROADCAST(int32);
+INSTANTIATE_BROADCAST(int64);
+INSTANTIATE_BROADCAST(uint8);
+INSTANTIATE_BROADCAST(uint16);
+INSTANTIATE_BROADCAST(uint32);
+INSTANTIATE_BROADCAST(uint64);
+INSTANTIATE_BROADCAST(float32);
+INSTANTIATE_BROADCAST(float64);
+INSTANTIATE_BROADCAST(float128);
+
+}  // namespace chime
@@ -0,0 +1,61 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_BROADCAST_H_
+#define CHIME_CORE_FRAMEWORK_BROADCAST_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Broadcasting binary operations between row-major arrays of dimensions
+/// `a_dims` and `b_dims`, such as the `TensorShape::Dims()` of two tensors.
+/// Dimensions are aligned at the end, a missing one counts as 1, and each
+/// pair must be equal or contain a 1, which is repeated along the other: a
+/// bias of dimensions {C} adds to every row of {N, C}, a scale of {C, 1, 1}
+/// multiplies every channel of {N, C, H, W}. Nothing is expanded in memory.
+///
+/// Unit dimensions are dropped and neighbouring dimensions merged wherever
+/// both operands are contiguous or broadcast across them, so that the
+/// innermost remaining dimension is as long as possible. It runs the
+/// vectorized elementwise kernel when neither operand is broadcast along it
+/// (equal shapes, or a row repeated over the outer dimensions), and the
+/// kernels with a broadcast operand otherwise (a scalar, or a column repeated
+/// along the rows). The rows, or pieces of long ones, are split over the
+/// intra-op threads.
+///
+/// y has the dimensions of `BroadcastDims(a_dims, b_dims)` and may alias an
+/// operand of the same dimensions. Every type of the `chime_cpu_add` family
+/// is supported but float16 and bfloat16.
+std::vector<utens_t> BroadcastDims(const std::vector<utens_t> &a_dims,
+                                   const std::vector<utens_t> &b_dims);
+
+template<typename Dtype>
+void chime_cpu_broadcast_add(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_broadcast_sub(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_broadcast_mul(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_broadcast_div(const std::vector<utens_t> &a_dims,
+                             const Dtype *a,
+                             const std::vector<utens_t> &b_dims,
+                             const Dtype *b, Dtype *y);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_BROADCAST_H_
@@ -0,0 +1,130 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/broadcast.h"
+
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+// Offset in an operand of dimensions `dims` of element `i` of y.
+utens_t SourceOffset(const std::vector<utens_t> &y_dims,
+                     const std::vector<utens_t> &dims, utens_t i) {
+  utens_t offset = 0, stride = 1;
+  for (size_t k = 0; k < y_dims.size(); k++) {
+    const utens_t index = i % y_dims[y_dims.size() - 1 - k];
+    i /= y_dims[y_dims.size() - 1 - k];
+    if (k < dims.size()) {
+      const utens_t d = dims[dims.size() - 1 - k];
+      if (d != 1) offset += index * stride;
+      stride *= d;
+    }
+  }
+  return offset;
+}
+
+template<typename Dtype>
+void CheckAgainstReference(const std::vector<utens_t> &a_dims,
+                           const std::vector<utens_t> &b_dims) {
+  const std::vector<utens_t> y_dims = BroadcastDims(a_dims, b_dims);
+  const std::vector<Dtype> a = Pattern<Dtype>(NumElements(a_dims), 1, 97, 1, 1);
+  const std::vector<Dtype> b = Pattern<Dtype>(NumElements(b_dims), 2, 97, 1, 1);
+  const utens_t n = NumElements(y_dims);
+  std::vector<Dtype> add(n), sub(n), mul(n), div(n);
+  chime_cpu_broadcast_add(a_dims, a.data(), b_dims, b.data(), add.data());
+  chime_cpu_broadcast_sub(a_dims, a.data(), b_dims, b.data(), sub.data());
+  chime_cpu_broadcast_mul(a_dims, a.data(), b_dims, b.data(), mul.data());
+  chime_cpu_broadcast_div(a_dims, a.data(), b_dims, b.data(), div.data());
+  for (utens_t i = 0; i < n; i++) {
+    const Dtype x = a[SourceOffset(y_dims, a_dims, i)];
+    const Dtype z = b[SourceOffset(y_dims, b_dims, i)];
+    EXPECT_EQ(add[i], static_cast<Dtype>(x + z)) << i;
+    EXPECT_EQ(sub[i], static_cast<Dtype>(x - z)) << i;
+    EXPECT_EQ(mul[i], static_cast<Dtype>(x * z)) << i;
+    EXPECT_EQ(div[i], static_cast<Dtype>(x / z)) << i;
+  }
+}
+
+// Pairs of operand dimensions covering every inner loop: equal shapes, a
+// scalar on either side, a row, a column, a channel and both operands
+// broadcast at once.
+const std::vector<std::pair<std::vector<utens_t>, std::vector<utens_t>>>
+    kCases = {{{5, 7}, {5, 7}},
+              {{4, 33}, {}},
+              {{1}, {3, 40}},
+              {{6, 35}, {35}},
+              {{6, 35}, {6, 1}},
+              {{2, 3, 5, 7}, {3, 1, 1}},
+              {{3, 1}, {1, 40}},
+              {{1, 4, 1, 9}, {2, 1, 1, 3, 1}},
+              {{2, 1, 37}, {2, 5, 37}},
+              {{}, {}}};
+
+}  // namespace
+
+TEST(BroadcastTest, TestBroadcastDims) {
+  EXPECT_EQ(BroadcastDims({2, 1, 4}, {3, 1}), std::vector<utens_t>({2, 3, 4}));
+  EXPECT_EQ(BroadcastDims({}, {5}), std::vector<utens_t>({5}));
+  EXPECT_EQ(BroadcastDims({0, 1}, {1, 3}), std::vector<utens_t>({0, 3}));
+  EXPECT_DEATH(BroadcastDims({2, 3}, {2}), "do not broadcast");
+}
+
+TEST(BroadcastTest, TestAgainstReference) {
+  for (const auto &c : kCases) {
+    CheckAgainstReference<float32>(c.first, c.second);
+    CheckAgainstReference<float64>(c.second, c.first);
+    CheckAgainstReference<int32>(c.first, c.second);
+    CheckAgainstReference<uint8>(c.second, c.first);
+  }
+}
+
+TEST(BroadcastTest, TestEmptyAndInPlace) {
+  std::vector<float32> a = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+  const std::vector<float32> bias = {10.f, 20.f, 30.f};
+  float32 untouched = -1.f;
+  chime_cpu_broadcast_add<float32>({0, 3}, a.data(), {3}, bias.data(),
+                                   &untouched);
+  EXPECT_EQ(untouched, -1.f);
+  chime_cpu_broadcast_add<float32>({2, 3}, a.data(), {3}, bias.data(),
+                                   a.data());
+  EXPECT_EQ(a, std::vector<float32>({11.f, 22.f, 33.f, 14.f, 25.f, 36.f}));
+}
+
+// Long rows are cut in pieces and outer rows split over the threads, with
+// the same result on any number of threads.
+TEST(BroadcastTest, TestIntraOpParallel) {
+  const std::vector<std::pair<std::vector<utens_t>, std::vector<utens_t>>>
+      cases = {{{1 << 20}, {1 << 20}},
+               {{300, 1000}, {1000}},
+               {{1000, 300}, {1000, 1}},
+               {{8, 64, 1000}, {64, 1}},
+               {{1 << 18}, {}}};
+  for (const auto &c : cases) {
+    const std::vector<float32> a =
+        Pattern<float32>(NumElements(c.first), 1, 97, 1, 1);
+    const std::vector<float32> b =
+        Pattern<float32>(NumElements(c.second), 2, 97, 1, 1);
+    const utens_t n = NumElements(BroadcastDims(c.first, c.second));
+    std::vector<float32> ref(n), y(n);
+    ScopedIntraOpNumThreads threads(1);
+    chime_cpu_broadcast_mul(c.first, a.data(), c.second, b.data(),
+                            ref.data());
+    SetIntraOpNumThreads(4);
+    chime_cpu_broadcast_mul(c.first, a.data(), c.second, b.data(), y.data());
+    EXPECT_EQ(y, ref);
+    for (utens_t i = 0; i < n; i += 4099) {
+      const std::vector<utens_t> y_dims = BroadcastDims(c.first, c.second);
+      EXPECT_EQ(y[i], a[SourceOffset(y_dims, c.first, i)] *
+                          b[SourceOffset(y_dims, c.second, i)])
+          << i;
+    }
+  }
+}
+
+}  // namespace chime
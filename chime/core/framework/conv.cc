@@ -0,0 +1,553 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/conv.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "chime/core/framework/broadcast.h"
+#include "chime/core/framework/grouped_conv.h"
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/reduction.h"
+#include "chime/core/framework/winograd.h"
+
+namespace chime {
+
+namespace {
+
+// Bytes of im2col matrix built at a time, half of a 1MB L2 so that the
+// panels of the filters and of the output that GEMM works on fit alongside.
+constexpr utens_t kIm2colTileBytes = 512 * 1024;
+
+// Fewest output pixels per tile, so that GEMM still gets a wide enough
+// product when the im2col rows are very long.
+constexpr utens_t kIm2colMinTile = 64;
+
+// Fewest input and output channels for which the transforms of Winograd
+// cost less than the multiplies they save.
+constexpr utens_t kWinogradMinChannels = 16;
+
+// Sizes derived from `Conv2DParams` shared by all the passes. Pixels are
+// counted over one image for NCHW, whose GEMMs go image by image, and over
+// the whole batch for NHWC, whose im2col rows are pixels.
+struct ConvShape {
+  ConvShape(const Conv2DParams &p, size_t bytes)
+      : out_h(p.OutH()),
+        out_w(p.OutW()),
+        pixels(out_h * out_w),
+        taps(p.kernel_h * p.kernel_w),
+        k(CheckedGroupChannels(p) * taps),
+        pointwise(taps == 1 && p.stride_h == 1 && p.stride_w == 1 &&
+                  p.pad_h == 0 && p.pad_w == 0) {
+    const utens_t rows =
+        p.layout == ConvLayout::kNCHW ? pixels : p.batch * pixels;
+    tile = std::min(rows, std::max(kIm2colMinTile,
+                                   kIm2colTileBytes /
+                                       std::max<utens_t>(1, k * bytes)));
+  }
+
+  utens_t out_h;
+  utens_t out_w;
+  utens_t pixels;
+  utens_t taps;
+  // Length of an im2col row, channels of a group times kernel taps.
+  utens_t k;
+  // Output pixels per im2col tile.
+  utens_t tile;
+  bool pointwise;
+
+ private:
+  static utens_t CheckedGroupChannels(const Conv2DParams &p) {
+    CHECK_GT(p.groups, 0u);
+    CHECK_EQ(p.in_channels % p.groups, 0u)
+        << p.groups << " groups do not divide " << p.in_channels
+        << " input channels";
+    CHECK_EQ(p.out_channels % p.groups, 0u)
+        << p.groups << " groups do not divide " << p.out_channels
+        << " output channels";
+    return p.in_channels / p.groups;
+  }
+};
+
+// Output columns of a row whose kernel tap reads an input column in range:
+// [lo, hi) for a tap offset by `dw` pixels from the output position.
+struct ValidColumns {
+  ValidColumns(const Conv2DParams &p, utens_t out_w, int64 dw) {
+    const int64 s = static_cast<int64>(p.stride_w);
+    const int64 w = static_cast<int64>(p.in_w);
+    const int64 first = dw >= 0 ? 0 : (-dw + s - 1) / s;
+    const int64 last = w - 1 - dw < 0 ? -1 : (w - 1 - dw) / s;
+    lo = static_cast<utens_t>(std::min<int64>(first, out_w));
+    hi = static_cast<utens_t>(
+        std::max<int64>(lo, std::min<int64>(last + 1, out_w)));
+  }
+
+  utens_t lo;
+  utens_t hi;
+};
+
+// Offsets of kernel tap (kh, kw) from the top-left input pixel of an output.
+inline int64 TapRow(const Conv2DParams &p, utens_t kh) {
+  return static_cast<int64>(kh * p.dilation_h) -
+         static_cast<int64>(p.pad_h);
+}
+
+inline int64 TapColumn(const Conv2DParams &p, utens_t kw) {
+  return static_cast<int64>(kw * p.dilation_w) -
+         static_cast<int64>(p.pad_w);
+}
+
+// A run of `len` consecutive output pixels of one row, as seen by one kernel
+// tap: pixels [0, lo) and [hi, len) of the run read padding, the others read
+// input row `ih` from column `iw` on, `stride_w` columns apart. The whole run
+// is padding when `ih` is outside the image.
+struct TapRun {
+  int64 ih;
+  int64 iw;
+  utens_t lo;
+  utens_t hi;
+  utens_t len;
+};
+
+// Calls fn(q, run) for the runs covering output pixels [first, first + count)
+// of a NCHW image for kernel tap `t`, q being where the run starts in
+// [0, count).
+template<typename Fn>
+void ForEachTapRun(const Conv2DParams &p, const ConvShape &s, utens_t t,
+                   utens_t first, utens_t count, const Fn &fn) {
+  const int64 dh = TapRow(p, t / p.kernel_w);
+  const int64 dw = TapColumn(p, t % p.kernel_w);
+  const ValidColumns v(p, s.out_w, dw);
+  for (utens_t q = 0; q < count;) {
+    const utens_t pixel = first + q;
+    const utens_t ow = pixel % s.out_w;
+    TapRun run;
+    run.len = std::min(s.out_w - ow, count - q);
+    run.ih = static_cast<int64>(pixel / s.out_w * p.stride_h) + dh;
+    run.lo = std::min(std::max(ow, v.lo), ow + run.len) - ow;
+    run.hi = std::max(ow + run.lo, std::min(ow + run.len, v.hi)) - ow;
+    run.iw = static_cast<int64>((ow + run.lo) * p.stride_w) + dw;
+    fn(q, run);
+    q += run.len;
+  }
+}
+
+inline bool InImage(const Conv2DParams &p, const TapRun &run) {
+  return run.ih >= 0 && run.ih < static_cast<int64>(p.in_h);
+}
+
+// im2col of output pixels [first, first + count) of a NCHW image x: a
+// k x count matrix, one row per channel and kernel tap.
+template<typename Dtype>
+void Im2colNCHW(const Conv2DParams &p, const ConvShape &s, const Dtype *x,
+                utens_t first, utens_t count, Dtype *col) {
+  const utens_t plane = p.in_h * p.in_w;
+  ParallelFor(
+      static_cast<int64_t>(s.k),
+      std::max<int64_t>(1, kIntraOpGrainSize / static_cast<int64_t>(count)),
+      [&](int64_t begin, int64_t end) {
+        for (int64_t k = begin; k < end; k++) {
+          const Dtype *in = x + k / s.taps * plane;
+          Dtype *row = col + k * count;
+          const auto copy = [&](utens_t q, const TapRun &run) {
+            Dtype *out = row + q;
+            if (!InImage(p, run)) {
+              std::fill(out, out + run.len, Dtype(0));
+              return;
+            }
+            std::fill(out, out + run.lo, Dtype(0));
+            std::fill(out + run.hi, out + run.len, Dtype(0));
+            if (run.lo == run.hi) return;
+            const Dtype *src = in + run.ih * p.in_w + run.iw;
+            if (p.stride_w == 1) {
+              std::memcpy(out + run.lo, src, (run.hi - run.lo) * sizeof(Dtype));
+            } else {
+              for (utens_t j = run.lo; j < run.hi; j++) {
+                out[j] = src[(j - run.lo) * p.stride_w];
+              }
+            }
+          };
+          ForEachTapRun(p, s, k % s.taps, first, count, copy);
+        }
+      });
+}
+
+// The reverse of `Im2colNCHW`, adding every element of col to the input
+// pixel it was read from. Channels are split over the threads, as each only
+// receives its own rows.
+template<typename Dtype>
+void Col2imNCHW(const Conv2DParams &p, const ConvShape &s, const Dtype *col,
+                utens_t first, utens_t count, Dtype *dx) {
+  const utens_t plane = p.in_h * p.in_w;
+  const auto add = kernels::GetElementwiseKernels<Dtype>().add;
+  ParallelFor(
+      static_cast<int64_t>(p.in_channels),
+      std::max<int64_t>(
+          1, kIntraOpGrainSize / static_cast<int64_t>(s.taps * count)),
+      [&](int64_t begin, int64_t end) {
+        const utens_t rows_end = static_cast<utens_t>(end) * s.taps;
+        for (utens_t k = static_cast<utens_t>(begin) * s.taps; k < rows_end;
+             k++) {
+          Dtype *in = dx + k / s.taps * plane;
+          const Dtype *row = col + k * count;
+          const auto add_back = [&](utens_t q, const TapRun &run) {
+            if (!InImage(p, run) || run.lo == run.hi) return;
+            Dtype *dst = in + run.ih * p.in_w + run.iw;
+            const Dtype *from = row + q + run.lo;
+            if (p.stride_w == 1) {
+              add(run.hi - run.lo, dst, from, dst);
+            } else {
+              for (utens_t j = 0; j < run.hi - run.lo; j++) {
+                dst[j * p.stride_w] += from[j];
+              }
+            }
+          };
+          ForEachTapRun(p, s, k % s.taps, first, count, add_back);
+        }
+      });
+}
+
+// Offset in a NHWC batch of the input pixel read by kernel tap `t` of output
+// pixel `pixel`, counted over the batch. False when it is padding.
+bool TapPixelNHWC(const Conv2DParams &p, const ConvShape &s, utens_t pixel,
+                  utens_t t, utens_t *offset) {
+  const utens_t n = pixel / s.pixels, rest = pixel % s.pixels;
+  const int64 ih = static_cast<int64>(rest / s.out_w * p.stride_h) +
+                   TapRow(p, t / p.kernel_w);
+  const int64 iw = static_cast<int64>(rest % s.out_w * p.stride_w) +
+                   TapColumn(p, t % p.kernel_w);
+  if (ih < 0 || ih >= static_cast<int64>(p.in_h) || iw < 0 ||
+      iw >= static_cast<int64>(p.in_w)) {
+    return false;
+  }
+  *offset = ((n * p.in_h + ih) * p.in_w + iw) * p.in_channels;
+  return true;
+}
+
+// im2col of output pixels [first, first + count) of a NHWC batch x: a
+// count x k matrix, one row per pixel holding the channels of every tap.
+template<typename Dtype>
+void Im2colNHWC(const Conv2DParams &p, const ConvShape &s, const Dtype *x,
+                utens_t first, utens_t count, Dtype *col) {
+  const utens_t c = p.in_channels;
+  ParallelFor(
+      static_cast<int64_t>(count),
+      std::max<int64_t>(1, kIntraOpGrainSize / static_cast<int64_t>(s.k)),
+      [&](int64_t begin, int64_t end) {
+        for (int64_t r = begin; r < end; r++) {
+          Dtype *row = col + r * s.k;
+          for (utens_t t = 0; t < s.taps; t++) {
+            utens_t offset;
+            if (TapPixelNHWC(p, s, first + r, t, &offset)) {
+              std::memcpy(row + t * c, x + offset, c * sizeof(Dtype));
+            } else {
+              std::fill(row + t * c, row + (t + 1) * c, Dtype(0));
+            }
+          }
+        }
+      });
+}
+
+// The reverse of `Im2colNHWC`. Pixels share input pixels, so the channels
+// are split over the threads instead, each adding its slice of every row.
+template<typename Dtype>
+void Col2imNHWC(const Conv2DParams &p, const ConvShape &s, const Dtype *col,
+                utens_t first, utens_t count, Dtype *dx) {
+  const utens_t c = p.in_channels;
+  const auto add = kernels::GetElementwiseKernels<Dtype>().add;
+  ParallelFor(
+      static_cast<int64_t>(c),
+      std::max<int64_t>(
+          1, kIntraOpGrainSize / static_cast<int64_t>(s.taps * count)),
+      [&](int64_t begin, int64_t end) {
+        for (utens_t r = 0; r < count; r++) {
+          const Dtype *row = col + r * s.k + begin;
+          for (utens_t t = 0; t < s.taps; t++) {
+            utens_t offset;
+            if (TapPixelNHWC(p, s, first + r, t, &offset)) {
+              Dtype *dst = dx + offset + begin;
+              add(end - begin, dst, row + t * c, dst);
+            }
+          }
+        }
+      });
+}
+
+template<typename Dtype>
+void ConvNCHW(const Conv2DParams &p, const ConvShape &s, const Dtype *x,
+              const Dtype *filter, Dtype *y) {
+  const utens_t oc = p.out_channels, image = p.in_channels * p.in_h * p.in_w;
+  std::vector<Dtype> col(s.pointwise ? 0 : s.k * s.tile);
+  for (utens_t n = 0; n < p.batch; n++) {
+    const Dtype *xn = x + n * image;
+    Dtype *yn = y + n * oc * s.pixels;
+    if (s.pointwise) {
+      chime_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, oc, s.pixels, s.k,
+                            Dtype(1), filter, xn, Dtype(0), yn);
+      continue;
+    }
+    for (utens_t first = 0; first < s.pixels; first += s.tile) {
+      const utens_t count = std::min(s.tile, s.pixels - first);
+      Im2colNCHW(p, s, xn, first, count, col.data());
+      chime_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, oc, count, s.k,
+                            Dtype(1), filter, s.k, col.data(), count,
+                            Dtype(0), yn + first, s.pixels);
+    }
+  }
+}
+
+template<typename Dtype>
+void ConvNHWC(const Conv2DParams &p, const ConvShape &s, const Dtype *x,
+              const Dtype *filter, Dtype *y) {
+  const utens_t oc = p.out_channels, rows = p.batch * s.pixels;
+  if (s.pointwise) {
+    chime_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rows, oc, s.k,
+                          Dtype(1), x, filter, Dtype(0), y);
+    return;
+  }
+  std::vector<Dtype> col(s.k * s.tile);
+  for (utens_t first = 0; first < rows; first += s.tile) {
+    const utens_t count = std::min(s.tile, rows - first);
+    Im2colNHWC(p, s, x, first, count, col.data());
+    chime_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, count, oc, s.k,
+                          Dtype(1), col.data(), s.k, filter, oc, Dtype(0),
+                          y + first * oc, oc);
+  }
+}
+
+template<typename Dtype>
+void ConvDataNCHW(const Conv2DParams &p, const ConvShape &s, const Dtype *dy,
+                  const Dtype *filter, Dtype *dx) {
+  const utens_t oc = p.out_channels, image = p.in_channels * p.in_h * p.in_w;
+  if (!s.pointwise) chime_cpu_set(dx, Dtype(0), p.batch * image);
+  std::vector<Dtype> col(s.pointwise ? 0 : s.k * s.tile);
+  for (utens_t n = 0; n < p.batch; n++) {
+    const Dtype *dyn = dy + n * oc * s.pixels;
+    Dtype *dxn = dx + n * image;
+    if (s.pointwise) {
+      chime_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, s.k, s.pixels, oc,
+                            Dtype(1), filter, dyn, Dtype(0), dxn);
+      continue;
+    }
+    for (utens_t first = 0; first < s.pixels; first += s.tile) {
+      const utens_t count = std::min(s.tile, s.pixels - first);
+      chime_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, s.k, count, oc,
+                            Dtype(1), filter, s.k, dyn + first, s.pixels,
+                            Dtype(0), col.data(), count);
+      Col2imNCHW(p, s, col.data(), first, count, dxn);
+    }
+  }
+}
+
+template<typename Dtype>
+void ConvDataNHWC(const Conv2DParams &p, const ConvShape &s, const Dtype *dy,
+                  const Dtype *filter, Dtype *dx) {
+  const utens_t oc = p.out_channels, rows = p.batch * s.pixels;
+  if (s.pointwise) {
+    chime_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, rows, s.k, oc, Dtype(1),
+                          dy, filter, Dtype(0), dx);
+    return;
+  }
+  chime_cpu_set(dx, Dtype(0), p.batch * p.in_h * p.in_w * p.in_channels);
+  std::vector<Dtype> col(s.k * s.tile);
+  for (utens_t first = 0; first < rows; first += s.tile) {
+    const utens_t count = std::min(s.tile, rows - first);
+    chime_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, count, s.k, oc, Dtype(1),
+                          dy + first * oc, oc, filter, oc, Dtype(0),
+                          col.data(), s.k);
+    Col2imNHWC(p, s, col.data(), first, count, dx);
+  }
+}
+
+// Filter gradients sum a product per tile into dfilter, zeroed first.
+template<typename Dtype>
+void ConvFilterNCHW(const Conv2DParams &p, const ConvShape &s,
+                    const Dtype *x, const Dtype *dy, Dtype *dfilter) {
+  const utens_t oc = p.out_channels, image = p.in_channels * p.in_h * p.in_w;
+  std::vector<Dtype> col(s.pointwise ? 0 : s.k * s.tile);
+  for (utens_t n = 0; n < p.batch; n++) {
+    const Dtype *xn = x + n * image;
+    const Dtype *dyn = dy + n * oc * s.pixels;
+    const Dtype beta = n == 0 ? Dtype(0) : Dtype(1);
+    if (s.pointwise) {
+      chime_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, oc, s.k, s.pixels,
+                            Dtype(1), dyn, xn, beta, dfilter);
+      continue;
+    }
+    for (utens_t first = 0; first < s.pixels; first += s.tile) {
+      const utens_t count = std::min(s.tile, s.pixels - first);
+      Im2colNCHW(p, s, xn, first, count, col.data());
+      chime_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, oc, s.k, count,
+                            Dtype(1), dyn + first, s.pixels, col.data(),
+                            count, first == 0 ? beta : Dtype(1), dfilter,
+                            s.k);
+    }
+  }
+}
+
+template<typename Dtype>
+void ConvFilterNHWC(const Conv2DParams &p, const ConvShape &s,
+                    const Dtype *x, const Dtype *dy, Dtype *dfilter) {
+  const utens_t oc = p.out_channels, rows = p.batch * s.pixels;
+  if (s.pointwise) {
+    chime_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, s.k, oc, rows, Dtype(1),
+                          x, dy, Dtype(0), dfilter);
+    return;
+  }
+  std::vector<Dtype> col(s.k * s.tile);
+  for (utens_t first = 0; first < rows; first += s.tile) {
+    const utens_t count = std::min(s.tile, rows - first);
+    Im2colNHWC(p, s, x, first, count, col.data());
+    chime_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, s.k, oc, count, Dtype(1),
+                          col.data(), s.k, dy + first * oc, oc,
+                          first == 0 ? Dtype(0) : Dtype(1), dfilter, oc);
+  }
+}
+
+}  // namespace
+
+utens_t Conv2DParams::OutH() const {
+  CHECK_GT(stride_h, 0u);
+  CHECK_GT(dilation_h, 0u);
+  CHECK_GT(kernel_h, 0u);
+  const utens_t span = dilation_h * (kernel_h - 1) + 1;
+  CHECK_GE(in_h + 2 * pad_h, span)
+      << "Kernel of height " << kernel_h << " dilated by " << dilation_h
+      << " does not fit in an input of height " << in_h << " padded by "
+      << pad_h;
+  return (in_h + 2 * pad_h - span) / stride_h + 1;
+}
+
+utens_t Conv2DParams::OutW() const {
+  CHECK_GT(stride_w, 0u);
+  CHECK_GT(dilation_w, 0u);
+  CHECK_GT(kernel_w, 0u);
+  const utens_t span = dilation_w * (kernel_w - 1) + 1;
+  CHECK_GE(in_w + 2 * pad_w, span)
+      << "Kernel of width " << kernel_w << " dilated by " << dilation_w
+      << " does not fit in an input of width " << in_w << " padded by "
+      << pad_w;
+  return (in_w + 2 * pad_w - span) / stride_w + 1;
+}
+
+template<typename Dtype>
+void chime_cpu_conv2d(const Conv2DParams &params, const Dtype *x,
+                      const Dtype *filter, const Dtype *bias, Dtype *y) {
+  chime_cpu_conv2d<Dtype>(params, x, filter, bias, y, nullptr);
+}
+
+template<typename Dtype>
+void chime_cpu_conv2d(const Conv2DParams &params, const Dtype *x,
+                      const Dtype *filter, const Dtype *bias, Dtype *y,
+                      WinogradFilterCache<Dtype> *winograd_cache) {
+  DCHECK(x);
+  DCHECK(filter);
+  DCHECK(y);
+  const ConvShape s(params, sizeof(Dtype));
+  const utens_t oc = params.out_channels;
+  if (params.batch * s.pixels * oc == 0) return;
+  if (params.groups > 1) {
+    internal::GroupedConv2D(params, x, filter, bias, y);
+    return;
+  }
+  if (WinogradApplies(params) && params.in_channels >= kWinogradMinChannels &&
+      oc >= kWinogradMinChannels) {
+    const WinogradTile tile = PreferredWinogradTile(params);
+    if (winograd_cache != nullptr) {
+      chime_cpu_conv2d_winograd(params, x,
+                                *winograd_cache->Get(params, filter, tile),
+                                bias, y);
+    } else {
+      chime_cpu_conv2d_winograd(
+          params, x, WinogradFilter<Dtype>(params, filter, tile), bias, y);
+    }
+    return;
+  }
+  if (params.layout == ConvLayout::kNCHW) {
+    ConvNCHW(params, s, x, filter, y);
+    if (bias) {
+      chime_cpu_broadcast_add<Dtype>({params.batch, oc, s.pixels}, y,
+                                     {oc, 1}, bias, y);
+    }
+  } else {
+    ConvNHWC(params, s, x, filter, y);
+    if (bias) {
+      chime_cpu_broadcast_add<Dtype>({params.batch * s.pixels, oc}, y, {oc},
+                                     bias, y);
+    }
+  }
+}
+
+template<typename Dtype>
+void chime_cpu_conv2d_backward_data(const Conv2DParams &params,
+                                    const Dtype *dy, const Dtype *filter,
+                                    Dtype *dx) {
+  DCHECK(dy);
+  DCHECK(filter);
+  DCHECK(dx);
+  const ConvShape s(params, sizeof(Dtype));
+  if (params.batch * s.pixels * params.out_channels == 0) {
+    chime_cpu_set(dx, Dtype(0), params.batch * params.in_channels *
+                                    params.in_h * params.in_w);
+    return;
+  }
+  if (params.groups > 1) {
+    internal::GroupedConv2DBackwardData(params, dy, filter, dx);
+  } else if (params.layout == ConvLayout::kNCHW) {
+    ConvDataNCHW(params, s, dy, filter, dx);
+  } else {
+    ConvDataNHWC(params, s, dy, filter, dx);
+  }
+}
+
+template<typename Dtype>
+void chime_cpu_conv2d_backward_weights(const Conv2DParams &params,
+                                       const Dtype *x, const Dtype *dy,
+                                       Dtype *dfilter, Dtype *dbias) {
+  DCHECK(x);
+  DCHECK(dy);
+  DCHECK(dfilter);
+  const ConvShape s(params, sizeof(Dtype));
+  const utens_t oc = params.out_channels;
+  if (params.batch * s.pixels * oc == 0) {
+    chime_cpu_set(dfilter, Dtype(0), s.k * oc);
+    if (dbias) chime_cpu_set(dbias, Dtype(0), oc);
+    return;
+  }
+  if (params.groups > 1) {
+    internal::GroupedConv2DBackwardFilter(params, x, dy, dfilter);
+  } else if (params.layout == ConvLayout::kNCHW) {
+    ConvFilterNCHW(params, s, x, dy, dfilter);
+  } else {
+    ConvFilterNHWC(params, s, x, dy, dfilter);
+  }
+  if (!dbias) return;
+  if (params.layout == ConvLayout::kNCHW) {
+    chime_cpu_reduce_sum<Dtype>({params.batch, oc, s.pixels}, {0, 2}, dy,
+                                dbias);
+  } else {
+    chime_cpu_reduce_sum<Dtype>({params.batch * s.pixels, oc}, {0}, dy,
+                                dbias);
+  }
+}
+
+#define INSTANTIATE_CONV(Dtype)                                               \
+  template void chime_cpu_conv2d<Dtype>(const Conv2DParams &, const Dtype *,  \
+                                        const Dtype *, const Dtype *,         \
+                                        Dtype *);                             \
+  template void chime_cpu_conv2d<Dtype>(                                      \
+      const Conv2DParams &, const Dtype *, const Dtype *, const Dtype *,      \
+      Dtype *, WinogradFilterCache<Dtype> *);                                 \
+  template void chime_cpu_conv2d_backward_data<Dtype>(                        \
+      const Conv2DParams &, const Dtype *, const Dtype *, Dtype *);           \
+  template void chime_cpu_conv2d_backward_weights<Dtype>(                     \
+      const Conv2DParams &, const Dtype *, const Dtype *, Dtype *, Dtype *)
+
+INSTANTIATE_CONV(float32);
+INSTANTIATE_CONV(float64);
+
+}  // namespace chime
@@ -0,0 +1,100 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_CONV_H_
+#define CHIME_CORE_FRAMEWORK_CONV_H_
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Order of the dimensions of the images of a convolution. Batches of NCHW
+/// images, the layout of `BaseTensor`, go with filters of dimensions
+/// {out_channels, in_channels / groups, kernel_h, kernel_w}, batches of NHWC
+/// images with filters of {kernel_h, kernel_w, in_channels / groups,
+/// out_channels}, so that both are a plain matrix in the GEMM of their
+/// layout.
+enum class ConvLayout { kNCHW, kNHWC };
+
+/// Geometry of a 2-D convolution. The input has `pad_h` rows of zeros added
+/// above and below and `pad_w` columns left and right; kernel taps are
+/// `dilation_*` pixels apart and move by `stride_*` pixels between outputs.
+/// The channels are split into `groups` consecutive groups, and output
+/// channels only see the input channels of their group; a depthwise
+/// convolution has as many groups as input channels.
+struct Conv2DParams {
+  ConvLayout layout = ConvLayout::kNCHW;
+  utens_t batch = 1;
+  utens_t in_channels = 1;
+  utens_t in_h = 1;
+  utens_t in_w = 1;
+  utens_t out_channels = 1;
+  utens_t kernel_h = 1;
+  utens_t kernel_w = 1;
+  utens_t stride_h = 1;
+  utens_t stride_w = 1;
+  utens_t pad_h = 0;
+  utens_t pad_w = 0;
+  utens_t dilation_h = 1;
+  utens_t dilation_w = 1;
+  utens_t groups = 1;
+
+  utens_t OutH() const;
+  utens_t OutW() const;
+};
+
+/// 2-D convolution (cross-correlation, as in every framework) of a batch of
+/// images, `chime_cpu_conv2d` from x to y, with `bias` added to every output
+/// channel unless it is null, and its gradients from dy: with respect to x
+/// in `chime_cpu_conv2d_backward_data`, with respect to the filters, and to
+/// the bias unless `dbias` is null, in `chime_cpu_conv2d_backward_weights`.
+/// Gradients are written, not accumulated.
+///
+/// Products go through `chime_cpu_gemm`. The im2col matrix, with one
+/// row or column per output pixel, is never built whole: it is filled for
+/// as many output pixels at a time as keep it in L2, multiplied, and
+/// dropped, and the gradient of x is scattered back (col2im) in the same
+/// tiles. A 1x1 kernel with unit stride and no padding multiplies the images
+/// in place.
+///
+/// Grouped convolutions skip im2col and GEMM, whose products would be tiny,
+/// for direct kernels vectorized over the channels of NHWC pixels and split
+/// over rows of pixels. NCHW batches are permuted to NHWC and back around
+/// them.
+///
+/// The forward pass of an ungrouped 3x3 kernel with unit stride and no
+/// dilation, over at least 16 input and output channels, goes through
+/// Winograd instead (see winograd.h), transforming the filter on every call.
+/// Pass a `WinogradFilterCache` to transform each filter once, or keep a
+/// `WinogradFilter` and call `chime_cpu_conv2d_winograd`.
+///
+/// Only float32 and float64 are supported.
+/// REQUIRES: the input, padded, is at least as large as the dilated kernel,
+/// and `groups` divides both channel counts.
+template<typename Dtype>
+void chime_cpu_conv2d(const Conv2DParams &params, const Dtype *x,
+                      const Dtype *filter, const Dtype *bias, Dtype *y);
+
+template<typename Dtype>
+class WinogradFilterCache;
+
+/// Same, taking the transformed filter of the Winograd path from
+/// `winograd_cache`, or transforming it on the call if it is null.
+template<typename Dtype>
+void chime_cpu_conv2d(const Conv2DParams &params, const Dtype *x,
+                      const Dtype *filter, const Dtype *bias, Dtype *y,
+                      WinogradFilterCache<Dtype> *winograd_cache);
+
+template<typename Dtype>
+void chime_cpu_conv2d_backward_data(const Conv2DParams &params,
+                                    const Dtype *dy, const Dtype *filter,
+                                    Dtype *dx);
+
+template<typename Dtype>
+void chime_cpu_conv2d_backward_weights(const Conv2DParams &params,
+                                       const Dtype *x, const Dtype *dy,
+                                       Dtype *dfilter, Dtype *dbias);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_CONV_H_
@@ -0,0 +1,219 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/conv.h"
+
+#include <cmath>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+utens_t XIndex(const Conv2DParams &p, utens_t n, utens_t c, utens_t h,
+               utens_t w) {
+  return p.layout == ConvLayout::kNCHW
+             ? ((n * p.in_channels + c) * p.in_h + h) * p.in_w + w
+             : ((n * p.in_h + h) * p.in_w + w) * p.in_channels + c;
+}
+
+utens_t YIndex(const Conv2DParams &p, utens_t n, utens_t c, utens_t h,
+               utens_t w) {
+  return p.layout == ConvLayout::kNCHW
+             ? ((n * p.out_channels + c) * p.OutH() + h) * p.OutW() + w
+             : ((n * p.OutH() + h) * p.OutW() + w) * p.out_channels + c;
+}
+
+utens_t FilterIndex(const Conv2DParams &p, utens_t oc, utens_t c, utens_t kh,
+                    utens_t kw) {
+  return p.layout == ConvLayout::kNCHW
+             ? ((oc * p.in_channels + c) * p.kernel_h + kh) * p.kernel_w + kw
+             : ((kh * p.kernel_w + kw) * p.in_channels + c) *
+                       p.out_channels + oc;
+}
+
+// The convolution and both gradients from the definition, one product of an
+// input pixel and a filter tap at a time.
+struct Reference {
+  Reference(const Conv2DParams &p, const std::vector<float64> &x,
+            const std::vector<float64> &filter,
+            const std::vector<float64> &bias,
+            const std::vector<float64> &dy)
+      : y(dy.size()), dx(x.size(), 0), dfilter(filter.size(), 0),
+        dbias(bias.size(), 0) {
+    for (utens_t n = 0; n < p.batch; n++) {
+      for (utens_t oc = 0; oc < p.out_channels; oc++) {
+        for (utens_t oh = 0; oh < p.OutH(); oh++) {
+          for (utens_t ow = 0; ow < p.OutW(); ow++) {
+            const utens_t o = YIndex(p, n, oc, oh, ow);
+            y[o] = bias[oc];
+            dbias[oc] += dy[o];
+            for (utens_t c = 0; c < p.in_channels; c++) {
+              for (utens_t kh = 0; kh < p.kernel_h; kh++) {
+                for (utens_t kw = 0; kw < p.kernel_w; kw++) {
+                  const int64 ih = static_cast<int64>(
+                      oh * p.stride_h + kh * p.dilation_h) -
+                      static_cast<int64>(p.pad_h);
+                  const int64 iw = static_cast<int64>(
+                      ow * p.stride_w + kw * p.dilation_w) -
+                      static_cast<int64>(p.pad_w);
+                  if (ih < 0 || iw < 0 || ih >= static_cast<int64>(p.in_h) ||
+                      iw >= static_cast<int64>(p.in_w)) {
+                    continue;
+                  }
+                  const utens_t i = XIndex(p, n, c, ih, iw);
+                  const utens_t f = FilterIndex(p, oc, c, kh, kw);
+                  y[o] += x[i] * filter[f];
+                  dx[i] += dy[o] * filter[f];
+                  dfilter[f] += dy[o] * x[i];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<float64> y, dx, dfilter, dbias;
+};
+
+Conv2DParams Params(ConvLayout layout, utens_t batch, utens_t in_channels,
+                    utens_t in_h, utens_t in_w, utens_t out_channels,
+                    utens_t kernel_h, utens_t kernel_w, utens_t stride,
+                    utens_t pad, utens_t dilation) {
+  Conv2DParams p;
+  p.layout = layout;
+  p.batch = batch;
+  p.in_channels = in_channels;
+  p.in_h = in_h;
+  p.in_w = in_w;
+  p.out_channels = out_channels;
+  p.kernel_h = kernel_h;
+  p.kernel_w = kernel_w;
+  p.stride_h = p.stride_w = stride;
+  p.pad_h = p.pad_w = pad;
+  p.dilation_h = p.dilation_w = dilation;
+  return p;
+}
+
+void CheckAgainstReference(const Conv2DParams &p) {
+  const utens_t x_size = p.batch * p.in_channels * p.in_h * p.in_w;
+  const utens_t y_size = p.batch * p.out_channels * p.OutH() * p.OutW();
+  const utens_t f_size =
+      p.out_channels * p.in_channels * p.kernel_h * p.kernel_w;
+  const std::vector<float64> x = Pattern<float64>(x_size, 1);
+  const std::vector<float64> filter = Pattern<float64>(f_size, 2);
+  const std::vector<float64> bias = Pattern<float64>(p.out_channels, 3);
+  const std::vector<float64> dy = Pattern<float64>(y_size, 4);
+  const Reference ref(p, x, filter, bias, dy);
+
+  std::vector<float64> y(y_size), dx(x_size, -1.), dfilter(f_size, -1.),
+      dbias(p.out_channels, -1.);
+  chime_cpu_conv2d(p, x.data(), filter.data(), bias.data(), y.data());
+  chime_cpu_conv2d_backward_data(p, dy.data(), filter.data(), dx.data());
+  chime_cpu_conv2d_backward_weights(p, x.data(), dy.data(), dfilter.data(),
+                                    dbias.data());
+  for (utens_t i = 0; i < y_size; i++) EXPECT_NEAR(y[i], ref.y[i], 1e-9) << i;
+  for (utens_t i = 0; i < x_size; i++) {
+    EXPECT_NEAR(dx[i], ref.dx[i], 1e-9) << i;
+  }
+  for (utens_t i = 0; i < f_size; i++) {
+    EXPECT_NEAR(dfilter[i], ref.dfilter[i], 1e-9) << i;
+  }
+  for (utens_t i = 0; i < p.out_channels; i++) {
+    EXPECT_NEAR(dbias[i], ref.dbias[i], 1e-9) << i;
+  }
+}
+
+}  // namespace
+
+TEST(ConvTest, TestOutputSize) {
+  Conv2DParams p = Params(ConvLayout::kNCHW, 1, 1, 7, 9, 1, 3, 3, 2, 1, 1);
+  EXPECT_EQ(p.OutH(), 4u);
+  EXPECT_EQ(p.OutW(), 5u);
+  p.dilation_h = 3;
+  EXPECT_EQ(p.OutH(), 2u);
+  p.kernel_h = 5;
+  EXPECT_DEATH(p.OutH(), "does not fit");
+}
+
+// Padding, strides and dilations in both layouts, a pointwise kernel, which
+// skips im2col, and images large enough for several tiles.
+TEST(ConvTest, TestAgainstReference) {
+  const std::vector<Conv2DParams> cases = {
+      Params(ConvLayout::kNCHW, 2, 3, 7, 9, 4, 3, 3, 1, 1, 1),
+      Params(ConvLayout::kNCHW, 2, 3, 8, 7, 5, 3, 3, 2, 0, 1),
+      Params(ConvLayout::kNCHW, 1, 2, 9, 9, 3, 3, 3, 1, 2, 2),
+      Params(ConvLayout::kNCHW, 2, 5, 6, 4, 3, 1, 1, 1, 0, 1),
+      Params(ConvLayout::kNCHW, 2, 5, 6, 5, 3, 1, 1, 2, 0, 1),
+      Params(ConvLayout::kNCHW, 2, 64, 20, 20, 8, 3, 3, 1, 1, 1),
+  };
+  for (Conv2DParams p : cases) {
+    CheckAgainstReference(p);
+    p.layout = ConvLayout::kNHWC;
+    CheckAgainstReference(p);
+  }
+
+  // Rectangular kernels with different strides along each axis.
+  Conv2DParams p = Params(ConvLayout::kNCHW, 2, 3, 11, 13, 2, 2, 5, 1, 0, 1);
+  p.stride_h = 2;
+  p.stride_w = 3;
+  p.pad_w = 2;
+  p.dilation_h = 2;
+  CheckAgainstReference(p);
+  p.layout = ConvLayout::kNHWC;
+  CheckAgainstReference(p);
+}
+
+TEST(ConvTest, TestFloat) {
+  const Conv2DParams p =
+      Params(ConvLayout::kNHWC, 2, 16, 10, 10, 8, 3, 3, 1, 1, 1);
+  const utens_t x_size = p.batch * p.in_channels * p.in_h * p.in_w;
+  const utens_t y_size = p.batch * p.out_channels * p.OutH() * p.OutW();
+  const utens_t f_size = p.out_channels * p.in_channels * 9;
+  const std::vector<float32> x = Pattern<float32>(x_size, 1);
+  const std::vector<float32> filter = Pattern<float32>(f_size, 2);
+  std::vector<float32> y(y_size);
+  chime_cpu_conv2d<float32>(p, x.data(), filter.data(), nullptr, y.data());
+  const Reference ref(p, std::vector<float64>(x.begin(), x.end()),
+                      std::vector<float64>(filter.begin(), filter.end()),
+                      std::vector<float64>(p.out_channels, 0.),
+                      std::vector<float64>(y_size, 0.));
+  for (utens_t i = 0; i < y_size; i++) EXPECT_NEAR(y[i], ref.y[i], 1e-4) << i;
+}
+
+// im2col and col2im split rows, pixels or channels over the threads without
+// changing the result.
+TEST(ConvTest, TestIntraOpParallel) {
+  for (ConvLayout layout : {ConvLayout::kNCHW, ConvLayout::kNHWC}) {
+    const Conv2DParams p = Params(layout, 2, 32, 24, 24, 16, 3, 3, 1, 1, 1);
+    const utens_t x_size = p.batch * p.in_channels * p.in_h * p.in_w;
+    const utens_t y_size = p.batch * p.out_channels * p.OutH() * p.OutW();
+    const utens_t f_size = p.out_channels * p.in_channels * 9;
+    const std::vector<float32> x = Pattern<float32>(x_size, 1);
+    const std::vector<float32> filter = Pattern<float32>(f_size, 2);
+    const std::vector<float32> dy = Pattern<float32>(y_size, 3);
+    std::vector<std::vector<float32>> y(2, std::vector<float32>(y_size)),
+        dx(2, std::vector<float32>(x_size)),
+        dfilter(2, std::vector<float32>(f_size));
+    for (int run = 0; run < 2; run++) {
+      ScopedIntraOpNumThreads threads(run == 0 ? 1 : 4);
+      chime_cpu_conv2d<float32>(p, x.data(), filter.data(), nullptr,
+                                y[run].data());
+      chime_cpu_conv2d_backward_data(p, dy.data(), filter.data(),
+                                     dx[run].data());
+      chime_cpu_conv2d_backward_weights<float32>(
+          p, x.data(), dy.data(), dfilter[run].data(), nullptr);
+    }
+    EXPECT_EQ(y[0], y[1]);
+    EXPECT_EQ(dx[0], dx[1]);
+    EXPECT_EQ(dfilter[0], dfilter[1]);
+  }
+}
+
+}  // namespace chime
@@ -0,0 +1,85 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/cpu_dispatch.h"
+
+#include <cstdlib>
+
+#include "chime/core/platform/cpu_info.h"
+#include "chime/core/platform/logging.hpp"
+
+namespace chime {
+
+CPUCapability DetectCPUCapability() {
+  using port::TestCPUFeature;
+  if (TestCPUFeature(port::AVX512F) && TestCPUFeature(port::AVX512DQ) &&
+      TestCPUFeature(port::AVX512BW) && TestCPUFeature(port::AVX512VL)) {
+    if (TestCPUFeature(port::AVX512_VNNI)) return CPUCapability::AVX512_VNNI;
+    return CPUCapability::AVX512;
+  }
+  if (TestCPUFeature(port::AVX2) && TestCPUFeature(port::FMA) &&
+      TestCPUFeature(port::F16C))
+    return CPUCapability::AVX2;
+  if (TestCPUFeature(port::SSE4_2)) return CPUCapability::SSE4_2;
+  return CPUCapability::DEFAULT;
+}
+
+std::string CPUCapabilityToString(CPUCapability capability) {
+  switch (capability) {
+    case CPUCapability::DEFAULT:
+      return "default";
+    case CPUCapability::SSE4_2:
+      return "sse4_2";
+    case CPUCapability::AVX2:
+      return "avx2";
+    case CPUCapability::AVX512:
+      return "avx512";
+    case CPUCapability::AVX512_VNNI:
+      return "avx512_vnni";
+    default:
+      return "unknown";
+  }
+}
+
+bool CPUCapabilityFromString(const std::string &name,
+                             CPUCapability *capability) {
+  for (int i = 0; i < static_cast<int>(CPUCapability::NUM_OPTIONS); i++) {
+    CPUCapability c = static_cast<CPUCapability>(i);
+    if (name == CPUCapabilityToString(c)) {
+      *capability = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+
+CPUCapability ComputeCPUCapability() {
+  const CPUCapability detected = DetectCPUCapability();
+  const char *env = std::getenv("CE_CPU_CAPABILITY");
+  if (env == nullptr || env[0] == '\0') return detected;
+
+  CPUCapability requested;
+  if (!CPUCapabilityFromString(env, &requested)) {
+    LOG(WARNING) << "Unknown CE_CPU_CAPABILITY `" << env << "`, using "
+                 << CPUCapabilityToString(detected);
+    return detected;
+  }
+  if (detected < requested) {
+    LOG(WARNING) << "CE_CPU_CAPABILITY `" << env
+                 << "` is not supported by this CPU, using "
+                 << CPUCapabilityToString(detected);
+    return detected;
+  }
+  return requested;
+}
+
+}  // namespace
+
+CPUCapability GetCPUCapability() {
+  static const CPUCapability capability = ComputeCPUCapability();
+  return capability;
+}
+
+}  // namespace chime
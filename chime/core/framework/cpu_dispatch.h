@@ -0,0 +1,42 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_CPU_DISPATCH_H_
+#define CHIME_CORE_FRAMEWORK_CPU_DISPATCH_H_
+
+#include <string>
+
+namespace chime {
+
+/// Instruction set levels that compute kernels are compiled for. Every level
+/// includes the ones before it, so they can be compared with `<`.
+enum class CPUCapability {
+  DEFAULT = 0,  // whatever the build's baseline flags allow (SSE2 on x86-64)
+  SSE4_2 = 1,
+  AVX2 = 2,     // AVX2 + FMA + F16C
+  AVX512 = 3,   // AVX512F/DQ/BW/VL
+  AVX512_VNNI = 4,  // AVX512 + the int8 dot products of AVX512_VNNI
+  NUM_OPTIONS
+};
+
+/// Returns the highest `CPUCapability` the current processor supports,
+/// ignoring any override.
+CPUCapability DetectCPUCapability();
+
+/// Returns the capability that kernels are dispatched to. It is computed once
+/// per process: the detected capability, lowered to the value of the
+/// `CE_CPU_CAPABILITY` environment variable ("default", "sse4_2", "avx2",
+/// "avx512" or "avx512_vnni") when that is set. Asking for more than the CPU
+/// supports logs a warning and falls back to the detected level.
+CPUCapability GetCPUCapability();
+
+std::string CPUCapabilityToString(CPUCapability capability);
+
+/// Parses the names accepted by `CE_CPU_CAPABILITY`. Returns false if `name`
+/// is not one of them.
+bool CPUCapabilityFromString(const std::string &name,
+                             CPUCapability *capability);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_CPU_DISPATCH_H_
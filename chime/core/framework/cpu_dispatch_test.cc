@@ -0,0 +1,25 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/cpu_dispatch.h"
+
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+TEST(CPUDispatchTest, CapabilityName) {
+  for (int i = 0; i < static_cast<int>(CPUCapability::NUM_OPTIONS); i++) {
+    CPUCapability c = static_cast<CPUCapability>(i);
+    CPUCapability parsed;
+    EXPECT_TRUE(CPUCapabilityFromString(CPUCapabilityToString(c), &parsed));
+    EXPECT_EQ(parsed, c);
+  }
+  CPUCapability parsed;
+  EXPECT_FALSE(CPUCapabilityFromString("avx3", &parsed));
+}
+
+TEST(CPUDispatchTest, NeverAboveDetected) {
+  EXPECT_FALSE(DetectCPUCapability() < GetCPUCapability());
+}
+
+}  // namespace chime
@@ -0,0 +1,292 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/elementwise_expr.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+
+namespace {
+
+// Elements per block. One scratch buffer of a block is 2KB for float32 and
+// 4KB for float64, so the handful an expression needs stays in L1.
+constexpr utens_t kBlockSize = 512;
+
+template<typename Dtype>
+const kernels::TranscendentalKernels<Dtype> *transcendental_kernels() {
+  return nullptr;
+}
+
+template<>
+const kernels::TranscendentalKernels<float32> *
+transcendental_kernels<float32>() {
+  return &kernels::GetTranscendentalKernels<float32>();
+}
+
+template<>
+const kernels::TranscendentalKernels<float64> *
+transcendental_kernels<float64>() {
+  return &kernels::GetTranscendentalKernels<float64>();
+}
+
+}  // namespace
+
+template<typename Dtype>
+void ElementwiseExpr<Dtype>::CheckNode(Node node) const {
+  CHECK(node._expr == this) << "Node belongs to another ElementwiseExpr";
+  DCHECK_GE(node._id, 0);
+  DCHECK_LT(node._id, NumOps());
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Push(
+    OpCode code, int a, int b, const Dtype *data, Dtype value) {
+  Op op;
+  op.code = code;
+  op.a = a;
+  op.b = b;
+  op.data = data;
+  op.value = value;
+  _ops.push_back(op);
+  return Node(this, NumOps() - 1);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Binary(
+    OpCode code, Node a, Node b) {
+  CheckNode(a);
+  CheckNode(b);
+  return Push(code, a._id, b._id, nullptr, Dtype(0));
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Transcendental(
+    OpCode code, Node a) {
+  CHECK(transcendental_kernels<Dtype>() != nullptr)
+      << "Transcendental ops are only implemented for float32 and float64";
+  CheckNode(a);
+  return Push(code, a._id, -1, nullptr, Dtype(0));
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Input(
+    const Dtype *data) {
+  CHECK(data);
+  return Push(INPUT, -1, -1, data, Dtype(0));
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Constant(
+    Dtype value) {
+  return Push(CONSTANT, -1, -1, nullptr, value);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Add(Node a,
+                                                                  Node b) {
+  return Binary(ADD, a, b);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Sub(Node a,
+                                                                  Node b) {
+  return Binary(SUB, a, b);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Mul(Node a,
+                                                                  Node b) {
+  return Binary(MUL, a, b);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Div(Node a,
+                                                                  Node b) {
+  return Binary(DIV, a, b);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Scale(
+    Node a, Dtype alpha) {
+  CheckNode(a);
+  return Push(SCALE, a._id, -1, nullptr, alpha);
+}
+
+template<typename Dtype>
+typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Sign(Node a) {
+  CheckNode(a);
+  return Push(SIGN, a._id, -1, nullptr, Dtype(0));
+}
+
+#define DEFINE_TRANSCENDENTAL_OP(Name, CODE)                                 \
+  template<typename Dtype>                                                   \
+  typename ElementwiseExpr<Dtype>::Node ElementwiseExpr<Dtype>::Name(        \
+      Node a) {                                                              \
+    return Transcendental(CODE, a);                                          \
+  }
+
+DEFINE_TRANSCENDENTAL_OP(Exp, EXP)
+DEFINE_TRANSCENDENTAL_OP(Log, LOG)
+DEFINE_TRANSCENDENTAL_OP(Tanh, TANH)
+DEFINE_TRANSCENDENTAL_OP(Sigmoid, SIGMOID)
+DEFINE_TRANSCENDENTAL_OP(Erf, ERF)
+DEFINE_TRANSCENDENTAL_OP(Gelu, GELU)
+DEFINE_TRANSCENDENTAL_OP(Softplus, SOFTPLUS)
+
+#undef DEFINE_TRANSCENDENTAL_OP
+
+template<typename Dtype>
+void ElementwiseExpr<Dtype>::Evaluate(utens_t n, Node result, Dtype *y) const {
+  CheckNode(result);
+  CHECK(y);
+  if (n == 0) return;
+
+  // Ops `result` depends on. `_ops` is in topological order by construction.
+  const int num_ops = NumOps();
+  std::vector<bool> live(num_ops, false);
+  live[result._id] = true;
+  for (int i = result._id; i >= 0; i--) {
+    if (!live[i]) continue;
+    if (_ops[i].a >= 0) live[_ops[i].a] = true;
+    if (_ops[i].b >= 0) live[_ops[i].b] = true;
+  }
+
+  // Assigns scratch buffers with a linear scan: a buffer is released after
+  // the last op reading it, so the one an op writes may be one it reads from,
+  // which every kernel allows. Constants are filled once and keep theirs.
+  std::vector<int> last_use(num_ops, -1);
+  for (int i = 0; i <= result._id; i++) {
+    if (!live[i]) continue;
+    if (_ops[i].a >= 0) last_use[_ops[i].a] = i;
+    if (_ops[i].b >= 0) last_use[_ops[i].b] = i;
+  }
+  std::vector<int> slot(num_ops, -1);
+  std::vector<int> free_slots;
+  int num_slots = 0;
+  for (int i = 0; i < result._id; i++) {
+    if (!live[i] || _ops[i].code == INPUT) continue;
+    const int a = _ops[i].a;
+    const int b = _ops[i].b != a ? _ops[i].b : -1;
+    for (int operand : {a, b}) {
+      if (operand >= 0 && last_use[operand] == i && slot[operand] >= 0 &&
+          _ops[operand].code != CONSTANT) {
+        free_slots.push_back(slot[operand]);
+      }
+    }
+    // A constant's buffer is filled before the first block, so it must not
+    // share one with anything.
+    if (free_slots.empty() || _ops[i].code == CONSTANT) {
+      slot[i] = num_slots++;
+    } else {
+      slot[i] = free_slots.back();
+      free_slots.pop_back();
+    }
+  }
+
+  const kernels::ElementwiseKernels<Dtype> &ew =
+      kernels::GetElementwiseKernels<Dtype>();
+  const kernels::TranscendentalKernels<Dtype> *tr =
+      transcendental_kernels<Dtype>();
+  const std::vector<Op> &ops = _ops;
+  const int last = result._id;
+
+  auto run = [&](int64_t begin, int64_t end) {
+    std::vector<Dtype> scratch(static_cast<size_t>(num_slots) * kBlockSize);
+    auto buffer = [&](int id) {
+      return scratch.data() + slot[id] * kBlockSize;
+    };
+    for (int i = 0; i < last; i++) {
+      if (live[i] && ops[i].code == CONSTANT) {
+        std::fill(buffer(i), buffer(i) + kBlockSize, ops[i].value);
+      }
+    }
+
+    for (utens_t b = begin; b < static_cast<utens_t>(end); b += kBlockSize) {
+      const utens_t len = std::min(kBlockSize, static_cast<utens_t>(end) - b);
+      auto operand = [&](int id) -> const Dtype * {
+        return ops[id].code == INPUT ? ops[id].data + b : buffer(id);
+      };
+      for (int i = 0; i <= last; i++) {
+        const Op &op = ops[i];
+        if (!live[i] || (op.code == INPUT && i != last) ||
+            (op.code == CONSTANT && i != last)) {
+          continue;
+        }
+        Dtype *dst = i == last ? y + b : buffer(i);
+        switch (op.code) {
+          case INPUT:
+            std::memmove(dst, op.data + b, len * sizeof(Dtype));
+            break;
+          case CONSTANT:
+            std::fill(dst, dst + len, op.value);
+            break;
+          case ADD:
+            ew.add(len, operand(op.a), operand(op.b), dst);
+            break;
+          case SUB:
+            ew.sub(len, operand(op.a), operand(op.b), dst);
+            break;
+          case MUL:
+            ew.mul(len, operand(op.a), operand(op.b), dst);
+            break;
+          case DIV:
+            ew.div(len, operand(op.a), operand(op.b), dst);
+            break;
+          case SCALE:
+            ew.scal(len, op.value, operand(op.a), dst);
+            break;
+          case SIGN:
+            ew.sign(len, operand(op.a), dst);
+            break;
+          case EXP:
+            tr->exp(len, operand(op.a), dst);
+            break;
+          case LOG:
+            tr->log(len, operand(op.a), dst);
+            break;
+          case TANH:
+            tr->tanh(len, operand(op.a), dst);
+            break;
+          case SIGMOID:
+            tr->sigmoid(len, operand(op.a), dst);
+            break;
+          case ERF:
+            tr->erf(len, operand(op.a), dst);
+            break;
+          case GELU:
+            tr->gelu(len, operand(op.a), dst);
+            break;
+          case SOFTPLUS:
+            tr->softplus(len, operand(op.a), dst);
+            break;
+        }
+      }
+    }
+  };
+
+  // Cheap expressions need more elements per shard than long ones to be
+  // worth a thread.
+  const int64_t num_live = std::count(live.begin(), live.end(), true);
+  const int64_t grain_size = std::max<int64_t>(
+      kBlockSize, kIntraOpGrainSize / num_live);
+  ParallelFor(static_cast<int64_t>(n), grain_size, run);
+}
+
+template class ElementwiseExpr<int8>;
+template class ElementwiseExpr<int16>;
+template class ElementwiseExpr<int32>;
+template class ElementwiseExpr<int64>;
+template class ElementwiseExpr<uint8>;
+template class ElementwiseExpr<uint16>;
+template class ElementwiseExpr<uint32>;
+template class ElementwiseExpr<uint64>;
+template class ElementwiseExpr<float32>;
+template class ElementwiseExpr<float64>;
+template class ElementwiseExpr<float128>;
+
+}  // namespace chime
@@ -0,0 +1,142 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_ELEMENTWISE_EXPR_H_
+#define CHIME_CORE_FRAMEWORK_ELEMENTWISE_EXPR_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/platform/macros.h"
+
+namespace chime {
+
+/// Fused evaluation of elementwise expressions over arrays of the same
+/// length. The expression is recorded as a list of ops, then `Evaluate` walks
+/// the arrays in small blocks and runs the whole op list on each block before
+/// moving on, so intermediates only ever live in a few block-sized scratch
+/// buffers that stay in L1 and every operand is read from memory once:
+///
+///   ElementwiseExpr<float32> e;
+///   auto a = e.Input(pa), b = e.Input(pb), c = e.Input(pc), d = e.Input(pd);
+///   e.Evaluate(n, a * b + c * d, y);
+///
+/// Each op of a block runs through the same vectorized, CPU-dispatched
+/// kernels as `chime_cpu_add` & co, and blocks are split over the intra-op
+/// thread pool. Tensors take part through their host data pointers. `y` may
+/// alias any input.
+///
+/// The transcendental ops (`Exp`, `Tanh`, ...) are only available for float32
+/// and float64.
+template<typename Dtype>
+class ElementwiseExpr {
+ public:
+  /// Handle to one value of the expression. Only valid together with the
+  /// `ElementwiseExpr` that created it.
+  class Node {
+   public:
+    friend Node operator+(Node a, Node b) { return a._expr->Add(a, b); }
+    friend Node operator-(Node a, Node b) { return a._expr->Sub(a, b); }
+    friend Node operator*(Node a, Node b) { return a._expr->Mul(a, b); }
+    friend Node operator/(Node a, Node b) { return a._expr->Div(a, b); }
+    friend Node operator-(Node a) { return a._expr->Scale(a, Dtype(-1)); }
+
+    friend Node operator+(Node a, Dtype b) {
+      return a._expr->Add(a, a._expr->Constant(b));
+    }
+    friend Node operator+(Dtype a, Node b) {
+      return b._expr->Add(b._expr->Constant(a), b);
+    }
+    friend Node operator-(Node a, Dtype b) {
+      return a._expr->Sub(a, a._expr->Constant(b));
+    }
+    friend Node operator-(Dtype a, Node b) {
+      return b._expr->Sub(b._expr->Constant(a), b);
+    }
+    friend Node operator*(Node a, Dtype b) { return a._expr->Scale(a, b); }
+    friend Node operator*(Dtype a, Node b) { return b._expr->Scale(b, a); }
+    friend Node operator/(Node a, Dtype b) {
+      return a._expr->Div(a, a._expr->Constant(b));
+    }
+    friend Node operator/(Dtype a, Node b) {
+      return b._expr->Div(b._expr->Constant(a), b);
+    }
+
+   private:
+    friend class ElementwiseExpr;
+    Node(ElementwiseExpr *expr, int id) : _expr(expr), _id(id) {}
+
+    ElementwiseExpr *_expr;
+    int _id;
+  };
+
+  ElementwiseExpr() {}
+
+  /// An array of at least as many elements as `Evaluate` is called with.
+  Node Input(const Dtype *data);
+  /// The same value for every element.
+  Node Constant(Dtype value);
+
+  Node Add(Node a, Node b);
+  Node Sub(Node a, Node b);
+  Node Mul(Node a, Node b);
+  Node Div(Node a, Node b);
+  /// alpha * a
+  Node Scale(Node a, Dtype alpha);
+  Node Sign(Node a);
+
+  Node Exp(Node a);
+  Node Log(Node a);
+  Node Tanh(Node a);
+  Node Sigmoid(Node a);
+  Node Erf(Node a);
+  Node Gelu(Node a);
+  Node Softplus(Node a);
+
+  /// Computes `result` for elements [0, n) and stores it in `y`. Ops that
+  /// `result` does not depend on are skipped.
+  void Evaluate(utens_t n, Node result, Dtype *y) const;
+
+  /// Number of ops recorded so far.
+  int NumOps() const { return static_cast<int>(_ops.size()); }
+
+ private:
+  enum OpCode {
+    INPUT,
+    CONSTANT,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    SCALE,
+    SIGN,
+    EXP,
+    LOG,
+    TANH,
+    SIGMOID,
+    ERF,
+    GELU,
+    SOFTPLUS,
+  };
+
+  struct Op {
+    OpCode code;
+    int a;
+    int b;
+    const Dtype *data;
+    Dtype value;
+  };
+
+  Node Push(OpCode code, int a, int b, const Dtype *data, Dtype value);
+  Node Binary(OpCode code, Node a, Node b);
+  Node Transcendental(OpCode code, Node a);
+  void CheckNode(Node node) const;
+
+  std::vector<Op> _ops;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(ElementwiseExpr);
+};
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_ELEMENTWISE_EXPR_H_
@@ -0,0 +1,111 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/elementwise_expr.h"
+
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+// A fused expression runs the same kernels as the separate calls, so the
+// results are bit for bit the same.
+TEST(ElementwiseExprTest, MatchesSeparateCalls) {
+  const utens_t n = 1237;
+  std::vector<float32> a(n), b(n), c(n), d(n);
+  for (utens_t i = 0; i < n; i++) {
+    a[i] = static_cast<float32>(i % 13) * 0.5f - 3.f;
+    b[i] = static_cast<float32>(i % 7) * 0.25f + 1.f;
+    c[i] = static_cast<float32>(i % 5) - 2.f;
+    d[i] = static_cast<float32>(i % 11) * 0.125f;
+  }
+
+  std::vector<float32> t(n), u(n), ref(n), y(n);
+  chime_cpu_mul<float32>(n, a.data(), b.data(), t.data());
+  chime_cpu_mul<float32>(n, c.data(), d.data(), u.data());
+  chime_cpu_add<float32>(n, t.data(), u.data(), ref.data());
+  chime_cpu_gelu<float32>(n, ref.data(), ref.data());
+  chime_cpu_div<float32>(n, ref.data(), b.data(), ref.data());
+
+  ElementwiseExpr<float32> e;
+  auto na = e.Input(a.data()), nb = e.Input(b.data());
+  auto nc = e.Input(c.data()), nd = e.Input(d.data());
+  e.Evaluate(n, e.Gelu(na * nb + nc * nd) / nb, y.data());
+  for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], ref[i]) << i;
+}
+
+TEST(ElementwiseExprTest, ScalarsAndReuse) {
+  const utens_t n = 515;
+  std::vector<float64> x(n), y(n);
+  for (utens_t i = 0; i < n; i++) x[i] = static_cast<float64>(i) + 1.;
+
+  ElementwiseExpr<float64> e;
+  auto nx = e.Input(x.data());
+  auto sq = nx * nx;
+  // Unused by the result, so never evaluated.
+  e.Log(e.Constant(-1.));
+  e.Evaluate(n, 2. - (sq + 1.) * 0.5 / (4. / nx) - -sq, y.data());
+  for (utens_t i = 0; i < n; i++) {
+    const float64 v = x[i];
+    const float64 sq_ref = v * v;
+    EXPECT_DOUBLE_EQ(y[i], 2. - (sq_ref + 1.) * 0.5 / (4. / v) + sq_ref) << i;
+  }
+}
+
+TEST(ElementwiseExprTest, OutputAliasesInput) {
+  const utens_t n = 600;
+  std::vector<int32> x(n), y(n);
+  for (utens_t i = 0; i < n; i++) {
+    x[i] = static_cast<int32>(i) - 300;
+    y[i] = static_cast<int32>(i % 9);
+  }
+  std::vector<int32> ref(n);
+  for (utens_t i = 0; i < n; i++) {
+    ref[i] = (x[i] - y[i]) * 3 + (x[i] > 0) - (x[i] < 0);
+  }
+
+  ElementwiseExpr<int32> e;
+  auto nx = e.Input(x.data()), ny = e.Input(y.data());
+  e.Evaluate(n, (nx - ny) * 3 + e.Sign(nx), y.data());
+  EXPECT_EQ(y, ref);
+}
+
+TEST(ElementwiseExprTest, TrivialResults) {
+  const utens_t n = 1000;
+  std::vector<float32> x(n), y(n);
+  for (utens_t i = 0; i < n; i++) x[i] = static_cast<float32>(i);
+
+  ElementwiseExpr<float32> e;
+  auto nx = e.Input(x.data());
+  e.Evaluate(n, nx, y.data());
+  EXPECT_EQ(y, x);
+  e.Evaluate(n, e.Constant(2.5f), y.data());
+  for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], 2.5f);
+  // Evaluating in place with the input as result is a no-op.
+  e.Evaluate(n, nx, x.data());
+  EXPECT_EQ(x[n - 1], static_cast<float32>(n - 1));
+}
+
+TEST(ElementwiseExprTest, IndependentOfThreads) {
+  const utens_t n = (1 << 18) + 77;
+  std::vector<float32> x(n), y(n), ref(n);
+  for (utens_t i = 0; i < n; i++) {
+    x[i] = static_cast<float32>(i % 1000) * 4e-3f - 2.f;
+  }
+
+  ElementwiseExpr<float32> e;
+  auto nx = e.Input(x.data());
+  auto r = e.Sigmoid(e.Tanh(nx) * 3.f) + e.Exp(nx) * nx;
+  ScopedIntraOpNumThreads threads(1);
+  e.Evaluate(n, r, ref.data());
+  for (int64_t num_threads : {2, 3, 8}) {
+    SetIntraOpNumThreads(num_threads);
+    e.Evaluate(n, r, y.data());
+    EXPECT_EQ(y, ref) << num_threads;
+  }
+}
+
+}  // namespace chime
@@ -0,0 +1,61 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_FLOAT16_H_
+#define CHIME_CORE_FRAMEWORK_FLOAT16_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fp16.h>
+#include <half.hpp>
+
+namespace chime {
+
+/// 16-bit floating point storage types. Values are meant to be widened to
+/// float32 for arithmetic, see the `chime_cpu_*` routines in
+/// math_functions.hpp, which compute in float32 and round once per result.
+///
+///   float16    IEEE 754 binary16: 5 exponent bits, 10 mantissa bits.
+///   bfloat16   the upper half of a float32: 8 exponent bits, 7 mantissa
+///              bits, so it keeps the range of float32.
+///
+/// Conversions from float32 round to nearest even and keep NaNs quiet.
+typedef half_float::half float16;
+
+inline float Float16BitsToFloat32(uint16_t bits) {
+  return fp16_ieee_to_fp32_value(bits);
+}
+
+inline uint16_t Float32ToFloat16Bits(float x) {
+  return fp16_ieee_from_fp32_value(x);
+}
+
+inline float BFloat16BitsToFloat32(uint16_t bits) {
+  const uint32_t word = static_cast<uint32_t>(bits) << 16;
+  float x;
+  std::memcpy(&x, &word, sizeof(x));
+  return x;
+}
+
+inline uint16_t Float32ToBFloat16Bits(float x) {
+  uint32_t word;
+  std::memcpy(&word, &x, sizeof(word));
+  if (x != x) return static_cast<uint16_t>((word >> 16) | 0x40);
+  // Adding 0x7FFF carries into the upper half past the halfway point, plus
+  // one more at it when the kept part is odd.
+  word += 0x7FFF + ((word >> 16) & 1);
+  return static_cast<uint16_t>(word >> 16);
+}
+
+struct bfloat16 {
+  bfloat16() = default;
+  explicit bfloat16(float x) : bits(Float32ToBFloat16Bits(x)) {}
+
+  operator float() const { return BFloat16BitsToFloat32(bits); }
+
+  uint16_t bits;
+};
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_FLOAT16_H_
@@ -0,0 +1,355 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/grouped_conv.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/transpose.h"
+
+namespace chime {
+namespace internal {
+
+namespace {
+
+// Kernel taps of output pixel (oh, ow) that read inside the image: their
+// indices kh * kernel_w + kw into `taps` and the pixels they read, as
+// ih * in_w + iw, into `pixels`. Returns how many there are.
+utens_t InputTaps(const Conv2DParams &p, utens_t oh, utens_t ow,
+                  utens_t *taps, utens_t *pixels) {
+  utens_t count = 0;
+  for (utens_t kh = 0; kh < p.kernel_h; kh++) {
+    const int64 ih = static_cast<int64>(oh * p.stride_h + kh * p.dilation_h) -
+                     static_cast<int64>(p.pad_h);
+    if (ih < 0 || ih >= static_cast<int64>(p.in_h)) continue;
+    for (utens_t kw = 0; kw < p.kernel_w; kw++) {
+      const int64 iw =
+          static_cast<int64>(ow * p.stride_w + kw * p.dilation_w) -
+          static_cast<int64>(p.pad_w);
+      if (iw < 0 || iw >= static_cast<int64>(p.in_w)) continue;
+      taps[count] = kh * p.kernel_w + kw;
+      pixels[count] = ih * p.in_w + iw;
+      count++;
+    }
+  }
+  return count;
+}
+
+// The other way round, the kernel taps through which outputs read input
+// pixel (ih, iw), and those outputs as oh * out_w + ow.
+utens_t OutputTaps(const Conv2DParams &p, utens_t out_h, utens_t out_w,
+                   utens_t ih, utens_t iw, utens_t *taps, utens_t *pixels) {
+  utens_t count = 0;
+  for (utens_t kh = 0; kh < p.kernel_h; kh++) {
+    const int64 h = static_cast<int64>(ih + p.pad_h) -
+                    static_cast<int64>(kh * p.dilation_h);
+    if (h < 0 || h % p.stride_h != 0) continue;
+    const utens_t oh = h / p.stride_h;
+    if (oh >= out_h) continue;
+    for (utens_t kw = 0; kw < p.kernel_w; kw++) {
+      const int64 w = static_cast<int64>(iw + p.pad_w) -
+                      static_cast<int64>(kw * p.dilation_w);
+      if (w < 0 || w % p.stride_w != 0) continue;
+      const utens_t ow = w / p.stride_w;
+      if (ow >= out_w) continue;
+      taps[count] = kh * p.kernel_w + kw;
+      pixels[count] = oh * out_w + ow;
+      count++;
+    }
+  }
+  return count;
+}
+
+// Pointer lists of the taps of one pixel, shifted to a group.
+template<typename Dtype>
+struct TapPointers {
+  explicit TapPointers(utens_t taps)
+      : taps(taps), pixels(taps), x(taps), w(taps), xg(taps), wg(taps) {}
+
+  void Shift(utens_t count, utens_t x_offset, utens_t w_offset) {
+    for (utens_t t = 0; t < count; t++) {
+      xg[t] = x[t] + x_offset;
+      wg[t] = w[t] + w_offset;
+    }
+  }
+
+  std::vector<utens_t> taps;
+  std::vector<utens_t> pixels;
+  std::vector<const Dtype *> x;
+  std::vector<const Dtype *> w;
+  std::vector<const Dtype *> xg;
+  std::vector<const Dtype *> wg;
+};
+
+// Rows of output pixels are split over the threads, each pixel computing
+// all its channels from the taps that fall inside the image. Depthwise
+// convolutions with one output channel per input channel go through one
+// call over all the channels of the pixel, the others through one per
+// group.
+template<typename Dtype>
+void ForwardNHWC(const Conv2DParams &p, const Dtype *x, const Dtype *filter,
+                 const Dtype *bias, Dtype *y) {
+  const kernels::GroupedConvKernels<Dtype> &k =
+      kernels::GetGroupedConvKernels<Dtype>();
+  const utens_t ic = p.in_channels, oc = p.out_channels;
+  const utens_t icg = ic / p.groups, ocg = oc / p.groups;
+  const utens_t out_h = p.OutH(), out_w = p.OutW();
+  const utens_t taps = p.kernel_h * p.kernel_w;
+  ParallelFor(
+      static_cast<int64_t>(p.batch * out_h),
+      std::max<int64_t>(1, kIntraOpGrainSize /
+                               static_cast<int64_t>(out_w * oc * taps * icg)),
+      [&](int64_t begin, int64_t end) {
+        TapPointers<Dtype> t(taps);
+        for (utens_t row = begin; row < static_cast<utens_t>(end); row++) {
+          const utens_t n = row / out_h, oh = row % out_h;
+          const Dtype *image = x + n * p.in_h * p.in_w * ic;
+          for (utens_t ow = 0; ow < out_w; ow++) {
+            const utens_t count =
+                InputTaps(p, oh, ow, t.taps.data(), t.pixels.data());
+            for (utens_t i = 0; i < count; i++) {
+              t.x[i] = image + t.pixels[i] * ic;
+              t.w[i] = filter + t.taps[i] * icg * oc;
+            }
+            Dtype *out = y + (row * out_w + ow) * oc;
+            if (icg == 1 && ocg == 1) {
+              k.depthwise(oc, count, t.x.data(), t.w.data(), bias, out);
+              continue;
+            }
+            for (utens_t g = 0; g < p.groups; g++) {
+              t.Shift(count, g * icg, g * ocg);
+              k.group(ocg, icg, count, t.xg.data(), t.wg.data(), oc,
+                      bias ? bias + g * ocg : nullptr, out + g * ocg);
+            }
+          }
+        }
+      });
+}
+
+// The data gradient gathers, for every input pixel, dy at the outputs that
+// read it, so that rows of dx are written by one thread each. Groups
+// multiply by the filter transposed, `filter_t` holding for every tap an
+// out_channels x (in_channels / groups) matrix.
+template<typename Dtype>
+void BackwardDataNHWC(const Conv2DParams &p, const Dtype *dy,
+                      const Dtype *filter, const Dtype *filter_t,
+                      Dtype *dx) {
+  const kernels::GroupedConvKernels<Dtype> &k =
+      kernels::GetGroupedConvKernels<Dtype>();
+  const utens_t ic = p.in_channels, oc = p.out_channels;
+  const utens_t icg = ic / p.groups, ocg = oc / p.groups;
+  const utens_t out_h = p.OutH(), out_w = p.OutW();
+  const utens_t taps = p.kernel_h * p.kernel_w;
+  ParallelFor(
+      static_cast<int64_t>(p.batch * p.in_h),
+      std::max<int64_t>(1, kIntraOpGrainSize /
+                               static_cast<int64_t>(p.in_w * ic * taps * ocg)),
+      [&](int64_t begin, int64_t end) {
+        TapPointers<Dtype> t(taps);
+        for (utens_t row = begin; row < static_cast<utens_t>(end); row++) {
+          const utens_t n = row / p.in_h, ih = row % p.in_h;
+          const Dtype *grad = dy + n * out_h * out_w * oc;
+          for (utens_t iw = 0; iw < p.in_w; iw++) {
+            const utens_t count = OutputTaps(p, out_h, out_w, ih, iw,
+                                             t.taps.data(), t.pixels.data());
+            Dtype *in = dx + (row * p.in_w + iw) * ic;
+            for (utens_t i = 0; i < count; i++) {
+              t.x[i] = grad + t.pixels[i] * oc;
+            }
+            if (icg == 1 && ocg == 1) {
+              for (utens_t i = 0; i < count; i++) {
+                t.w[i] = filter + t.taps[i] * oc;
+              }
+              k.depthwise(ic, count, t.x.data(), t.w.data(), nullptr, in);
+              continue;
+            }
+            for (utens_t i = 0; i < count; i++) {
+              t.w[i] = filter_t + t.taps[i] * oc * icg;
+            }
+            for (utens_t g = 0; g < p.groups; g++) {
+              t.Shift(count, g * ocg, g * ocg * icg);
+              k.group(icg, ocg, count, t.xg.data(), t.wg.data(), icg,
+                      nullptr, in + g * icg);
+            }
+          }
+        }
+      });
+}
+
+// The filter gradient sums over every output pixel, so the groups are split
+// over the threads instead, each owning the gradient of its groups.
+template<typename Dtype>
+void BackwardFilterNHWC(const Conv2DParams &p, const Dtype *x,
+                        const Dtype *dy, Dtype *dfilter) {
+  const kernels::GroupedConvKernels<Dtype> &k =
+      kernels::GetGroupedConvKernels<Dtype>();
+  const utens_t ic = p.in_channels, oc = p.out_channels;
+  const utens_t icg = ic / p.groups, ocg = oc / p.groups;
+  const utens_t out_h = p.OutH(), out_w = p.OutW();
+  const utens_t taps = p.kernel_h * p.kernel_w;
+  chime_cpu_set(dfilter, Dtype(0), taps * icg * oc);
+  const utens_t pixels = p.batch * out_h * out_w;
+  ParallelFor(
+      static_cast<int64_t>(p.groups),
+      std::max<int64_t>(
+          1, kIntraOpGrainSize /
+                 static_cast<int64_t>(pixels * taps * icg * ocg)),
+      [&](int64_t begin, int64_t end) {
+        const utens_t g0 = begin, g1 = end;
+        TapPointers<Dtype> t(taps);
+        std::vector<Dtype *> dw(taps), dwg(taps);
+        for (utens_t pixel = 0; pixel < pixels; pixel++) {
+          const utens_t n = pixel / (out_h * out_w);
+          const utens_t oh = pixel / out_w % out_h, ow = pixel % out_w;
+          const Dtype *image = x + n * p.in_h * p.in_w * ic;
+          const Dtype *grad = dy + pixel * oc;
+          const utens_t count =
+              InputTaps(p, oh, ow, t.taps.data(), t.pixels.data());
+          for (utens_t i = 0; i < count; i++) {
+            t.x[i] = image + t.pixels[i] * ic;
+            dw[i] = dfilter + t.taps[i] * icg * oc;
+          }
+          if (icg == 1 && ocg == 1) {
+            for (utens_t i = 0; i < count; i++) {
+              t.xg[i] = t.x[i] + g0;
+              dwg[i] = dw[i] + g0;
+            }
+            k.depthwise_filter(g1 - g0, count, t.xg.data(), grad + g0,
+                               dwg.data());
+            continue;
+          }
+          for (utens_t g = g0; g < g1; g++) {
+            for (utens_t i = 0; i < count; i++) {
+              t.xg[i] = t.x[i] + g * icg;
+              dwg[i] = dw[i] + g * ocg;
+            }
+            k.group_filter(ocg, icg, count, t.xg.data(), grad + g * ocg,
+                           dwg.data(), oc);
+          }
+        }
+      });
+}
+
+// NCHW batches and OIHW filters permuted to NHWC and HWIO, and back.
+Conv2DParams AsNHWC(const Conv2DParams &p) {
+  Conv2DParams nhwc = p;
+  nhwc.layout = ConvLayout::kNHWC;
+  return nhwc;
+}
+
+template<typename Dtype>
+std::vector<Dtype> ImagesToNHWC(utens_t batch, utens_t channels, utens_t h,
+                                utens_t w, const Dtype *x) {
+  std::vector<Dtype> nhwc(batch * channels * h * w);
+  chime_cpu_permute<Dtype>({batch, channels, h, w}, {0, 2, 3, 1}, x,
+                           nhwc.data());
+  return nhwc;
+}
+
+template<typename Dtype>
+void ImagesToNCHW(utens_t batch, utens_t channels, utens_t h, utens_t w,
+                  const std::vector<Dtype> &nhwc, Dtype *x) {
+  chime_cpu_permute<Dtype>({batch, h, w, channels}, {0, 3, 1, 2},
+                           nhwc.data(), x);
+}
+
+template<typename Dtype>
+std::vector<Dtype> FilterToHWIO(const Conv2DParams &p, const Dtype *filter) {
+  const utens_t icg = p.in_channels / p.groups;
+  std::vector<Dtype> hwio(p.kernel_h * p.kernel_w * icg * p.out_channels);
+  chime_cpu_permute<Dtype>({p.out_channels, icg, p.kernel_h, p.kernel_w},
+                           {2, 3, 1, 0}, filter, hwio.data());
+  return hwio;
+}
+
+}  // namespace
+
+template<typename Dtype>
+void GroupedConv2D(const Conv2DParams &params, const Dtype *x,
+                   const Dtype *filter, const Dtype *bias, Dtype *y) {
+  if (params.layout == ConvLayout::kNHWC) {
+    ForwardNHWC(params, x, filter, bias, y);
+    return;
+  }
+  const utens_t n = params.batch, out_h = params.OutH(),
+                out_w = params.OutW();
+  const std::vector<Dtype> x_nhwc = ImagesToNHWC(
+      n, params.in_channels, params.in_h, params.in_w, x);
+  const std::vector<Dtype> hwio = FilterToHWIO(params, filter);
+  std::vector<Dtype> y_nhwc(n * out_h * out_w * params.out_channels);
+  ForwardNHWC(AsNHWC(params), x_nhwc.data(), hwio.data(), bias,
+              y_nhwc.data());
+  ImagesToNCHW(n, params.out_channels, out_h, out_w, y_nhwc, y);
+}
+
+template<typename Dtype>
+void GroupedConv2DBackwardData(const Conv2DParams &params, const Dtype *dy,
+                               const Dtype *filter, Dtype *dx) {
+  const utens_t n = params.batch, out_h = params.OutH(),
+                out_w = params.OutW();
+  const utens_t taps = params.kernel_h * params.kernel_w;
+  const utens_t icg = params.in_channels / params.groups;
+  const utens_t oc = params.out_channels;
+  std::vector<Dtype> hwio;
+  if (params.layout == ConvLayout::kNCHW) {
+    hwio = FilterToHWIO(params, filter);
+    filter = hwio.data();
+  }
+  std::vector<Dtype> filter_t;
+  if (icg != 1 || oc != params.groups) {
+    filter_t.resize(taps * icg * oc);
+    chime_cpu_permute<Dtype>({taps, icg, oc}, {0, 2, 1}, filter,
+                             filter_t.data());
+  }
+  if (params.layout == ConvLayout::kNHWC) {
+    BackwardDataNHWC(params, dy, filter, filter_t.data(), dx);
+    return;
+  }
+  const std::vector<Dtype> dy_nhwc = ImagesToNHWC(n, oc, out_h, out_w, dy);
+  std::vector<Dtype> dx_nhwc(n * params.in_h * params.in_w *
+                             params.in_channels);
+  BackwardDataNHWC(AsNHWC(params), dy_nhwc.data(), filter, filter_t.data(),
+                   dx_nhwc.data());
+  ImagesToNCHW(n, params.in_channels, params.in_h, params.in_w, dx_nhwc, dx);
+}
+
+template<typename Dtype>
+void GroupedConv2DBackwardFilter(const Conv2DParams &params, const Dtype *x,
+                                 const Dtype *dy, Dtype *dfilter) {
+  if (params.layout == ConvLayout::kNHWC) {
+    BackwardFilterNHWC(params, x, dy, dfilter);
+    return;
+  }
+  const utens_t n = params.batch, out_h = params.OutH(),
+                out_w = params.OutW();
+  const utens_t icg = params.in_channels / params.groups;
+  const std::vector<Dtype> x_nhwc = ImagesToNHWC(
+      n, params.in_channels, params.in_h, params.in_w, x);
+  const std::vector<Dtype> dy_nhwc =
+      ImagesToNHWC(n, params.out_channels, out_h, out_w, dy);
+  std::vector<Dtype> hwio(params.kernel_h * params.kernel_w * icg *
+                          params.out_channels);
+  BackwardFilterNHWC(AsNHWC(params), x_nhwc.data(), dy_nhwc.data(),
+                     hwio.data());
+  chime_cpu_permute<Dtype>(
+      {params.kernel_h, params.kernel_w, icg, params.out_channels},
+      {3, 2, 0, 1}, hwio.data(), dfilter);
+}
+
+#define INSTANTIATE_GROUPED_CONV(Dtype)                                       \
+  template void GroupedConv2D<Dtype>(const Conv2DParams &, const Dtype *,     \
+                                     const Dtype *, const Dtype *, Dtype *);  \
+  template void GroupedConv2DBackwardData<Dtype>(                             \
+      const Conv2DParams &, const Dtype *, const Dtype *, Dtype *);           \
+  template void GroupedConv2DBackwardFilter<Dtype>(                           \
+      const Conv2DParams &, const Dtype *, const Dtype *, Dtype *)
+
+INSTANTIATE_GROUPED_CONV(float32);
+INSTANTIATE_GROUPED_CONV(float64);
+
+}  // namespace internal
+}  // namespace chime
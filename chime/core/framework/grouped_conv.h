@@ -0,0 +1,32 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_GROUPED_CONV_H_
+#define CHIME_CORE_FRAMEWORK_GROUPED_CONV_H_
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/conv.h"
+
+namespace chime {
+namespace internal {
+
+/// The paths of `chime_cpu_conv2d`, `chime_cpu_conv2d_backward_data` and
+/// `chime_cpu_conv2d_backward_weights` for `params.groups` > 1, with the
+/// same arguments and layouts. The filter gradient does not include the
+/// bias. Arguments are not checked.
+template<typename Dtype>
+void GroupedConv2D(const Conv2DParams &params, const Dtype *x,
+                   const Dtype *filter, const Dtype *bias, Dtype *y);
+
+template<typename Dtype>
+void GroupedConv2DBackwardData(const Conv2DParams &params, const Dtype *dy,
+                               const Dtype *filter, Dtype *dx);
+
+template<typename Dtype>
+void GroupedConv2DBackwardFilter(const Conv2DParams &params, const Dtype *x,
+                                 const Dtype *dy, Dtype *dfilter);
+
+}  // namespace internal
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_GROUPED_CONV_H_
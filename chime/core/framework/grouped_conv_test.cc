@@ -0,0 +1,233 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/grouped_conv.h"
+
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+Conv2DParams Params(ConvLayout layout, utens_t groups, utens_t in_channels,
+                    utens_t out_channels, utens_t kernel, utens_t stride,
+                    utens_t pad, utens_t dilation) {
+  Conv2DParams p;
+  p.layout = layout;
+  p.batch = 2;
+  p.in_channels = in_channels;
+  p.in_h = 7;
+  p.in_w = 6;
+  p.out_channels = out_channels;
+  p.kernel_h = p.kernel_w = kernel;
+  p.stride_h = p.stride_w = stride;
+  p.pad_h = p.pad_w = pad;
+  p.dilation_h = p.dilation_w = dilation;
+  p.groups = groups;
+  return p;
+}
+
+// Index helpers of the layout of `p`.
+struct Indexer {
+  explicit Indexer(const Conv2DParams &p)
+      : p(p), out_h(p.OutH()), out_w(p.OutW()) {}
+
+  utens_t X(utens_t n, utens_t c, utens_t h, utens_t w) const {
+    return p.layout == ConvLayout::kNCHW
+               ? ((n * p.in_channels + c) * p.in_h + h) * p.in_w + w
+               : ((n * p.in_h + h) * p.in_w + w) * p.in_channels + c;
+  }
+
+  utens_t Y(utens_t n, utens_t o, utens_t h, utens_t w) const {
+    return p.layout == ConvLayout::kNCHW
+               ? ((n * p.out_channels + o) * out_h + h) * out_w + w
+               : ((n * out_h + h) * out_w + w) * p.out_channels + o;
+  }
+
+  // `c` counts the input channels of the group of `o`.
+  utens_t F(utens_t o, utens_t c, utens_t kh, utens_t kw) const {
+    const utens_t icg = p.in_channels / p.groups;
+    return p.layout == ConvLayout::kNCHW
+               ? ((o * icg + c) * p.kernel_h + kh) * p.kernel_w + kw
+               : ((kh * p.kernel_w + kw) * icg + c) * p.out_channels + o;
+  }
+
+  const Conv2DParams &p;
+  utens_t out_h;
+  utens_t out_w;
+};
+
+// Calls fn(x index, y index, filter index) for every product of the
+// convolution, from its definition.
+template<typename Fn>
+void ForEachProduct(const Conv2DParams &p, const Fn &fn) {
+  const Indexer at(p);
+  const utens_t icg = p.in_channels / p.groups;
+  const utens_t ocg = p.out_channels / p.groups;
+  for (utens_t n = 0; n < p.batch; n++) {
+    for (utens_t o = 0; o < p.out_channels; o++) {
+      for (utens_t oh = 0; oh < at.out_h; oh++) {
+        for (utens_t ow = 0; ow < at.out_w; ow++) {
+          for (utens_t c = 0; c < icg; c++) {
+            for (utens_t kh = 0; kh < p.kernel_h; kh++) {
+              for (utens_t kw = 0; kw < p.kernel_w; kw++) {
+                const int64 ih = static_cast<int64>(
+                    oh * p.stride_h + kh * p.dilation_h) -
+                    static_cast<int64>(p.pad_h);
+                const int64 iw = static_cast<int64>(
+                    ow * p.stride_w + kw * p.dilation_w) -
+                    static_cast<int64>(p.pad_w);
+                if (ih < 0 || iw < 0 || ih >= static_cast<int64>(p.in_h) ||
+                    iw >= static_cast<int64>(p.in_w)) {
+                  continue;
+                }
+                fn(at.X(n, o / ocg * icg + c, ih, iw), at.Y(n, o, oh, ow),
+                   at.F(o, c, kh, kw));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+utens_t InputSize(const Conv2DParams &p) {
+  return p.batch * p.in_channels * p.in_h * p.in_w;
+}
+
+utens_t OutputSize(const Conv2DParams &p) {
+  return p.batch * p.out_channels * p.OutH() * p.OutW();
+}
+
+utens_t FilterSize(const Conv2DParams &p) {
+  return p.out_channels * p.in_channels / p.groups * p.kernel_h * p.kernel_w;
+}
+
+template<typename Dtype>
+void ExpectNear(const std::vector<Dtype> &actual,
+                const std::vector<float64> &expected, float64 tolerance) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (utens_t i = 0; i < actual.size(); i++) {
+    EXPECT_NEAR(actual[i], expected[i], tolerance) << i;
+  }
+}
+
+// The forward pass and all the gradients against the definition.
+template<typename Dtype>
+void CheckAgainstReference(const Conv2DParams &p, float64 tolerance) {
+  const std::vector<Dtype> x = Pattern<Dtype>(InputSize(p), 1);
+  const std::vector<Dtype> filter = Pattern<Dtype>(FilterSize(p), 2);
+  const std::vector<Dtype> bias = Pattern<Dtype>(p.out_channels, 3);
+  const std::vector<Dtype> dy = Pattern<Dtype>(OutputSize(p), 4);
+
+  std::vector<float64> y(OutputSize(p));
+  std::vector<float64> dx(InputSize(p));
+  std::vector<float64> dfilter(FilterSize(p));
+  std::vector<float64> dbias(p.out_channels);
+  const Indexer at(p);
+  for (utens_t n = 0; n < p.batch; n++) {
+    for (utens_t o = 0; o < p.out_channels; o++) {
+      for (utens_t oh = 0; oh < at.out_h; oh++) {
+        for (utens_t ow = 0; ow < at.out_w; ow++) {
+          y[at.Y(n, o, oh, ow)] = bias[o];
+          dbias[o] += dy[at.Y(n, o, oh, ow)];
+        }
+      }
+    }
+  }
+  ForEachProduct(p, [&](utens_t i, utens_t j, utens_t f) {
+    y[j] += static_cast<float64>(x[i]) * filter[f];
+    dx[i] += static_cast<float64>(dy[j]) * filter[f];
+    dfilter[f] += static_cast<float64>(dy[j]) * x[i];
+  });
+
+  std::vector<Dtype> actual_y(y.size());
+  chime_cpu_conv2d<Dtype>(p, x.data(), filter.data(), bias.data(),
+                          actual_y.data());
+  ExpectNear(actual_y, y, tolerance);
+  std::vector<Dtype> actual_dx(dx.size());
+  chime_cpu_conv2d_backward_data<Dtype>(p, dy.data(), filter.data(),
+                                        actual_dx.data());
+  ExpectNear(actual_dx, dx, tolerance);
+  std::vector<Dtype> actual_dfilter(dfilter.size());
+  std::vector<Dtype> actual_dbias(dbias.size());
+  chime_cpu_conv2d_backward_weights<Dtype>(p, x.data(), dy.data(),
+                                           actual_dfilter.data(),
+                                           actual_dbias.data());
+  ExpectNear(actual_dfilter, dfilter, tolerance);
+  ExpectNear(actual_dbias, dbias, tolerance);
+}
+
+}  // namespace
+
+// Depthwise with one and two outputs per channel, channel counts that do
+// and do not fill a register, groups of several channels, strides, padding
+// and dilation, in both layouts.
+TEST(GroupedConvTest, TestAgainstReference) {
+  const std::vector<Conv2DParams> cases = {
+      Params(ConvLayout::kNCHW, 3, 3, 3, 3, 1, 1, 1),
+      Params(ConvLayout::kNCHW, 37, 37, 37, 3, 1, 1, 1),
+      Params(ConvLayout::kNCHW, 16, 16, 16, 3, 2, 1, 1),
+      Params(ConvLayout::kNCHW, 8, 8, 16, 3, 1, 2, 2),
+      Params(ConvLayout::kNCHW, 5, 5, 5, 5, 1, 2, 1),
+      Params(ConvLayout::kNCHW, 2, 6, 4, 3, 1, 1, 1),
+      Params(ConvLayout::kNCHW, 4, 8, 40, 3, 2, 0, 1),
+      Params(ConvLayout::kNCHW, 2, 34, 18, 1, 1, 0, 1),
+      Params(ConvLayout::kNCHW, 4, 12, 64, 2, 1, 1, 2),
+  };
+  for (Conv2DParams p : cases) {
+    CheckAgainstReference<float64>(p, 1e-10);
+    p.layout = ConvLayout::kNHWC;
+    CheckAgainstReference<float64>(p, 1e-10);
+  }
+}
+
+TEST(GroupedConvTest, TestFloat) {
+  CheckAgainstReference<float32>(
+      Params(ConvLayout::kNHWC, 32, 32, 32, 3, 1, 1, 1), 1e-4);
+  CheckAgainstReference<float32>(
+      Params(ConvLayout::kNCHW, 4, 32, 32, 3, 1, 1, 1), 1e-4);
+}
+
+TEST(GroupedConvTest, TestGroupsMustDivideChannels) {
+  const Conv2DParams p = Params(ConvLayout::kNCHW, 4, 6, 8, 3, 1, 1, 1);
+  float32 buffer[1];
+  EXPECT_DEATH(
+      chime_cpu_conv2d<float32>(p, buffer, buffer, nullptr, buffer),
+      "do not divide");
+}
+
+// Rows of pixels, and groups for the filter gradient, are split over the
+// threads without changing the result.
+TEST(GroupedConvTest, TestIntraOpParallel) {
+  for (utens_t groups : {64, 8}) {
+    Conv2DParams p = Params(ConvLayout::kNHWC, groups, 64, 64, 3, 1, 1, 1);
+    p.in_h = p.in_w = 32;
+    const std::vector<float32> x = Pattern<float32>(InputSize(p), 1);
+    const std::vector<float32> filter = Pattern<float32>(FilterSize(p), 2);
+    const std::vector<float32> dy = Pattern<float32>(OutputSize(p), 3);
+    std::vector<std::vector<float32>> y(2), dx(2), dfilter(2);
+    for (int run = 0; run < 2; run++) {
+      ScopedIntraOpNumThreads threads(run == 0 ? 1 : 4);
+      y[run].resize(OutputSize(p));
+      dx[run].resize(InputSize(p));
+      dfilter[run].resize(FilterSize(p));
+      chime_cpu_conv2d<float32>(p, x.data(), filter.data(), nullptr,
+                                y[run].data());
+      chime_cpu_conv2d_backward_data<float32>(p, dy.data(), filter.data(),
+                                              dx[run].data());
+      chime_cpu_conv2d_backward_weights<float32>(
+          p, x.data(), dy.data(), dfilter[run].data(), nullptr);
+    }
+    EXPECT_EQ(y[0], y[1]);
+    EXPECT_EQ(dx[0], dx[1]);
+    EXPECT_EQ(dfilter[0], dfilter[1]);
+  }
+}
+
+}  // namespace chime
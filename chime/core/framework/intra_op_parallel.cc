@@ -0,0 +1,124 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/intra_op_parallel.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+
+#include "chime/core/platform/blocking_counter.h"
+#include "chime/core/platform/cpu_info.h"
+#include "chime/core/platform/env.hpp"
+#include "chime/core/platform/logging.hpp"
+#include "chime/core/platform/mutex.h"
+
+namespace chime {
+
+namespace {
+
+// Shards start on multiples of this many elements, so that two threads never
+// write to the same cache line of a float or wider array.
+constexpr int64_t kShardAlignment = 64;
+
+thread_local bool in_parallel_region = false;
+
+mutex pool_mutex;
+std::unique_ptr<platform::ThreadPool> intra_op_pool;
+// 0 until the default has been computed.
+std::atomic<int64_t> intra_op_num_threads(0);
+
+int64_t DefaultNumThreads() {
+  const char *env = std::getenv("CE_INTRA_OP_THREADS");
+  if (env != nullptr && env[0] != '\0') {
+    char *end = nullptr;
+    long long value = std::strtoll(env, &end, 10);
+    if (*end == '\0' && value > 0) return static_cast<int64_t>(value);
+    LOG(WARNING) << "Invalid CE_INTRA_OP_THREADS `" << env
+                 << "`, using the number of CPUs";
+  }
+  return std::max(port::NumSchedulableCPUs(), 1);
+}
+
+}  // namespace
+
+int64_t GetIntraOpNumThreads() {
+  int64_t num_threads = intra_op_num_threads.load(std::memory_order_acquire);
+  if (num_threads > 0) return num_threads;
+
+  mutex_lock lock(pool_mutex);
+  num_threads = intra_op_num_threads.load(std::memory_order_relaxed);
+  if (num_threads == 0) {
+    num_threads = DefaultNumThreads();
+    intra_op_num_threads.store(num_threads, std::memory_order_release);
+  }
+  return num_threads;
+}
+
+void SetIntraOpNumThreads(int64_t num_threads) {
+  CHECK_GT(num_threads, 0);
+  mutex_lock lock(pool_mutex);
+  intra_op_pool.reset();
+  intra_op_num_threads.store(num_threads, std::memory_order_release);
+}
+
+platform::ThreadPool *GetIntraOpThreadPool() {
+  const int64_t num_threads = GetIntraOpNumThreads();
+  if (num_threads == 1) return nullptr;
+
+  mutex_lock lock(pool_mutex);
+  if (!intra_op_pool) {
+    intra_op_pool.reset(new platform::ThreadPool(
+        platform::Env::Default(), "intra_op", num_threads));
+  }
+  return intra_op_pool.get();
+}
+
+namespace internal {
+
+bool InParallelRegion() { return in_parallel_region; }
+
+void ParallelForImpl(int64_t total, int64_t grain_size,
+                     const std::function<void(int64_t, int64_t)> &fn) {
+  platform::ThreadPool *pool = GetIntraOpThreadPool();
+  const int64_t max_shards = total / std::max<int64_t>(grain_size, 1);
+  const int64_t num_shards =
+      pool == nullptr ? 1 : std::min(pool->NumThreads(), max_shards);
+  if (num_shards <= 1) {
+    fn(0, total);
+    return;
+  }
+
+  int64_t block_size = (total + num_shards - 1) / num_shards;
+  // Only shards of many elements are aligned, coarser work items (a matrix of
+  // a batch, ...) would otherwise all end up in one shard.
+  if (block_size > kShardAlignment) {
+    block_size = (block_size + kShardAlignment - 1) / kShardAlignment *
+                 kShardAlignment;
+  }
+  const int64_t num_blocks = (total + block_size - 1) / block_size;
+  const auto run_block = [&fn, total, block_size](int64_t block) {
+    // Nested calls run inline: a worker waiting on shards queued behind it
+    // could otherwise block the pool.
+    const bool was_in_parallel_region = in_parallel_region;
+    in_parallel_region = true;
+    fn(block * block_size, std::min(total, (block + 1) * block_size));
+    in_parallel_region = was_in_parallel_region;
+  };
+
+  // The pool is shared by every thread calling into chime, so only the shards
+  // of this call are waited for. The calling thread runs the first one.
+  BlockingCounter counter(static_cast<int>(num_blocks - 1));
+  for (int64_t block = 1; block < num_blocks; ++block) {
+    pool->Schedule([&run_block, &counter, block]() {
+      run_block(block);
+      counter.DecrementCount();
+    });
+  }
+  run_block(0);
+  counter.Wait();
+}
+
+}  // namespace internal
+
+}  // namespace chime
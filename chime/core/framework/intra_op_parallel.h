@@ -0,0 +1,108 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_INTRA_OP_PARALLEL_H_
+#define CHIME_CORE_FRAMEWORK_INTRA_OP_PARALLEL_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "chime/core/platform/macros.h"
+#include "chime/core/platform/threadpool.h"
+
+namespace chime {
+
+/// Intra-op parallelism for the `chime_cpu_*` routines. A large call is split
+/// into contiguous shards which run on a process-wide thread pool, the calling
+/// thread taking one of them. Calls on fewer than `2 * grain_size` elements,
+/// and calls made from inside a shard, stay on the calling thread.
+
+/// Smallest shard worth handing to another thread, in elements. The first is
+/// meant for memory-bound kernels (copy, axpy, add, ...), the second for
+/// kernels that do more arithmetic per element (exp, tanh, ...).
+constexpr int64_t kIntraOpGrainSize = 32768;
+constexpr int64_t kIntraOpComputeGrainSize = 4096;
+
+/// Number of threads used for intra-op parallelism. Defaults to the value of
+/// the `CE_INTRA_OP_THREADS` environment variable or, when it is not set, to
+/// the number of schedulable CPUs. 1 means no intra-op parallelism.
+int64_t GetIntraOpNumThreads();
+
+/// Resizes the intra-op pool. Must not be called while any `chime_cpu_*`
+/// routine is running.
+/// REQUIRES: num_threads > 0
+void SetIntraOpNumThreads(int64_t num_threads);
+
+/// Sets the number of intra-op threads for the lifetime of the object, and
+/// restores the previous number when it goes out of scope:
+///
+///   {
+///     ScopedIntraOpNumThreads threads(1);
+///     ...  // runs serially
+///   }
+///
+/// Same requirements as `SetIntraOpNumThreads`.
+class ScopedIntraOpNumThreads {
+ public:
+  explicit ScopedIntraOpNumThreads(int64_t num_threads)
+      : _saved(GetIntraOpNumThreads()) {
+    SetIntraOpNumThreads(num_threads);
+  }
+  ~ScopedIntraOpNumThreads() { SetIntraOpNumThreads(_saved); }
+
+ private:
+  int64_t _saved;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(ScopedIntraOpNumThreads);
+};
+
+/// Returns the intra-op pool, creating it on first use, or nullptr if
+/// `GetIntraOpNumThreads()` is 1.
+platform::ThreadPool *GetIntraOpThreadPool();
+
+namespace internal {
+
+bool InParallelRegion();
+
+void ParallelForImpl(int64_t total, int64_t grain_size,
+                     const std::function<void(int64_t, int64_t)> &fn);
+
+}  // namespace internal
+
+/// Calls `fn(begin, end)` over disjoint ranges covering [0, total), at most
+/// one range per intra-op thread and none shorter than `grain_size` (except
+/// for the last one). Returns when every range is done.
+template <typename Fn>
+inline void ParallelFor(int64_t total, int64_t grain_size, const Fn &fn) {
+  if (total < 2 * grain_size || internal::InParallelRegion() ||
+      GetIntraOpNumThreads() == 1) {
+    if (total > 0) fn(0, total);
+    return;
+  }
+  internal::ParallelForImpl(total, grain_size, fn);
+}
+
+/// Returns the sum of `fn(begin, end)` over the blocks
+/// [i * grain_size, (i + 1) * grain_size) of [0, total). Partial sums are
+/// added in block order and the blocks only depend on `total`, so the result
+/// is the same whatever the number of threads.
+template <typename T, typename Fn>
+inline T ParallelSum(int64_t total, int64_t grain_size, const Fn &fn) {
+  if (total < 2 * grain_size) return total > 0 ? fn(0, total) : T(0);
+  const int64_t num_blocks = (total + grain_size - 1) / grain_size;
+  std::vector<T> partials(num_blocks);
+  ParallelFor(num_blocks, 1, [&](int64_t first, int64_t last) {
+    for (int64_t b = first; b < last; b++) {
+      partials[b] = fn(b * grain_size, std::min(total, (b + 1) * grain_size));
+    }
+  });
+  T sum = T(0);
+  for (int64_t b = 0; b < num_blocks; b++) sum += partials[b];
+  return sum;
+}
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_INTRA_OP_PARALLEL_H_
@@ -0,0 +1,120 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/intra_op_parallel.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+TEST(IntraOpParallelTest, CoversRangeOnce) {
+  ScopedIntraOpNumThreads threads(4);
+  const int64_t total = 100003;
+  std::vector<std::atomic<int>> hits(total);
+  for (auto &h : hits) h = 0;
+  std::atomic<int> shards(0);
+  ParallelFor(total, 1000, [&](int64_t begin, int64_t end) {
+    shards++;
+    for (int64_t i = begin; i < end; i++) hits[i]++;
+  });
+  for (int64_t i = 0; i < total; i++) EXPECT_EQ(hits[i], 1) << i;
+  EXPECT_LE(shards, 4);
+}
+
+TEST(IntraOpParallelTest, SplitsFewCoarseItems) {
+  ScopedIntraOpNumThreads threads(4);
+  std::atomic<int> shards(0);
+  ParallelFor(8, 1, [&](int64_t begin, int64_t end) {
+    shards++;
+    EXPECT_EQ(end - begin, 2);
+  });
+  EXPECT_EQ(shards, 4);
+}
+
+TEST(IntraOpParallelTest, SmallInputStaysSerial) {
+  ScopedIntraOpNumThreads threads(4);
+  int calls = 0;
+  ParallelFor(1999, 1000, [&](int64_t begin, int64_t end) {
+    calls++;
+    EXPECT_EQ(begin, 0);
+    EXPECT_EQ(end, 1999);
+  });
+  EXPECT_EQ(calls, 1);
+  ParallelFor(0, 1000, [&](int64_t, int64_t) { calls++; });
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(IntraOpParallelTest, NestedRunsInline) {
+  ScopedIntraOpNumThreads threads(4);
+  std::atomic<int64_t> sum(0);
+  ParallelFor(8, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i++) {
+      ParallelFor(1000, 1, [&](int64_t b, int64_t e) { sum += e - b; });
+    }
+  });
+  EXPECT_EQ(sum, 8000);
+}
+
+TEST(IntraOpParallelTest, ConcurrentCallsWaitOnlyForTheirShards) {
+  ScopedIntraOpNumThreads threads(2);
+  std::atomic<int> started(0);
+  std::atomic<bool> release(false);
+  std::thread blocked([&]() {
+    ParallelFor(2, 1, [&](int64_t, int64_t) {
+      started++;
+      while (!release) std::this_thread::yield();
+    });
+  });
+  while (started < 2) std::this_thread::yield();
+
+  // Would hang if this call also waited for the shards of the blocked one.
+  std::atomic<int64_t> sum(0);
+  ParallelFor(2, 1, [&](int64_t begin, int64_t end) { sum += end - begin; });
+  EXPECT_EQ(sum, 2);
+
+  release = true;
+  blocked.join();
+}
+
+TEST(IntraOpParallelTest, ScopedNumThreadsRestores) {
+  const int64_t saved = GetIntraOpNumThreads();
+  {
+    ScopedIntraOpNumThreads threads(3);
+    EXPECT_EQ(GetIntraOpNumThreads(), 3);
+    {
+      ScopedIntraOpNumThreads serial(1);
+      EXPECT_EQ(GetIntraOpNumThreads(), 1);
+    }
+    EXPECT_EQ(GetIntraOpNumThreads(), 3);
+  }
+  EXPECT_EQ(GetIntraOpNumThreads(), saved);
+}
+
+TEST(IntraOpParallelTest, SumIndependentOfThreads) {
+  const int64_t total = 1 << 20;
+  std::vector<float> x(total);
+  for (int64_t i = 0; i < total; i++) x[i] = 1.f / static_cast<float>(i + 1);
+  auto partial = [&](int64_t begin, int64_t end) {
+    float s = 0.f;
+    for (int64_t i = begin; i < end; i++) s += x[i];
+    return s;
+  };
+
+  float serial;
+  {
+    ScopedIntraOpNumThreads threads(1);
+    serial = ParallelSum<float>(total, 4096, partial);
+  }
+  for (int64_t num_threads : {2, 3, 8}) {
+    ScopedIntraOpNumThreads threads(num_threads);
+    EXPECT_EQ(ParallelSum<float>(total, 4096, partial), serial)
+        << num_threads;
+  }
+  EXPECT_EQ(ParallelSum<float>(10, 4096, partial), partial(0, 10));
+}
+
+}  // namespace chime
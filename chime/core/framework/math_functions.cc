@@ -3,83 +3,381 @@
 
 #include "chime/core/framework/math_functions.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <random>
+#include <vector>
+
+#include "chime/core/framework/blas_backend.h"
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/packed_matrix.h"
 
 namespace chime {
 
+namespace {
+
+// Checks the leading dimensions of a row-major gemm against the number of
+// columns each operand stores.
+void check_gemm_ld(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                   utens_t n, utens_t k, utens_t lda, utens_t ldb,
+                   utens_t ldc) {
+  CHECK_GE(lda, std::max<utens_t>(transA == CblasNoTrans ? k : m, 1));
+  CHECK_GE(ldb, std::max<utens_t>(transB == CblasNoTrans ? n : k, 1));
+  CHECK_GE(ldc, std::max<utens_t>(n, 1));
+}
+
+void check_gemv_ld(utens_t n, utens_t lda, utens_t incx, utens_t incy) {
+  CHECK_GE(lda, std::max<utens_t>(n, 1));
+  CHECK_GT(incx, 0);
+  CHECK_GT(incy, 0);
+}
+
+// Runs the fully unrolled kernel for m x n x k if there is one.
+template<typename Dtype>
+bool gemm_fixed(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                utens_t n, utens_t k, Dtype alpha, const Dtype *A, utens_t lda,
+                const Dtype *B, utens_t ldb, Dtype beta, Dtype *C,
+                utens_t ldc) {
+  const int shape = kernels::FixedGemmShapeIndex(m, n, k);
+  if (shape < 0) return false;
+  kernels::GetGemmKernels<Dtype>().fixed[shape](
+      transA != CblasNoTrans, transB != CblasNoTrans, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+  return true;
+}
+
+}  // namespace
+
 template<>
 void chime_cpu_gemm<float32>(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
                              utens_t m, utens_t n, utens_t k, float32 alpha,
-                             const float32 *A, const float32 *B, float32 beta,
-                             float32 *C) {
-  blasint lda = static_cast<blasint>((transA == CblasNoTrans) ? k : m);
-  blasint ldb = static_cast<blasint>((transB == CblasNoTrans) ? n : k);
-  cblas_sgemm(CblasRowMajor, transA, transB, static_cast<blasint>(m),
-              static_cast<blasint>(n), static_cast<blasint>(k), alpha, A, lda,
-              B, ldb, beta, C, static_cast<blasint>(n));
+                             const float32 *A, utens_t lda, const float32 *B,
+                             utens_t ldb, float32 beta, float32 *C,
+                             utens_t ldc) {
+  check_gemm_ld(transA, transB, m, n, k, lda, ldb, ldc);
+  if (gemm_fixed<float32>(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta,
+                          C, ldc)) {
+    return;
+  }
+  GetBlasRoutines<float32>(GetBlasBackend())
+      .gemm(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
 }
 
 template<>
 void chime_cpu_gemm<float64>(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
                              utens_t m, utens_t n, utens_t k, float64 alpha,
-                             const float64 *A, const float64 *B, float64 beta,
-                             float64 *C) {
-  blasint lda = static_cast<blasint>((transA == CblasNoTrans) ? k : m);
-  blasint ldb = static_cast<blasint>((transB == CblasNoTrans) ? n : k);
-  cblas_dgemm(CblasRowMajor, transA, transB, static_cast<blasint>(m),
-              static_cast<blasint>(n), static_cast<blasint>(k), alpha, A, lda,
-              B, ldb, beta, C, static_cast<blasint>(n));
+                             const float64 *A, utens_t lda, const float64 *B,
+                             utens_t ldb, float64 beta, float64 *C,
+                             utens_t ldc) {
+  check_gemm_ld(transA, transB, m, n, k, lda, ldb, ldc);
+  if (gemm_fixed<float64>(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta,
+                          C, ldc)) {
+    return;
+  }
+  GetBlasRoutines<float64>(GetBlasBackend())
+      .gemm(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
 }
 
 template<>
 void chime_cpu_gemm<float128>(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
                               utens_t m, utens_t n, utens_t k, float128 alpha,
-                              const float128 *A, const float128 *B,
-                              float128 beta, float128 *C) {
-#ifndef NOT_IMPLEMENTED
-  blasint lda = static_cast<blasint>((transA == CblasNoTrans) ? k : m);
-  blasint ldb = static_cast<blasint>((transB == CblasNoTrans) ? n : k);
-#endif
-  NOT_IMPLEMENTED;
+                              const float128 *A, utens_t lda,
+                              const float128 *B, utens_t ldb, float128 beta,
+                              float128 *C, utens_t ldc) {
+  check_gemm_ld(transA, transB, m, n, k, lda, ldb, ldc);
+  if (gemm_fixed<float128>(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta,
+                           C, ldc)) {
+    return;
+  }
+  GetBlasRoutines<float128>(BlasBackend::BUILTIN)
+      .gemm(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+namespace {
+
+// The matrix stays in its 16-bit storage and is read once: rows of A are
+// dotted with x, or for op(A) = A^T, scaled by x and added to float32 sums of
+// the columns, each thread taking its own slice of columns.
+template<typename Htype>
+void gemv_half(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Htype alpha,
+               const Htype *A, utens_t lda, const Htype *x, utens_t incx,
+               Htype beta, Htype *y, utens_t incy) {
+  check_gemv_ld(n, lda, incx, incy);
+  const kernels::HalfKernels<Htype> &half = kernels::GetHalfKernels<Htype>();
+  const bool trans = transA != CblasNoTrans;
+  const utens_t x_size = trans ? m : n;
+  const utens_t y_size = trans ? n : m;
+  std::vector<float32> x_f(x_size), sums(y_size);
+  for (utens_t i = 0; i < x_size; i++) {
+    x_f[i] = static_cast<float32>(x[i * incx]);
+  }
+  const int64_t grain_size = std::max<int64_t>(
+      1, kIntraOpGrainSize /
+             static_cast<int64_t>(std::max<utens_t>(x_size, 1)));
+  if (!trans) {
+    ParallelFor(static_cast<int64_t>(m), grain_size,
+                [&](int64_t begin, int64_t end) {
+                  for (utens_t i = begin; i < static_cast<utens_t>(end); i++) {
+                    sums[i] = half.dot(n, A + i * lda, x_f.data());
+                  }
+                });
+  } else {
+    ParallelFor(static_cast<int64_t>(n), grain_size,
+                [&](int64_t begin, int64_t end) {
+                  for (utens_t i = 0; i < m; i++) {
+                    half.axpy(end - begin, x_f[i], A + i * lda + begin,
+                              sums.data() + begin);
+                  }
+                });
+  }
+  const float32 alpha_f = static_cast<float32>(alpha);
+  const float32 beta_f = static_cast<float32>(beta);
+  for (utens_t i = 0; i < y_size; i++) {
+    float32 value = alpha_f * sums[i];
+    if (beta_f != 0.f) value += beta_f * static_cast<float32>(y[i * incy]);
+    y[i * incy] = Htype(value);
+  }
+}
+
+// float16 and bfloat16 products accumulate in float32. A single row or
+// column of C is a matrix-vector product and goes to `gemv_half`, which reads
+// the matrix in its 16-bit storage; larger products widen blocks of the
+// operands as the built-in GEMM packs them.
+template<typename Htype>
+void gemm_half(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+               utens_t n, utens_t k, Htype alpha, const Htype *A, utens_t lda,
+               const Htype *B, utens_t ldb, Htype beta, Htype *C,
+               utens_t ldc) {
+  check_gemm_ld(transA, transB, m, n, k, lda, ldb, ldc);
+  if (m == 1 && n > 0) {
+    // c = op(B)^T * a, with a the only row of op(A).
+    const bool b_rows = transB == CblasNoTrans;
+    gemv_half(b_rows ? CblasTrans : CblasNoTrans, b_rows ? k : n,
+              b_rows ? n : k, alpha, B, ldb, A,
+              transA == CblasNoTrans ? 1 : lda, beta, C, 1);
+    return;
+  }
+  if (n == 1 && m > 0) {
+    // c = op(A) * b, with b the only column of op(B).
+    const bool a_rows = transA == CblasNoTrans;
+    gemv_half(transA, a_rows ? m : k, a_rows ? k : m, alpha, A, lda, B,
+              transB == CblasNoTrans ? ldb : 1, beta, C, ldc);
+    return;
+  }
+  internal::GemmHalf(transA, transB, m, n, k, static_cast<float32>(alpha), A,
+                     lda, B, ldb, static_cast<float32>(beta), C, ldc);
+}
+
+}  // namespace
+
+template<>
+void chime_cpu_gemm<float16>(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                             utens_t m, utens_t n, utens_t k, float16 alpha,
+                             const float16 *A, utens_t lda, const float16 *B,
+                             utens_t ldb, float16 beta, float16 *C,
+                             utens_t ldc) {
+  gemm_half(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+template<>
+void chime_cpu_gemm<bfloat16>(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                              utens_t m, utens_t n, utens_t k, bfloat16 alpha,
+                              const bfloat16 *A, utens_t lda,
+                              const bfloat16 *B, utens_t ldb, bfloat16 beta,
+                              bfloat16 *C, utens_t ldc) {
+  gemm_half(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+template<typename Dtype>
+void chime_cpu_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                    utens_t n, utens_t k, Dtype alpha, const Dtype *A,
+                    const Dtype *B, Dtype beta, Dtype *C) {
+  utens_t lda = (transA == CblasNoTrans) ? k : m;
+  utens_t ldb = (transB == CblasNoTrans) ? n : k;
+  chime_cpu_gemm<Dtype>(transA, transB, m, n, k, alpha, A,
+                        std::max<utens_t>(lda, 1), B,
+                        std::max<utens_t>(ldb, 1), beta, C,
+                        std::max<utens_t>(n, 1));
+}
+
+template void chime_cpu_gemm<float32>(CBLAS_TRANSPOSE, CBLAS_TRANSPOSE,
+                                      utens_t, utens_t, utens_t, float32,
+                                      const float32 *, const float32 *,
+                                      float32, float32 *);
+template void chime_cpu_gemm<float64>(CBLAS_TRANSPOSE, CBLAS_TRANSPOSE,
+                                      utens_t, utens_t, utens_t, float64,
+                                      const float64 *, const float64 *,
+                                      float64, float64 *);
+template void chime_cpu_gemm<float128>(CBLAS_TRANSPOSE, CBLAS_TRANSPOSE,
+                                       utens_t, utens_t, utens_t, float128,
+                                       const float128 *, const float128 *,
+                                       float128, float128 *);
+template void chime_cpu_gemm<float16>(CBLAS_TRANSPOSE, CBLAS_TRANSPOSE,
+                                      utens_t, utens_t, utens_t, float16,
+                                      const float16 *, const float16 *,
+                                      float16, float16 *);
+template void chime_cpu_gemm<bfloat16>(CBLAS_TRANSPOSE, CBLAS_TRANSPOSE,
+                                       utens_t, utens_t, utens_t, bfloat16,
+                                       const bfloat16 *, const bfloat16 *,
+                                       bfloat16, bfloat16 *);
+
+namespace {
+
+// Products with at most this many multiply-adds run on a single BLAS thread,
+// so a batch of them is better split over the intra-op pool.
+constexpr utens_t kSmallGemmSize = 128 * 128 * 128;
+
+// Runs `gemm(i)` for every i in [0, batch_count).
+template<typename Fn>
+void for_each_gemm(utens_t m, utens_t n, utens_t k, utens_t batch_count,
+                   const Fn &gemm) {
+  const utens_t size = std::max<utens_t>(m * n * k, 1);
+  if (size > kSmallGemmSize) {
+    for (utens_t i = 0; i < batch_count; i++) gemm(i);
+    return;
+  }
+  const int64_t grain_size = static_cast<int64_t>(
+      std::max<utens_t>(kIntraOpComputeGrainSize * 16 / size, 1));
+  ParallelFor(static_cast<int64_t>(batch_count), grain_size,
+              [&](int64_t begin, int64_t end) {
+                for (int64_t i = begin; i < end; i++) gemm(i);
+              });
+}
+
+}  // namespace
+
+template<typename Dtype>
+void chime_cpu_gemm_strided_batched(CBLAS_TRANSPOSE transA,
+                                    CBLAS_TRANSPOSE transB, utens_t m,
+                                    utens_t n, utens_t k, Dtype alpha,
+                                    const Dtype *A, utens_t stride_a,
+                                    const Dtype *B, utens_t stride_b,
+                                    Dtype beta, Dtype *C, utens_t stride_c,
+                                    utens_t batch_count) {
+  CHECK(batch_count <= 1 || stride_c >= m * n)
+      << "Matrices of C overlap across the batch";
+  for_each_gemm(m, n, k, batch_count, [&](utens_t i) {
+    chime_cpu_gemm<Dtype>(transA, transB, m, n, k, alpha, A + i * stride_a,
+                          B + i * stride_b, beta, C + i * stride_c);
+  });
+}
+
+template<typename Dtype>
+void chime_cpu_gemm_batched(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                            utens_t m, utens_t n, utens_t k, Dtype alpha,
+                            const Dtype *const *A, const Dtype *const *B,
+                            Dtype beta, Dtype *const *C, utens_t batch_count) {
+  for_each_gemm(m, n, k, batch_count, [&](utens_t i) {
+    chime_cpu_gemm<Dtype>(transA, transB, m, n, k, alpha, A[i], B[i], beta,
+                          C[i]);
+  });
 }
 
+#define INSTANTIATE_GEMM_BATCHED(Dtype)                                       \
+  template void chime_cpu_gemm_strided_batched<Dtype>(                        \
+      CBLAS_TRANSPOSE, CBLAS_TRANSPOSE, utens_t, utens_t, utens_t, Dtype,     \
+      const Dtype *, utens_t, const Dtype *, utens_t, Dtype, Dtype *,         \
+      utens_t, utens_t);                                                      \
+  template void chime_cpu_gemm_batched<Dtype>(                                \
+      CBLAS_TRANSPOSE, CBLAS_TRANSPOSE, utens_t, utens_t, utens_t, Dtype,     \
+      const Dtype *const *, const Dtype *const *, Dtype, Dtype *const *,      \
+      utens_t)
+
+INSTANTIATE_GEMM_BATCHED(float32);
+INSTANTIATE_GEMM_BATCHED(float64);
+INSTANTIATE_GEMM_BATCHED(float128);
+
 template<>
 void chime_cpu_gemv<float32>(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
-                             float32 alpha, const float32 *A, const float32 *x,
-                             float32 beta, float32 *y) {
-  cblas_sgemv(CblasRowMajor, transA, static_cast<blasint>(m),
-              static_cast<blasint>(n), alpha, A, static_cast<blasint>(n), x,
-              static_cast<blasint>(1), beta, y, static_cast<blasint>(1));
+                             float32 alpha, const float32 *A, utens_t lda,
+                             const float32 *x, utens_t incx, float32 beta,
+                             float32 *y, utens_t incy) {
+  check_gemv_ld(n, lda, incx, incy);
+  GetBlasRoutines<float32>(GetBlasBackend())
+      .gemv(transA, m, n, alpha, A, lda, x, incx, beta, y, incy);
 }
 
 template<>
 void chime_cpu_gemv<float64>(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
-                             float64 alpha, const float64 *A, const float64 *x,
-                             float64 beta, float64 *y) {
-  cblas_dgemv(CblasRowMajor, transA, static_cast<blasint>(m),
-              static_cast<blasint>(n), alpha, A, static_cast<blasint>(n), x,
-              static_cast<blasint>(1), beta, y, static_cast<blasint>(1));
+                             float64 alpha, const float64 *A, utens_t lda,
+                             const float64 *x, utens_t incx, float64 beta,
+                             float64 *y, utens_t incy) {
+  check_gemv_ld(n, lda, incx, incy);
+  GetBlasRoutines<float64>(GetBlasBackend())
+      .gemv(transA, m, n, alpha, A, lda, x, incx, beta, y, incy);
 }
 
 template<>
 void chime_cpu_gemv<float128>(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
-                              float128 alpha, const float128 *A,
-                              const float128 *x, float128 beta, float128 *y) {
-  NOT_IMPLEMENTED;
+                              float128 alpha, const float128 *A, utens_t lda,
+                              const float128 *x, utens_t incx, float128 beta,
+                              float128 *y, utens_t incy) {
+  check_gemv_ld(n, lda, incx, incy);
+  GetBlasRoutines<float128>(BlasBackend::BUILTIN)
+      .gemv(transA, m, n, alpha, A, lda, x, incx, beta, y, incy);
 }
 
+template<>
+void chime_cpu_gemv<float16>(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
+                             float16 alpha, const float16 *A, utens_t lda,
+                             const float16 *x, utens_t incx, float16 beta,
+                             float16 *y, utens_t incy) {
+  gemv_half(transA, m, n, alpha, A, lda, x, incx, beta, y, incy);
+}
+
+template<>
+void chime_cpu_gemv<bfloat16>(CBLAS_TRANSPOSE transA, utens_t m, utens_t n,
+                              bfloat16 alpha, const bfloat16 *A, utens_t lda,
+                              const bfloat16 *x, utens_t incx, bfloat16 beta,
+                              bfloat16 *y, utens_t incy) {
+  gemv_half(transA, m, n, alpha, A, lda, x, incx, beta, y, incy);
+}
+
+template<typename Dtype>
+void chime_cpu_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Dtype alpha,
+                    const Dtype *A, const Dtype *x, Dtype beta, Dtype *y) {
+  chime_cpu_gemv<Dtype>(transA, m, n, alpha, A, std::max<utens_t>(n, 1), x, 1,
+                        beta, y, 1);
+}
+
+template void chime_cpu_gemv<float32>(CBLAS_TRANSPOSE, utens_t, utens_t,
+                                      float32, const float32 *,
+                                      const float32 *, float32, float32 *);
+template void chime_cpu_gemv<float64>(CBLAS_TRANSPOSE, utens_t, utens_t,
+                                      float64, const float64 *,
+                                      const float64 *, float64, float64 *);
+template void chime_cpu_gemv<float128>(CBLAS_TRANSPOSE, utens_t, utens_t,
+                                       float128, const float128 *,
+                                       const float128 *, float128, float128 *);
+template void chime_cpu_gemv<float16>(CBLAS_TRANSPOSE, utens_t, utens_t,
+                                      float16, const float16 *,
+                                      const float16 *, float16, float16 *);
+template void chime_cpu_gemv<bfloat16>(CBLAS_TRANSPOSE, utens_t, utens_t,
+                                       bfloat16, const bfloat16 *,
+                                       const bfloat16 *, bfloat16, bfloat16 *);
+
 template<>
 void chime_cpu_axpy<float32>(utens_t N, float32 alpha, const float32 *x,
                              float32 *y) {
-  cblas_saxpy(static_cast<blasint>(N), alpha, x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(N), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_saxpy(static_cast<blasint>(end - begin), alpha, x + begin,
+                            static_cast<blasint>(1), y + begin,
+                            static_cast<blasint>(1));
+              });
 }
 
 template<>
 void chime_cpu_axpy<float64>(utens_t N, float64 alpha, const float64 *x,
                              float64 *y) {
-  cblas_daxpy(static_cast<blasint>(N), alpha, x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(N), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_daxpy(static_cast<blasint>(end - begin), alpha, x + begin,
+                            static_cast<blasint>(1), y + begin,
+                            static_cast<blasint>(1));
+              });
 }
 
 template<>
@@ -91,15 +389,23 @@ void chime_cpu_axpy<float128>(utens_t N, float128 alpha, const float128 *x,
 template<>
 void chime_cpu_axpby<float32>(utens_t N, float32 alpha, const float32 *x,
                               float32 beta, float32 *y) {
-  cblas_saxpby(static_cast<blasint>(N), alpha, x, static_cast<blasint>(1), beta,
-               y, static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(N), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_saxpby(static_cast<blasint>(end - begin), alpha,
+                             x + begin, static_cast<blasint>(1), beta,
+                             y + begin, static_cast<blasint>(1));
+              });
 }
 
 template<>
 void chime_cpu_axpby<float64>(utens_t N, float64 alpha, const float64 *x,
                               float64 beta, float64 *y) {
-  cblas_daxpby(static_cast<blasint>(N), alpha, x, static_cast<blasint>(1), beta,
-               y, static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(N), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_daxpby(static_cast<blasint>(end - begin), alpha,
+                             x + begin, static_cast<blasint>(1), beta,
+                             y + begin, static_cast<blasint>(1));
+              });
 }
 
 template<>
@@ -111,15 +417,23 @@ void chime_cpu_axpby<float128>(utens_t N, float128 alpha, const float128 *x,
 template<>
 void chime_cpu_copy<float32>(float32 *y, const float32 *x, utens_t n) {
   DCHECK_NE(x, y);
-  cblas_scopy(static_cast<blasint>(n), x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_scopy(static_cast<blasint>(end - begin), x + begin,
+                            static_cast<blasint>(1), y + begin,
+                            static_cast<blasint>(1));
+              });
 }
 
 template<>
 void chime_cpu_copy<float64>(float64 *y, const float64 *x, utens_t n) {
   DCHECK_NE(x, y);
-  cblas_dcopy(static_cast<blasint>(n), x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_dcopy(static_cast<blasint>(end - begin), x + begin,
+                            static_cast<blasint>(1), y + begin,
+                            static_cast<blasint>(1));
+              });
 }
 
 template<>
@@ -130,7 +444,11 @@ void chime_cpu_copy<float128>(float128 *y, const float128 *x, utens_t n) {
 template<typename Dtype>
 void chime_cpu_copy(Dtype *y, const Dtype *x, utens_t n) {
   DCHECK_NE(x, y);
-  std::memcpy(y, x, n * sizeof(Dtype));
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                std::memcpy(y + begin, x + begin,
+                            static_cast<size_t>(end - begin) * sizeof(Dtype));
+              });
 }
 
 template void chime_cpu_copy<int8>(int8 *y, const int8 *x, utens_t n);
@@ -141,16 +459,22 @@ template void chime_cpu_copy<uint8>(uint8 *y, const uint8 *x, utens_t n);
 template void chime_cpu_copy<uint16>(uint16 *y, const uint16 *x, utens_t n);
 template void chime_cpu_copy<uint32>(uint32 *y, const uint32 *x, utens_t n);
 template void chime_cpu_copy<uint64>(uint64 *y, const uint64 *x, utens_t n);
+template void chime_cpu_copy<float16>(float16 *y, const float16 *x, utens_t n);
+template void chime_cpu_copy<bfloat16>(bfloat16 *y, const bfloat16 *x,
+                                       utens_t n);
 
 template<typename Dtype>
 void chime_cpu_set(Dtype *y, Dtype alpha, utens_t n) {
   DCHECK(y);
-  if (alpha == 0) {
-    std::memset(y, 0, static_cast<size_t>(n) * sizeof(Dtype));
-    return;
-  } else {
-    for (utens_t i = 0; i < n; i++) { y[i] = alpha; }
-  }
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                if (alpha == 0) {
+                  std::memset(static_cast<void *>(y + begin), 0,
+                              static_cast<size_t>(end - begin) * sizeof(Dtype));
+                } else {
+                  for (int64_t i = begin; i < end; i++) { y[i] = alpha; }
+                }
+              });
 }
 
 template void chime_cpu_set<int8>(int8 *y, int8 alpha, utens_t n);
@@ -164,15 +488,27 @@ template void chime_cpu_set<uint64>(uint64 *y, uint64 alpha, utens_t n);
 template void chime_cpu_set<float32>(float32 *y, float32 alpha, utens_t n);
 template void chime_cpu_set<float64>(float64 *y, float64 alpha, utens_t n);
 template void chime_cpu_set<float128>(float128 *y, float128 alpha, utens_t n);
+template void chime_cpu_set<float16>(float16 *y, float16 alpha, utens_t n);
+template void chime_cpu_set<bfloat16>(bfloat16 *y, bfloat16 alpha, utens_t n);
 
 template<>
 float32 chime_cpu_asum<float32>(utens_t n, const float32 *x) {
-  return cblas_sasum(static_cast<blasint>(n), x, static_cast<blasint>(1));
+  return ParallelSum<float32>(
+      static_cast<int64_t>(n), kIntraOpGrainSize,
+      [=](int64_t begin, int64_t end) {
+        return cblas_sasum(static_cast<blasint>(end - begin), x + begin,
+                           static_cast<blasint>(1));
+      });
 }
 
 template<>
 float64 chime_cpu_asum<float64>(utens_t n, const float64 *x) {
-  return cblas_dasum(static_cast<blasint>(n), x, static_cast<blasint>(1));
+  return ParallelSum<float64>(
+      static_cast<int64_t>(n), kIntraOpGrainSize,
+      [=](int64_t begin, int64_t end) {
+        return cblas_dasum(static_cast<blasint>(end - begin), x + begin,
+                           static_cast<blasint>(1));
+      });
 }
 
 template<>
@@ -184,16 +520,26 @@ template<>
 float32 chime_cpu_strided_dot<float32>(utens_t n, const float32 *x,
                                        utens_t incx, const float32 *y,
                                        utens_t incy) {
-  return cblas_sdot(static_cast<blasint>(n), x, static_cast<blasint>(incx), y,
-                    static_cast<blasint>(incy));
+  return ParallelSum<float32>(
+      static_cast<int64_t>(n), kIntraOpGrainSize,
+      [=](int64_t begin, int64_t end) {
+        return cblas_sdot(static_cast<blasint>(end - begin), x + begin * incx,
+                          static_cast<blasint>(incx), y + begin * incy,
+                          static_cast<blasint>(incy));
+      });
 }
 
 template<>
 float64 chime_cpu_strided_dot<float64>(utens_t n, const float64 *x,
                                        utens_t incx, const float64 *y,
                                        utens_t incy) {
-  return cblas_ddot(static_cast<blasint>(n), x, static_cast<blasint>(incx), y,
-                    static_cast<blasint>(incy));
+  return ParallelSum<float64>(
+      static_cast<int64_t>(n), kIntraOpGrainSize,
+      [=](int64_t begin, int64_t end) {
+        return cblas_ddot(static_cast<blasint>(end - begin), x + begin * incx,
+                          static_cast<blasint>(incx), y + begin * incy,
+                          static_cast<blasint>(incy));
+      });
 }
 
 template<>
@@ -216,178 +562,473 @@ template float128 chime_cpu_dot(utens_t n, const float128 *x,
 
 template<>
 void chime_cpu_scal<float32>(utens_t n, float32 alpha, float32 *x) {
-  cblas_sscal(static_cast<blasint>(n), alpha, x, static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_sscal(static_cast<blasint>(end - begin), alpha,
+                            x + begin, static_cast<blasint>(1));
+              });
 }
 
 template<>
 void chime_cpu_scal<float64>(utens_t n, float64 alpha, float64 *x) {
-  cblas_dscal(static_cast<blasint>(n), alpha, x, static_cast<blasint>(1));
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                cblas_dscal(static_cast<blasint>(end - begin), alpha,
+                            x + begin, static_cast<blasint>(1));
+              });
 }
 
-template<>
-void chime_cpu_scal<float128>(utens_t n, float128 alpha, float128 *x) {
-  NOT_IMPLEMENTED;
+template<typename Dtype>
+void chime_cpu_scal(utens_t n, Dtype alpha, Dtype *x) {
+  DCHECK(x);
+  chime_cpu_scal<Dtype>(n, alpha, x, x);
 }
 
-template<>
-void chime_cpu_scal<float32>(utens_t n, float32 alpha, const float32 *x,
-                             float32 *y) {
-  cblas_scopy(static_cast<blasint>(n), x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_sscal(static_cast<blasint>(n), alpha, y, static_cast<blasint>(1));
+template<typename Dtype>
+void chime_cpu_scal(utens_t n, Dtype alpha, const Dtype *x, Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  auto scal = kernels::GetElementwiseKernels<Dtype>().scal;
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                scal(end - begin, alpha, x + begin, y + begin);
+              });
 }
 
-template<>
-void chime_cpu_scal<float64>(utens_t n, float64 alpha, const float64 *x,
-                             float64 *y) {
-  cblas_dcopy(static_cast<blasint>(n), x, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_dscal(static_cast<blasint>(n), alpha, y, static_cast<blasint>(1));
+namespace {
+
+// Gaussian numbers are made in blocks of this many elements, see
+// kernels::RandomKernels, and calls are sharded on block boundaries.
+constexpr utens_t kRandomBlock = 32;
+
+// Elements whose words are generated at once on the stack.
+constexpr utens_t kRandomChunk = 256;
+
+// Words of the stream taken by one uniform number.
+template<typename Dtype>
+constexpr uint64 random_words() {
+  return sizeof(Dtype) > sizeof(uint32) ? 2 : 1;
 }
 
-template<>
-void chime_cpu_scal<float128>(utens_t n, float128 alpha, const float128 *x,
-                              float128 *y) {
-  NOT_IMPLEMENTED;
+// Runs `fn(begin, end)` over [0, n) on the intra-op pool, cut at multiples of
+// kRandomBlock.
+template<typename Fn>
+void parallel_random(utens_t n, const Fn &fn) {
+  const int64_t blocks =
+      static_cast<int64_t>((n + kRandomBlock - 1) / kRandomBlock);
+  ParallelFor(blocks, kIntraOpGrainSize / kRandomBlock,
+              [&](int64_t first, int64_t last) {
+                fn(static_cast<utens_t>(first) * kRandomBlock,
+                   std::min(static_cast<utens_t>(last) * kRandomBlock, n));
+              });
+}
+
+void philox_bits(utens_t n, uint64 seed, uint64 offset, uint32 *y) {
+  kernels::GetRandomKernels<float64>().bits(n, seed, offset, y);
+}
+
+// float128 has no kernels, its uniform numbers in [0, 1) are two words over
+// 2^64.
+template<typename Fn>
+void for_each_uniform128(utens_t n, uint64 seed, uint64 offset,
+                         const Fn &fn) {
+  uint32 words[2 * kRandomChunk];
+  for (utens_t i = 0; i < n; i += kRandomChunk) {
+    const utens_t len = std::min(kRandomChunk, n - i);
+    philox_bits(2 * len, seed, offset + 2 * i, words);
+    for (utens_t j = 0; j < len; j++) {
+      const uint64 w = words[2 * j] | static_cast<uint64>(words[2 * j + 1])
+                                          << 32;
+      fn(i + j, std::ldexp(static_cast<float128>(w), -64));
+    }
+  }
+}
+
+uint64 initial_random_seed() {
+  std::random_device rd;
+  return static_cast<uint64>(rd()) << 32 | rd();
+}
+
+std::atomic<uint64> random_seed{initial_random_seed()};
+std::atomic<uint64> random_offset{0};
+
+// Takes the next `words` words of the process-wide stream, returns the seed
+// and sets `offset` to the first of them.
+uint64 reserve_random_words(uint64 words, uint64 *offset) {
+  *offset = random_offset.fetch_add(words);
+  return random_seed.load();
+}
+
+}  // namespace
+
+void chime_set_random_seed(uint64 seed) {
+  random_seed.store(seed);
+  random_offset.store(0);
 }
 
 template<typename Dtype>
-void chime_cpu_rng_uniform(utens_t n, Dtype a, Dtype b, Dtype *r) {
+void chime_cpu_rng_uniform(utens_t n, Dtype a, Dtype b, Dtype *r, uint64 seed,
+                           uint64 offset) {
   DCHECK_LE(n, UTENS_MAX);
   DCHECK(r);
   DCHECK_LE(a, b);
+  auto uniform = kernels::GetRandomKernels<Dtype>().uniform;
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    uniform(end - begin, seed, offset + begin * random_words<Dtype>(), a, b,
+            r + begin);
+  });
+}
 
-  std::random_device rd;
-  std::mt19937 gen{rd()};
-  std::uniform_real_distribution<Dtype> dis(a, b);
-  for (utens_t i = 0; i < n; i++) { r[i] = dis(gen); }
+template<>
+void chime_cpu_rng_uniform<float128>(utens_t n, float128 a, float128 b,
+                                     float128 *r, uint64 seed, uint64 offset) {
+  DCHECK(r);
+  DCHECK_LE(a, b);
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    for_each_uniform128(end - begin, seed, offset + 2 * begin,
+                        [=](utens_t i, float128 u) {
+                          r[begin + i] = a + (b - a) * u;
+                        });
+  });
 }
 
-template void chime_cpu_rng_uniform<float32>(utens_t n, float32 a, float32 b,
-                                             float32 *r);
-template void chime_cpu_rng_uniform<float64>(utens_t n, float64 a, float64 b,
-                                             float64 *r);
-template void chime_cpu_rng_uniform<float128>(utens_t n, float128 a, float128 b,
-                                              float128 *r);
+template<typename Dtype>
+void chime_cpu_rng_uniform(utens_t n, Dtype a, Dtype b, Dtype *r) {
+  uint64 offset;
+  const uint64 seed = reserve_random_words(n * random_words<Dtype>(), &offset);
+  chime_cpu_rng_uniform(n, a, b, r, seed, offset);
+}
 
 template<typename Dtype>
-void chime_cpu_rng_gaussian(utens_t n, Dtype mu, Dtype sigma, Dtype *r) {
+void chime_cpu_rng_gaussian(utens_t n, Dtype mu, Dtype sigma, Dtype *r,
+                            uint64 seed, uint64 offset) {
   DCHECK(r);
+  auto gaussian = kernels::GetRandomKernels<Dtype>().gaussian;
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    gaussian(end - begin, seed, offset + begin * random_words<Dtype>(), mu,
+             sigma, r + begin);
+  });
+}
 
-  std::random_device rd{};
-  std::mt19937 gen{rd()};
-  std::normal_distribution<Dtype> random_distribution(mu, sigma);
-  for (utens_t i = 0; i < n; i++) { r[i] = random_distribution(gen); }
+// float128 has no vector kernel: Box-Muller on Philox blocks with
+// std::log/std::cos/std::sin.
+template<>
+void chime_cpu_rng_gaussian<float128>(utens_t n, float128 mu, float128 sigma,
+                                      float128 *r, uint64 seed,
+                                      uint64 offset) {
+  DCHECK(r);
+  constexpr utens_t kPairs = kRandomBlock / 2;
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    float128 u[kRandomBlock];
+    for (utens_t b = begin; b < end; b += kRandomBlock) {
+      for_each_uniform128(kRandomBlock, seed, offset + 2 * b,
+                          [&](utens_t i, float128 v) { u[i] = v; });
+      for (utens_t t = 0; t < kPairs && b + t < end; t++) {
+        const float128 radius = std::sqrt(-2 * std::log(1 - u[t]));
+        const float128 angle = 2 * static_cast<float128>(M_PI) * u[kPairs + t];
+        r[b + t] = mu + sigma * radius * std::cos(angle);
+        if (b + kPairs + t < end) {
+          r[b + kPairs + t] = mu + sigma * radius * std::sin(angle);
+        }
+      }
+    }
+  });
 }
 
-template void chime_cpu_rng_gaussian<float32>(utens_t n, float32 mu,
-                                              float32 sigma, float32 *r);
-template void chime_cpu_rng_gaussian<float64>(utens_t n, float64 mu,
-                                              float64 sigma, float64 *r);
-template void chime_cpu_rng_gaussian<float128>(utens_t n, float128 mu,
-                                               float128 sigma, float128 *r);
+template<typename Dtype>
+void chime_cpu_rng_gaussian(utens_t n, Dtype mu, Dtype sigma, Dtype *r) {
+  const uint64 blocks = (n + kRandomBlock - 1) / kRandomBlock;
+  uint64 offset;
+  const uint64 seed = reserve_random_words(
+      blocks * kRandomBlock * random_words<Dtype>(), &offset);
+  chime_cpu_rng_gaussian(n, mu, sigma, r, seed, offset);
+}
 
+// A word below p * 2^32 is a success.
 template<typename Dprob, typename Dtype>
-void chime_cpu_rng_bernoulli(utens_t n, Dprob p, Dtype *r) {
+void chime_cpu_rng_bernoulli(utens_t n, Dprob p, Dtype *r, uint64 seed,
+                             uint64 offset) {
   DCHECK(r);
+  DCHECK_GE(p, static_cast<Dprob>(0));
   DCHECK_LE(p, static_cast<Dprob>(1));
+  const uint64 threshold =
+      static_cast<uint64>(std::ldexp(static_cast<float64>(p), 32));
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    uint32 words[kRandomChunk];
+    for (utens_t i = begin; i < end; i += kRandomChunk) {
+      const utens_t len = std::min(kRandomChunk, end - i);
+      philox_bits(len, seed, offset + i, words);
+      for (utens_t j = 0; j < len; j++) {
+        r[i + j] = static_cast<Dtype>(words[j] < threshold);
+      }
+    }
+  });
+}
+
+template<typename Dprob, typename Dtype>
+void chime_cpu_rng_bernoulli(utens_t n, Dprob p, Dtype *r) {
+  uint64 offset;
+  const uint64 seed = reserve_random_words(n, &offset);
+  chime_cpu_rng_bernoulli(n, p, r, seed, offset);
+}
 
-  std::bernoulli_distribution random_distribution(p);
+#define INSTANTIATE_RNG(Dtype)                                                \
+  template void chime_cpu_rng_uniform<Dtype>(utens_t, Dtype, Dtype, Dtype *,  \
+                                             uint64, uint64);                 \
+  template void chime_cpu_rng_uniform<Dtype>(utens_t, Dtype, Dtype, Dtype *); \
+  template void chime_cpu_rng_gaussian<Dtype>(utens_t, Dtype, Dtype, Dtype *, \
+                                              uint64, uint64);                \
+  template void chime_cpu_rng_gaussian<Dtype>(utens_t, Dtype, Dtype, Dtype *)
 
-  std::random_device rd{};
-  std::mt19937 gen{rd()};
-  for (utens_t i = 0; i < n; i++) {
-    r[i] = static_cast<Dtype>(random_distribution(gen));
-  }
+INSTANTIATE_RNG(float32);
+INSTANTIATE_RNG(float64);
+INSTANTIATE_RNG(float128);
+
+#define INSTANTIATE_RNG_BERNOULLI(Dtype)                                      \
+  template void chime_cpu_rng_bernoulli<float32, Dtype>(utens_t, float32,     \
+                                                        Dtype *, uint64,      \
+                                                        uint64);              \
+  template void chime_cpu_rng_bernoulli<float32, Dtype>(utens_t, float32,     \
+                                                        Dtype *);             \
+  template void chime_cpu_rng_bernoulli<float64, Dtype>(utens_t, float64,     \
+                                                        Dtype *, uint64,      \
+                                                        uint64);              \
+  template void chime_cpu_rng_bernoulli<float64, Dtype>(utens_t, float64,     \
+                                                        Dtype *)
+
+INSTANTIATE_RNG_BERNOULLI(int8);
+INSTANTIATE_RNG_BERNOULLI(int16);
+INSTANTIATE_RNG_BERNOULLI(int32);
+INSTANTIATE_RNG_BERNOULLI(int64);
+INSTANTIATE_RNG_BERNOULLI(uint8);
+INSTANTIATE_RNG_BERNOULLI(uint16);
+INSTANTIATE_RNG_BERNOULLI(uint32);
+INSTANTIATE_RNG_BERNOULLI(uint64);
+
+namespace {
+
+// 0 when everything is dropped, so that no infinity is formed.
+template<typename Dtype>
+Dtype dropout_scale(Dtype p) {
+  return p < Dtype(1) ? Dtype(1) / (Dtype(1) - p) : Dtype(0);
 }
 
-template void chime_cpu_rng_bernoulli<float32, int8>(utens_t n, float32 p,
-                                                     int8 *r);
-template void chime_cpu_rng_bernoulli<float64, int8>(utens_t n, float64 p,
-                                                     int8 *r);
-template void chime_cpu_rng_bernoulli<float32, int16>(utens_t n, float32 p,
-                                                      int16 *r);
-template void chime_cpu_rng_bernoulli<float64, int16>(utens_t n, float64 p,
-                                                      int16 *r);
-template void chime_cpu_rng_bernoulli<float32, int32>(utens_t n, float32 p,
-                                                      int32 *r);
-template void chime_cpu_rng_bernoulli<float64, int32>(utens_t n, float64 p,
-                                                      int32 *r);
-template void chime_cpu_rng_bernoulli<float32, int64>(utens_t n, float32 p,
-                                                      int64 *r);
-template void chime_cpu_rng_bernoulli<float64, int64>(utens_t n, float64 p,
-                                                      int64 *r);
-template void chime_cpu_rng_bernoulli<float32, uint8>(utens_t n, float32 p,
-                                                      uint8 *r);
-template void chime_cpu_rng_bernoulli<float64, uint8>(utens_t n, float64 p,
-                                                      uint8 *r);
-template void chime_cpu_rng_bernoulli<float32, uint16>(utens_t n, float32 p,
-                                                       uint16 *r);
-template void chime_cpu_rng_bernoulli<float64, uint16>(utens_t n, float64 p,
-                                                       uint16 *r);
-template void chime_cpu_rng_bernoulli<float32, uint32>(utens_t n, float32 p,
-                                                       uint32 *r);
-template void chime_cpu_rng_bernoulli<float64, uint32>(utens_t n, float64 p,
-                                                       uint32 *r);
-template void chime_cpu_rng_bernoulli<float32, uint64>(utens_t n, float32 p,
-                                                       uint64 *r);
-template void chime_cpu_rng_bernoulli<float64, uint64>(utens_t n, float64 p,
-                                                       uint64 *r);
+}  // namespace
 
-template<>
-void chime_cpu_add<float32>(utens_t n, const float32 *a, const float32 *b,
-                            float32 *y) {
-  cblas_scopy(static_cast<blasint>(n), a, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_saxpy(static_cast<blasint>(n), static_cast<float32>(1.f), b,
-              static_cast<blasint>(1), y, static_cast<blasint>(1));
+template<typename Dtype>
+void chime_cpu_dropout(utens_t n, Dtype p, const Dtype *x, Dtype *y,
+                       uint32 *mask, uint64 seed, uint64 offset) {
+  DCHECK(x);
+  DCHECK(y);
+  DCHECK(mask);
+  DCHECK_GE(p, Dtype(0));
+  DCHECK_LE(p, Dtype(1));
+  const uint64 threshold = static_cast<uint64>(
+      std::ldexp(1 - static_cast<float64>(p), 32));
+  const Dtype scale = dropout_scale(p);
+  auto dropout = kernels::GetRandomKernels<Dtype>().dropout;
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    dropout(end - begin, seed, offset + begin, threshold, scale, x + begin,
+            y + begin, mask + begin / kernels::kMaskWordBits);
+  });
 }
 
-template<>
-void chime_cpu_add<float64>(utens_t n, const float64 *a, const float64 *b,
-                            float64 *y) {
-  cblas_dcopy(static_cast<blasint>(n), a, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_daxpy(static_cast<blasint>(n), static_cast<float64>(1.), b,
-              static_cast<blasint>(1), y, static_cast<blasint>(1));
+template<typename Dtype>
+void chime_cpu_dropout(utens_t n, Dtype p, const Dtype *x, Dtype *y,
+                       uint32 *mask) {
+  uint64 offset;
+  const uint64 seed = reserve_random_words(n, &offset);
+  chime_cpu_dropout(n, p, x, y, mask, seed, offset);
 }
 
-template<>
-void chime_cpu_sub<float32>(utens_t n, const float32 *a, const float32 *b,
-                            float32 *y) {
-  cblas_scopy(static_cast<blasint>(n), a, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_saxpy(static_cast<blasint>(n), static_cast<float32>(-1.f), b,
-              static_cast<blasint>(1), y, static_cast<blasint>(1));
+template<typename Dtype>
+void chime_cpu_dropout_backward(utens_t n, Dtype p, const uint32 *mask,
+                                const Dtype *dy, Dtype *dx) {
+  DCHECK(mask);
+  DCHECK(dy);
+  DCHECK(dx);
+  const Dtype scale = dropout_scale(p);
+  auto masked_scale = kernels::GetRandomKernels<Dtype>().masked_scale;
+  parallel_random(n, [=](utens_t begin, utens_t end) {
+    masked_scale(end - begin, mask + begin / kernels::kMaskWordBits, scale,
+                 dy + begin, dx + begin);
+  });
 }
 
-template<>
-void chime_cpu_sub<float64>(utens_t n, const float64 *a, const float64 *b,
-                            float64 *y) {
-  cblas_dcopy(static_cast<blasint>(n), a, static_cast<blasint>(1), y,
-              static_cast<blasint>(1));
-  cblas_daxpy(static_cast<blasint>(n), static_cast<float64>(-1.), b,
-              static_cast<blasint>(1), y, static_cast<blasint>(1));
+#define INSTANTIATE_DROPOUT(Dtype)                                            \
+  template void chime_cpu_dropout<Dtype>(utens_t, Dtype, const Dtype *,       \
+                                         Dtype *, uint32 *, uint64, uint64);  \
+  template void chime_cpu_dropout<Dtype>(utens_t, Dtype, const Dtype *,       \
+                                         Dtype *, uint32 *);                  \
+  template void chime_cpu_dropout_backward<Dtype>(utens_t, Dtype,             \
+                                                  const uint32 *,             \
+                                                  const Dtype *, Dtype *)
+
+INSTANTIATE_DROPOUT(float32);
+INSTANTIATE_DROPOUT(float64);
+
+namespace {
+
+// Runs an elementwise kernel over [0, n), sharded on the intra-op pool.
+template<typename Dtype>
+void parallel_binary(
+    typename kernels::ElementwiseKernels<Dtype>::BinaryFn kernel, utens_t n,
+    const Dtype *a, const Dtype *b, Dtype *y) {
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                kernel(end - begin, a + begin, b + begin, y + begin);
+              });
 }
 
-template<>
-void chime_cpu_mul<float32>(utens_t n, const float32 *a, const float32 *b,
-                            float32 *y) {
-  chime_cpu_gemm<float32>(CblasNoTrans, CblasNoTrans, n,
-                          static_cast<utens_t>(1), static_cast<utens_t>(1),
-                          static_cast<float32>(1.f), a, b,
-                          static_cast<float32>(0.f), y);
+template<typename Dtype>
+void parallel_unary(void (*kernel)(utens_t, const Dtype *, Dtype *),
+                    int64_t grain_size, utens_t n, const Dtype *x, Dtype *y) {
+  ParallelFor(static_cast<int64_t>(n), grain_size,
+              [=](int64_t begin, int64_t end) {
+                kernel(end - begin, x + begin, y + begin);
+              });
 }
 
-template<>
-void chime_cpu_mul<float64>(utens_t n, const float64 *a, const float64 *b,
-                            float64 *y) {
-  chime_cpu_gemm<float64>(CblasNoTrans, CblasNoTrans, n,
-                          static_cast<utens_t>(1), static_cast<utens_t>(1),
-                          static_cast<float64>(1.f), a, b,
-                          static_cast<float64>(0.), y);
+}  // namespace
+
+template<typename Dtype>
+void chime_cpu_add(utens_t n, const Dtype *a, const Dtype *b, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().add, n, a, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_add(utens_t n, const Dtype *a, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().add, n, y, a, y);
+}
+
+template<typename Dtype>
+void chime_cpu_sub(utens_t n, const Dtype *a, const Dtype *b, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().sub, n, a, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_sub(utens_t n, const Dtype *a, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().sub, n, y, a, y);
+}
+
+template<typename Dtype>
+void chime_cpu_mul(utens_t n, const Dtype *a, const Dtype *b, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().mul, n, a, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_mul(utens_t n, const Dtype *a, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().mul, n, y, a, y);
+}
+
+template<typename Dtype>
+void chime_cpu_div(utens_t n, const Dtype *a, const Dtype *b, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().div, n, a, b, y);
+}
+
+template<typename Dtype>
+void chime_cpu_div(utens_t n, const Dtype *a, Dtype *y) {
+  parallel_binary(kernels::GetElementwiseKernels<Dtype>().div, n, y, a, y);
+}
+
+template<typename Dtype>
+void chime_cpu_sign(utens_t n, const Dtype *a, Dtype *b) {
+  parallel_unary(kernels::GetElementwiseKernels<Dtype>().sign,
+                 kIntraOpGrainSize, n, a, b);
 }
 
+#define INSTANTIATE_ELEMENTWISE(Dtype)                                        \
+  template void chime_cpu_add<Dtype>(utens_t, const Dtype *, const Dtype *,   \
+                                     Dtype *);                                \
+  template void chime_cpu_add<Dtype>(utens_t, const Dtype *, Dtype *);        \
+  template void chime_cpu_sub<Dtype>(utens_t, const Dtype *, const Dtype *,   \
+                                     Dtype *);                                \
+  template void chime_cpu_sub<Dtype>(utens_t, const Dtype *, Dtype *);        \
+  template void chime_cpu_mul<Dtype>(utens_t, const Dtype *, const Dtype *,   \
+                                     Dtype *);                                \
+  template void chime_cpu_mul<Dtype>(utens_t, const Dtype *, Dtype *);        \
+  template void chime_cpu_div<Dtype>(utens_t, const Dtype *, const Dtype *,   \
+                                     Dtype *);                                \
+  template void chime_cpu_div<Dtype>(utens_t, const Dtype *, Dtype *);        \
+  template void chime_cpu_sign<Dtype>(utens_t, const Dtype *, Dtype *);       \
+  template void chime_cpu_scal<Dtype>(utens_t, Dtype, const Dtype *, Dtype *)
+
+INSTANTIATE_ELEMENTWISE(int8);
+INSTANTIATE_ELEMENTWISE(int16);
+INSTANTIATE_ELEMENTWISE(int32);
+INSTANTIATE_ELEMENTWISE(int64);
+INSTANTIATE_ELEMENTWISE(uint8);
+INSTANTIATE_ELEMENTWISE(uint16);
+INSTANTIATE_ELEMENTWISE(uint32);
+INSTANTIATE_ELEMENTWISE(uint64);
+INSTANTIATE_ELEMENTWISE(float32);
+INSTANTIATE_ELEMENTWISE(float64);
+INSTANTIATE_ELEMENTWISE(float128);
+INSTANTIATE_ELEMENTWISE(float16);
+INSTANTIATE_ELEMENTWISE(bfloat16);
+
+#undef INSTANTIATE_ELEMENTWISE
+
+template void chime_cpu_scal<int8>(utens_t n, int8 alpha, int8 *x);
+template void chime_cpu_scal<int16>(utens_t n, int16 alpha, int16 *x);
+template void chime_cpu_scal<int32>(utens_t n, int32 alpha, int32 *x);
+template void chime_cpu_scal<int64>(utens_t n, int64 alpha, int64 *x);
+template void chime_cpu_scal<uint8>(utens_t n, uint8 alpha, uint8 *x);
+template void chime_cpu_scal<uint16>(utens_t n, uint16 alpha, uint16 *x);
+template void chime_cpu_scal<uint32>(utens_t n, uint32 alpha, uint32 *x);
+template void chime_cpu_scal<uint64>(utens_t n, uint64 alpha, uint64 *x);
+template void chime_cpu_scal<float128>(utens_t n, float128 alpha, float128 *x);
+template void chime_cpu_scal<float16>(utens_t n, float16 alpha, float16 *x);
+template void chime_cpu_scal<bfloat16>(utens_t n, bfloat16 alpha, bfloat16 *x);
+
+template<typename Htype>
+void chime_cpu_half_to_float(utens_t n, const Htype *x, float32 *y) {
+  auto kernel = kernels::GetHalfKernels<Htype>().to_float;
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                kernel(end - begin, x + begin, y + begin);
+              });
+}
+
+template<typename Htype>
+void chime_cpu_float_to_half(utens_t n, const float32 *x, Htype *y) {
+  auto kernel = kernels::GetHalfKernels<Htype>().from_float;
+  ParallelFor(static_cast<int64_t>(n), kIntraOpGrainSize,
+              [=](int64_t begin, int64_t end) {
+                kernel(end - begin, x + begin, y + begin);
+              });
+}
+
+template void chime_cpu_half_to_float<float16>(utens_t, const float16 *,
+                                               float32 *);
+template void chime_cpu_half_to_float<bfloat16>(utens_t, const bfloat16 *,
+                                                float32 *);
+template void chime_cpu_float_to_half<float16>(utens_t, const float32 *,
+                                               float16 *);
+template void chime_cpu_float_to_half<bfloat16>(utens_t, const float32 *,
+                                                bfloat16 *);
+
+#define DEFINE_TRANSCENDENTAL(name)                                     \
+  template<typename Dtype>                                              \
+  void chime_cpu_##name(utens_t n, const Dtype *x, Dtype *y) {          \
+    parallel_unary(kernels::GetTranscendentalKernels<Dtype>().name,     \
+                   kIntraOpComputeGrainSize, n, x, y);                  \
+  }                                                                     \
+  template void chime_cpu_##name<float32>(utens_t, const float32 *,     \
+                                          float32 *);                   \
+  template void chime_cpu_##name<float64>(utens_t, const float64 *,     \
+                                          float64 *)
+
+DEFINE_TRANSCENDENTAL(exp);
+DEFINE_TRANSCENDENTAL(log);
+DEFINE_TRANSCENDENTAL(tanh);
+DEFINE_TRANSCENDENTAL(sigmoid);
+DEFINE_TRANSCENDENTAL(erf);
+DEFINE_TRANSCENDENTAL(gelu);
+DEFINE_TRANSCENDENTAL(softplus);
+
+#undef DEFINE_TRANSCENDENTAL
+
 template<>
 void chime_cpu_matmul<float32>(utens_t m, utens_t n, utens_t k,
                                const float32 *a, const float32 *b, float32 *y) {
@@ -7,6 +7,7 @@
 #include <openblas/cblas.h>
 
 #include "chime/core/framework/common.hpp"
+#include "chime/core/framework/math_kernels.h"
 
 namespace chime {
 
@@ -14,15 +15,92 @@ namespace chime {
 
 // chime gemmm provides a simpler interface to the gemm functions, with the
 // limitation that the data has to be contiguous in the memory
+//
+// gemm and gemv run on the BLAS backend selected at runtime, see
+// blas_backend.h. float16 and bfloat16 operands accumulate in float32: gemm
+// widens blocks of them as the built-in float32 GEMM packs them, gemv, and
+// gemm with a single row or column of C, read the matrix in its 16-bit
+// storage. Results are rounded back once.
 template<typename Dtype>
 void chime_cpu_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
                     utens_t n, utens_t k, Dtype alpha, const Dtype *A,
                     const Dtype *B, Dtype beta, Dtype *C);
 
+// Computes C[i] = alpha * op(A[i]) * op(B[i]) + beta * C[i] for
+// i in [0, batch_count), where every product has the shape of a
+// `chime_cpu_gemm` call. The strided form finds the i-th matrix of each
+// operand at `A + i * stride_a` and so on; a stride of 0 shares one matrix
+// across the batch (not allowed for C). When a single product is too small to
+// keep the BLAS threads busy, the batch is split over the intra-op thread
+// pool instead.
+template<typename Dtype>
+void chime_cpu_gemm_strided_batched(CBLAS_TRANSPOSE transA,
+                                    CBLAS_TRANSPOSE transB, utens_t m,
+                                    utens_t n, utens_t k, Dtype alpha,
+                                    const Dtype *A, utens_t stride_a,
+                                    const Dtype *B, utens_t stride_b,
+                                    Dtype beta, Dtype *C, utens_t stride_c,
+                                    utens_t batch_count);
+
+template<typename Dtype>
+void chime_cpu_gemm_batched(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                            utens_t m, utens_t n, utens_t k, Dtype alpha,
+                            const Dtype *const *A, const Dtype *const *B,
+                            Dtype beta, Dtype *const *C, utens_t batch_count);
+
 template<typename Dtype>
 void chime_cpu_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Dtype alpha,
                     const Dtype *A, const Dtype *x, Dtype beta, Dtype *y);
 
+// Full forms of gemm and gemv for operands that are views into larger
+// buffers. Matrices are row-major with `ld*` elements between the starts of
+// two rows, which must be at least the number of columns stored. Vector
+// elements are `inc*` apart.
+template<typename Dtype>
+void chime_cpu_gemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                    utens_t n, utens_t k, Dtype alpha, const Dtype *A,
+                    utens_t lda, const Dtype *B, utens_t ldb, Dtype beta,
+                    Dtype *C, utens_t ldc);
+
+template<typename Dtype>
+void chime_cpu_gemv(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, Dtype alpha,
+                    const Dtype *A, utens_t lda, const Dtype *x, utens_t incx,
+                    Dtype beta, Dtype *y, utens_t incy);
+
+// gemm for small matrices whose shape is known at compile time, with fully
+// unrolled kernels that skip the packing and threading of the BLAS backends.
+// Each of M, N and K is 4, 8, 16 or 32. `chime_cpu_gemm` picks these kernels
+// by itself whenever its runtime shape matches one of them, calling them
+// directly only saves that lookup. Supports float32, float64 and float128.
+template<int M, int N, int K, typename Dtype>
+void chime_cpu_gemm_fixed(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                          Dtype alpha, const Dtype *A, utens_t lda,
+                          const Dtype *B, utens_t ldb, Dtype beta, Dtype *C,
+                          utens_t ldc) {
+  static_assert(kernels::FixedGemmShapeIndex(M, N, K) >= 0,
+                "no fixed-size gemm kernel for this shape");
+  DCHECK_GE(lda, transA == CblasNoTrans ? K : M);
+  DCHECK_GE(ldb, transB == CblasNoTrans ? N : K);
+  DCHECK_GE(ldc, N);
+  kernels::GetGemmKernels<Dtype>()
+      .fixed[kernels::FixedGemmShapeIndex(M, N, K)](
+          transA != CblasNoTrans, transB != CblasNoTrans, alpha, A, lda, B,
+          ldb, beta, C, ldc);
+}
+
+template<int M, int N, int K, typename Dtype>
+void chime_cpu_gemm_fixed(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                          Dtype alpha, const Dtype *A, const Dtype *B,
+                          Dtype beta, Dtype *C) {
+  chime_cpu_gemm_fixed<M, N, K, Dtype>(
+      transA, transB, alpha, A, transA == CblasNoTrans ? K : M, B,
+      transB == CblasNoTrans ? N : K, beta, C, N);
+}
+
+// Level-1 routines (axpy, axpby, copy, set, asum, dot, scal) and the
+// elementwise ones below split large inputs over the intra-op thread pool,
+// see intra_op_parallel.h. Reductions add up fixed-size blocks in order, so
+// their result does not depend on the number of threads.
 template<typename Dtype>
 void chime_cpu_axpy(utens_t N, Dtype alpha, const Dtype *x, Dtype *y);
 
@@ -52,6 +130,27 @@ void chime_cpu_scal(utens_t n, Dtype alpha, Dtype *x);
 template<typename Dtype>
 void chime_cpu_scal(utens_t n, Dtype alpha, const Dtype *x, Dtype *y);
 
+// Random numbers from the Philox stream of `seed`, starting at word `offset`,
+// see kernels::RandomKernels. Element i depends on seed, offset and i only,
+// whatever the number of intra-op threads. A uniform number takes one word for
+// float32 and two otherwise, a bernoulli draw one word. Gaussian numbers come
+// in blocks of 32 elements, so that splitting a call in two gives the same
+// numbers when the first part has a multiple of 32 elements.
+template<typename Dtype>
+void chime_cpu_rng_uniform(utens_t n, Dtype a, Dtype b, Dtype *r, uint64 seed,
+                           uint64 offset);
+
+template<typename Dtype>
+void chime_cpu_rng_gaussian(utens_t n, Dtype mu, Dtype sigma, Dtype *r,
+                            uint64 seed, uint64 offset);
+
+template<typename Dprob, typename Dtype>
+void chime_cpu_rng_bernoulli(utens_t n, Dprob p, Dtype *r, uint64 seed,
+                             uint64 offset);
+
+// Same as above on the process-wide stream: every call takes the words after
+// those of the previous call. The seed is random until
+// `chime_set_random_seed` is called, which also rewinds the stream.
 template<typename Dtype>
 void chime_cpu_rng_uniform(utens_t n, Dtype a, Dtype b, Dtype *r);
 
@@ -61,25 +160,109 @@ void chime_cpu_rng_gaussian(utens_t n, Dtype mu, Dtype sigma, Dtype *r);
 template<typename Dprob, typename Dtype>
 void chime_cpu_rng_bernoulli(utens_t n, Dprob p, Dtype *r);
 
+void chime_set_random_seed(uint64 seed);
+
+// Number of words of a mask of n elements, see kernels::kMaskWordBits.
+inline utens_t chime_mask_words(utens_t n) {
+  return (n + kernels::kMaskWordBits - 1) / kernels::kMaskWordBits;
+}
+
+// Inverted dropout in one pass: drops each element with probability p and
+// scales the others by 1 / (1 - p), recording the kept ones in the bit-packed
+// `mask` of chime_mask_words(n) words. The mask is the bernoulli draw of
+// 1 - p with the same seed and offset. y may alias x.
+template<typename Dtype>
+void chime_cpu_dropout(utens_t n, Dtype p, const Dtype *x, Dtype *y,
+                       uint32 *mask, uint64 seed, uint64 offset);
+
+template<typename Dtype>
+void chime_cpu_dropout(utens_t n, Dtype p, const Dtype *x, Dtype *y,
+                       uint32 *mask);
+
+// The gradient of chime_cpu_dropout, dx may alias dy.
+template<typename Dtype>
+void chime_cpu_dropout_backward(utens_t n, Dtype p, const uint32 *mask,
+                                const Dtype *dy, Dtype *dx);
+
+// Vectorized transcendental functions for float32 and float64, y may alias x.
+// Error bounds are in ulp against the correctly rounded result, over finite
+// inputs whose result is a normal number; NaN propagates and infinities map to
+// the mathematical limits.
+//
+//                 float32   float64
+//   exp           1         1
+//   log           1         1
+//   tanh          2         2
+//   sigmoid       3         3
+//   erf           4         4
+//   gelu          8         8
+//   softplus      2         2
+//
+// gelu(x) = x * Phi(x) uses the exact erf form, not the tanh approximation,
+// and keeps its bound for negative x as long as Phi(x) is a normal number.
+// softplus(x) = log(1 + exp(x)).
 template<typename Dtype>
 void chime_cpu_exp(utens_t n, const Dtype *x, Dtype *y);
 
+template<typename Dtype>
+void chime_cpu_log(utens_t n, const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_tanh(utens_t n, const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_sigmoid(utens_t n, const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_erf(utens_t n, const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_gelu(utens_t n, const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_softplus(utens_t n, const Dtype *x, Dtype *y);
+
 template<typename Dtype>
 void chime_cpu_matmul(utens_t m, utens_t n, utens_t k, const Dtype *a,
                       const Dtype *b, Dtype *y);
 
+// Conversions between float32 and the 16-bit floating point types float16
+// and bfloat16, rounding to nearest even. NaN stays NaN.
+template<typename Htype>
+void chime_cpu_half_to_float(utens_t n, const Htype *x, float32 *y);
+
+template<typename Htype>
+void chime_cpu_float_to_half(utens_t n, const float32 *x, Htype *y);
+
+// Elementwise kernels below make a single vectorized pass over memory and are
+// instantiated for every integer and floating point dtype. float16 and
+// bfloat16 elements are computed in float32 and rounded once. `y` may alias
+// `a` or `b`. The two-operand overloads update `y` in place, e.g. `y += a`.
 template<typename Dtype>
 void chime_cpu_div(utens_t n, const Dtype *a, const Dtype *b, Dtype *y);
 
+template<typename Dtype>
+void chime_cpu_div(utens_t n, const Dtype *a, Dtype *y);
+
 template<typename Dtype>
 void chime_cpu_mul(utens_t n, const Dtype *a, const Dtype *b, Dtype *y);
 
+template<typename Dtype>
+void chime_cpu_mul(utens_t n, const Dtype *a, Dtype *y);
+
 template<typename Dtype>
 void chime_cpu_add(utens_t n, const Dtype *a, const Dtype *b, Dtype *y);
 
+template<typename Dtype>
+void chime_cpu_add(utens_t n, const Dtype *a, Dtype *y);
+
 template<typename Dtype>
 void chime_cpu_sub(utens_t n, const Dtype *a, const Dtype *b, Dtype *y);
 
+template<typename Dtype>
+void chime_cpu_sub(utens_t n, const Dtype *a, Dtype *y);
+
+// b[i] = -1, 0 or 1 according to the sign of a[i]. NaN maps to 0.
 template<typename Dtype>
 void chime_cpu_sign(utens_t n, const Dtype *a, Dtype *b);
 
@@ -3,9 +3,16 @@
 
 #include "chime/core/framework/math_functions.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 #include "chime/core/framework/common.hpp"
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/philox.h"
 
 namespace chime {
 
@@ -328,6 +335,181 @@ TEST_F(MathFunctionsTest, TestChimeCpuGemv) {
   }
 }
 
+TEST_F(MathFunctionsTest, TestChimeCpuGemmBatched) {
+  const utens_t m = 5, n = 3, k = 4, batch = 37;
+  // Small integers, so every product is exact whatever the summation order.
+  std::vector<float32> a(batch * k * m), b(k * n), c(batch * m * n, 1.f);
+  for (utens_t i = 0; i < a.size(); i++) a[i] = static_cast<float32>(i % 7);
+  for (utens_t i = 0; i < b.size(); i++) b[i] = static_cast<float32>(i % 5);
+
+  // A is transposed and B is shared by the whole batch.
+  std::vector<float32> ref(c);
+  for (utens_t t = 0; t < batch; t++) {
+    chime_cpu_gemm<float32>(CblasTrans, CblasNoTrans, m, n, k, 2.f,
+                            a.data() + t * k * m, b.data(), 0.5f,
+                            ref.data() + t * m * n);
+  }
+
+  for (int64_t num_threads : {1, 4}) {
+    ScopedIntraOpNumThreads threads(num_threads);
+    std::vector<float32> y(c);
+    chime_cpu_gemm_strided_batched<float32>(CblasTrans, CblasNoTrans, m, n, k,
+                                            2.f, a.data(), k * m, b.data(), 0,
+                                            0.5f, y.data(), m * n, batch);
+    EXPECT_EQ(y, ref) << num_threads;
+
+    std::vector<float32> z(c);
+    std::vector<const float32 *> pa(batch), pb(batch, b.data());
+    std::vector<float32 *> pc(batch);
+    for (utens_t t = 0; t < batch; t++) {
+      pa[t] = a.data() + t * k * m;
+      pc[t] = z.data() + t * m * n;
+    }
+    chime_cpu_gemm_batched<float32>(CblasTrans, CblasNoTrans, m, n, k, 2.f,
+                                    pa.data(), pb.data(), 0.5f, pc.data(),
+                                    batch);
+    EXPECT_EQ(z, ref) << num_threads;
+  }
+
+  // Batches of products large enough to be threaded by BLAS.
+  const utens_t big = 160;
+  std::vector<float64> ba(2 * big * big), bb(2 * big * big);
+  std::vector<float64> by(2 * big * big), bref(2 * big * big);
+  for (utens_t i = 0; i < ba.size(); i++) {
+    ba[i] = static_cast<float64>(i % 3);
+    bb[i] = static_cast<float64>(i % 4);
+  }
+  for (utens_t t = 0; t < 2; t++) {
+    chime_cpu_gemm<float64>(CblasNoTrans, CblasTrans, big, big, big, 1.,
+                            ba.data() + t * big * big,
+                            bb.data() + t * big * big, 0.,
+                            bref.data() + t * big * big);
+  }
+  chime_cpu_gemm_strided_batched<float64>(
+      CblasNoTrans, CblasTrans, big, big, big, 1., ba.data(), big * big,
+      bb.data(), big * big, 0., by.data(), big * big, 2);
+  EXPECT_EQ(by, bref);
+}
+
+// Views into larger buffers give the same result as contiguous copies.
+TEST_F(MathFunctionsTest, TestChimeCpuGemmLeadingDims) {
+  const utens_t rows = 9, cols = 11;
+  std::vector<float64> buf(rows * cols), out(rows * cols, -1.);
+  for (utens_t i = 0; i < buf.size(); i++) {
+    buf[i] = static_cast<float64>(i % 13) - 6.;
+  }
+
+  // A is the 4x3 block at (1, 2), B the transposed 5x3 block at (4, 6), C the
+  // 4x5 block at (2, 3) of `out`.
+  const utens_t m = 4, n = 5, k = 3;
+  std::vector<float64> a(m * k), b(n * k), c(m * n, -1.);
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < k; j++) a[i * k + j] = buf[(1 + i) * cols + 2 + j];
+  }
+  for (utens_t i = 0; i < n; i++) {
+    for (utens_t j = 0; j < k; j++) b[i * k + j] = buf[(4 + i) * cols + 6 + j];
+  }
+  chime_cpu_gemm<float64>(CblasNoTrans, CblasTrans, m, n, k, 1.5, a.data(),
+                          b.data(), 2., c.data());
+  chime_cpu_gemm<float64>(CblasNoTrans, CblasTrans, m, n, k, 1.5,
+                          buf.data() + 1 * cols + 2, cols,
+                          buf.data() + 4 * cols + 6, cols, 2.,
+                          out.data() + 2 * cols + 3, cols);
+  for (utens_t i = 0; i < rows; i++) {
+    for (utens_t j = 0; j < cols; j++) {
+      const bool inside = i >= 2 && i < 2 + m && j >= 3 && j < 3 + n;
+      EXPECT_EQ(out[i * cols + j], inside ? c[(i - 2) * n + j - 3] : -1.)
+          << i << " " << j;
+    }
+  }
+
+  // y = A * x with x a column of `buf` and y every other element of `ys`.
+  std::vector<float64> x(k), y(m), ys(2 * m, 0.);
+  for (utens_t j = 0; j < k; j++) x[j] = buf[j * cols + 7];
+  chime_cpu_gemv<float64>(CblasNoTrans, m, k, 1., a.data(), x.data(), 0.,
+                          y.data());
+  chime_cpu_gemv<float64>(CblasNoTrans, m, k, 1., buf.data() + 1 * cols + 2,
+                          cols, buf.data() + 7, cols, 0., ys.data(), 2);
+  for (utens_t i = 0; i < m; i++) {
+    EXPECT_EQ(ys[2 * i], y[i]);
+    EXPECT_EQ(ys[2 * i + 1], 0.);
+  }
+}
+
+namespace {
+
+// Checks `chime_cpu_gemm` on a shape with a fixed-size kernel against a naive
+// product, for every transposition and on every instruction set. Inputs are
+// multiples of 1/4, so the results are exact.
+template<typename Dtype>
+void CheckGemmFixed(utens_t m, utens_t n, utens_t k) {
+  ASSERT_GE(kernels::FixedGemmShapeIndex(m, n, k), 0);
+  const utens_t pad = 3;
+  std::vector<Dtype> a((m + pad) * (k + pad)), b((k + pad) * (n + pad));
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<Dtype>(static_cast<int>(i % 9) - 4) / Dtype(4);
+  }
+  for (utens_t i = 0; i < b.size(); i++) {
+    b[i] = static_cast<Dtype>(static_cast<int>(i % 7) - 3);
+  }
+  const utens_t ldc = n + pad;
+  for (CBLAS_TRANSPOSE ta : {CblasNoTrans, CblasTrans}) {
+    for (CBLAS_TRANSPOSE tb : {CblasNoTrans, CblasTrans}) {
+      const utens_t lda = (ta == CblasNoTrans ? k : m) + pad;
+      const utens_t ldb = (tb == CblasNoTrans ? n : k) + pad;
+      std::vector<Dtype> ref(m * ldc, Dtype(-1));
+      for (utens_t i = 0; i < m; i++) {
+        for (utens_t j = 0; j < n; j++) {
+          Dtype sum = 0;
+          for (utens_t p = 0; p < k; p++) {
+            sum += (ta == CblasNoTrans ? a[i * lda + p] : a[p * lda + i]) *
+                   (tb == CblasNoTrans ? b[p * ldb + j] : b[j * ldb + p]);
+          }
+          ref[i * ldc + j] = Dtype(2) * sum + Dtype(0.5) * ref[i * ldc + j];
+        }
+      }
+
+      std::vector<Dtype> c(m * ldc, Dtype(-1));
+      chime_cpu_gemm<Dtype>(ta, tb, m, n, k, Dtype(2), a.data(), lda,
+                            b.data(), ldb, Dtype(0.5), c.data(), ldc);
+      EXPECT_EQ(c, ref) << m << "x" << n << "x" << k;
+
+      const int shape = kernels::FixedGemmShapeIndex(m, n, k);
+      const CPUCapability detected = DetectCPUCapability();
+      for (int cap = 0; cap <= static_cast<int>(detected); cap++) {
+        std::vector<Dtype> c2(m * ldc, Dtype(-1));
+        kernels::GetGemmKernels<Dtype>(static_cast<CPUCapability>(cap))
+            .fixed[shape](ta != CblasNoTrans, tb != CblasNoTrans, Dtype(2),
+                          a.data(), lda, b.data(), ldb, Dtype(0.5), c2.data(),
+                          ldc);
+        EXPECT_EQ(c2, ref) << m << "x" << n << "x" << k << " on "
+                           << CPUCapabilityToString(
+                                  static_cast<CPUCapability>(cap));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST_F(MathFunctionsTest, TestChimeCpuGemmFixed) {
+  for (utens_t m : {4, 8, 16, 32}) {
+    for (utens_t n : {4, 8, 16, 32}) {
+      CheckGemmFixed<float32>(m, n, 8);
+      CheckGemmFixed<float64>(m, n, 32);
+    }
+  }
+  CheckGemmFixed<float128>(4, 16, 8);
+  CheckGemmFixed<float128>(32, 8, 4);
+
+  // Called directly, and with beta = 0 ignoring what C holds.
+  std::vector<float32> a(4 * 16, 1.f), b(16 * 8, 0.5f);
+  std::vector<float32> c(4 * 8, std::numeric_limits<float32>::quiet_NaN());
+  chime_cpu_gemm_fixed<4, 8, 16, float32>(CblasNoTrans, CblasNoTrans, 1.f,
+                                          a.data(), b.data(), 0.f, c.data());
+  EXPECT_EQ(c, std::vector<float32>(4 * 8, 8.f));
+}
+
 TEST_F(MathFunctionsTest, TestChimeCpuAxpy) {
   utens_t N;
   {  //  ********************* float32 ****************** //
@@ -421,4 +603,828 @@ TEST_F(MathFunctionsTest, TestChimeCpuAsum) {
   }
 }
 
+TEST_F(MathFunctionsTest, TestChimeCpuElementwise) {
+  //  ********************* float32 ****************** //
+  {
+    // odd length so that both the vector body and the scalar tail run
+    utens_t n = 67;
+    auto a = static_cast<float32 *>(malloc(n * sizeof(float32)));
+    auto b = static_cast<float32 *>(malloc(n * sizeof(float32)));
+    auto y = static_cast<float32 *>(malloc(n * sizeof(float32)));
+
+    for (utens_t i = 0; i < n; i++) {
+      a[i] = static_cast<float32>(i) - 30.f;
+      b[i] = static_cast<float32>(i % 7) + 1.f;
+    }
+
+    chime_cpu_add<float32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] + b[i]);
+    chime_cpu_sub<float32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] - b[i]);
+    chime_cpu_mul<float32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] * b[i]);
+    chime_cpu_div<float32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] / b[i]);
+    chime_cpu_scal<float32>(n, 2.5f, a, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], 2.5f * a[i]);
+    chime_cpu_sign<float32>(n, a, y);
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(y[i], a[i] > 0.f ? 1.f : (a[i] < 0.f ? -1.f : 0.f));
+    }
+
+    // in-place variants
+    for (utens_t i = 0; i < n; i++) y[i] = a[i];
+    chime_cpu_add<float32>(n, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] + b[i]);
+    chime_cpu_sub<float32>(n, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i]);
+    chime_cpu_mul<float32>(n, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] * b[i]);
+    chime_cpu_div<float32>(n, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] * b[i] / b[i]);
+
+    free(a);
+    free(b);
+    free(y);
+  }
+
+  //  ********************* float64 ****************** //
+  {
+    utens_t n = 37;
+    auto a = static_cast<float64 *>(malloc(n * sizeof(float64)));
+    auto b = static_cast<float64 *>(malloc(n * sizeof(float64)));
+    auto y = static_cast<float64 *>(malloc(n * sizeof(float64)));
+
+    for (utens_t i = 0; i < n; i++) {
+      a[i] = static_cast<float64>(i) * 0.5 - 9.;
+      b[i] = static_cast<float64>(i % 5) + 0.25;
+    }
+
+    chime_cpu_add<float64>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] + b[i]);
+    chime_cpu_sub<float64>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] - b[i]);
+    chime_cpu_mul<float64>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] * b[i]);
+    chime_cpu_div<float64>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] / b[i]);
+    chime_cpu_sign<float64>(n, a, y);
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(y[i], a[i] > 0. ? 1. : (a[i] < 0. ? -1. : 0.));
+    }
+
+    free(a);
+    free(b);
+    free(y);
+  }
+
+  //  ********************* int32 ****************** //
+  {
+    utens_t n = 45;
+    auto a = static_cast<int32 *>(malloc(n * sizeof(int32)));
+    auto b = static_cast<int32 *>(malloc(n * sizeof(int32)));
+    auto y = static_cast<int32 *>(malloc(n * sizeof(int32)));
+
+    for (utens_t i = 0; i < n; i++) {
+      a[i] = static_cast<int32>(i) - 20;
+      b[i] = static_cast<int32>(i % 3) + 1;
+    }
+
+    chime_cpu_add<int32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] + b[i]);
+    chime_cpu_mul<int32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] * b[i]);
+    chime_cpu_div<int32>(n, a, b, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] / b[i]);
+    chime_cpu_scal<int32>(n, -3, a, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], -3 * a[i]);
+    chime_cpu_sign<int32>(n, a, y);
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(y[i], a[i] > 0 ? 1 : (a[i] < 0 ? -1 : 0));
+    }
+
+    free(a);
+    free(b);
+    free(y);
+  }
+
+  //  ********************* uint8 ****************** //
+  {
+    utens_t n = 133;
+    auto a = static_cast<uint8 *>(malloc(n * sizeof(uint8)));
+    auto y = static_cast<uint8 *>(malloc(n * sizeof(uint8)));
+
+    for (utens_t i = 0; i < n; i++) {
+      a[i] = static_cast<uint8>(i);
+      y[i] = static_cast<uint8>(2 * i);
+    }
+
+    chime_cpu_sub<uint8>(n, a, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i]);
+    chime_cpu_sign<uint8>(n, a, y);
+    for (utens_t i = 0; i < n; i++) EXPECT_EQ(y[i], a[i] > 0 ? 1 : 0);
+
+    free(a);
+    free(y);
+  }
+}
+
+// Every kernel table the host can run must produce the same results as the
+// baseline one.
+TEST_F(MathFunctionsTest, TestElementwiseKernelsAgree) {
+  const utens_t n = 131;
+  std::vector<float32> a(n), b(n), y_ref(n), y(n);
+  std::vector<int16> ia(n), ib(n), iy_ref(n), iy(n);
+  for (utens_t i = 0; i < n; i++) {
+    a[i] = static_cast<float32>(i) * 0.75f - 40.f;
+    b[i] = static_cast<float32>(i % 11) + 0.5f;
+    ia[i] = static_cast<int16>(i) - 60;
+    ib[i] = static_cast<int16>(i % 7) + 1;
+  }
+
+  const auto &ref = kernels::GetElementwiseKernels<float32>(
+      CPUCapability::DEFAULT);
+  const auto &iref =
+      kernels::GetElementwiseKernels<int16>(CPUCapability::DEFAULT);
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    CPUCapability capability = static_cast<CPUCapability>(c);
+    const auto &k = kernels::GetElementwiseKernels<float32>(capability);
+    const auto &ik = kernels::GetElementwiseKernels<int16>(capability);
+
+    ref.add(n, a.data(), b.data(), y_ref.data());
+    k.add(n, a.data(), b.data(), y.data());
+    EXPECT_EQ(y, y_ref) << CPUCapabilityToString(capability);
+    ref.div(n, a.data(), b.data(), y_ref.data());
+    k.div(n, a.data(), b.data(), y.data());
+    EXPECT_EQ(y, y_ref) << CPUCapabilityToString(capability);
+    ref.scal(n, -1.5f, a.data(), y_ref.data());
+    k.scal(n, -1.5f, a.data(), y.data());
+    EXPECT_EQ(y, y_ref) << CPUCapabilityToString(capability);
+    ref.sign(n, a.data(), y_ref.data());
+    k.sign(n, a.data(), y.data());
+    EXPECT_EQ(y, y_ref) << CPUCapabilityToString(capability);
+
+    iref.mul(n, ia.data(), ib.data(), iy_ref.data());
+    ik.mul(n, ia.data(), ib.data(), iy.data());
+    EXPECT_EQ(iy, iy_ref) << CPUCapabilityToString(capability);
+    iref.sub(n, ia.data(), ib.data(), iy_ref.data());
+    ik.sub(n, ia.data(), ib.data(), iy.data());
+    EXPECT_EQ(iy, iy_ref) << CPUCapabilityToString(capability);
+  }
+}
+
+namespace {
+
+// Scalar reference conversions of float16.h, on raw bit patterns.
+struct Float16Ref {
+  typedef float16 type;
+  static float32 ToFloat(uint16 h) { return Float16BitsToFloat32(h); }
+  static uint16 FromFloat(float32 x) { return Float32ToFloat16Bits(x); }
+};
+
+struct BFloat16Ref {
+  typedef bfloat16 type;
+  static float32 ToFloat(uint16 h) { return BFloat16BitsToFloat32(h); }
+  static uint16 FromFloat(float32 x) { return Float32ToBFloat16Bits(x); }
+};
+
+template<typename Htype>
+uint16 BitsOf(Htype h) {
+  uint16 bits;
+  std::memcpy(&bits, &h, sizeof(bits));
+  return bits;
+}
+
+template<typename Htype>
+Htype FromBits(uint16 bits) {
+  Htype h;
+  std::memcpy(static_cast<void *>(&h), &bits, sizeof(bits));
+  return h;
+}
+
+// Widens every bit pattern and rounds a spread of float32 values, including
+// ties and overflows, on every instruction set.
+template<typename Ref>
+void CheckHalfConversion() {
+  typedef typename Ref::type Htype;
+  std::vector<Htype> h(65536);
+  for (utens_t i = 0; i < h.size(); i++) h[i] = FromBits<Htype>(uint16(i));
+  std::vector<float32> x;
+  for (int e = -30; e <= 30; e++) {
+    for (int t = 0; t < 64; t++) {
+      const float32 v = std::ldexp(1.f + static_cast<float32>(t) / 128.f +
+                                       static_cast<float32>(t % 3) / 65536.f,
+                                   e * 5);
+      x.push_back(v);
+      x.push_back(-v);
+    }
+  }
+  x.push_back(std::numeric_limits<float32>::infinity());
+  x.push_back(std::numeric_limits<float32>::quiet_NaN());
+  x.push_back(std::numeric_limits<float32>::denorm_min());
+
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    const CPUCapability capability = static_cast<CPUCapability>(c);
+    const kernels::HalfKernels<Htype> &k =
+        kernels::GetHalfKernels<Htype>(capability);
+    std::vector<float32> f(h.size());
+    std::vector<Htype> back(h.size());
+    k.to_float(h.size(), h.data(), f.data());
+    k.from_float(f.size(), f.data(), back.data());
+    for (utens_t i = 0; i < h.size(); i++) {
+      const float32 ref = Ref::ToFloat(uint16(i));
+      if (std::isnan(ref)) {
+        ASSERT_TRUE(std::isnan(f[i])) << i;
+        ASSERT_TRUE(std::isnan(Ref::ToFloat(BitsOf(back[i])))) << i;
+      } else {
+        ASSERT_EQ(f[i], ref) << i << " " << CPUCapabilityToString(capability);
+        ASSERT_EQ(BitsOf(back[i]), uint16(i)) << i;
+      }
+    }
+
+    std::vector<Htype> y(x.size());
+    k.from_float(x.size(), x.data(), y.data());
+    for (utens_t i = 0; i < x.size(); i++) {
+      if (std::isnan(x[i])) {
+        EXPECT_TRUE(std::isnan(Ref::ToFloat(BitsOf(y[i]))));
+      } else {
+        EXPECT_EQ(BitsOf(y[i]), Ref::FromFloat(x[i]))
+            << x[i] << " " << CPUCapabilityToString(capability);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST_F(MathFunctionsTest, TestHalfConversion) {
+  // Ties round to even.
+  EXPECT_EQ(Float32ToFloat16Bits(1.f + std::ldexp(1.f, -11)), 0x3C00);
+  EXPECT_EQ(Float32ToFloat16Bits(1.f + 3.f * std::ldexp(1.f, -11)), 0x3C02);
+  EXPECT_EQ(Float32ToFloat16Bits(65520.f), 0x7C00);
+  EXPECT_EQ(Float32ToBFloat16Bits(1.f + std::ldexp(1.f, -8)), 0x3F80);
+  EXPECT_EQ(Float32ToBFloat16Bits(1.f + 3.f * std::ldexp(1.f, -8)), 0x3F82);
+  EXPECT_EQ(Float32ToBFloat16Bits(-2.5f), 0xC020);
+  EXPECT_EQ(static_cast<float32>(bfloat16(3.f)), 3.f);
+
+  CheckHalfConversion<Float16Ref>();
+  CheckHalfConversion<BFloat16Ref>();
+
+  std::vector<float32> x(1000), y(1000);
+  std::vector<bfloat16> h(1000);
+  for (utens_t i = 0; i < x.size(); i++) x[i] = static_cast<float32>(i) - 500;
+  chime_cpu_float_to_half<bfloat16>(x.size(), x.data(), h.data());
+  chime_cpu_half_to_float<bfloat16>(h.size(), h.data(), y.data());
+  EXPECT_EQ(y[0], -500.f);
+  EXPECT_EQ(y[999], 500.f);
+  EXPECT_EQ(y[758], 258.f);  // 258 is a bfloat16, 259 is a tie
+  EXPECT_EQ(y[759], 260.f);
+}
+
+namespace {
+
+// Elementwise results and products of 16-bit operands are computed in
+// float32 and rounded once.
+template<typename Htype>
+void CheckHalfElementwise() {
+  const utens_t n = 131;
+  std::vector<Htype> a(n), b(n), y(n);
+  for (utens_t i = 0; i < n; i++) {
+    a[i] = Htype(static_cast<float32>(i) * 0.37f - 20.f);
+    b[i] = Htype(static_cast<float32>(i % 11) + 0.3f);
+  }
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    const CPUCapability capability = static_cast<CPUCapability>(c);
+    const kernels::ElementwiseKernels<Htype> &k =
+        kernels::GetElementwiseKernels<Htype>(capability);
+    k.add(n, a.data(), b.data(), y.data());
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(BitsOf(y[i]), BitsOf(Htype(float32(a[i]) + float32(b[i]))));
+    }
+    k.div(n, a.data(), b.data(), y.data());
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(BitsOf(y[i]), BitsOf(Htype(float32(a[i]) / float32(b[i]))));
+    }
+    k.scal(n, Htype(-1.5f), a.data(), y.data());
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_EQ(BitsOf(y[i]), BitsOf(Htype(-1.5f * float32(a[i]))));
+    }
+    k.sign(n, a.data(), y.data());
+    for (utens_t i = 0; i < n; i++) {
+      const float32 s = float32(a[i]) > 0.f ? 1.f : float32(a[i]) < 0.f ? -1.f
+                                                                       : 0.f;
+      EXPECT_EQ(float32(y[i]), s);
+    }
+  }
+  chime_cpu_mul<Htype>(n, a.data(), b.data(), y.data());
+  for (utens_t i = 0; i < n; i++) {
+    EXPECT_EQ(BitsOf(y[i]), BitsOf(Htype(float32(a[i]) * float32(b[i]))));
+  }
+}
+
+// Inputs are small multiples of 1/4, so that every sum is exact in float32
+// and the result is rounded once to the 16-bit type.
+template<typename Htype>
+void CheckHalfGemm(utens_t m, utens_t n, utens_t k) {
+  const utens_t pad = 2;
+  std::vector<Htype> a((std::max(m, k) + pad) * (std::max(m, k) + pad)),
+      b((std::max(n, k) + pad) * (std::max(n, k) + pad));
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = Htype(static_cast<float32>(static_cast<int>(i % 5) - 2) * 0.25f);
+  }
+  for (utens_t i = 0; i < b.size(); i++) {
+    b[i] = Htype(static_cast<float32>(static_cast<int>(i % 3) - 1));
+  }
+  const float32 nan = std::numeric_limits<float32>::quiet_NaN();
+  for (CBLAS_TRANSPOSE ta : {CblasNoTrans, CblasTrans}) {
+    for (CBLAS_TRANSPOSE tb : {CblasNoTrans, CblasTrans}) {
+      const utens_t lda = (ta == CblasNoTrans ? k : m) + pad;
+      const utens_t ldb = (tb == CblasNoTrans ? n : k) + pad;
+      const utens_t ldc = n + pad;
+      std::vector<Htype> c(m * ldc, Htype(nan)), c2(m * ldc, Htype(1.f));
+      chime_cpu_gemm<Htype>(ta, tb, m, n, k, Htype(2.f), a.data(), lda,
+                            b.data(), ldb, Htype(0.f), c.data(), ldc);
+      chime_cpu_gemm<Htype>(ta, tb, m, n, k, Htype(2.f), a.data(), lda,
+                            b.data(), ldb, Htype(-1.f), c2.data(), ldc);
+      for (utens_t i = 0; i < m; i++) {
+        for (utens_t j = 0; j < n; j++) {
+          float32 sum = 0.f;
+          for (utens_t p = 0; p < k; p++) {
+            sum += float32(ta == CblasNoTrans ? a[i * lda + p]
+                                              : a[p * lda + i]) *
+                   float32(tb == CblasNoTrans ? b[p * ldb + j]
+                                              : b[j * ldb + p]);
+          }
+          ASSERT_EQ(float32(c[i * ldc + j]), float32(Htype(2.f * sum)))
+              << m << "x" << n << "x" << k;
+          ASSERT_EQ(float32(c2[i * ldc + j]),
+                    float32(Htype(2.f * sum - 1.f)));
+        }
+        ASSERT_TRUE(std::isnan(float32(c[i * ldc + n])));
+      }
+    }
+  }
+}
+
+template<typename Htype>
+void CheckHalfGemm() {
+  // Blocks of rows and columns of C and slices of k, and a single row or
+  // column of C.
+  CheckHalfGemm<Htype>(13, 21, 37);
+  CheckHalfGemm<Htype>(201, 70, 300);
+  CheckHalfGemm<Htype>(20, 1100, 9);
+  CheckHalfGemm<Htype>(1, 50, 40);
+  CheckHalfGemm<Htype>(40, 1, 50);
+  CheckHalfGemm<Htype>(3, 5, 0);
+
+  const utens_t m = 13, k = 37, pad = 2;
+  std::vector<Htype> a((k + pad) * (k + pad)), b((k + pad) * (k + pad));
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = Htype(static_cast<float32>(static_cast<int>(i % 5) - 2) * 0.25f);
+    b[i] = Htype(static_cast<float32>(static_cast<int>(i % 3) - 1));
+  }
+  for (CBLAS_TRANSPOSE ta : {CblasNoTrans, CblasTrans}) {
+    // y = op(A) * x with strided vectors.
+    const utens_t lda = k + pad, inc = 2;
+    const utens_t x_size = ta == CblasNoTrans ? k : m;
+    const utens_t y_size = ta == CblasNoTrans ? m : k;
+    std::vector<Htype> y(y_size * inc, Htype(3.f));
+    chime_cpu_gemv<Htype>(ta, m, k, Htype(0.5f), a.data(), lda, b.data(), inc,
+                          Htype(2.f), y.data(), inc);
+    for (utens_t i = 0; i < y_size; i++) {
+      float32 sum = 0.f;
+      for (utens_t p = 0; p < x_size; p++) {
+        sum += float32(ta == CblasNoTrans ? a[i * lda + p] : a[p * lda + i]) *
+               float32(b[p * inc]);
+      }
+      ASSERT_EQ(float32(y[i * inc]), 0.5f * sum + 6.f);
+      ASSERT_EQ(float32(y[i * inc + 1]), 3.f);
+    }
+  }
+}
+
+}  // namespace
+
+TEST_F(MathFunctionsTest, TestChimeCpuHalfKernels) {
+  CheckHalfElementwise<float16>();
+  CheckHalfElementwise<bfloat16>();
+  CheckHalfGemm<float16>();
+  CheckHalfGemm<bfloat16>();
+
+  // A long dot product reads the matrix in 16-bit storage on every
+  // instruction set.
+  const utens_t n = 1000;
+  std::vector<bfloat16> x(n);
+  std::vector<float32> y(n), z(n, 1.f);
+  for (utens_t i = 0; i < n; i++) {
+    x[i] = bfloat16(static_cast<float32>(i % 9) - 4.f);
+    y[i] = static_cast<float32>(i % 4) * 0.5f;
+  }
+  float32 ref = 0.f;
+  for (utens_t i = 0; i < n; i++) ref += float32(x[i]) * y[i];
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    const kernels::HalfKernels<bfloat16> &k =
+        kernels::GetHalfKernels<bfloat16>(static_cast<CPUCapability>(c));
+    EXPECT_EQ(k.dot(n, x.data(), y.data()), ref);
+    std::vector<float32> w = z;
+    k.axpy(n, 2.f, x.data(), w.data());
+    for (utens_t i = 0; i < n; i++) ASSERT_EQ(w[i], 1.f + 2.f * float32(x[i]));
+  }
+}
+
+namespace {
+
+// Distance in ulp of `y` from the exact `ref`, counting only results in the
+// normal range of `Dtype`.
+template<typename Dtype>
+double UlpError(Dtype y, long double ref) {
+  if (std::isnan(ref)) return std::isnan(y) ? 0. : HUGE_VAL;
+  if (std::isinf(static_cast<Dtype>(ref)))
+    return y == static_cast<Dtype>(ref) ? 0. : HUGE_VAL;
+  if (std::fabs(ref) < std::numeric_limits<Dtype>::min()) return 0.;
+  int e;
+  std::frexp(ref, &e);
+  long double ulp = std::ldexp(1.L, e - std::numeric_limits<Dtype>::digits);
+  return static_cast<double>(std::fabs(y - ref) / ulp);
+}
+
+template<typename Dtype>
+struct TranscendentalCase {
+  void (*fn)(utens_t, const Dtype *, Dtype *);
+  long double (*ref)(long double);
+  Dtype lo, hi;
+  double max_ulp;
+};
+
+long double GeluRef(long double x) {
+  if (std::isinf(x)) return x > 0 ? x : 0.L;
+  return 0.5L * x * std::erfc(-x / std::sqrt(2.L));
+}
+long double SigmoidRef(long double x) { return 1.L / (1.L + std::exp(-x)); }
+long double SoftplusRef(long double x) {
+  return x > 0 ? x + std::log1p(std::exp(-x)) : std::log1p(std::exp(x));
+}
+
+// Checks `c.fn` on a grid over [lo, hi], the same grid scaled towards zero
+// and a handful of special values.
+template<typename Dtype>
+void CheckTranscendental(const char *name, const TranscendentalCase<Dtype> &c) {
+  const utens_t grid = 20001;
+  std::vector<Dtype> x;
+  for (utens_t i = 0; i < grid; i++) {
+    Dtype t = c.lo + (c.hi - c.lo) * static_cast<Dtype>(i) / (grid - 1);
+    x.push_back(t);
+    x.push_back(t * static_cast<Dtype>(1e-4));
+  }
+  const Dtype inf = std::numeric_limits<Dtype>::infinity();
+  x.push_back(static_cast<Dtype>(0.));
+  x.push_back(static_cast<Dtype>(-0.));
+  x.push_back(std::numeric_limits<Dtype>::denorm_min());
+  x.push_back(inf);
+  x.push_back(-inf);
+  x.push_back(std::numeric_limits<Dtype>::quiet_NaN());
+
+  std::vector<Dtype> y(x.size());
+  c.fn(x.size(), x.data(), y.data());
+  double max_err = 0.;
+  Dtype worst = 0;
+  for (utens_t i = 0; i < x.size(); i++) {
+    double err = UlpError(y[i], c.ref(x[i]));
+    if (err > max_err) {
+      max_err = err;
+      worst = x[i];
+    }
+  }
+  EXPECT_LE(max_err, c.max_ulp) << name << "(" << worst << ")";
+}
+
+}  // namespace
+
+TEST_F(MathFunctionsTest, TestChimeCpuTranscendental) {
+  long double (*exp_ref)(long double) = std::exp;
+  long double (*log_ref)(long double) = std::log;
+  long double (*tanh_ref)(long double) = std::tanh;
+  long double (*erf_ref)(long double) = std::erf;
+
+  // The bounds documented in math_functions.hpp.
+  CheckTranscendental<float32>(
+      "exp", {chime_cpu_exp<float32>, exp_ref, -104.f, 89.f, 1.});
+  CheckTranscendental<float32>(
+      "log", {chime_cpu_log<float32>, log_ref, 0.f, 4.f, 1.});
+  CheckTranscendental<float32>(
+      "log", {chime_cpu_log<float32>, log_ref, 0.f, 1e37f, 1.});
+  CheckTranscendental<float32>(
+      "tanh", {chime_cpu_tanh<float32>, tanh_ref, -12.f, 12.f, 2.});
+  CheckTranscendental<float32>(
+      "sigmoid", {chime_cpu_sigmoid<float32>, SigmoidRef, -104.f, 30.f, 3.});
+  CheckTranscendental<float32>(
+      "erf", {chime_cpu_erf<float32>, erf_ref, -5.f, 5.f, 4.});
+  CheckTranscendental<float32>(
+      "gelu", {chime_cpu_gelu<float32>, GeluRef, -12.5f, 10.f, 8.});
+  CheckTranscendental<float32>(
+      "softplus",
+      {chime_cpu_softplus<float32>, SoftplusRef, -104.f, 104.f, 2.});
+
+  CheckTranscendental<float64>(
+      "exp", {chime_cpu_exp<float64>, exp_ref, -745., 710., 1.});
+  CheckTranscendental<float64>(
+      "log", {chime_cpu_log<float64>, log_ref, 0., 4., 1.});
+  CheckTranscendental<float64>(
+      "log", {chime_cpu_log<float64>, log_ref, 0., 1e300, 1.});
+  CheckTranscendental<float64>(
+      "tanh", {chime_cpu_tanh<float64>, tanh_ref, -25., 25., 2.});
+  CheckTranscendental<float64>(
+      "sigmoid", {chime_cpu_sigmoid<float64>, SigmoidRef, -745., 40., 3.});
+  CheckTranscendental<float64>(
+      "erf", {chime_cpu_erf<float64>, erf_ref, -7., 7., 4.});
+  CheckTranscendental<float64>(
+      "gelu", {chime_cpu_gelu<float64>, GeluRef, -37., 10., 8.});
+  CheckTranscendental<float64>(
+      "softplus",
+      {chime_cpu_softplus<float64>, SoftplusRef, -745., 745., 2.});
+}
+
+// The tail of an array goes through the same vector code as its body, so
+// every capability computes a given element identically wherever it sits.
+TEST_F(MathFunctionsTest, TestTranscendentalTail) {
+  const utens_t n = 37;
+  std::vector<float64> x(n), y(n), y1(1);
+  for (utens_t i = 0; i < n; i++) x[i] = static_cast<float64>(i) * 0.3 - 5.;
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    const auto &k = kernels::GetTranscendentalKernels<float64>(
+        static_cast<CPUCapability>(c));
+    k.gelu(n, x.data(), y.data());
+    for (utens_t i = 0; i < n; i++) {
+      k.gelu(1, x.data() + i, y1.data());
+      EXPECT_EQ(y1[0], y[i]);
+    }
+  }
+}
+
+// Known answer of the Random123 reference implementation.
+TEST_F(MathFunctionsTest, TestPhilox) {
+  const uint32 counter[4] = {0, 0, 0, 0};
+  const uint32 key[2] = {0, 0};
+  uint32 out[4];
+  Philox4x32(counter, key, out);
+  EXPECT_EQ(out[0], 0x6627e8d5u);
+  EXPECT_EQ(out[1], 0xe169c58du);
+  EXPECT_EQ(out[2], 0xbc57ac4cu);
+  EXPECT_EQ(out[3], 0x9b00dbd8u);
+
+  const uint64 seed = 0x0123456789abcdefull;
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    CPUCapability capability = static_cast<CPUCapability>(c);
+    const auto &k = kernels::GetRandomKernels<float32>(capability);
+    for (uint64 offset : {0ull, 5ull, 64ull, 100ull, (1ull << 36) - 3}) {
+      std::vector<uint32> y(203);
+      k.bits(y.size(), seed, offset, y.data());
+      for (utens_t i = 0; i < y.size(); i++) {
+        ASSERT_EQ(y[i], PhiloxWord(seed, offset + i))
+            << CPUCapabilityToString(capability) << " " << offset << " " << i;
+      }
+    }
+  }
+}
+
+TEST_F(MathFunctionsTest, TestRandomKernelsAgree) {
+  const utens_t n = 301;
+  const uint64 seed = 42;
+  std::vector<float32> y_ref(n), y(n);
+  std::vector<float64> d_ref(n), d(n);
+  const auto &ref = kernels::GetRandomKernels<float32>(CPUCapability::DEFAULT);
+  const auto &dref = kernels::GetRandomKernels<float64>(CPUCapability::DEFAULT);
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    CPUCapability capability = static_cast<CPUCapability>(c);
+    const auto &k = kernels::GetRandomKernels<float32>(capability);
+    const auto &dk = kernels::GetRandomKernels<float64>(capability);
+
+    ref.uniform(n, seed, 7, 0.f, 1.f, y_ref.data());
+    k.uniform(n, seed, 7, 0.f, 1.f, y.data());
+    EXPECT_EQ(y, y_ref) << CPUCapabilityToString(capability);
+    dref.uniform(n, seed, 7, 0., 1., d_ref.data());
+    dk.uniform(n, seed, 7, 0., 1., d.data());
+    EXPECT_EQ(d, d_ref) << CPUCapabilityToString(capability);
+
+    ref.gaussian(n, seed, 9, 1.f, 2.f, y_ref.data());
+    k.gaussian(n, seed, 9, 1.f, 2.f, y.data());
+    dref.gaussian(n, seed, 9, 1., 2., d_ref.data());
+    dk.gaussian(n, seed, 9, 1., 2., d.data());
+    for (utens_t i = 0; i < n; i++) {
+      EXPECT_NEAR(y[i], y_ref[i], 1e-5f * (1.f + std::fabs(y_ref[i])))
+          << CPUCapabilityToString(capability) << " " << i;
+      EXPECT_NEAR(d[i], d_ref[i], 1e-13 * (1. + std::fabs(d_ref[i])))
+          << CPUCapabilityToString(capability) << " " << i;
+    }
+  }
+}
+
+// Random numbers only depend on the seed, the offset and the index.
+TEST_F(MathFunctionsTest, TestChimeCpuRngDeterministic) {
+  const utens_t n = (1 << 17) + 45;
+  const uint64 seed = 2022;
+
+  auto run = [&](std::vector<float32> *u, std::vector<float64> *g,
+                 std::vector<float128> *lg, std::vector<uint8> *b) {
+    u->resize(n);
+    g->resize(n);
+    lg->resize(n / 64);
+    b->resize(n);
+    chime_cpu_rng_uniform<float32>(n, 0.f, 1.f, u->data(), seed, 3);
+    chime_cpu_rng_gaussian<float64>(n, 0., 1., g->data(), seed, 11);
+    chime_cpu_rng_gaussian<float128>(lg->size(), 0, 1, lg->data(), seed, 11);
+    chime_cpu_rng_bernoulli<float32, uint8>(n, 0.3f, b->data(), seed, 5);
+  };
+
+  std::vector<float32> u_ref, u;
+  std::vector<float64> g_ref, g;
+  std::vector<float128> lg_ref, lg;
+  std::vector<uint8> b_ref, b;
+  ScopedIntraOpNumThreads threads(1);
+  run(&u_ref, &g_ref, &lg_ref, &b_ref);
+  SetIntraOpNumThreads(4);
+  run(&u, &g, &lg, &b);
+  EXPECT_EQ(u, u_ref);
+  EXPECT_EQ(g, g_ref);
+  EXPECT_EQ(lg, lg_ref);
+  EXPECT_EQ(b, b_ref);
+
+  // A call split at a multiple of 32 elements continues where the first part
+  // stopped.
+  const utens_t head = 32 * 100;
+  chime_cpu_rng_uniform<float32>(head, 0.f, 1.f, u.data(), seed, 3);
+  chime_cpu_rng_uniform<float32>(n - head, 0.f, 1.f, u.data() + head, seed,
+                                 3 + head);
+  EXPECT_EQ(u, u_ref);
+  chime_cpu_rng_gaussian<float64>(head, 0., 1., g.data(), seed, 11);
+  chime_cpu_rng_gaussian<float64>(n - head, 0., 1., g.data() + head, seed,
+                                  11 + 2 * head);
+  EXPECT_EQ(g, g_ref);
+
+  chime_set_random_seed(seed);
+  chime_cpu_rng_uniform<float32>(n, 0.f, 1.f, u.data());
+  chime_cpu_rng_uniform<float32>(n, 0.f, 1.f, u_ref.data(), seed, 0);
+  EXPECT_EQ(u, u_ref);
+  chime_cpu_rng_uniform<float32>(n, 0.f, 1.f, u.data());
+  chime_cpu_rng_uniform<float32>(n, 0.f, 1.f, u_ref.data(), seed, n);
+  EXPECT_EQ(u, u_ref);
+}
+
+TEST_F(MathFunctionsTest, TestChimeCpuRngMoments) {
+  const utens_t n = 1 << 20;
+  std::vector<float32> u(n), g(n);
+  std::vector<float64> dg(n);
+  std::vector<float128> lg(n / 16);
+  std::vector<int32> b(n);
+  chime_cpu_rng_uniform<float32>(n, -1.f, 3.f, u.data(), 1, 0);
+  chime_cpu_rng_gaussian<float32>(n, 2.f, 0.5f, g.data(), 1, 0);
+  chime_cpu_rng_gaussian<float64>(n, 0., 1., dg.data(), 2, 0);
+  chime_cpu_rng_gaussian<float128>(lg.size(), 0, 1, lg.data(), 3, 0);
+  chime_cpu_rng_bernoulli<float64, int32>(n, 0.25, b.data(), 4, 0);
+
+  auto moments = [](const auto &x, float64 *mean, float64 *var) {
+    float64 s = 0, s2 = 0;
+    for (auto v : x) {
+      s += static_cast<float64>(v);
+      s2 += static_cast<float64>(v) * static_cast<float64>(v);
+    }
+    *mean = s / x.size();
+    *var = s2 / x.size() - *mean * *mean;
+  };
+  float64 mean, var;
+  moments(u, &mean, &var);
+  EXPECT_NEAR(mean, 1., 1e-2);
+  EXPECT_NEAR(var, 16. / 12, 1e-2);
+  for (float32 v : u) {
+    ASSERT_GE(v, -1.f);
+    ASSERT_LT(v, 3.f);
+  }
+  moments(g, &mean, &var);
+  EXPECT_NEAR(mean, 2., 1e-2);
+  EXPECT_NEAR(var, 0.25, 1e-2);
+  moments(dg, &mean, &var);
+  EXPECT_NEAR(mean, 0., 1e-2);
+  EXPECT_NEAR(var, 1., 1e-2);
+  // The share of samples beyond one standard deviation.
+  utens_t outside = 0;
+  for (float64 v : dg) outside += std::fabs(v) > 1.;
+  EXPECT_NEAR(static_cast<float64>(outside) / n, 0.3173, 2e-3);
+  moments(lg, &mean, &var);
+  EXPECT_NEAR(mean, 0., 2e-2);
+  EXPECT_NEAR(var, 1., 3e-2);
+  moments(b, &mean, &var);
+  EXPECT_NEAR(mean, 0.25, 2e-3);
+}
+
+TEST_F(MathFunctionsTest, TestChimeCpuDropout) {
+  const utens_t n = (1 << 16) + 77;
+  const uint64 seed = 7;
+  const float64 p = 0.3;
+  std::vector<float32> x(n), y(n), dy(n), dx(n);
+  for (utens_t i = 0; i < n; i++) {
+    x[i] = static_cast<float32>(i % 97) * 0.125f - 6.f;
+    dy[i] = static_cast<float32>(i % 13) - 6.5f;
+  }
+  std::vector<uint32> mask(chime_mask_words(n), 0xdeadbeef);
+  std::vector<uint8> keep(n);
+  chime_cpu_rng_bernoulli<float64, uint8>(n, 1 - p, keep.data(), seed, 3);
+
+  const float32 scale = 1.f / (1.f - static_cast<float32>(p));
+  ScopedIntraOpNumThreads threads(4);
+  chime_cpu_dropout<float32>(n, p, x.data(), y.data(), mask.data(), seed, 3);
+  chime_cpu_dropout_backward<float32>(n, p, mask.data(), dy.data(),
+                                      dx.data());
+  utens_t kept = 0;
+  for (utens_t i = 0; i < n; i++) {
+    const bool bit = mask[i / 32] >> (i % 32) & 1;
+    ASSERT_EQ(bit, keep[i] != 0) << i;
+    ASSERT_EQ(y[i], bit ? x[i] * scale : 0.f) << i;
+    ASSERT_EQ(dx[i], bit ? dy[i] * scale : 0.f) << i;
+    kept += bit;
+  }
+  EXPECT_EQ(mask.back() >> (n % 32), 0u);
+  EXPECT_NEAR(static_cast<float64>(kept) / n, 1 - p, 1e-2);
+
+  // In place, on one thread and on every instruction set.
+  SetIntraOpNumThreads(1);
+  std::vector<float32> z = x;
+  std::vector<uint32> z_mask(mask.size());
+  chime_cpu_dropout<float32>(n, p, z.data(), z.data(), z_mask.data(), seed,
+                             3);
+  EXPECT_EQ(z, y);
+  EXPECT_EQ(z_mask, mask);
+  const uint64 threshold = static_cast<uint64>(std::ldexp(1 - p, 32));
+  const CPUCapability detected = DetectCPUCapability();
+  for (int c = 0; c <= static_cast<int>(detected); c++) {
+    CPUCapability capability = static_cast<CPUCapability>(c);
+    const auto &k = kernels::GetRandomKernels<float32>(capability);
+    const utens_t m = 1000;
+    k.dropout(m, seed, 3, threshold, scale, x.data(), z.data(),
+              z_mask.data());
+    EXPECT_TRUE(std::equal(z.begin(), z.begin() + m, y.begin()))
+        << CPUCapabilityToString(capability);
+    EXPECT_TRUE(std::equal(z_mask.begin(), z_mask.begin() + m / 32,
+                           mask.begin()))
+        << CPUCapabilityToString(capability);
+    k.masked_scale(m, mask.data(), scale, dy.data(), z.data());
+    EXPECT_TRUE(std::equal(z.begin(), z.begin() + m, dx.begin()))
+        << CPUCapabilityToString(capability);
+  }
+
+  std::vector<float64> d(n), dz(n);
+  for (utens_t i = 0; i < n; i++) d[i] = x[i];
+  chime_cpu_dropout<float64>(n, 0., d.data(), dz.data(), mask.data(), seed, 0);
+  EXPECT_EQ(dz, d);
+  for (utens_t w = 0; w + 1 < mask.size(); w++) {
+    ASSERT_EQ(mask[w], 0xFFFFFFFFu);
+  }
+  EXPECT_EQ(mask.back(), (1u << n % 32) - 1);
+  chime_cpu_dropout<float64>(n, 1., d.data(), dz.data(), mask.data(), seed, 0);
+  for (float64 v : dz) ASSERT_EQ(v, 0.);
+  for (uint32 w : mask) EXPECT_EQ(w, 0u);
+}
+
+// Sharding over the intra-op pool must not change any result.
+TEST_F(MathFunctionsTest, TestIntraOpParallel) {
+  const utens_t n = (1 << 18) + 5;
+  std::vector<float32> x(n), y(n), z(n);
+  for (utens_t i = 0; i < n; i++) {
+    x[i] = static_cast<float32>(i % 1000) * 1e-3f - 0.5f;
+    y[i] = static_cast<float32>(i % 17) * 0.25f;
+  }
+
+  auto run = [&](std::vector<float32> *out, float32 *dot, float32 *asum) {
+    std::vector<float32> &r = *out;
+    r = y;
+    chime_cpu_axpy<float32>(n, 1.5f, x.data(), r.data());
+    chime_cpu_mul<float32>(n, x.data(), r.data());
+    chime_cpu_tanh<float32>(n, r.data(), r.data());
+    chime_cpu_scal<float32>(n, -2.f, r.data());
+    *dot = chime_cpu_dot<float32>(n, x.data(), r.data());
+    *asum = chime_cpu_asum<float32>(n, r.data());
+  };
+
+  float32 dot_ref, asum_ref, dot, asum;
+  ScopedIntraOpNumThreads threads(1);
+  run(&z, &dot_ref, &asum_ref);
+  SetIntraOpNumThreads(4);
+  std::vector<float32> r;
+  run(&r, &dot, &asum);
+  EXPECT_EQ(r, z);
+  EXPECT_EQ(dot, dot_ref);
+  EXPECT_EQ(asum, asum_ref);
+
+  std::vector<int32> ia(n, 3), iy(n);
+  chime_cpu_set<int32>(iy.data(), 7, n);
+  chime_cpu_add<int32>(n, ia.data(), iy.data());
+  for (utens_t i = 0; i < n; i++) ASSERT_EQ(iy[i], 10);
+}
+
 }  // namespace chime
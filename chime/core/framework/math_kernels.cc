@@ -0,0 +1,313 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+namespace kernels {
+
+// Returns the kernel table `Table` of the namespace compiled for
+// `capability`. Adding an ISA level only adds its case below.
+#if CHIME_CPU_DISPATCH
+#define CHIME_DISPATCHED_KERNEL_TABLE_CASES(Table)                            \
+  case CPUCapability::AVX512_VNNI:                                            \
+    return cpu_avx512_vnni::Table();                                          \
+  case CPUCapability::AVX512:                                                 \
+    return cpu_avx512::Table();                                               \
+  case CPUCapability::AVX2:                                                   \
+    return cpu_avx2::Table();                                                 \
+  case CPUCapability::SSE4_2:                                                 \
+    return cpu_sse4_2::Table();
+#else
+#define CHIME_DISPATCHED_KERNEL_TABLE_CASES(Table)
+#endif  // CHIME_CPU_DISPATCH
+
+#define CHIME_RETURN_KERNEL_TABLE(capability, Table)                          \
+  DCHECK(!(DetectCPUCapability() < (capability)))                             \
+      << "Kernels for " << CPUCapabilityToString(capability)                  \
+      << " are not supported by this CPU";                                    \
+  switch (capability) {                                                       \
+    CHIME_DISPATCHED_KERNEL_TABLE_CASES(Table)                                \
+    default:                                                                  \
+      return cpu_default::Table();                                            \
+  }
+
+template<typename Dtype>
+const ElementwiseKernels<Dtype> &GetElementwiseKernels(
+    CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, ElementwiseKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const ElementwiseKernels<Dtype> &GetElementwiseKernels() {
+  static const ElementwiseKernels<Dtype> &table =
+      GetElementwiseKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+#define INSTANTIATE_GET_KERNELS(Dtype)                                      \
+  template const ElementwiseKernels<Dtype> &GetElementwiseKernels<Dtype>(  \
+      CPUCapability capability);                                           \
+  template const ElementwiseKernels<Dtype> &GetElementwiseKernels<Dtype>()
+
+INSTANTIATE_GET_KERNELS(int8);
+INSTANTIATE_GET_KERNELS(int16);
+INSTANTIATE_GET_KERNELS(int32);
+INSTANTIATE_GET_KERNELS(int64);
+INSTANTIATE_GET_KERNELS(uint8);
+INSTANTIATE_GET_KERNELS(uint16);
+INSTANTIATE_GET_KERNELS(uint32);
+INSTANTIATE_GET_KERNELS(uint64);
+INSTANTIATE_GET_KERNELS(float32);
+INSTANTIATE_GET_KERNELS(float64);
+INSTANTIATE_GET_KERNELS(float128);
+INSTANTIATE_GET_KERNELS(float16);
+INSTANTIATE_GET_KERNELS(bfloat16);
+
+#undef INSTANTIATE_GET_KERNELS
+
+template<typename Dtype>
+const BroadcastKernels<Dtype> &GetBroadcastKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, BroadcastKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const BroadcastKernels<Dtype> &GetBroadcastKernels() {
+  static const BroadcastKernels<Dtype> &table =
+      GetBroadcastKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+#define INSTANTIATE_GET_KERNELS(Dtype)                                      \
+  template const BroadcastKernels<Dtype> &GetBroadcastKernels<Dtype>(      \
+      CPUCapability capability);                                           \
+  template const BroadcastKernels<Dtype> &GetBroadcastKernels<Dtype>()
+
+INSTANTIATE_GET_KERNELS(int8);
+INSTANTIATE_GET_KERNELS(int16);
+INSTANTIATE_GET_KERNELS(int32);
+INSTANTIATE_GET_KERNELS(int64);
+INSTANTIATE_GET_KERNELS(uint8);
+INSTANTIATE_GET_KERNELS(uint16);
+INSTANTIATE_GET_KERNELS(uint32);
+INSTANTIATE_GET_KERNELS(uint64);
+INSTANTIATE_GET_KERNELS(float32);
+INSTANTIATE_GET_KERNELS(float64);
+INSTANTIATE_GET_KERNELS(float128);
+
+#undef INSTANTIATE_GET_KERNELS
+
+template<typename Htype>
+const HalfKernels<Htype> &GetHalfKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, HalfKernelTable<Htype>);
+}
+
+template<typename Htype>
+const HalfKernels<Htype> &GetHalfKernels() {
+  static const HalfKernels<Htype> &table =
+      GetHalfKernels<Htype>(GetCPUCapability());
+  return table;
+}
+
+template const HalfKernels<float16> &GetHalfKernels<float16>(
+    CPUCapability capability);
+template const HalfKernels<float16> &GetHalfKernels<float16>();
+template const HalfKernels<bfloat16> &GetHalfKernels<bfloat16>(
+    CPUCapability capability);
+template const HalfKernels<bfloat16> &GetHalfKernels<bfloat16>();
+
+template<typename Dtype>
+const TranscendentalKernels<Dtype> &GetTranscendentalKernels(
+    CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, TranscendentalKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const TranscendentalKernels<Dtype> &GetTranscendentalKernels() {
+  static const TranscendentalKernels<Dtype> &table =
+      GetTranscendentalKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const TranscendentalKernels<float32>
+    &GetTranscendentalKernels<float32>(CPUCapability capability);
+template const TranscendentalKernels<float32>
+    &GetTranscendentalKernels<float32>();
+template const TranscendentalKernels<float64>
+    &GetTranscendentalKernels<float64>(CPUCapability capability);
+template const TranscendentalKernels<float64>
+    &GetTranscendentalKernels<float64>();
+
+template<typename Dtype>
+const RandomKernels<Dtype> &GetRandomKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, RandomKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const RandomKernels<Dtype> &GetRandomKernels() {
+  static const RandomKernels<Dtype> &table =
+      GetRandomKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const RandomKernels<float32> &GetRandomKernels<float32>(
+    CPUCapability capability);
+template const RandomKernels<float32> &GetRandomKernels<float32>();
+template const RandomKernels<float64> &GetRandomKernels<float64>(
+    CPUCapability capability);
+template const RandomKernels<float64> &GetRandomKernels<float64>();
+
+template<typename Dtype>
+const ReduceKernels<Dtype> &GetReduceKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, ReduceKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const ReduceKernels<Dtype> &GetReduceKernels() {
+  static const ReduceKernels<Dtype> &table =
+      GetReduceKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const ReduceKernels<float32> &GetReduceKernels<float32>(
+    CPUCapability capability);
+template const ReduceKernels<float32> &GetReduceKernels<float32>();
+template const ReduceKernels<float64> &GetReduceKernels<float64>(
+    CPUCapability capability);
+template const ReduceKernels<float64> &GetReduceKernels<float64>();
+
+template<typename Dtype>
+const SoftmaxKernels<Dtype> &GetSoftmaxKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, SoftmaxKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const SoftmaxKernels<Dtype> &GetSoftmaxKernels() {
+  static const SoftmaxKernels<Dtype> &table =
+      GetSoftmaxKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const SoftmaxKernels<float32> &GetSoftmaxKernels<float32>(
+    CPUCapability capability);
+template const SoftmaxKernels<float32> &GetSoftmaxKernels<float32>();
+template const SoftmaxKernels<float64> &GetSoftmaxKernels<float64>(
+    CPUCapability capability);
+template const SoftmaxKernels<float64> &GetSoftmaxKernels<float64>();
+
+template<typename Dtype>
+const WinogradKernels<Dtype> &GetWinogradKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, WinogradKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const WinogradKernels<Dtype> &GetWinogradKernels() {
+  static const WinogradKernels<Dtype> &table =
+      GetWinogradKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const WinogradKernels<float32> &GetWinogradKernels<float32>(
+    CPUCapability capability);
+template const WinogradKernels<float32> &GetWinogradKernels<float32>();
+template const WinogradKernels<float64> &GetWinogradKernels<float64>(
+    CPUCapability capability);
+template const WinogradKernels<float64> &GetWinogradKernels<float64>();
+
+template<typename Dtype>
+const GroupedConvKernels<Dtype> &GetGroupedConvKernels(
+    CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, GroupedConvKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const GroupedConvKernels<Dtype> &GetGroupedConvKernels() {
+  static const GroupedConvKernels<Dtype> &table =
+      GetGroupedConvKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const GroupedConvKernels<float32> &GetGroupedConvKernels<float32>(
+    CPUCapability capability);
+template const GroupedConvKernels<float32> &GetGroupedConvKernels<float32>();
+template const GroupedConvKernels<float64> &GetGroupedConvKernels<float64>(
+    CPUCapability capability);
+template const GroupedConvKernels<float64> &GetGroupedConvKernels<float64>();
+
+template<typename Dtype>
+const PoolKernels<Dtype> &GetPoolKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, PoolKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const PoolKernels<Dtype> &GetPoolKernels() {
+  static const PoolKernels<Dtype> &table =
+      GetPoolKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const PoolKernels<float32> &GetPoolKernels<float32>(
+    CPUCapability capability);
+template const PoolKernels<float32> &GetPoolKernels<float32>();
+template const PoolKernels<float64> &GetPoolKernels<float64>(
+    CPUCapability capability);
+template const PoolKernels<float64> &GetPoolKernels<float64>();
+
+template<typename Dtype>
+const GemmKernels<Dtype> &GetGemmKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, GemmKernelTable<Dtype>);
+}
+
+template<typename Dtype>
+const GemmKernels<Dtype> &GetGemmKernels() {
+  static const GemmKernels<Dtype> &table =
+      GetGemmKernels<Dtype>(GetCPUCapability());
+  return table;
+}
+
+template const GemmKernels<float32> &GetGemmKernels<float32>(
+    CPUCapability capability);
+template const GemmKernels<float32> &GetGemmKernels<float32>();
+template const GemmKernels<float64> &GetGemmKernels<float64>(
+    CPUCapability capability);
+template const GemmKernels<float64> &GetGemmKernels<float64>();
+template const GemmKernels<float128> &GetGemmKernels<float128>(
+    CPUCapability capability);
+template const GemmKernels<float128> &GetGemmKernels<float128>();
+
+const TransposeKernels &GetTransposeKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, TransposeKernelTable);
+}
+
+const TransposeKernels &GetTransposeKernels() {
+  static const TransposeKernels &table =
+      GetTransposeKernels(GetCPUCapability());
+  return table;
+}
+
+const QuantizedGemmKernels &GetQuantizedGemmKernels(
+    CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, QuantizedGemmKernelTable);
+}
+
+const QuantizedGemmKernels &GetQuantizedGemmKernels() {
+  static const QuantizedGemmKernels &table =
+      GetQuantizedGemmKernels(GetCPUCapability());
+  return table;
+}
+
+const Int4GemmKernels &GetInt4GemmKernels(CPUCapability capability) {
+  CHIME_RETURN_KERNEL_TABLE(capability, Int4GemmKernelTable);
+}
+
+const Int4GemmKernels &GetInt4GemmKernels() {
+  static const Int4GemmKernels &table =
+      GetInt4GemmKernels(GetCPUCapability());
+  return table;
+}
+
+#undef CHIME_RETURN_KERNEL_TABLE
+#undef CHIME_DISPATCHED_KERNEL_TABLE_CASES
+
+}  // namespace kernels
+}  // namespace chime
@@ -0,0 +1,559 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_MATH_KERNELS_H_
+#define CHIME_CORE_FRAMEWORK_MATH_KERNELS_H_
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/cpu_dispatch.h"
+
+/// Kernels are compiled once per `CPUCapability` only on x86, elsewhere the
+/// default build is the only one.
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIME_CPU_DISPATCH 1
+#else
+#define CHIME_CPU_DISPATCH 0
+#endif
+
+namespace chime {
+namespace kernels {
+
+/// Function-pointer table of the vectorized elementwise kernels for one dtype
+/// and one instruction set. `chime_cpu_*` routines look up the table that
+/// matches `GetCPUCapability()` and call through it, so a single binary runs
+/// the widest kernels the host supports.
+template<typename Dtype>
+struct ElementwiseKernels {
+  typedef void (*BinaryFn)(utens_t n, const Dtype *a, const Dtype *b,
+                           Dtype *y);
+  typedef void (*UnaryFn)(utens_t n, const Dtype *x, Dtype *y);
+  typedef void (*ScalFn)(utens_t n, Dtype alpha, const Dtype *x, Dtype *y);
+
+  BinaryFn add;
+  BinaryFn sub;
+  BinaryFn mul;
+  BinaryFn div;
+  UnaryFn sign;
+  ScalFn scal;
+};
+
+/// Elementwise kernels with one operand broadcast to every element: the
+/// `*_rhs` kernels compute y[i] = a[i] op b and the `*_lhs` ones
+/// y[i] = a op b[i]. Compiled for the types of `ElementwiseKernels` but the
+/// 16-bit floating point ones.
+template<typename Dtype>
+struct BroadcastKernels {
+  typedef void (*RhsFn)(utens_t n, const Dtype *a, Dtype b, Dtype *y);
+  typedef void (*LhsFn)(utens_t n, Dtype a, const Dtype *b, Dtype *y);
+
+  RhsFn add_rhs;
+  RhsFn sub_rhs;
+  RhsFn mul_rhs;
+  RhsFn div_rhs;
+  LhsFn add_lhs;
+  LhsFn sub_lhs;
+  LhsFn mul_lhs;
+  LhsFn div_lhs;
+};
+
+/// Kernels over the 16-bit floating point types float16 and bfloat16, see
+/// float16.h. Elements are widened to float32 lanes as they are loaded, and
+/// float32 results are rounded to nearest even as they are stored. float16
+/// uses the conversion instructions of AVX-512 and F16C, found in every AVX2
+/// CPU; bfloat16 only needs integer shifts. `ElementwiseKernels` exist for
+/// both types as well, computing each element in float32.
+///
+/// `dot` returns the float32 sum of x[i] * y[i] and `axpy` adds alpha * x[i]
+/// to y[i], with x in 16-bit storage and everything else float32. They are
+/// the row and column forms of a matrix-vector product whose matrix stays in
+/// 16-bit storage.
+template<typename Htype>
+struct HalfKernels {
+  typedef void (*ToFloatFn)(utens_t n, const Htype *x, float32 *y);
+  typedef void (*FromFloatFn)(utens_t n, const float32 *x, Htype *y);
+  typedef float32 (*DotFn)(utens_t n, const Htype *x, const float32 *y);
+  typedef void (*AxpyFn)(utens_t n, float32 alpha, const Htype *x,
+                         float32 *y);
+
+  ToFloatFn to_float;
+  FromFloatFn from_float;
+  DotFn dot;
+  AxpyFn axpy;
+};
+
+/// Vectorized transcendental functions, only compiled for float32 and
+/// float64. See simd_math.h for the algorithms and math_functions.hpp for the
+/// accuracy of each routine.
+template<typename Dtype>
+struct TranscendentalKernels {
+  typedef void (*UnaryFn)(utens_t n, const Dtype *x, Dtype *y);
+
+  UnaryFn exp;
+  UnaryFn log;
+  UnaryFn tanh;
+  UnaryFn sigmoid;
+  UnaryFn erf;
+  UnaryFn gelu;
+  UnaryFn softplus;
+};
+
+/// Masks pack one bit per element into 32-bit words: element i is bit
+/// i % kMaskWordBits of word i / kMaskWordBits, and the bits past the last
+/// element are 0.
+constexpr utens_t kMaskWordBits = 32;
+
+/// Counter-based random numbers, compiled for float32 and float64. `bits`
+/// writes words [offset, offset + n) of the Philox stream of `seed`, see
+/// `PhiloxWord` in philox.h. Element i of `uniform` is made of the word at
+/// offset + i for float32, of the two at offset + 2 i and offset + 2 i + 1
+/// for float64, widened to a uniform number in [0, 1) with the 23 or 52 bits
+/// of a mantissa.
+///
+/// `gaussian` uses the Box-Muller transform over blocks of 32 elements: the
+/// first 16 uniforms of a block make the radii, the next 16 the angles, and
+/// radius t times the cosine and the sine of angle t give elements t and
+/// t + 16. Blocks start at element 0 of every call, so calls should start on a
+/// multiple of 32 to continue each other. Angles take two random signs from
+/// the top bits of their words and the next 23 or 52 bits for a quarter turn,
+/// whose sine and cosine are polynomials. float32 samples lie within about
+/// 5.65 standard deviations of the mean.
+///
+/// `dropout` keeps element i when the word at offset + i is below
+/// `threshold`, setting y[i] = x[i] * scale and bit i of the packed `mask`,
+/// and sets y[i] = 0 otherwise; a threshold of 2^32 or more keeps everything.
+/// `masked_scale` applies such a mask again, e.g. to the gradient. See
+/// `kMaskWordBits` for the layout of masks, y may alias x in both.
+///
+/// Each element depends on `seed`, `offset` and its index only. `bits` is the
+/// same on every instruction set, as are uniform numbers in [0, 1), masks and
+/// masked products, and the rest may differ in the last bits where
+/// multiply-adds are fused.
+template<typename Dtype>
+struct RandomKernels {
+  typedef void (*BitsFn)(utens_t n, uint64 seed, uint64 offset, uint32 *y);
+  typedef void (*UniformFn)(utens_t n, uint64 seed, uint64 offset, Dtype a,
+                            Dtype b, Dtype *y);
+  typedef void (*GaussianFn)(utens_t n, uint64 seed, uint64 offset, Dtype mu,
+                             Dtype sigma, Dtype *y);
+  typedef void (*DropoutFn)(utens_t n, uint64 seed, uint64 offset,
+                            uint64 threshold, Dtype scale, const Dtype *x,
+                            Dtype *y, uint32 *mask);
+  typedef void (*MaskedScaleFn)(utens_t n, const uint32 *mask, Dtype scale,
+                                const Dtype *x, Dtype *y);
+
+  BitsFn bits;
+  UniformFn uniform;
+  GaussianFn gaussian;
+  DropoutFn dropout;
+  MaskedScaleFn masked_scale;
+};
+
+/// Inner loops of the axis reductions of reduction.h, only compiled for
+/// float32 and float64. The row forms reduce n contiguous elements to one:
+/// `sum` adds x[i] and `sum_sq_dev` adds (x[i] - mean)^2, both pairwise, and
+/// `max` and `min` require n > 0. The column forms fold n contiguous elements
+/// into as many accumulators: acc[i] += x[i], acc[i] += (x[i] - mean[i])^2,
+/// or acc[i] = max(acc[i], x[i]) and the same for the minimum.
+template<typename Dtype>
+struct ReduceKernels {
+  typedef Dtype (*RowFn)(utens_t n, const Dtype *x);
+  typedef Dtype (*RowDevFn)(utens_t n, const Dtype *x, Dtype mean);
+  typedef void (*ColFn)(utens_t n, const Dtype *x, Dtype *acc);
+  typedef void (*ColDevFn)(utens_t n, const Dtype *x, const Dtype *mean,
+                           Dtype *acc);
+
+  RowFn sum;
+  RowDevFn sum_sq_dev;
+  RowFn max;
+  RowFn min;
+  ColFn add_col;
+  ColDevFn sq_dev_col;
+  ColFn max_col;
+  ColFn min_col;
+};
+
+/// Fused softmax and log-softmax kernels of softmax.h, only compiled for
+/// float32 and float64. The row forms normalize n contiguous elements, the
+/// column forms normalize each of `width` contiguous columns over n rows
+/// `stride` elements apart. Both read x twice: the first pass keeps a running
+/// maximum and rescales the running sum of exp(x - maximum) whenever the
+/// maximum grows, the second writes y, which may alias x.
+///
+/// `cross_entropy` returns the cross-entropy between softmax(x) and the
+/// target (1 - smoothing) * onehot(label) + smoothing / n, and writes its
+/// gradient softmax(x) - target to dx unless dx is null, from the same two
+/// passes.
+/// REQUIRES: label < n
+template<typename Dtype>
+struct SoftmaxKernels {
+  typedef void (*RowFn)(utens_t n, const Dtype *x, Dtype *y);
+  typedef void (*ColFn)(utens_t n, utens_t width, utens_t stride,
+                        const Dtype *x, Dtype *y);
+  typedef Dtype (*CrossEntropyFn)(utens_t n, const Dtype *x, utens_t label,
+                                  Dtype smoothing, Dtype *dx);
+
+  RowFn softmax;
+  RowFn log_softmax;
+  ColFn softmax_col;
+  ColFn log_softmax_col;
+  CrossEntropyFn cross_entropy;
+};
+
+/// Tile transforms of the Winograd convolution of winograd.h, only compiled
+/// for float32 and float64, vectorized over n channels. Index 0 is
+/// F(2x2, 3x3), 1 is F(4x4, 3x3), alpha is 4 or 6.
+///
+/// `filter` reads the 3 x 3 filters g, tap (i, j) being the n channels at
+/// g + (i * 3 + j) * g_stride, and writes point (i, j) of G g G^T to
+/// u + (i * alpha + j) * u_stride.
+/// `input` reads the alpha x alpha input tile d, pixel (i, j) being the n
+/// channels at d + i * row_stride + j * col_stride, and writes point
+/// (i, j) of B^T d B to v + (i * alpha + j) * v_stride. `output` reads
+/// the alpha x alpha tile of products from m likewise, `m_stride` apart,
+/// and writes the m x m outputs A^T m A, plus `bias` unless it is null, to y
+/// at the given strides.
+template<typename Dtype>
+struct WinogradKernels {
+  typedef void (*FilterFn)(utens_t n, const Dtype *g, utens_t g_stride,
+                           Dtype *u, utens_t u_stride);
+  typedef void (*InputFn)(utens_t n, const Dtype *d, utens_t row_stride,
+                          utens_t col_stride, Dtype *v, utens_t v_stride);
+  typedef void (*OutputFn)(utens_t n, const Dtype *m, utens_t m_stride,
+                           const Dtype *bias, Dtype *y, utens_t row_stride,
+                           utens_t col_stride);
+
+  FilterFn filter[2];
+  InputFn input[2];
+  OutputFn output[2];
+};
+
+/// Direct kernels of grouped and depthwise convolutions (see conv.h), only
+/// compiled for float32 and float64, for one NHWC pixel at a time. Each gets
+/// the `taps` kernel taps that fall inside the image as lists of pointers,
+/// x[t] to the input channels a tap reads and w[t] to its filter, and is
+/// vectorized over the channels:
+///
+///   depthwise:        y[c] = bias[c] + sum_t x[t][c] * w[t][c], c < n
+///   group:            y[o] = bias[o] + sum_t sum_c x[t][c] *
+///                            w[t][c * w_stride + o], o < n, c < k
+///   depthwise_filter: dw[t][c] += x[t][c] * dy[c], c < n
+///   group_filter:     dw[t][c * w_stride + o] += x[t][c] * dy[o], o < n,
+///                     c < k
+///
+/// `bias` may be null. The forward kernels serve the data gradient too, with
+/// dy as x and the filter transposed.
+template<typename Dtype>
+struct GroupedConvKernels {
+  typedef void (*DepthwiseFn)(utens_t n, utens_t taps, const Dtype *const *x,
+                              const Dtype *const *w, const Dtype *bias,
+                              Dtype *y);
+  typedef void (*GroupFn)(utens_t n, utens_t k, utens_t taps,
+                          const Dtype *const *x, const Dtype *const *w,
+                          utens_t w_stride, const Dtype *bias, Dtype *y);
+  typedef void (*DepthwiseFilterFn)(utens_t n, utens_t taps,
+                                    const Dtype *const *x, const Dtype *dy,
+                                    Dtype *const *dw);
+  typedef void (*GroupFilterFn)(utens_t n, utens_t k, utens_t taps,
+                                const Dtype *const *x, const Dtype *dy,
+                                Dtype *const *dw, utens_t w_stride);
+
+  DepthwiseFn depthwise;
+  GroupFn group;
+  DepthwiseFilterFn depthwise_filter;
+  GroupFilterFn group_filter;
+};
+
+/// Pooling kernels of pool.h, only compiled for float32 and float64, for
+/// `n` independent lanes at a time: the channels of an NHWC pixel, or
+/// neighbouring outputs of a NCHW row with unit stride. Each gets the `taps`
+/// window positions that fall inside the image as pointers to their lanes:
+///
+///   max:              y[i] = max_t x[t][i], and tap[i] the first t holding
+///                     it, as a Dtype, unless `tap` is null
+///   average:          y[i] = scale * sum_t x[t][i]
+///   average_backward: dx[t][i] += scale * dy[i]
+///
+/// REQUIRES: taps > 0 for `max`. NaN is not handled. The lanes of dx[t] may
+/// overlap those of other taps: taps are accumulated in order.
+template<typename Dtype>
+struct PoolKernels {
+  typedef void (*MaxFn)(utens_t n, utens_t taps, const Dtype *const *x,
+                        Dtype *y, Dtype *tap);
+  typedef void (*AverageFn)(utens_t n, utens_t taps, const Dtype *const *x,
+                            Dtype scale, Dtype *y);
+  typedef void (*AverageBackwardFn)(utens_t n, utens_t taps, const Dtype *dy,
+                                    Dtype scale, Dtype *const *dx);
+
+  MaxFn max;
+  AverageFn average;
+  AverageBackwardFn average_backward;
+};
+
+/// Transpose kernels of transpose.h. Elements are moved as raw bits, so that
+/// one kernel serves every type of the same size: `tile[w]` handles elements
+/// of 2^w bytes, from 1 to 16. It writes the transpose of the `rows` x `cols`
+/// matrix at `x`, with `ldx` elements between rows, to the `cols` x `rows`
+/// matrix at `y`, with `ldy` elements between rows. Square blocks of elements
+/// of up to 8 bytes are transposed with register shuffles, the edges that do
+/// not fill one are copied element by element. Callers keep the tile small
+/// enough for both matrices to stay in cache.
+struct TransposeKernels {
+  typedef void (*TileFn)(utens_t rows, utens_t cols, const void *x,
+                         utens_t ldx, void *y, utens_t ldy);
+
+  TileFn tile[5];
+};
+
+/// Sizes that each of M, N and K can take in the fully unrolled GEMM kernels
+/// of `GemmKernels::fixed`.
+constexpr int kNumFixedGemmSizes = 4;
+constexpr int kNumFixedGemmShapes =
+    kNumFixedGemmSizes * kNumFixedGemmSizes * kNumFixedGemmSizes;
+
+/// Position of `size` among 4, 8, 16 and 32, or -1.
+constexpr int FixedGemmSizeIndex(utens_t size) {
+  return size == 4 ? 0 : size == 8 ? 1 : size == 16 ? 2 : size == 32 ? 3 : -1;
+}
+
+/// Index into `GemmKernels::fixed` of the m x n x k kernel, or -1 if there is
+/// none for that shape.
+constexpr int FixedGemmShapeIndex(utens_t m, utens_t n, utens_t k) {
+  return FixedGemmSizeIndex(m) < 0 || FixedGemmSizeIndex(n) < 0 ||
+                 FixedGemmSizeIndex(k) < 0
+             ? -1
+             : (FixedGemmSizeIndex(m) * kNumFixedGemmSizes +
+                FixedGemmSizeIndex(n)) * kNumFixedGemmSizes +
+                   FixedGemmSizeIndex(k);
+}
+
+/// Register-tiled GEMM microkernel, compiled for float32, float64 and, with
+/// scalar registers, float128.
+/// `micro_kernel` multiplies an `mr` x k panel of A by a k x `nr` panel of B,
+/// both packed: the p-th column of the A panel is `a[p * mr .. p * mr + mr)`
+/// and the p-th row of the B panel is `b[p * nr .. p * nr + nr)`, padded with
+/// zeros past the edges of the matrices. It then stores
+/// `alpha * A * B + beta * C` to the top-left `m` x `n` corner of the tile at
+/// `c`, without reading `c` when beta is zero. `row_kernel` does the same for
+/// a single row, with an A panel of one element per column, and avoids
+/// computing `mr - 1` rows of padding for matrix-vector shaped products.
+///
+/// `fixed` holds whole products of small matrices whose shape is known at
+/// compile time, indexed by `FixedGemmShapeIndex(m, n, k)`. They compute
+/// C = alpha * op(A) * op(B) + beta * C straight from the row-major operands,
+/// without packing, and do not read C when beta is zero.
+template<typename Dtype>
+struct GemmKernels {
+  typedef void (*MicroKernelFn)(utens_t k, Dtype alpha, const Dtype *a,
+                                const Dtype *b, Dtype beta, Dtype *c,
+                                utens_t ldc, utens_t m, utens_t n);
+  typedef void (*FixedGemmFn)(bool trans_a, bool trans_b, Dtype alpha,
+                              const Dtype *A, utens_t lda, const Dtype *B,
+                              utens_t ldb, Dtype beta, Dtype *C, utens_t ldc);
+
+  int mr;
+  int nr;
+  MicroKernelFn micro_kernel;
+  MicroKernelFn row_kernel;
+  FixedGemmFn fixed[kNumFixedGemmShapes];
+};
+
+/// Int8 GEMM microkernel, summing products of uint8 and int8 in int32. Panels
+/// store k in groups of four consecutive elements: the four bytes of row i of
+/// the A panel for group q are at `a + (q * mr + i) * 4`, those of column j of
+/// the B panel at `b + (q * nr + j) * 4`, both padded with zeros past the
+/// edges of the matrices. `micro_kernel` multiplies an `mr` x 4 * k4 panel of
+/// A by a 4 * k4 x `nr` panel of B and stores the result to, or adds it to
+/// when `accumulate` is set, the top-left `m` x `n` corner of the tile at `c`.
+/// AVX512_VNNI does four products per lane and instruction, the other
+/// instruction sets widen to int32 first.
+struct QuantizedGemmKernels {
+  typedef void (*MicroKernelFn)(utens_t k4, const uint8 *a, const int8 *b,
+                                bool accumulate, int32 *c, utens_t ldc,
+                                utens_t m, utens_t n);
+
+  int mr;
+  int nr;
+  MicroKernelFn micro_kernel;
+};
+
+/// Number of elements of a block of int4 weights, see `Int4GemmKernels`.
+constexpr utens_t kInt4BlockSize = 32;
+
+/// Int4 weight-only GEMM kernel, float32 activations times 4-bit weights.
+/// Each column of B is stored on its own, `ldb` bytes apart, in blocks of
+/// `kInt4BlockSize` elements: byte t of a block holds element t in its low
+/// nibble and element t + 16 in its high one, as q + 8 for q in [-8, 7].
+/// Every `group_blocks` consecutive blocks make a group g, whose scale is
+/// `scales[g]` for column 0, `scales[lds + g]` for column 1 and so on.
+///
+/// `micro_kernel` computes an `mr` x `nr` tile of A * B over k, with A
+/// row-major with `lda` elements between rows, and stores it to, or adds it
+/// to when `accumulate` is set, the top-left `m` x `n` corner of the tile at
+/// `c`. Weights are turned into float32 in registers, so that they stream from
+/// memory at 4 bits each, and then go through one multiply-add per row of the
+/// tile. k may end in the middle of a block, the rest of it is ignored.
+/// `row_kernel` does the same for a single row of A.
+struct Int4GemmKernels {
+  typedef void (*MicroKernelFn)(utens_t k, const float32 *a, utens_t lda,
+                                const uint8 *b, utens_t ldb,
+                                const float32 *scales, utens_t lds,
+                                utens_t group_blocks, bool accumulate,
+                                float32 *c, utens_t ldc, utens_t m,
+                                utens_t n);
+
+  int mr;
+  int nr;
+  MicroKernelFn micro_kernel;
+  MicroKernelFn row_kernel;
+};
+
+/// Returns the table compiled for `capability`.
+/// REQUIRES: `capability` is supported by the host, i.e. it is not greater
+/// than `DetectCPUCapability()`.
+template<typename Dtype>
+const ElementwiseKernels<Dtype> &GetElementwiseKernels(
+    CPUCapability capability);
+
+/// Returns the table for the process-wide `GetCPUCapability()`. The lookup is
+/// resolved once per dtype.
+template<typename Dtype>
+const ElementwiseKernels<Dtype> &GetElementwiseKernels();
+
+/// Same as `GetElementwiseKernels`, for every type but float16 and bfloat16.
+template<typename Dtype>
+const BroadcastKernels<Dtype> &GetBroadcastKernels(CPUCapability capability);
+
+template<typename Dtype>
+const BroadcastKernels<Dtype> &GetBroadcastKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64 only.
+template<typename Dtype>
+const TranscendentalKernels<Dtype> &GetTranscendentalKernels(
+    CPUCapability capability);
+
+template<typename Dtype>
+const TranscendentalKernels<Dtype> &GetTranscendentalKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const RandomKernels<Dtype> &GetRandomKernels(CPUCapability capability);
+
+template<typename Dtype>
+const RandomKernels<Dtype> &GetRandomKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const ReduceKernels<Dtype> &GetReduceKernels(CPUCapability capability);
+
+template<typename Dtype>
+const ReduceKernels<Dtype> &GetReduceKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const SoftmaxKernels<Dtype> &GetSoftmaxKernels(CPUCapability capability);
+
+template<typename Dtype>
+const SoftmaxKernels<Dtype> &GetSoftmaxKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const WinogradKernels<Dtype> &GetWinogradKernels(CPUCapability capability);
+
+template<typename Dtype>
+const WinogradKernels<Dtype> &GetWinogradKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const GroupedConvKernels<Dtype> &GetGroupedConvKernels(
+    CPUCapability capability);
+
+template<typename Dtype>
+const GroupedConvKernels<Dtype> &GetGroupedConvKernels();
+
+/// Same as `GetElementwiseKernels`, for float32 and float64.
+template<typename Dtype>
+const PoolKernels<Dtype> &GetPoolKernels(CPUCapability capability);
+
+template<typename Dtype>
+const PoolKernels<Dtype> &GetPoolKernels();
+
+/// Same as `GetElementwiseKernels`, for float32, float64 and float128.
+template<typename Dtype>
+const GemmKernels<Dtype> &GetGemmKernels(CPUCapability capability);
+
+template<typename Dtype>
+const GemmKernels<Dtype> &GetGemmKernels();
+
+/// Same as `GetElementwiseKernels`, for float16 and bfloat16.
+template<typename Htype>
+const HalfKernels<Htype> &GetHalfKernels(CPUCapability capability);
+
+template<typename Htype>
+const HalfKernels<Htype> &GetHalfKernels();
+
+/// Same as `GetElementwiseKernels`.
+const TransposeKernels &GetTransposeKernels(CPUCapability capability);
+
+const TransposeKernels &GetTransposeKernels();
+
+/// Same as `GetElementwiseKernels`.
+const QuantizedGemmKernels &GetQuantizedGemmKernels(CPUCapability capability);
+
+const QuantizedGemmKernels &GetQuantizedGemmKernels();
+
+/// Same as `GetElementwiseKernels`.
+const Int4GemmKernels &GetInt4GemmKernels(CPUCapability capability);
+
+const Int4GemmKernels &GetInt4GemmKernels();
+
+/// Every capability has its own namespace so that the per-ISA translation
+/// units, which share the kernel sources in `math_kernels_impl.h`, never
+/// define the same symbol twice. The elementwise tables of the 16-bit types
+/// are specializations, built from the kernels of `HalfKernelTable`.
+#define CHIME_DECLARE_KERNEL_TABLES(capability_namespace)         \
+  namespace capability_namespace {                                \
+  template<typename Dtype>                                        \
+  const ElementwiseKernels<Dtype> &ElementwiseKernelTable();       \
+  template<>                                                      \
+  const ElementwiseKernels<float16> &ElementwiseKernelTable();     \
+  template<>                                                      \
+  const ElementwiseKernels<bfloat16> &ElementwiseKernelTable();    \
+  template<typename Dtype>                                        \
+  const BroadcastKernels<Dtype> &BroadcastKernelTable();           \
+  template<typename Htype>                                        \
+  const HalfKernels<Htype> &HalfKernelTable();                     \
+  template<typename Dtype>                                        \
+  const TranscendentalKernels<Dtype> &TranscendentalKernelTable(); \
+  template<typename Dtype>                                        \
+  const RandomKernels<Dtype> &RandomKernelTable();                 \
+  template<typename Dtype>                                        \
+  const ReduceKernels<Dtype> &ReduceKernelTable();                 \
+  template<typename Dtype>                                        \
+  const SoftmaxKernels<Dtype> &SoftmaxKernelTable();               \
+  template<typename Dtype>                                        \
+  const WinogradKernels<Dtype> &WinogradKernelTable();             \
+  template<typename Dtype>                                        \
+  const GroupedConvKernels<Dtype> &GroupedConvKernelTable();       \
+  template<typename Dtype>                                        \
+  const PoolKernels<Dtype> &PoolKernelTable();                     \
+  template<typename Dtype>                                        \
+  const GemmKernels<Dtype> &GemmKernelTable();                     \
+  const TransposeKernels &TransposeKernelTable();                  \
+  const QuantizedGemmKernels &QuantizedGemmKernelTable();          \
+  const Int4GemmKernels &Int4GemmKernelTable();                    \
+  }
+
+CHIME_DECLARE_KERNEL_TABLES(cpu_default)
+#if CHIME_CPU_DISPATCH
+CHIME_DECLARE_KERNEL_TABLES(cpu_sse4_2)
+CHIME_DECLARE_KERNEL_TABLES(cpu_avx2)
+CHIME_DECLARE_KERNEL_TABLES(cpu_avx512)
+CHIME_DECLARE_KERNEL_TABLES(cpu_avx512_vnni)
+#endif  // CHIME_CPU_DISPATCH
+
+#undef CHIME_DECLARE_KERNEL_TABLES
+
+}  // namespace kernels
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_MATH_KERNELS_H_
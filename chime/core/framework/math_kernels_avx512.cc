@@ -0,0 +1,6 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+// Must be compiled with `-mavx512f -mavx512dq -mavx512bw -mavx512vl`.
+#define CHIME_CPU_CAPABILITY cpu_avx512
+#include "chime/core/framework/math_kernels_impl.h"
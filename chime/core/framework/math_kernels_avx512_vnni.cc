@@ -0,0 +1,7 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+// Must be compiled with
+// `-mavx512f -mavx512dq -mavx512bw -mavx512vl -mavx512vnni`.
+#define CHIME_CPU_CAPABILITY cpu_avx512_vnni
+#include "chime/core/framework/math_kernels_impl.h"
@@ -0,0 +1,7 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+// Kernels built with the baseline flags of the build. Always linked, it is the
+// fallback on hosts (and architectures) without any of the wider ISAs.
+#define CHIME_CPU_CAPABILITY cpu_default
+#include "chime/core/framework/math_kernels_impl.h"
@@ -0,0 +1,2619 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+// Sources of the vectorized kernels behind `chime_cpu_*`. This header is not
+// meant to be included anywhere but the `math_kernels_<capability>.cc` files:
+// each of them defines `CHIME_CPU_CAPABILITY`, is compiled with the matching
+// `-m` flags and so instantiates everything below once per instruction set.
+
+#ifndef CHIME_CORE_FRAMEWORK_MATH_KERNELS_IMPL_H_
+#define CHIME_CORE_FRAMEWORK_MATH_KERNELS_IMPL_H_
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/philox.h"
+#include "chime/core/framework/simd.h"
+#include "chime/core/framework/simd_math.h"
+
+namespace chime {
+namespace kernels {
+namespace CHIME_CPU_CAPABILITY {
+
+namespace {
+
+// Functors for the elementwise kernels. `Packet` works on a full SIMD register
+// and `Scalar` handles the tail that does not fill one.
+template<typename Dtype>
+struct AddFunctor {
+  typedef simd::Vec<Dtype> V;
+  typename V::Reg Packet(typename V::Reg a, typename V::Reg b) const {
+    return V::Add(a, b);
+  }
+  Dtype Scalar(Dtype a, Dtype b) const { return static_cast<Dtype>(a + b); }
+};
+
+template<typename Dtype>
+struct SubFunctor {
+  typedef simd::Vec<Dtype> V;
+  typename V::Reg Packet(typename V::Reg a, typename V::Reg b) const {
+    return V::Sub(a, b);
+  }
+  Dtype Scalar(Dtype a, Dtype b) const { return static_cast<Dtype>(a - b); }
+};
+
+template<typename Dtype>
+struct MulFunctor {
+  typedef simd::Vec<Dtype> V;
+  typename V::Reg Packet(typename V::Reg a, typename V::Reg b) const {
+    return V::Mul(a, b);
+  }
+  Dtype Scalar(Dtype a, Dtype b) const { return static_cast<Dtype>(a * b); }
+};
+
+template<typename Dtype>
+struct DivFunctor {
+  typedef simd::Vec<Dtype> V;
+  typename V::Reg Packet(typename V::Reg a, typename V::Reg b) const {
+    return V::Div(a, b);
+  }
+  Dtype Scalar(Dtype a, Dtype b) const { return static_cast<Dtype>(a / b); }
+};
+
+template<typename Dtype>
+struct SignFunctor {
+  typedef simd::Vec<Dtype> V;
+  typename V::Reg Packet(typename V::Reg a) const { return V::Sign(a); }
+  Dtype Scalar(Dtype a) const {
+    return static_cast<Dtype>((Dtype(0) < a) - (a < Dtype(0)));
+  }
+};
+
+template<typename Dtype>
+struct ScalFunctor {
+  typedef simd::Vec<Dtype> V;
+  explicit ScalFunctor(Dtype alpha) : alpha(alpha), v_alpha(V::Set1(alpha)) {}
+  typename V::Reg Packet(typename V::Reg x) const {
+    return V::Mul(v_alpha, x);
+  }
+  Dtype Scalar(Dtype x) const { return static_cast<Dtype>(alpha * x); }
+
+  Dtype alpha;
+  typename V::Reg v_alpha;
+};
+
+template<typename Dtype, typename Functor>
+inline void unary_map(utens_t n, const Dtype *x, Dtype *y, const Functor &f) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) V::Store(y + i, f.Packet(V::Load(x + i)));
+  for (; i < n; i++) y[i] = f.Scalar(x[i]);
+}
+
+template<typename Dtype, typename Functor>
+inline void binary_map(utens_t n, const Dtype *a, const Dtype *b, Dtype *y,
+                       const Functor &f) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(y + i, f.Packet(V::Load(a + i), V::Load(b + i)));
+  }
+  for (; i < n; i++) y[i] = f.Scalar(a[i], b[i]);
+}
+
+template<typename Dtype, typename Functor>
+void binary_kernel(utens_t n, const Dtype *a, const Dtype *b, Dtype *y) {
+  binary_map(n, a, b, y, Functor());
+}
+
+// y[i] = f(a[i], b), the right operand broadcast.
+template<typename Dtype, typename Functor>
+void rhs_kernel(utens_t n, const Dtype *a, Dtype b, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  const Functor f;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const typename V::Reg vb = V::Set1(b);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(y + i, f.Packet(V::Load(a + i), vb));
+  }
+  for (; i < n; i++) y[i] = f.Scalar(a[i], b);
+}
+
+// y[i] = f(a, b[i]), the left operand broadcast.
+template<typename Dtype, typename Functor>
+void lhs_kernel(utens_t n, Dtype a, const Dtype *b, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  const Functor f;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const typename V::Reg va = V::Set1(a);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(y + i, f.Packet(va, V::Load(b + i)));
+  }
+  for (; i < n; i++) y[i] = f.Scalar(a, b[i]);
+}
+
+template<typename Dtype>
+void sign_kernel(utens_t n, const Dtype *x, Dtype *y) {
+  unary_map(n, x, y, SignFunctor<Dtype>());
+}
+
+template<typename Dtype>
+void scal_kernel(utens_t n, Dtype alpha, const Dtype *x, Dtype *y) {
+  unary_map(n, x, y, ScalFunctor<Dtype>(alpha));
+}
+
+#define CHIME_TRANSCENDENTAL_FUNCTOR(Name)                      \
+  template<typename Dtype>                                     \
+  struct Name##Functor {                                       \
+    typedef simd::Vec<Dtype> V;                                \
+    typename V::Reg Packet(typename V::Reg x) const {          \
+      return simd::Name<V>(x);                                 \
+    }                                                          \
+  }
+
+CHIME_TRANSCENDENTAL_FUNCTOR(Exp);
+CHIME_TRANSCENDENTAL_FUNCTOR(Log);
+CHIME_TRANSCENDENTAL_FUNCTOR(Tanh);
+CHIME_TRANSCENDENTAL_FUNCTOR(Sigmoid);
+CHIME_TRANSCENDENTAL_FUNCTOR(Erf);
+CHIME_TRANSCENDENTAL_FUNCTOR(Gelu);
+CHIME_TRANSCENDENTAL_FUNCTOR(Softplus);
+
+#undef CHIME_TRANSCENDENTAL_FUNCTOR
+
+// Like `unary_map`, but the tail goes through the vector path too, padded
+// into a full register. Functors with no scalar twin need this, and it keeps
+// the result of each element independent of its position in the array.
+template<typename Dtype, typename Functor>
+void padded_unary_kernel(utens_t n, const Dtype *x, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  Functor f;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) V::Store(y + i, f.Packet(V::Load(x + i)));
+  if (i < n) {
+    Dtype buf[V::kLanes] = {};
+    std::memcpy(buf, x + i, (n - i) * sizeof(Dtype));
+    V::Store(buf, f.Packet(V::Load(buf)));
+    std::memcpy(y + i, buf, (n - i) * sizeof(Dtype));
+  }
+}
+
+// Moves one register of float32 lanes in and out of 16-bit storage, see
+// `HalfKernels`. `ToFloat` and `FromFloat` convert a single element the same
+// way, for the tails.
+template<typename Htype>
+struct HalfLanes;
+
+template<>
+struct HalfLanes<float16> {
+  typedef simd::Vec<float32> V;
+
+  static float32 ToFloat(uint16 h) { return Float16BitsToFloat32(h); }
+  static uint16 FromFloat(float32 x) { return Float32ToFloat16Bits(x); }
+
+#if CHIME_SIMD_BYTES == 64
+  static V::Reg Load(const uint16 *p) {
+    return _mm512_cvtph_ps(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+  }
+  static void Store(uint16 *p, V::Reg v) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(p),
+        _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+#elif CHIME_SIMD_BYTES == 32 && defined(__F16C__)
+  static V::Reg Load(const uint16 *p) {
+    return _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  }
+  static void Store(uint16 *p, V::Reg v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+#else
+  // No conversion instruction before F16C.
+  static V::Reg Load(const uint16 *p) {
+    float32 buf[V::kLanes];
+    for (int i = 0; i < V::kLanes; i++) buf[i] = ToFloat(p[i]);
+    return V::Load(buf);
+  }
+  static void Store(uint16 *p, V::Reg v) {
+    float32 buf[V::kLanes];
+    V::Store(buf, v);
+    for (int i = 0; i < V::kLanes; i++) p[i] = FromFloat(buf[i]);
+  }
+#endif  // CHIME_SIMD_BYTES
+};
+
+template<>
+struct HalfLanes<bfloat16> {
+  typedef simd::Vec<float32> V;
+
+  static float32 ToFloat(uint16 h) { return BFloat16BitsToFloat32(h); }
+  static uint16 FromFloat(float32 x) { return Float32ToBFloat16Bits(x); }
+
+#if CHIME_SIMD_BYTES > 0
+  // Float32ToBFloat16Bits on every lane, leaving the result in the low half
+  // of each 32-bit lane.
+  static V::Bits Round(V::Reg v) {
+    const V::Bits bits = V::AsBits(v);
+    const V::Bits high = V::BitsShr(bits, 16);
+    const V::Bits bias =
+        V::BitsAdd(V::SetBits(0x7FFF), V::BitsAnd(high, V::SetBits(1)));
+    const V::Bits rounded = V::BitsShr(V::BitsAdd(bits, bias), 16);
+    const V::Bits quiet = V::BitsOr(high, V::SetBits(0x40));
+    return V::AsBits(
+        V::Select(V::IsNan(v), V::FromBits(quiet), V::FromBits(rounded)));
+  }
+#endif  // CHIME_SIMD_BYTES > 0
+
+#if CHIME_SIMD_BYTES == 64
+  static V::Reg Load(const uint16 *p) {
+    const __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    return V::FromBits(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+  }
+  static void Store(uint16 *p, V::Reg v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p),
+                        _mm512_cvtepi32_epi16(Round(v)));
+  }
+#elif CHIME_SIMD_BYTES == 32
+  static V::Reg Load(const uint16 *p) {
+    const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return V::FromBits(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+  }
+  static void Store(uint16 *p, V::Reg v) {
+    // packus works within 128-bit lanes, the permute gathers the halves.
+    const __m256i r = Round(v);
+    const __m256i packed =
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                     _mm256_castsi256_si128(packed));
+  }
+#elif CHIME_SIMD_BYTES == 16
+  static V::Reg Load(const uint16 *p) {
+    const __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    return V::FromBits(_mm_unpacklo_epi16(_mm_setzero_si128(), h));
+  }
+  static void Store(uint16 *p, V::Reg v) {
+#if defined(__SSE4_1__)
+    const __m128i packed = _mm_packus_epi32(Round(v), Round(v));
+#else
+    // Sign-extends the low halves so that the signed pack keeps them as is.
+    const __m128i r = _mm_srai_epi32(_mm_slli_epi32(Round(v), 16), 16);
+    const __m128i packed = _mm_packs_epi32(r, r);
+#endif  // __SSE4_1__
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(p), packed);
+  }
+#else
+  static V::Reg Load(const uint16 *p) { return ToFloat(*p); }
+  static void Store(uint16 *p, V::Reg v) { *p = FromFloat(v); }
+#endif  // CHIME_SIMD_BYTES
+};
+
+template<typename Htype>
+void half_to_float_kernel(utens_t n, const Htype *x, float32 *y) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  const uint16 *src = reinterpret_cast<const uint16 *>(x);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) V::Store(y + i, H::Load(src + i));
+  for (; i < n; i++) y[i] = H::ToFloat(src[i]);
+}
+
+template<typename Htype>
+void float_to_half_kernel(utens_t n, const float32 *x, Htype *y) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  uint16 *dst = reinterpret_cast<uint16 *>(y);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) H::Store(dst + i, V::Load(x + i));
+  for (; i < n; i++) dst[i] = H::FromFloat(x[i]);
+}
+
+// Four accumulators hide the latency of the multiply-adds.
+template<typename Htype>
+float32 half_dot_kernel(utens_t n, const Htype *x, const float32 *y) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  const uint16 *src = reinterpret_cast<const uint16 *>(x);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  V::Reg acc[4] = {V::Set1(0.f), V::Set1(0.f), V::Set1(0.f), V::Set1(0.f)};
+  utens_t i = 0;
+  for (; i + 4 * lanes <= n; i += 4 * lanes) {
+#pragma GCC unroll 4
+    for (int u = 0; u < 4; u++) {
+      acc[u] = V::MulAdd(H::Load(src + i + u * lanes),
+                         V::Load(y + i + u * lanes), acc[u]);
+    }
+  }
+  for (; i + lanes <= n; i += lanes) {
+    acc[0] = V::MulAdd(H::Load(src + i), V::Load(y + i), acc[0]);
+  }
+  float32 buf[V::kLanes];
+  V::Store(buf, V::Add(V::Add(acc[0], acc[1]), V::Add(acc[2], acc[3])));
+  float32 sum = 0.f;
+  for (int l = 0; l < V::kLanes; l++) sum += buf[l];
+  for (; i < n; i++) sum += H::ToFloat(src[i]) * y[i];
+  return sum;
+}
+
+template<typename Htype>
+void half_axpy_kernel(utens_t n, float32 alpha, const Htype *x, float32 *y) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  const uint16 *src = reinterpret_cast<const uint16 *>(x);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const V::Reg v_alpha = V::Set1(alpha);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(y + i, V::MulAdd(v_alpha, H::Load(src + i), V::Load(y + i)));
+  }
+  for (; i < n; i++) y[i] += alpha * H::ToFloat(src[i]);
+}
+
+// The elementwise kernels of the 16-bit types run the float32 functors.
+template<typename Htype, typename Functor>
+void half_unary_map(utens_t n, const Htype *x, Htype *y, const Functor &f) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  const uint16 *src = reinterpret_cast<const uint16 *>(x);
+  uint16 *dst = reinterpret_cast<uint16 *>(y);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    H::Store(dst + i, f.Packet(H::Load(src + i)));
+  }
+  for (; i < n; i++) dst[i] = H::FromFloat(f.Scalar(H::ToFloat(src[i])));
+}
+
+template<typename Htype, typename Functor>
+void half_binary_kernel(utens_t n, const Htype *a, const Htype *b, Htype *y) {
+  typedef HalfLanes<Htype> H;
+  typedef simd::Vec<float32> V;
+  Functor f;
+  const uint16 *src_a = reinterpret_cast<const uint16 *>(a);
+  const uint16 *src_b = reinterpret_cast<const uint16 *>(b);
+  uint16 *dst = reinterpret_cast<uint16 *>(y);
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    H::Store(dst + i, f.Packet(H::Load(src_a + i), H::Load(src_b + i)));
+  }
+  for (; i < n; i++) {
+    dst[i] = H::FromFloat(
+        f.Scalar(H::ToFloat(src_a[i]), H::ToFloat(src_b[i])));
+  }
+}
+
+template<typename Htype>
+void half_sign_kernel(utens_t n, const Htype *x, Htype *y) {
+  half_unary_map(n, x, y, SignFunctor<float32>());
+}
+
+template<typename Htype>
+void half_scal_kernel(utens_t n, Htype alpha, const Htype *x, Htype *y) {
+  half_unary_map(n, x, y, ScalFunctor<float32>(static_cast<float32>(alpha)));
+}
+
+template<typename Htype>
+const ElementwiseKernels<Htype> &HalfElementwiseKernelTable() {
+  static const ElementwiseKernels<Htype> table = {
+      &half_binary_kernel<Htype, AddFunctor<float32>>,
+      &half_binary_kernel<Htype, SubFunctor<float32>>,
+      &half_binary_kernel<Htype, MulFunctor<float32>>,
+      &half_binary_kernel<Htype, DivFunctor<float32>>,
+      &half_sign_kernel<Htype>,
+      &half_scal_kernel<Htype>,
+  };
+  return table;
+}
+
+// Computes an MR x (NV * kLanes) tile of C in MR * NV accumulator registers,
+// see `GemmKernels`. Each step of the k loop loads NV vectors of B and
+// broadcasts MR elements of A, so the loop bodies are fully unrolled to keep
+// the accumulators in registers.
+template<typename Dtype, int MR, int NV>
+void gemm_micro_kernel(utens_t k, Dtype alpha, const Dtype *a, const Dtype *b,
+                       Dtype beta, Dtype *c, utens_t ldc, utens_t m,
+                       utens_t n) {
+  typedef simd::Vec<Dtype> V;
+  typedef typename V::Reg Reg;
+  constexpr int kLanes = V::kLanes;
+  constexpr int NR = NV * kLanes;
+
+  Reg acc[MR][NV];
+#pragma GCC unroll 32
+  for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) acc[i][j] = V::Set1(Dtype(0));
+  }
+
+  for (utens_t p = 0; p < k; p++, a += MR, b += NR) {
+    Reg bv[NV];
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) bv[j] = V::Load(b + j * kLanes);
+#pragma GCC unroll 32
+    for (int i = 0; i < MR; i++) {
+      const Reg av = V::Set1(a[i]);
+#pragma GCC unroll 4
+      for (int j = 0; j < NV; j++) acc[i][j] = V::MulAdd(av, bv[j], acc[i][j]);
+    }
+  }
+
+  const Reg v_alpha = V::Set1(alpha);
+  if (m == MR && n == NR) {
+    const Reg v_beta = V::Set1(beta);
+#pragma GCC unroll 32
+    for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+      for (int j = 0; j < NV; j++) {
+        Dtype *dst = c + i * ldc + j * kLanes;
+        Reg r = V::Mul(v_alpha, acc[i][j]);
+        if (beta != Dtype(0)) r = V::MulAdd(v_beta, V::Load(dst), r);
+        V::Store(dst, r);
+      }
+    }
+    return;
+  }
+
+  // Edge tile: goes through a buffer so that nothing outside of the m x n
+  // corner is touched.
+  Dtype buf[MR * NR];
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NV; j++) {
+      V::Store(buf + i * NR + j * kLanes, V::Mul(v_alpha, acc[i][j]));
+    }
+  }
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      const Dtype r = buf[i * NR + j];
+      c[i * ldc + j] = beta == Dtype(0) ? r : r + beta * c[i * ldc + j];
+    }
+  }
+}
+
+// Rows of C = alpha * A * B + beta * C for row-major M x K and K x N operands,
+// see `GemmKernels::fixed`. Every loop has a constant trip count, so that the
+// compiler unrolls them completely, and several rows of C are accumulated over
+// k side by side so that the multiply-adds do not wait on one another. This
+// one handles rows narrower than a vector register, holding each in a GCC
+// vector of exactly N elements (16 or 32 bytes).
+template<typename Dtype, int M, int N, int K,
+         bool kFullVectors = N % simd::Vec<Dtype>::kLanes == 0>
+struct GemmFixedRows {
+  static void Run(Dtype alpha, const Dtype *A, utens_t lda, const Dtype *B,
+                  utens_t ldb, Dtype beta, Dtype *C, utens_t ldc) {
+    typedef Dtype Row __attribute__((vector_size(N * sizeof(Dtype))));
+    constexpr int MB = M < 4 ? M : 4;
+
+    for (int i0 = 0; i0 < M; i0 += MB) {
+      Row acc[MB] = {};
+#pragma GCC unroll 32
+      for (int p = 0; p < K; p++) {
+        Row b;
+        std::memcpy(&b, B + p * ldb, sizeof(b));
+#pragma GCC unroll 4
+        for (int i = 0; i < MB; i++) acc[i] += A[(i0 + i) * lda + p] * b;
+      }
+#pragma GCC unroll 4
+      for (int i = 0; i < MB; i++) {
+        Dtype *dst = C + (i0 + i) * ldc;
+        Row r = alpha * acc[i];
+        if (beta != Dtype(0)) {
+          Row c;
+          std::memcpy(&c, dst, sizeof(c));
+          r += beta * c;
+        }
+        std::memcpy(dst, &r, sizeof(r));
+      }
+    }
+  }
+};
+
+// Rows made of whole vectors, in blocks of MB rows by NB vectors.
+template<typename Dtype, int M, int N, int K>
+struct GemmFixedRows<Dtype, M, N, K, true> {
+  static void Run(Dtype alpha, const Dtype *A, utens_t lda, const Dtype *B,
+                  utens_t ldb, Dtype beta, Dtype *C, utens_t ldc) {
+    typedef simd::Vec<Dtype> V;
+    typedef typename V::Reg Reg;
+    constexpr int kLanes = V::kLanes;
+    constexpr int NV = N / kLanes;
+    constexpr int NB = NV < 8 ? NV : 8;
+    constexpr int MB = 8 / NB < M ? 8 / NB : M;
+
+    const Reg v_alpha = V::Set1(alpha);
+    const Reg v_beta = V::Set1(beta);
+    for (int i0 = 0; i0 < M; i0 += MB) {
+#pragma GCC unroll 4
+      for (int j0 = 0; j0 < NV; j0 += NB) {
+        Reg acc[MB][NB];
+#pragma GCC unroll 8
+        for (int i = 0; i < MB; i++) {
+#pragma GCC unroll 8
+          for (int j = 0; j < NB; j++) acc[i][j] = V::Set1(Dtype(0));
+        }
+#pragma GCC unroll 32
+        for (int p = 0; p < K; p++) {
+          const Dtype *b = B + p * ldb + j0 * kLanes;
+          Reg bv[NB];
+#pragma GCC unroll 8
+          for (int j = 0; j < NB; j++) bv[j] = V::Load(b + j * kLanes);
+#pragma GCC unroll 8
+          for (int i = 0; i < MB; i++) {
+            const Reg av = V::Set1(A[(i0 + i) * lda + p]);
+#pragma GCC unroll 8
+            for (int j = 0; j < NB; j++) {
+              acc[i][j] = V::MulAdd(av, bv[j], acc[i][j]);
+            }
+          }
+        }
+#pragma GCC unroll 8
+        for (int i = 0; i < MB; i++) {
+#pragma GCC unroll 8
+          for (int j = 0; j < NB; j++) {
+            Dtype *dst = C + (i0 + i) * ldc + (j0 + j) * kLanes;
+            Reg r = V::Mul(v_alpha, acc[i][j]);
+            if (beta != Dtype(0)) r = V::MulAdd(v_beta, V::Load(dst), r);
+            V::Store(dst, r);
+          }
+        }
+      }
+    }
+  }
+};
+
+// Transposed operands are copied to row-major buffers first, which costs
+// little next to the M * N * K multiply-adds.
+template<typename Dtype, int M, int N, int K>
+void gemm_fixed_kernel(bool trans_a, bool trans_b, Dtype alpha,
+                       const Dtype *A, utens_t lda, const Dtype *B,
+                       utens_t ldb, Dtype beta, Dtype *C, utens_t ldc) {
+  Dtype a_buf[M * K];
+  Dtype b_buf[K * N];
+  if (trans_a) {
+    for (int i = 0; i < M; i++) {
+      for (int p = 0; p < K; p++) a_buf[i * K + p] = A[p * lda + i];
+    }
+    A = a_buf;
+    lda = K;
+  }
+  if (trans_b) {
+    for (int p = 0; p < K; p++) {
+      for (int j = 0; j < N; j++) b_buf[p * N + j] = B[j * ldb + p];
+    }
+    B = b_buf;
+    ldb = N;
+  }
+  GemmFixedRows<Dtype, M, N, K>::Run(alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+// Tile shapes leave room for the two vectors of B and the broadcast element of
+// A next to the accumulators: 24 of the 32 AVX-512 registers hold the tile,
+// 12 of the 16 AVX2 or SSE ones.
+#if CHIME_SIMD_BYTES == 64
+constexpr int kGemmMR = 12;
+#elif CHIME_SIMD_BYTES > 0
+constexpr int kGemmMR = 6;
+#else
+constexpr int kGemmMR = 4;
+#endif
+
+// Register tile of the GEMM microkernel, kMR rows by kNV vectors.
+template<typename Dtype>
+struct GemmTile {
+  static constexpr int kMR = kGemmMR;
+  static constexpr int kNV = 2;
+};
+
+// long double lives in the eight x87 registers.
+template<>
+struct GemmTile<float128> {
+  static constexpr int kMR = 2;
+  static constexpr int kNV = 2;
+};
+
+// Widening int8 arithmetic of `quantized_gemm_micro_kernel`. Bytes are
+// widened to int16 and pmaddwd adds up the products of each pair, so an `Acc`
+// holds two int32 partial sums for each of its kCols columns of B; the k loop
+// only adds them up at the end. Products of uint8 and int8 and sums of two of
+// them fit, unlike with the saturating pmaddubsw.
+#if CHIME_SIMD_BYTES == 64
+
+struct Int8Dot {
+  typedef __m512i Wide;
+  typedef __m512i Acc;
+  static constexpr int kCols = 8;
+
+  static Acc Zero() { return _mm512_setzero_si512(); }
+  static Wide LoadB(const int8 *b) {
+    return _mm512_cvtepi8_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b)));
+  }
+  static Wide BroadcastA(uint32 word) {
+    return _mm512_broadcastq_epi64(
+        _mm_cvtepu8_epi16(_mm_cvtsi32_si128(static_cast<int>(word))));
+  }
+  static Acc MulAdd(Wide a, Wide b, Acc acc) {
+    return _mm512_add_epi32(acc, _mm512_madd_epi16(a, b));
+  }
+  static void Store(int32 *p, Acc v) { _mm512_storeu_si512(p, v); }
+};
+
+#elif CHIME_SIMD_BYTES == 32
+
+struct Int8Dot {
+  typedef __m256i Wide;
+  typedef __m256i Acc;
+  static constexpr int kCols = 4;
+
+  static Acc Zero() { return _mm256_setzero_si256(); }
+  static Wide LoadB(const int8 *b) {
+    return _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b)));
+  }
+  static Wide BroadcastA(uint32 word) {
+    return _mm256_broadcastq_epi64(
+        _mm_cvtepu8_epi16(_mm_cvtsi32_si128(static_cast<int>(word))));
+  }
+  static Acc MulAdd(Wide a, Wide b, Acc acc) {
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(a, b));
+  }
+  static void Store(int32 *p, Acc v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+};
+
+#elif CHIME_SIMD_BYTES == 16
+
+struct Int8Dot {
+  typedef __m128i Wide;
+  typedef __m128i Acc;
+  static constexpr int kCols = 2;
+
+  static Acc Zero() { return _mm_setzero_si128(); }
+  static Wide LoadB(const int8 *b) {
+    const __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(b));
+#if defined(__SSE4_1__)
+    return _mm_cvtepi8_epi16(bytes);
+#else
+    return _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+#endif  // __SSE4_1__
+  }
+  static Wide BroadcastA(uint32 word) {
+    const __m128i bytes = _mm_cvtsi32_si128(static_cast<int>(word));
+    return _mm_shuffle_epi32(_mm_unpacklo_epi8(bytes, _mm_setzero_si128()),
+                             _MM_SHUFFLE(1, 0, 1, 0));
+  }
+  static Acc MulAdd(Wide a, Wide b, Acc acc) {
+    return _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+  }
+  static void Store(int32 *p, Acc v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+  }
+};
+
+#else
+
+struct Int8Dot {
+  struct Wide {
+    int32 v[4];
+  };
+  struct Acc {
+    int32 v[2];
+  };
+  static constexpr int kCols = 1;
+
+  static Acc Zero() { return Acc{{0, 0}}; }
+  static Wide LoadB(const int8 *b) { return Wide{{b[0], b[1], b[2], b[3]}}; }
+  static Wide BroadcastA(uint32 word) {
+    uint8 a[4];
+    std::memcpy(a, &word, sizeof(a));
+    return Wide{{a[0], a[1], a[2], a[3]}};
+  }
+  static Acc MulAdd(Wide a, Wide b, Acc acc) {
+    acc.v[0] += a.v[0] * b.v[0] + a.v[1] * b.v[1];
+    acc.v[1] += a.v[2] * b.v[2] + a.v[3] * b.v[3];
+    return acc;
+  }
+  static void Store(int32 *p, Acc v) { std::memcpy(p, v.v, sizeof(v.v)); }
+};
+
+#endif  // CHIME_SIMD_BYTES
+
+// Int8 microkernel for instruction sets without int8 dot products, see
+// `QuantizedGemmKernels` and `Int8Dot`.
+template<int MR, int NV>
+void quantized_gemm_micro_kernel(utens_t k4, const uint8 *a, const int8 *b,
+                                 bool accumulate, int32 *c, utens_t ldc,
+                                 utens_t m, utens_t n) {
+  typedef Int8Dot::Acc Acc;
+  typedef Int8Dot::Wide Wide;
+  constexpr int kCols = Int8Dot::kCols;
+  constexpr int NR = NV * kCols;
+
+  Acc acc[MR][NV];
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) acc[i][j] = Int8Dot::Zero();
+  }
+
+  for (utens_t q = 0; q < k4; q++, a += MR * 4, b += NR * 4) {
+    Wide bv[NV];
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) bv[j] = Int8Dot::LoadB(b + j * kCols * 4);
+#pragma GCC unroll 8
+    for (int i = 0; i < MR; i++) {
+      uint32 word;
+      std::memcpy(&word, a + i * 4, sizeof(word));
+      const Wide av = Int8Dot::BroadcastA(word);
+#pragma GCC unroll 4
+      for (int j = 0; j < NV; j++) {
+        acc[i][j] = Int8Dot::MulAdd(av, bv[j], acc[i][j]);
+      }
+    }
+  }
+
+  int32 pairs[MR * NR * 2];
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NV; j++) {
+      Int8Dot::Store(pairs + (i * NR + j * kCols) * 2, acc[i][j]);
+    }
+  }
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      const int32 sum = pairs[(i * NR + j) * 2] + pairs[(i * NR + j) * 2 + 1];
+      c[i * ldc + j] = accumulate ? c[i * ldc + j] + sum : sum;
+    }
+  }
+}
+
+#if defined(__AVX512VNNI__)
+
+// Same as `quantized_gemm_micro_kernel`, with each lane holding a column: one
+// vpdpbusd multiplies the four bytes of a group and adds them up at once.
+template<int MR, int NV>
+void quantized_gemm_vnni_kernel(utens_t k4, const uint8 *a, const int8 *b,
+                                bool accumulate, int32 *c, utens_t ldc,
+                                utens_t m, utens_t n) {
+  constexpr int NR = NV * 16;
+
+  __m512i acc[MR][NV];
+#pragma GCC unroll 16
+  for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) acc[i][j] = _mm512_setzero_si512();
+  }
+
+  for (utens_t q = 0; q < k4; q++, a += MR * 4, b += NR * 4) {
+    __m512i bv[NV];
+#pragma GCC unroll 4
+    for (int j = 0; j < NV; j++) bv[j] = _mm512_loadu_si512(b + j * 64);
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++) {
+      int32 word;
+      std::memcpy(&word, a + i * 4, sizeof(word));
+      const __m512i av = _mm512_set1_epi32(word);
+#pragma GCC unroll 4
+      for (int j = 0; j < NV; j++) {
+        acc[i][j] = _mm512_dpbusd_epi32(acc[i][j], av, bv[j]);
+      }
+    }
+  }
+
+  if (m == MR && n == NR) {
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+      for (int j = 0; j < NV; j++) {
+        int32 *dst = c + i * ldc + j * 16;
+        __m512i r = acc[i][j];
+        if (accumulate) r = _mm512_add_epi32(r, _mm512_loadu_si512(dst));
+        _mm512_storeu_si512(dst, r);
+      }
+    }
+    return;
+  }
+
+  int32 buf[MR * NR];
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NV; j++) {
+      _mm512_storeu_si512(buf + i * NR + j * 16, acc[i][j]);
+    }
+  }
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      c[i * ldc + j] = accumulate ? c[i * ldc + j] + buf[i * NR + j]
+                                  : buf[i * NR + j];
+    }
+  }
+}
+
+#endif  // __AVX512VNNI__
+
+// Int8 tiles keep 24 accumulators in AVX-512 registers and 8 in the smaller
+// register files.
+#if CHIME_SIMD_BYTES == 64
+constexpr int kQuantizedGemmMR = 6;
+constexpr int kQuantizedGemmNV = 4;
+#else
+constexpr int kQuantizedGemmMR = 4;
+constexpr int kQuantizedGemmNV = 2;
+#endif
+
+// Widens `kLanes` consecutive bytes of an int4 block, see `Int4GemmKernels`,
+// to float32 lanes holding the low nibbles and lanes holding the high ones.
+struct Int4Lanes {
+  typedef simd::Vec<float32> V;
+
+#if CHIME_SIMD_BYTES == 64
+  static void Load(const uint8 *p, V::Reg *lo, V::Reg *hi) {
+    const __m512i x = _mm512_cvtepu8_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    *lo = _mm512_cvtepi32_ps(_mm512_and_si512(x, _mm512_set1_epi32(15)));
+    *hi = _mm512_cvtepi32_ps(_mm512_srli_epi32(x, 4));
+  }
+#elif CHIME_SIMD_BYTES == 32
+  static void Load(const uint8 *p, V::Reg *lo, V::Reg *hi) {
+    const __m256i x = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+    *lo = _mm256_cvtepi32_ps(_mm256_and_si256(x, _mm256_set1_epi32(15)));
+    *hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 4));
+  }
+#elif CHIME_SIMD_BYTES == 16
+  static void Load(const uint8 *p, V::Reg *lo, V::Reg *hi) {
+    int32 word;
+    std::memcpy(&word, p, sizeof(word));
+    const __m128i bytes = _mm_cvtsi32_si128(word);
+#if defined(__SSE4_1__)
+    const __m128i x = _mm_cvtepu8_epi32(bytes);
+#else
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i x =
+        _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+#endif  // __SSE4_1__
+    *lo = _mm_cvtepi32_ps(_mm_and_si128(x, _mm_set1_epi32(15)));
+    *hi = _mm_cvtepi32_ps(_mm_srli_epi32(x, 4));
+  }
+#else
+  static void Load(const uint8 *p, V::Reg *lo, V::Reg *hi) {
+    *lo = static_cast<float32>(*p & 15);
+    *hi = static_cast<float32>(*p >> 4);
+  }
+#endif  // CHIME_SIMD_BYTES
+};
+
+// Int4 microkernel, see `Int4GemmKernels`. Weights are scaled as they are
+// widened, (q + 8) * s - 8 * s in one multiply-add, so the accumulators sum
+// real products over all of k and are only reduced across lanes at the end.
+// Rows and columns past the corner of the tile repeat the last ones and their
+// sums are dropped; the block cut short by k reads a zero-padded copy of A.
+template<int MR, int NR>
+void int4_gemm_micro_kernel(utens_t k, const float32 *a, utens_t lda,
+                            const uint8 *b, utens_t ldb, const float32 *scales,
+                            utens_t lds, utens_t group_blocks, bool accumulate,
+                            float32 *c, utens_t ldc, utens_t m, utens_t n) {
+  typedef simd::Vec<float32> V;
+  constexpr int kHalf = static_cast<int>(kInt4BlockSize) / 2;
+
+  const float32 *rows[MR];
+  for (int i = 0; i < MR; i++) {
+    rows[i] = a + std::min<utens_t>(i, m - 1) * lda;
+  }
+  const uint8 *cols[NR];
+  const float32 *col_scales[NR];
+  for (int j = 0; j < NR; j++) {
+    cols[j] = b + std::min<utens_t>(j, n - 1) * ldb;
+    col_scales[j] = scales + std::min<utens_t>(j, n - 1) * lds;
+  }
+
+  V::Reg acc[MR][NR];
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for (int j = 0; j < NR; j++) acc[i][j] = V::Set1(0.f);
+  }
+
+  const utens_t full_blocks = k / kInt4BlockSize;
+  const utens_t blocks = (k + kInt4BlockSize - 1) / kInt4BlockSize;
+  float32 scale[NR] = {}, offset[NR] = {};
+  float32 tail[MR][kInt4BlockSize];
+  for (utens_t q = 0; q < blocks; q++) {
+    if (q % group_blocks == 0) {
+      for (int j = 0; j < NR; j++) {
+        scale[j] = col_scales[j][q / group_blocks];
+        offset[j] = -8.f * scale[j];
+      }
+    }
+    const float32 *a_block[MR];
+    if (q < full_blocks) {
+      for (int i = 0; i < MR; i++) a_block[i] = rows[i] + q * kInt4BlockSize;
+    } else {
+      const utens_t rest = k - q * kInt4BlockSize;
+      for (int i = 0; i < MR; i++) {
+        std::fill(std::copy(rows[i] + q * kInt4BlockSize,
+                            rows[i] + q * kInt4BlockSize + rest, tail[i]),
+                  tail[i] + kInt4BlockSize, 0.f);
+        a_block[i] = tail[i];
+      }
+    }
+#pragma GCC unroll 4
+    for (int o = 0; o < kHalf; o += V::kLanes) {
+      V::Reg lo[NR], hi[NR];
+#pragma GCC unroll 4
+      for (int j = 0; j < NR; j++) {
+        Int4Lanes::Load(cols[j] + q * kHalf + o, &lo[j], &hi[j]);
+        lo[j] = V::MulAdd(lo[j], V::Set1(scale[j]), V::Set1(offset[j]));
+        hi[j] = V::MulAdd(hi[j], V::Set1(scale[j]), V::Set1(offset[j]));
+      }
+#pragma GCC unroll 8
+      for (int i = 0; i < MR; i++) {
+        const V::Reg a_lo = V::Load(a_block[i] + o);
+        const V::Reg a_hi = V::Load(a_block[i] + kHalf + o);
+#pragma GCC unroll 4
+        for (int j = 0; j < NR; j++) {
+          acc[i][j] = V::MulAdd(a_lo, lo[j], acc[i][j]);
+          acc[i][j] = V::MulAdd(a_hi, hi[j], acc[i][j]);
+        }
+      }
+    }
+  }
+
+  float32 buf[V::kLanes];
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      V::Store(buf, acc[i][j]);
+      float32 sum = 0.f;
+      for (int l = 0; l < V::kLanes; l++) sum += buf[l];
+      c[i * ldc + j] = accumulate ? c[i * ldc + j] + sum : sum;
+    }
+  }
+}
+
+// Int4 tiles keep 16 accumulators in AVX-512 registers and 6 in the smaller
+// register files, next to two widened vectors of each column.
+#if CHIME_SIMD_BYTES == 64
+constexpr int kInt4GemmMR = 4;
+constexpr int kInt4GemmNR = 4;
+#else
+constexpr int kInt4GemmMR = 3;
+constexpr int kInt4GemmNR = 2;
+#endif
+
+// Philox4x32-10 on kLanes counters at once, see philox.h. Each register holds
+// one of the four words of the counters, so that a group of the stream comes
+// out already in order.
+struct PhiloxLanes {
+#if CHIME_SIMD_BYTES == 64
+  typedef __m512i Reg;
+  static constexpr int kLanes = 16;
+
+  static Reg Set1(uint32 v) { return _mm512_set1_epi32(static_cast<int>(v)); }
+  static Reg Iota(uint32 v) {
+    return _mm512_add_epi32(Set1(v), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6,
+                                                       7, 8, 9, 10, 11, 12,
+                                                       13, 14, 15));
+  }
+  static Reg Xor(Reg a, Reg b) { return _mm512_xor_si512(a, b); }
+  // vpmuludq multiplies the even lanes, shifting brings the odd ones there.
+  static void MulHiLo(uint32 m, Reg a, Reg *hi, Reg *lo) {
+    const Reg vm = Set1(m);
+    const Reg even = _mm512_mul_epu32(a, vm);
+    const Reg odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), vm);
+    *hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+    *lo = _mm512_mullo_epi32(a, vm);
+  }
+  static void Store(uint32 *p, Reg v) { _mm512_storeu_si512(p, v); }
+  static Reg Load(const uint32 *p) { return _mm512_loadu_si512(p); }
+  static uint32 LessMask(Reg a, uint32 t) {
+    return _mm512_cmplt_epu32_mask(a, Set1(t));
+  }
+#elif CHIME_SIMD_BYTES == 32
+  typedef __m256i Reg;
+  static constexpr int kLanes = 8;
+
+  static Reg Set1(uint32 v) { return _mm256_set1_epi32(static_cast<int>(v)); }
+  static Reg Iota(uint32 v) {
+    return _mm256_add_epi32(Set1(v), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  static Reg Xor(Reg a, Reg b) { return _mm256_xor_si256(a, b); }
+  static void MulHiLo(uint32 m, Reg a, Reg *hi, Reg *lo) {
+    const Reg vm = Set1(m);
+    const Reg even = _mm256_mul_epu32(a, vm);
+    const Reg odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), vm);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    *lo = _mm256_mullo_epi32(a, vm);
+  }
+  static void Store(uint32 *p, Reg v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  static Reg Load(const uint32 *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  // There is no unsigned compare, flipping the top bits makes a signed one.
+  static uint32 LessMask(Reg a, uint32 t) {
+    const Reg flip = Set1(0x80000000u);
+    const Reg lt = _mm256_cmpgt_epi32(Xor(Set1(t), flip), Xor(a, flip));
+    return static_cast<uint32>(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+  }
+#elif CHIME_SIMD_BYTES == 16
+  typedef __m128i Reg;
+  static constexpr int kLanes = 4;
+
+  static Reg Set1(uint32 v) { return _mm_set1_epi32(static_cast<int>(v)); }
+  static Reg Iota(uint32 v) {
+    return _mm_add_epi32(Set1(v), _mm_setr_epi32(0, 1, 2, 3));
+  }
+  static Reg Xor(Reg a, Reg b) { return _mm_xor_si128(a, b); }
+  static void MulHiLo(uint32 m, Reg a, Reg *hi, Reg *lo) {
+    const Reg vm = Set1(m);
+    const Reg even = _mm_mul_epu32(a, vm);
+    const Reg odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), vm);
+#if defined(__SSE4_1__)
+    *hi = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+    *lo = _mm_mullo_epi32(a, vm);
+#else
+    // Gathers the halves of the four products, then puts them back in order.
+    const __m128 e = _mm_castsi128_ps(even);
+    const __m128 o = _mm_castsi128_ps(odd);
+    *hi = _mm_shuffle_epi32(
+        _mm_castps_si128(_mm_shuffle_ps(e, o, _MM_SHUFFLE(3, 1, 3, 1))),
+        _MM_SHUFFLE(3, 1, 2, 0));
+    *lo = _mm_shuffle_epi32(
+        _mm_castps_si128(_mm_shuffle_ps(e, o, _MM_SHUFFLE(2, 0, 2, 0))),
+        _MM_SHUFFLE(3, 1, 2, 0));
+#endif  // __SSE4_1__
+  }
+  static void Store(uint32 *p, Reg v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+  }
+  static Reg Load(const uint32 *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+  static uint32 LessMask(Reg a, uint32 t) {
+    const Reg flip = Set1(0x80000000u);
+    const Reg lt = _mm_cmpgt_epi32(Xor(Set1(t), flip), Xor(a, flip));
+    return static_cast<uint32>(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+  }
+#else
+  typedef uint32 Reg;
+  static constexpr int kLanes = 1;
+
+  static Reg Set1(uint32 v) { return v; }
+  static Reg Iota(uint32 v) { return v; }
+  static Reg Xor(Reg a, Reg b) { return a ^ b; }
+  static void MulHiLo(uint32 m, Reg a, Reg *hi, Reg *lo) {
+    const uint64 p = static_cast<uint64>(m) * a;
+    *hi = static_cast<uint32>(p >> 32);
+    *lo = static_cast<uint32>(p);
+  }
+  static void Store(uint32 *p, Reg v) { *p = v; }
+  static Reg Load(const uint32 *p) { return *p; }
+  static uint32 LessMask(Reg a, uint32 t) { return a < t; }
+#endif  // CHIME_SIMD_BYTES
+};
+
+// Writes group g of the stream of `seed`, `kPhiloxGroupWords` words.
+inline void philox_group(uint64 seed, uint64 g, uint32 *y) {
+  typedef PhiloxLanes P;
+  for (int l = 0; l < 16; l += P::kLanes) {
+    const uint64 counter = g * 16 + l;
+    P::Reg c0 = P::Iota(static_cast<uint32>(counter));
+    P::Reg c1 = P::Set1(static_cast<uint32>(counter >> 32));
+    P::Reg c2 = P::Set1(0);
+    P::Reg c3 = P::Set1(0);
+    uint32 k0 = static_cast<uint32>(seed);
+    uint32 k1 = static_cast<uint32>(seed >> 32);
+#pragma GCC unroll 10
+    for (int round = 0; round < kPhiloxRounds; round++) {
+      P::Reg hi0, lo0, hi1, lo1;
+      P::MulHiLo(kPhiloxM0, c0, &hi0, &lo0);
+      P::MulHiLo(kPhiloxM1, c2, &hi1, &lo1);
+      c0 = P::Xor(P::Xor(hi1, c1), P::Set1(k0));
+      c1 = lo1;
+      c2 = P::Xor(P::Xor(hi0, c3), P::Set1(k1));
+      c3 = lo0;
+      k0 += kPhiloxW0;
+      k1 += kPhiloxW1;
+    }
+    P::Store(y + l, c0);
+    P::Store(y + 16 + l, c1);
+    P::Store(y + 32 + l, c2);
+    P::Store(y + 48 + l, c3);
+  }
+}
+
+void philox_bits_kernel(utens_t n, uint64 seed, uint64 offset, uint32 *y) {
+  uint32 group[kPhiloxGroupWords];
+  utens_t i = 0;
+  while (i < n) {
+    const uint64 g = (offset + i) / kPhiloxGroupWords;
+    const utens_t skip = (offset + i) % kPhiloxGroupWords;
+    const utens_t len = std::min<utens_t>(kPhiloxGroupWords - skip, n - i);
+    if (len == kPhiloxGroupWords) {
+      philox_group(seed, g, y + i);
+    } else {
+      philox_group(seed, g, group);
+      std::copy(group + skip, group + skip + len, y + i);
+    }
+    i += len;
+  }
+}
+
+// How many words make a uniform number of each type, and how to build one in
+// [1, 2) by planting the top bits of the words in the mantissa of 1.
+template<typename Dtype>
+struct RandomTraits;
+
+template<>
+struct RandomTraits<float32> {
+  static constexpr utens_t kWords = 1;
+  static constexpr int kBits = 32;
+  static constexpr int kExponentBits = 9;
+  static constexpr uint64_t kOneBits = 0x3F800000u;
+};
+
+template<>
+struct RandomTraits<float64> {
+  static constexpr utens_t kWords = 2;
+  static constexpr int kBits = 64;
+  static constexpr int kExponentBits = 12;
+  static constexpr uint64_t kOneBits = 0x3FF0000000000000ull;
+};
+
+// Uniform lanes in [0, 1) from the words at `words`.
+template<typename Dtype>
+inline typename simd::Vec<Dtype>::Reg UniformPacket(const uint32 *words) {
+  typedef simd::Vec<Dtype> V;
+  typedef RandomTraits<Dtype> R;
+  const typename V::Bits bits = V::LoadBits(words);
+  return V::Sub(V::FromBits(V::BitsOr(V::BitsShr(bits, R::kExponentBits),
+                                      V::SetBits(R::kOneBits))),
+                V::Set1(1));
+}
+
+// Runs `f(words, i, len)` over chunks of at most kRandomChunk elements, with
+// `words` holding the uniforms of elements [i, i + len) of the call, and
+// enough more for whole registers.
+constexpr utens_t kRandomChunk = 256;
+
+template<typename Dtype, typename Functor>
+void random_chunks(utens_t n, uint64 seed, uint64 offset, utens_t align,
+                   const Functor &f) {
+  typedef RandomTraits<Dtype> R;
+  uint32 words[kRandomChunk * R::kWords];
+  for (utens_t i = 0; i < n; i += kRandomChunk) {
+    const utens_t len = std::min(kRandomChunk, n - i);
+    const utens_t padded = (len + align - 1) / align * align;
+    philox_bits_kernel(padded * R::kWords, seed, offset + i * R::kWords,
+                       words);
+    f(words, i, len);
+  }
+}
+
+// Stores the lanes of `v` to y[0 .. len), len being at most kLanes.
+template<typename Dtype>
+inline void store_lanes(Dtype *y, utens_t len,
+                        typename simd::Vec<Dtype>::Reg v) {
+  typedef simd::Vec<Dtype> V;
+  if (len >= static_cast<utens_t>(V::kLanes)) {
+    V::Store(y, v);
+  } else {
+    Dtype buf[V::kLanes];
+    V::Store(buf, v);
+    std::copy(buf, buf + len, y);
+  }
+}
+
+template<typename Dtype>
+void uniform_kernel(utens_t n, uint64 seed, uint64 offset, Dtype a, Dtype b,
+                    Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef RandomTraits<Dtype> R;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const typename V::Reg va = V::Set1(a);
+  const typename V::Reg range = V::Set1(b - a);
+  random_chunks<Dtype>(
+      n, seed, offset, lanes, [&](const uint32 *words, utens_t i, utens_t len) {
+        for (utens_t j = 0; j < len; j += lanes) {
+          const typename V::Reg u = UniformPacket<Dtype>(words + j * R::kWords);
+          store_lanes(y + i + j, len - j, V::MulAdd(range, u, va));
+        }
+      });
+}
+
+// Sine and cosine of x in [-pi/4, pi/4] from their Taylor series, whose
+// remainders stay below the rounding error there.
+template<typename Dtype>
+struct QuarterSinCos;
+
+template<>
+struct QuarterSinCos<float32> {
+  template<typename V>
+  static void Eval(typename V::Reg x, typename V::Reg *s,
+                   typename V::Reg *c) {
+    const typename V::Reg z = V::Mul(x, x);
+    *s = V::MulAdd(V::Mul(x, z),
+                   simd::Horner<V>(z, -1. / 6, 1. / 120, -1. / 5040,
+                                   1. / 362880),
+                   x);
+    *c = simd::Horner<V>(z, 1., -1. / 2, 1. / 24, -1. / 720, 1. / 40320,
+                         -1. / 3628800);
+  }
+};
+
+template<>
+struct QuarterSinCos<float64> {
+  template<typename V>
+  static void Eval(typename V::Reg x, typename V::Reg *s,
+                   typename V::Reg *c) {
+    const typename V::Reg z = V::Mul(x, x);
+    *s = V::MulAdd(V::Mul(x, z),
+                   simd::Horner<V>(z, -1. / 6, 1. / 120, -1. / 5040,
+                                   1. / 362880, -1. / 39916800,
+                                   1. / 6227020800, -1. / 1307674368000),
+                   x);
+    *c = simd::Horner<V>(z, 1., -1. / 2, 1. / 24, -1. / 720, 1. / 40320,
+                         -1. / 3628800, 1. / 479001600, -1. / 87178291200,
+                         1. / 20922789888000);
+  }
+};
+
+// Box-Muller over blocks of 32 elements, see `RandomKernels`. The angle of a
+// pair lies in a quarter turn and two random signs pick its quadrant, which
+// gives the same distribution as a full turn.
+template<typename Dtype>
+void gaussian_kernel(utens_t n, uint64 seed, uint64 offset, Dtype mu,
+                     Dtype sigma, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef typename V::Reg Reg;
+  typedef typename V::Bits Bits;
+  typedef RandomTraits<Dtype> R;
+  constexpr utens_t kPairs = 16;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const Reg vmu = V::Set1(mu);
+  const Reg vsigma = V::Set1(sigma);
+  const Reg one = V::Set1(1);
+  const Bits sign = V::SetBits(uint64_t(1) << (R::kBits - 1));
+  random_chunks<Dtype>(
+      n, seed, offset, 2 * kPairs,
+      [&](const uint32 *words, utens_t i, utens_t len) {
+        for (utens_t b = 0; b < len; b += 2 * kPairs) {
+          const uint32 *radii = words + b * R::kWords;
+          const uint32 *angles = radii + kPairs * R::kWords;
+          for (utens_t t = 0; t < kPairs; t += lanes) {
+            // u in (0, 1], so that the logarithm is finite.
+            const Reg u =
+                V::Sub(one, UniformPacket<Dtype>(radii + t * R::kWords));
+            const Reg r = V::Sqrt(V::Mul(V::Set1(-2), simd::Log<V>(u)));
+            const Bits bits = V::LoadBits(angles + t * R::kWords);
+            const Reg f = V::Sub(
+                V::FromBits(V::BitsOr(
+                    V::BitsShr(V::BitsShl(bits, 2), R::kExponentBits),
+                    V::SetBits(R::kOneBits))),
+                one);
+            const Reg x = V::MulAdd(f, V::Set1(M_PI / 2), V::Set1(-M_PI / 4));
+            Reg s, c;
+            QuarterSinCos<Dtype>::template Eval<V>(x, &s, &c);
+            // cos(x + pi/4) and sin(x + pi/4).
+            const Reg cos_a = V::Mul(V::Sub(c, s), V::Set1(M_SQRT1_2));
+            const Reg sin_a = V::Mul(V::Add(c, s), V::Set1(M_SQRT1_2));
+            const Reg z0 = V::FromBits(V::BitsOr(
+                V::AsBits(V::Mul(r, cos_a)), V::BitsAnd(bits, sign)));
+            const Reg z1 = V::FromBits(V::BitsOr(
+                V::AsBits(V::Mul(r, sin_a)),
+                V::BitsAnd(V::BitsShl(bits, 1), sign)));
+            const utens_t j0 = b + t;
+            const utens_t j1 = b + kPairs + t;
+            if (j0 < len) {
+              store_lanes(y + i + j0, len - j0, V::MulAdd(vsigma, z0, vmu));
+            }
+            if (j1 < len) {
+              store_lanes(y + i + j1, len - j1, V::MulAdd(vsigma, z1, vmu));
+            }
+          }
+        }
+      });
+}
+
+// Bit j of the result is set where word j of the 32 at `words` is below
+// `threshold`, which keeps everything from 2^32 on.
+inline uint32 keep_bits(const uint32 *words, uint64 threshold) {
+  typedef PhiloxLanes P;
+  if (threshold > 0xFFFFFFFFu) return 0xFFFFFFFFu;
+  const uint32 t = static_cast<uint32>(threshold);
+  uint32 bits = 0;
+  for (utens_t l = 0; l < kMaskWordBits; l += P::kLanes) {
+    bits |= P::LessMask(P::Load(words + l), t) << l;
+  }
+  return bits;
+}
+
+// y = x * scale where the bits are set and 0 elsewhere, for len <= 32.
+template<typename Dtype>
+inline void masked_scale_word(uint32 bits, utens_t len, Dtype scale,
+                              const Dtype *x, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const typename V::Reg vscale = V::Set1(scale);
+  const typename V::Reg zero = V::Set1(0);
+  utens_t l = 0;
+  for (; l + lanes <= len; l += lanes) {
+    V::Store(y + l, V::Select(V::LaneMask(bits >> l),
+                              V::Mul(V::Load(x + l), vscale), zero));
+  }
+  for (; l < len; l++) y[l] = (bits >> l & 1) ? x[l] * scale : Dtype(0);
+}
+
+template<typename Dtype>
+void dropout_kernel(utens_t n, uint64 seed, uint64 offset, uint64 threshold,
+                    Dtype scale, const Dtype *x, Dtype *y, uint32 *mask) {
+  uint32 words[kRandomChunk];
+  for (utens_t i = 0; i < n; i += kRandomChunk) {
+    const utens_t len = std::min(kRandomChunk, n - i);
+    const utens_t padded = (len + kMaskWordBits - 1) / kMaskWordBits *
+                           kMaskWordBits;
+    philox_bits_kernel(padded, seed, offset + i, words);
+    for (utens_t b = 0; b < len; b += kMaskWordBits) {
+      const utens_t word_len = std::min<utens_t>(kMaskWordBits, len - b);
+      uint32 bits = keep_bits(words + b, threshold);
+      if (word_len < kMaskWordBits) bits &= (1u << word_len) - 1;
+      mask[(i + b) / kMaskWordBits] = bits;
+      masked_scale_word(bits, word_len, scale, x + i + b, y + i + b);
+    }
+  }
+}
+
+template<typename Dtype>
+void masked_scale_kernel(utens_t n, const uint32 *mask, Dtype scale,
+                         const Dtype *x, Dtype *y) {
+  for (utens_t b = 0; b < n; b += kMaskWordBits) {
+    masked_scale_word(mask[b / kMaskWordBits],
+                      std::min<utens_t>(kMaskWordBits, n - b), scale, x + b,
+                      y + b);
+  }
+}
+
+// What the pairwise sums add up, on registers of any width W.
+struct IdentityOp {
+  template<typename W>
+  static typename W::Reg Apply(typename W::Reg x, typename W::Reg) {
+    return x;
+  }
+};
+
+struct SquaredDeviationOp {
+  template<typename W>
+  static typename W::Reg Apply(typename W::Reg x, typename W::Reg mean) {
+    const typename W::Reg d = W::Sub(x, mean);
+    return W::Mul(d, d);
+  }
+};
+
+// Sums up to this many elements in eight accumulators, longer arrays are cut
+// in halves whose sums are added, so that the rounding error grows with the
+// logarithm of n.
+constexpr utens_t kPairwiseBlock = 128;
+
+template<typename Dtype, typename Op>
+Dtype pairwise_sum(utens_t n, const Dtype *x, Dtype mean) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  if (n > kPairwiseBlock) {
+    const utens_t half = n / 2 / lanes * lanes;
+    return pairwise_sum<Dtype, Op>(half, x, mean) +
+           pairwise_sum<Dtype, Op>(n - half, x + half, mean);
+  }
+  const typename V::Reg vmean = V::Set1(mean);
+  typename V::Reg acc[8];
+  for (int u = 0; u < 8; u++) acc[u] = V::Set1(0);
+  utens_t i = 0;
+  for (; i + 8 * lanes <= n; i += 8 * lanes) {
+#pragma GCC unroll 8
+    for (int u = 0; u < 8; u++) {
+      acc[u] = V::Add(
+          acc[u], Op::template Apply<V>(V::Load(x + i + u * lanes), vmean));
+    }
+  }
+  for (; i + lanes <= n; i += lanes) {
+    acc[0] = V::Add(acc[0], Op::template Apply<V>(V::Load(x + i), vmean));
+  }
+  for (int w = 4; w > 0; w /= 2) {
+    for (int u = 0; u < w; u++) acc[u] = V::Add(acc[u], acc[u + w]);
+  }
+  Dtype buf[V::kLanes];
+  V::Store(buf, acc[0]);
+  for (int w = V::kLanes / 2; w > 0; w /= 2) {
+    for (int l = 0; l < w; l++) buf[l] += buf[l + w];
+  }
+  Dtype tail = 0;
+  for (; i < n; i++) tail += Op::template Apply<S>(x[i], mean);
+  return buf[0] + tail;
+}
+
+template<typename Dtype>
+Dtype sum_kernel(utens_t n, const Dtype *x) {
+  return pairwise_sum<Dtype, IdentityOp>(n, x, Dtype(0));
+}
+
+template<typename Dtype>
+Dtype sum_sq_dev_kernel(utens_t n, const Dtype *x, Dtype mean) {
+  return pairwise_sum<Dtype, SquaredDeviationOp>(n, x, mean);
+}
+
+template<typename V, bool kMax>
+inline typename V::Reg Extremum(typename V::Reg a, typename V::Reg b) {
+  return kMax ? V::Max(a, b) : V::Min(a, b);
+}
+
+// REQUIRES: n > 0.
+template<typename Dtype, bool kMax>
+Dtype extremum_kernel(utens_t n, const Dtype *x) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  typename V::Reg acc[4];
+  for (int u = 0; u < 4; u++) acc[u] = V::Set1(x[0]);
+  utens_t i = 0;
+  for (; i + 4 * lanes <= n; i += 4 * lanes) {
+#pragma GCC unroll 4
+    for (int u = 0; u < 4; u++) {
+      acc[u] = Extremum<V, kMax>(acc[u], V::Load(x + i + u * lanes));
+    }
+  }
+  for (; i + lanes <= n; i += lanes) {
+    acc[0] = Extremum<V, kMax>(acc[0], V::Load(x + i));
+  }
+  Dtype buf[V::kLanes];
+  V::Store(buf, Extremum<V, kMax>(Extremum<V, kMax>(acc[0], acc[1]),
+                                  Extremum<V, kMax>(acc[2], acc[3])));
+  Dtype best = buf[0];
+  for (int l = 1; l < V::kLanes; l++) {
+    if (kMax ? buf[l] > best : buf[l] < best) best = buf[l];
+  }
+  for (; i < n; i++) {
+    if (kMax ? x[i] > best : x[i] < best) best = x[i];
+  }
+  return best;
+}
+
+template<typename Dtype>
+void add_col_kernel(utens_t n, const Dtype *x, Dtype *acc) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(acc + i, V::Add(V::Load(acc + i), V::Load(x + i)));
+  }
+  for (; i < n; i++) acc[i] += x[i];
+}
+
+template<typename Dtype, bool kMax>
+void extremum_col_kernel(utens_t n, const Dtype *x, Dtype *acc) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(acc + i, Extremum<V, kMax>(V::Load(acc + i), V::Load(x + i)));
+  }
+  for (; i < n; i++) {
+    if (kMax ? x[i] > acc[i] : x[i] < acc[i]) acc[i] = x[i];
+  }
+}
+
+template<typename Dtype>
+void sq_dev_col_kernel(utens_t n, const Dtype *x, const Dtype *mean,
+                       Dtype *acc) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    const typename V::Reg d = V::Sub(V::Load(x + i), V::Load(mean + i));
+    V::Store(acc + i, V::Add(V::Load(acc + i), V::Mul(d, d)));
+  }
+  for (; i < n; i++) {
+    const Dtype d = x[i] - mean[i];
+    acc[i] += d * d;
+  }
+}
+
+// Running maximum of every lane of W and running sum of exp(x - maximum),
+// rescaled by exp(old - new maximum) whenever the maximum grows. The maximum
+// starts at the lowest finite value rather than -inf so that lanes which only
+// ever see -inf keep a sum of 0 instead of turning it into NaN.
+template<typename W>
+struct OnlineSoftmax {
+  typedef typename W::Reg Reg;
+
+  OnlineSoftmax()
+      : max(W::Set1(std::numeric_limits<typename W::Scalar>::lowest())),
+        sum(W::Set1(0)) {}
+
+  // Four registers at the price of one rescaling.
+  void Add(Reg a, Reg b, Reg c, Reg d) {
+    const Reg m = W::Max(W::Max(max, W::Max(a, b)), W::Max(c, d));
+    const Reg e = W::Add(W::Add(simd::Exp<W>(W::Sub(a, m)),
+                                simd::Exp<W>(W::Sub(b, m))),
+                         W::Add(simd::Exp<W>(W::Sub(c, m)),
+                                simd::Exp<W>(W::Sub(d, m))));
+    sum = W::MulAdd(sum, simd::Exp<W>(W::Sub(max, m)), e);
+    max = m;
+  }
+
+  void Add(Reg a) {
+    const Reg m = W::Max(max, a);
+    sum = W::MulAdd(sum, simd::Exp<W>(W::Sub(max, m)),
+                    simd::Exp<W>(W::Sub(a, m)));
+    max = m;
+  }
+
+  Reg max;
+  Reg sum;
+};
+
+// Maximum of a row of n elements and sum of exp(x - maximum), in one pass.
+template<typename Dtype>
+void softmax_row_stats(utens_t n, const Dtype *x, Dtype *max, Dtype *sum) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  OnlineSoftmax<V> acc;
+  utens_t i = 0;
+  for (; i + 4 * lanes <= n; i += 4 * lanes) {
+    acc.Add(V::Load(x + i), V::Load(x + i + lanes),
+            V::Load(x + i + 2 * lanes), V::Load(x + i + 3 * lanes));
+  }
+  for (; i + lanes <= n; i += lanes) acc.Add(V::Load(x + i));
+  OnlineSoftmax<S> tail;
+  for (; i < n; i++) tail.Add(x[i]);
+
+  Dtype buf[V::kLanes];
+  V::Store(buf, acc.max);
+  Dtype best = tail.max;
+  for (int l = 0; l < V::kLanes; l++) best = std::max(best, buf[l]);
+  V::Store(buf, V::Mul(acc.sum, simd::Exp<V>(V::Sub(acc.max, V::Set1(best)))));
+  Dtype total = tail.sum * simd::Exp<S>(tail.max - best);
+  for (int l = 0; l < V::kLanes; l++) total += buf[l];
+  *max = best;
+  *sum = total;
+}
+
+// y = exp(x - max) / sum, or y = (x - max) - log(sum) for the log-softmax,
+// given c = 1 / sum or log(sum). x - max is exact near the maximum, where
+// x - (max + log(sum)) would round max + log(sum) first.
+template<typename W, bool kLog>
+inline typename W::Reg SoftmaxOutput(typename W::Reg x, typename W::Reg max,
+                                     typename W::Reg c) {
+  return kLog ? W::Sub(W::Sub(x, max), c)
+              : W::Mul(simd::Exp<W>(W::Sub(x, max)), c);
+}
+
+template<typename W, bool kLog>
+inline typename W::Reg SoftmaxFactor(typename W::Reg sum) {
+  return kLog ? simd::Log<W>(sum) : W::Div(W::Set1(1), sum);
+}
+
+template<typename Dtype, bool kLog>
+void softmax_kernel(utens_t n, const Dtype *x, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  if (n == 0) return;
+  Dtype max, sum;
+  softmax_row_stats(n, x, &max, &sum);
+  const Dtype c = SoftmaxFactor<S, kLog>(sum);
+  const typename V::Reg vmax = V::Set1(max);
+  const typename V::Reg vc = V::Set1(c);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    V::Store(y + i, SoftmaxOutput<V, kLog>(V::Load(x + i), vmax, vc));
+  }
+  for (; i < n; i++) y[i] = SoftmaxOutput<S, kLog>(x[i], max, c);
+}
+
+// log(sum(exp(x))) - sum(target * x) with the terms grouped so that nothing
+// cancels: (1 - smoothing) * (max - x[label]) + smoothing * (max - mean(x))
+// + log(sum(exp(x - max))), each term being nonnegative.
+template<typename Dtype>
+Dtype cross_entropy_kernel(utens_t n, const Dtype *x, utens_t label,
+                           Dtype smoothing, Dtype *dx) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  Dtype max, sum;
+  softmax_row_stats(n, x, &max, &sum);
+  Dtype loss = (1 - smoothing) * (max - x[label]) + simd::Log<S>(sum);
+  if (smoothing != 0) {
+    const Dtype mean = sum_kernel(n, x) / static_cast<Dtype>(n);
+    loss += smoothing * (max - mean);
+  }
+  if (dx == nullptr) return loss;
+
+  const Dtype scale = 1 / sum;
+  const Dtype uniform = smoothing / static_cast<Dtype>(n);
+  const typename V::Reg vmax = V::Set1(max);
+  const typename V::Reg vscale = V::Set1(scale);
+  const typename V::Reg vuniform = V::Set1(uniform);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    const typename V::Reg p =
+        V::Mul(simd::Exp<V>(V::Sub(V::Load(x + i), vmax)), vscale);
+    V::Store(dx + i, V::Sub(p, vuniform));
+  }
+  for (; i < n; i++) dx[i] = simd::Exp<S>(x[i] - max) * scale - uniform;
+  dx[label] -= 1 - smoothing;
+  return loss;
+}
+
+// Columns normalized together by the column form, whose running maxima and
+// sums stay in L1.
+constexpr utens_t kSoftmaxColumnTile = 128;
+
+// The column form on at most kSoftmaxColumnTile columns: the first pass
+// walks the rows four at a time, the lanes of the running values being
+// columns.
+template<typename Dtype, bool kLog>
+void softmax_col_tile(utens_t n, utens_t width, utens_t stride,
+                      const Dtype *x, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  const utens_t vector_width = width / lanes * lanes;
+  OnlineSoftmax<V> acc[kSoftmaxColumnTile / V::kLanes];
+  OnlineSoftmax<S> tail[V::kLanes];
+  utens_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const Dtype *row = x + j * stride;
+    for (utens_t c = 0; c < vector_width; c += lanes) {
+      acc[c / lanes].Add(V::Load(row + c), V::Load(row + stride + c),
+                         V::Load(row + 2 * stride + c),
+                         V::Load(row + 3 * stride + c));
+    }
+    for (utens_t c = vector_width; c < width; c++) {
+      tail[c - vector_width].Add(row[c], row[stride + c], row[2 * stride + c],
+                                 row[3 * stride + c]);
+    }
+  }
+  for (; j < n; j++) {
+    const Dtype *row = x + j * stride;
+    for (utens_t c = 0; c < vector_width; c += lanes) {
+      acc[c / lanes].Add(V::Load(row + c));
+    }
+    for (utens_t c = vector_width; c < width; c++) {
+      tail[c - vector_width].Add(row[c]);
+    }
+  }
+
+  typename V::Reg cs[kSoftmaxColumnTile / V::kLanes];
+  Dtype tail_c[V::kLanes];
+  for (utens_t c = 0; c < vector_width; c += lanes) {
+    cs[c / lanes] = SoftmaxFactor<V, kLog>(acc[c / lanes].sum);
+  }
+  for (utens_t c = vector_width; c < width; c++) {
+    tail_c[c - vector_width] =
+        SoftmaxFactor<S, kLog>(tail[c - vector_width].sum);
+  }
+  for (j = 0; j < n; j++) {
+    const Dtype *row = x + j * stride;
+    Dtype *out = y + j * stride;
+    for (utens_t c = 0; c < vector_width; c += lanes) {
+      V::Store(out + c, SoftmaxOutput<V, kLog>(V::Load(row + c),
+                                               acc[c / lanes].max,
+                                               cs[c / lanes]));
+    }
+    for (utens_t c = vector_width; c < width; c++) {
+      out[c] = SoftmaxOutput<S, kLog>(row[c], tail[c - vector_width].max,
+                                      tail_c[c - vector_width]);
+    }
+  }
+}
+
+template<typename Dtype, bool kLog>
+void softmax_col_kernel(utens_t n, utens_t width, utens_t stride,
+                        const Dtype *x, Dtype *y) {
+  for (utens_t c = 0; c < width; c += kSoftmaxColumnTile) {
+    softmax_col_tile<Dtype, kLog>(n, std::min(kSoftmaxColumnTile, width - c),
+                                  stride, x + c, y + c);
+  }
+}
+
+// One-dimensional transforms of F(m, 3) (Lavin and Gray, 2015), with the
+// points 0, -1, 1 for m = 2 and 0, -1, 1, -2, 2 for m = 4, plus the point
+// at infinity. They read z[0], z[s], ... and write r[0], r[s], ...: G for the
+// 3 taps of a filter, B^T for the alpha values of an input tile, A^T for the
+// alpha products. Two of them, along the columns then along the rows,
+// transform a whole tile in registers.
+template<typename W, int kM>
+struct WinogradTransform;
+
+template<typename W>
+struct WinogradTransform<W, 2> {
+  typedef typename W::Reg Reg;
+  typedef typename W::Scalar T;
+
+  static void Filter(const Reg *z, int s, Reg *r) {
+    const Reg sum = W::Add(z[0], z[2 * s]);
+    const Reg half = W::Set1(T(0.5));
+    r[0] = z[0];
+    r[s] = W::Mul(half, W::Add(sum, z[s]));
+    r[2 * s] = W::Mul(half, W::Sub(sum, z[s]));
+    r[3 * s] = z[2 * s];
+  }
+
+  static void Input(const Reg *z, int s, Reg *r) {
+    r[0] = W::Sub(z[0], z[2 * s]);
+    r[s] = W::Add(z[s], z[2 * s]);
+    r[2 * s] = W::Sub(z[2 * s], z[s]);
+    r[3 * s] = W::Sub(z[s], z[3 * s]);
+  }
+
+  static void Output(const Reg *z, int s, Reg *r) {
+    r[0] = W::Add(W::Add(z[0], z[s]), z[2 * s]);
+    r[s] = W::Sub(W::Sub(z[s], z[2 * s]), z[3 * s]);
+  }
+};
+
+template<typename W>
+struct WinogradTransform<W, 4> {
+  typedef typename W::Reg Reg;
+  typedef typename W::Scalar T;
+
+  static void Filter(const Reg *z, int s, Reg *r) {
+    const Reg sixth = W::Set1(T(1) / T(6));
+    const Reg sum = W::Add(z[0], z[2 * s]);
+    // Rows 3 and 4 of G are p +- q.
+    const Reg p = W::MulAdd(W::Set1(T(1) / T(24)), z[0],
+                            W::Mul(sixth, z[2 * s]));
+    const Reg q = W::Mul(W::Set1(T(1) / T(12)), z[s]);
+    r[0] = W::Mul(W::Set1(T(0.25)), z[0]);
+    r[s] = W::Neg(W::Mul(sixth, W::Add(sum, z[s])));
+    r[2 * s] = W::Neg(W::Mul(sixth, W::Sub(sum, z[s])));
+    r[3 * s] = W::Add(p, q);
+    r[4 * s] = W::Sub(p, q);
+    r[5 * s] = z[2 * s];
+  }
+
+  static void Input(const Reg *z, int s, Reg *r) {
+    const Reg four = W::Set1(T(4)), minus_four = W::Set1(T(-4));
+    const Reg minus_five = W::Set1(T(-5));
+    // Rows 1 and 2 of B^T are p1 +- q1, rows 3 and 4 p2 +- q2.
+    const Reg p1 = W::MulAdd(minus_four, z[2 * s], z[4 * s]);
+    const Reg q1 = W::MulAdd(minus_four, z[s], z[3 * s]);
+    const Reg p2 = W::Sub(z[4 * s], z[2 * s]);
+    const Reg q2 = W::Mul(W::Set1(T(2)), W::Sub(z[3 * s], z[s]));
+    r[0] = W::MulAdd(four, z[0], W::MulAdd(minus_five, z[2 * s], z[4 * s]));
+    r[s] = W::Add(p1, q1);
+    r[2 * s] = W::Sub(p1, q1);
+    r[3 * s] = W::Add(p2, q2);
+    r[4 * s] = W::Sub(p2, q2);
+    r[5 * s] = W::MulAdd(four, z[s], W::MulAdd(minus_five, z[3 * s], z[5 * s]));
+  }
+
+  static void Output(const Reg *z, int s, Reg *r) {
+    const Reg a = W::Add(z[s], z[2 * s]), b = W::Sub(z[s], z[2 * s]);
+    const Reg c = W::Add(z[3 * s], z[4 * s]), d = W::Sub(z[3 * s], z[4 * s]);
+    r[0] = W::Add(W::Add(z[0], a), c);
+    r[s] = W::MulAdd(W::Set1(T(2)), d, b);
+    r[2 * s] = W::MulAdd(W::Set1(T(4)), c, a);
+    r[3 * s] = W::Add(W::MulAdd(W::Set1(T(8)), d, b), z[5 * s]);
+  }
+};
+
+// G g G^T of the channels of one register, see `WinogradKernels`.
+template<typename W, int kM>
+inline void winograd_filter_block(const typename W::Scalar *g, utens_t gs,
+                                  typename W::Scalar *u, utens_t us) {
+  typedef WinogradTransform<W, kM> F;
+  constexpr int kAlpha = kM + 2;
+  typename W::Reg t[3][3], h[kAlpha][3], w[kAlpha][kAlpha];
+#pragma GCC unroll 9
+  for (int k = 0; k < 9; k++) t[k / 3][k % 3] = W::Load(g + k * gs);
+#pragma GCC unroll 3
+  for (int j = 0; j < 3; j++) F::Filter(&t[0][j], 3, &h[0][j]);
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) F::Filter(&h[i][0], 1, &w[i][0]);
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) {
+#pragma GCC unroll 6
+    for (int j = 0; j < kAlpha; j++) {
+      W::Store(u + (i * kAlpha + j) * us, w[i][j]);
+    }
+  }
+}
+
+template<typename Dtype, int kM>
+void winograd_filter_kernel(utens_t n, const Dtype *g, utens_t g_stride,
+                            Dtype *u, utens_t u_stride) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    winograd_filter_block<V, kM>(g + i, g_stride, u + i, u_stride);
+  }
+  for (; i < n; i++) {
+    winograd_filter_block<S, kM>(g + i, g_stride, u + i, u_stride);
+  }
+}
+
+// B^T d B of the channels of one register, see `WinogradKernels`.
+template<typename W, int kM>
+inline void winograd_input_block(const typename W::Scalar *d, utens_t rs,
+                                 utens_t cs, typename W::Scalar *v,
+                                 utens_t vs) {
+  typedef WinogradTransform<W, kM> F;
+  constexpr int kAlpha = kM + 2;
+  typename W::Reg t[kAlpha][kAlpha], u[kAlpha][kAlpha];
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) {
+#pragma GCC unroll 6
+    for (int j = 0; j < kAlpha; j++) t[i][j] = W::Load(d + i * rs + j * cs);
+  }
+#pragma GCC unroll 6
+  for (int j = 0; j < kAlpha; j++) F::Input(&t[0][j], kAlpha, &u[0][j]);
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) F::Input(&u[i][0], 1, &t[i][0]);
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) {
+#pragma GCC unroll 6
+    for (int j = 0; j < kAlpha; j++) {
+      W::Store(v + (i * kAlpha + j) * vs, t[i][j]);
+    }
+  }
+}
+
+template<typename Dtype, int kM>
+void winograd_input_kernel(utens_t n, const Dtype *d, utens_t row_stride,
+                           utens_t col_stride, Dtype *v, utens_t v_stride) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    winograd_input_block<V, kM>(d + i, row_stride, col_stride, v + i,
+                                v_stride);
+  }
+  for (; i < n; i++) {
+    winograd_input_block<S, kM>(d + i, row_stride, col_stride, v + i,
+                                v_stride);
+  }
+}
+
+// A^T m A plus the bias of the channels of one register.
+template<typename W, int kM>
+inline void winograd_output_block(const typename W::Scalar *m, utens_t ms,
+                                  const typename W::Scalar *bias,
+                                  typename W::Scalar *y, utens_t rs,
+                                  utens_t cs) {
+  typedef WinogradTransform<W, kM> F;
+  constexpr int kAlpha = kM + 2;
+  typename W::Reg t[kAlpha][kAlpha], u[kM][kAlpha], o[kM][kM];
+#pragma GCC unroll 6
+  for (int i = 0; i < kAlpha; i++) {
+#pragma GCC unroll 6
+    for (int j = 0; j < kAlpha; j++) {
+      t[i][j] = W::Load(m + (i * kAlpha + j) * ms);
+    }
+  }
+#pragma GCC unroll 6
+  for (int j = 0; j < kAlpha; j++) F::Output(&t[0][j], kAlpha, &u[0][j]);
+#pragma GCC unroll 4
+  for (int i = 0; i < kM; i++) F::Output(&u[i][0], 1, &o[i][0]);
+  const typename W::Reg b = bias ? W::Load(bias) : W::Set1(0);
+#pragma GCC unroll 4
+  for (int i = 0; i < kM; i++) {
+#pragma GCC unroll 4
+    for (int j = 0; j < kM; j++) {
+      W::Store(y + i * rs + j * cs, W::Add(o[i][j], b));
+    }
+  }
+}
+
+template<typename Dtype, int kM>
+void winograd_output_kernel(utens_t n, const Dtype *m, utens_t m_stride,
+                            const Dtype *bias, Dtype *y, utens_t row_stride,
+                            utens_t col_stride) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    winograd_output_block<V, kM>(m + i, m_stride, bias ? bias + i : nullptr,
+                                 y + i, row_stride, col_stride);
+  }
+  for (; i < n; i++) {
+    winograd_output_block<S, kM>(m + i, m_stride, bias ? bias + i : nullptr,
+                                 y + i, row_stride, col_stride);
+  }
+}
+
+// Depthwise kernel on kBlocks registers of channels at once, whose
+// accumulators are independent, so that the chains of multiply-adds over
+// the taps overlap.
+template<typename W, int kBlocks>
+inline void depthwise_block(utens_t c, utens_t taps,
+                            const typename W::Scalar *const *x,
+                            const typename W::Scalar *const *w,
+                            const typename W::Scalar *bias,
+                            typename W::Scalar *y) {
+  typename W::Reg acc[kBlocks];
+#pragma GCC unroll 4
+  for (int b = 0; b < kBlocks; b++) {
+    acc[b] = bias ? W::Load(bias + c + b * W::kLanes) : W::Set1(0);
+  }
+  for (utens_t t = 0; t < taps; t++) {
+#pragma GCC unroll 4
+    for (int b = 0; b < kBlocks; b++) {
+      const utens_t i = c + b * W::kLanes;
+      acc[b] = W::MulAdd(W::Load(x[t] + i), W::Load(w[t] + i), acc[b]);
+    }
+  }
+#pragma GCC unroll 4
+  for (int b = 0; b < kBlocks; b++) W::Store(y + c + b * W::kLanes, acc[b]);
+}
+
+template<typename Dtype>
+void depthwise_kernel(utens_t n, utens_t taps, const Dtype *const *x,
+                      const Dtype *const *w, const Dtype *bias, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t c = 0;
+  for (; c + 4 * lanes <= n; c += 4 * lanes) {
+    depthwise_block<V, 4>(c, taps, x, w, bias, y);
+  }
+  for (; c + lanes <= n; c += lanes) {
+    depthwise_block<V, 1>(c, taps, x, w, bias, y);
+  }
+  for (; c < n; c++) depthwise_block<S, 1>(c, taps, x, w, bias, y);
+}
+
+// The output channels [o, o + lanes) of a group, each input channel
+// broadcast against a row of the filter.
+template<typename W>
+inline void group_block(utens_t o, utens_t k, utens_t taps,
+                        const typename W::Scalar *const *x,
+                        const typename W::Scalar *const *w, utens_t w_stride,
+                        const typename W::Scalar *bias,
+                        typename W::Scalar *y) {
+  typename W::Reg acc = bias ? W::Load(bias + o) : W::Set1(0);
+  for (utens_t t = 0; t < taps; t++) {
+    const typename W::Scalar *row = w[t] + o;
+    for (utens_t c = 0; c < k; c++) {
+      acc = W::MulAdd(W::Set1(x[t][c]), W::Load(row + c * w_stride), acc);
+    }
+  }
+  W::Store(y + o, acc);
+}
+
+template<typename Dtype>
+void group_kernel(utens_t n, utens_t k, utens_t taps, const Dtype *const *x,
+                  const Dtype *const *w, utens_t w_stride, const Dtype *bias,
+                  Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t o = 0;
+  for (; o + lanes <= n; o += lanes) {
+    group_block<V>(o, k, taps, x, w, w_stride, bias, y);
+  }
+  for (; o < n; o++) group_block<S>(o, k, taps, x, w, w_stride, bias, y);
+}
+
+template<typename Dtype>
+void depthwise_filter_kernel(utens_t n, utens_t taps, const Dtype *const *x,
+                             const Dtype *dy, Dtype *const *dw) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t c = 0;
+  for (; c + lanes <= n; c += lanes) {
+    const typename V::Reg g = V::Load(dy + c);
+    for (utens_t t = 0; t < taps; t++) {
+      V::Store(dw[t] + c,
+               V::MulAdd(V::Load(x[t] + c), g, V::Load(dw[t] + c)));
+    }
+  }
+  for (; c < n; c++) {
+    for (utens_t t = 0; t < taps; t++) dw[t][c] += x[t][c] * dy[c];
+  }
+}
+
+template<typename Dtype>
+void group_filter_kernel(utens_t n, utens_t k, utens_t taps,
+                         const Dtype *const *x, const Dtype *dy,
+                         Dtype *const *dw, utens_t w_stride) {
+  typedef simd::Vec<Dtype> V;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t o = 0;
+  for (; o + lanes <= n; o += lanes) {
+    const typename V::Reg g = V::Load(dy + o);
+    for (utens_t t = 0; t < taps; t++) {
+      for (utens_t c = 0; c < k; c++) {
+        Dtype *row = dw[t] + c * w_stride + o;
+        V::Store(row, V::MulAdd(V::Set1(x[t][c]), g, V::Load(row)));
+      }
+    }
+  }
+  for (; o < n; o++) {
+    for (utens_t t = 0; t < taps; t++) {
+      for (utens_t c = 0; c < k; c++) {
+        dw[t][c * w_stride + o] += x[t][c] * dy[o];
+      }
+    }
+  }
+}
+
+// Max pooling on one register of lanes. The tap holding the maximum is
+// tracked in a register of Dtype, which holds any window size exactly.
+template<typename W, bool kTap>
+inline void max_pool_block(utens_t i, utens_t taps,
+                           const typename W::Scalar *const *x,
+                           typename W::Scalar *y, typename W::Scalar *tap) {
+  typedef typename W::Scalar T;
+  typename W::Reg best = W::Load(x[0] + i);
+  typename W::Reg best_tap = W::Set1(T(0));
+  for (utens_t t = 1; t < taps; t++) {
+    const typename W::Reg v = W::Load(x[t] + i);
+    if (kTap) {
+      const typename W::Mask greater = W::Gt(v, best);
+      best = W::Select(greater, v, best);
+      best_tap = W::Select(greater, W::Set1(static_cast<T>(t)), best_tap);
+    } else {
+      best = W::Max(best, v);
+    }
+  }
+  W::Store(y + i, best);
+  if (kTap) W::Store(tap + i, best_tap);
+}
+
+template<typename Dtype, bool kTap>
+void max_pool_lanes(utens_t n, utens_t taps, const Dtype *const *x, Dtype *y,
+                    Dtype *tap) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    max_pool_block<V, kTap>(i, taps, x, y, tap);
+  }
+  for (; i < n; i++) max_pool_block<S, kTap>(i, taps, x, y, tap);
+}
+
+template<typename Dtype>
+void max_pool_kernel(utens_t n, utens_t taps, const Dtype *const *x,
+                     Dtype *y, Dtype *tap) {
+  if (tap) {
+    max_pool_lanes<Dtype, true>(n, taps, x, y, tap);
+  } else {
+    max_pool_lanes<Dtype, false>(n, taps, x, y, tap);
+  }
+}
+
+template<typename W>
+inline void average_pool_block(utens_t i, utens_t taps,
+                               const typename W::Scalar *const *x,
+                               typename W::Scalar scale,
+                               typename W::Scalar *y) {
+  typename W::Reg sum = W::Set1(0);
+  for (utens_t t = 0; t < taps; t++) sum = W::Add(sum, W::Load(x[t] + i));
+  W::Store(y + i, W::Mul(sum, W::Set1(scale)));
+}
+
+template<typename Dtype>
+void average_pool_kernel(utens_t n, utens_t taps, const Dtype *const *x,
+                         Dtype scale, Dtype *y) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    average_pool_block<V>(i, taps, x, scale, y);
+  }
+  for (; i < n; i++) average_pool_block<S>(i, taps, x, scale, y);
+}
+
+// Each tap is loaded and stored in turn, so that taps whose lanes overlap
+// see each other's sums.
+template<typename W>
+inline void average_pool_backward_block(utens_t i, utens_t taps,
+                                        const typename W::Scalar *dy,
+                                        typename W::Scalar scale,
+                                        typename W::Scalar *const *dx) {
+  const typename W::Reg g = W::Mul(W::Load(dy + i), W::Set1(scale));
+  for (utens_t t = 0; t < taps; t++) {
+    W::Store(dx[t] + i, W::Add(W::Load(dx[t] + i), g));
+  }
+}
+
+template<typename Dtype>
+void average_pool_backward_kernel(utens_t n, utens_t taps, const Dtype *dy,
+                                  Dtype scale, Dtype *const *dx) {
+  typedef simd::Vec<Dtype> V;
+  typedef simd::Vec<Dtype, 0> S;
+  const utens_t lanes = static_cast<utens_t>(V::kLanes);
+  utens_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    average_pool_backward_block<V>(i, taps, dy, scale, dx);
+  }
+  for (; i < n; i++) average_pool_backward_block<S>(i, taps, dy, scale, dx);
+}
+
+// Copies the transpose of a `rows` x `cols` block of `kBytes`-byte elements
+// one element at a time. `lx` and `ly` are the distances between rows in
+// bytes. Used for the edges of the tiles and for elements without a shuffle.
+template<int kBytes>
+void transpose_scalar(utens_t rows, utens_t cols, const char *x, utens_t lx,
+                      char *y, utens_t ly) {
+  for (utens_t j = 0; j < cols; j++) {
+    for (utens_t i = 0; i < rows; i++) {
+      std::memcpy(y + j * ly + i * kBytes, x + i * lx + j * kBytes, kBytes);
+    }
+  }
+}
+
+// Transposes a `kSize` x `kSize` block of `kBytes`-byte elements in registers.
+// The generic form has no shuffle and moves one element.
+template<int kBytes>
+struct TransposeBlock {
+  static constexpr utens_t kSize = 1;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    transpose_scalar<kBytes>(1, 1, x, lx, y, ly);
+  }
+};
+
+#if CHIME_SIMD_BYTES > 0
+// Eight rows of eight bytes are widened to 16, 32 and then 64 bits by
+// interleaving pairs of registers, which leaves two columns in each.
+template<>
+struct TransposeBlock<1> {
+  static constexpr utens_t kSize = 8;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    __m128i r[8], t[4];
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+      r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i * lx));
+    }
+#pragma GCC unroll 8
+    for (int i = 0; i < 4; i++) {
+      t[i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
+    }
+    r[0] = _mm_unpacklo_epi16(t[0], t[1]);
+    r[1] = _mm_unpackhi_epi16(t[0], t[1]);
+    r[2] = _mm_unpacklo_epi16(t[2], t[3]);
+    r[3] = _mm_unpackhi_epi16(t[2], t[3]);
+    t[0] = _mm_unpacklo_epi32(r[0], r[2]);
+    t[1] = _mm_unpackhi_epi32(r[0], r[2]);
+    t[2] = _mm_unpacklo_epi32(r[1], r[3]);
+    t[3] = _mm_unpackhi_epi32(r[1], r[3]);
+#pragma GCC unroll 8
+    for (int j = 0; j < 4; j++) {
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(y + 2 * j * ly), t[j]);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(y + (2 * j + 1) * ly),
+                       _mm_unpackhi_epi64(t[j], t[j]));
+    }
+  }
+};
+
+template<>
+struct TransposeBlock<2> {
+  static constexpr utens_t kSize = 8;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    __m128i r[8], t[8];
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+      r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i * lx));
+    }
+#pragma GCC unroll 8
+    for (int i = 0; i < 4; i++) {
+      t[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+    }
+#pragma GCC unroll 8
+    for (int h = 0; h < 2; h++) {
+      r[4 * h] = _mm_unpacklo_epi32(t[4 * h], t[4 * h + 2]);
+      r[4 * h + 1] = _mm_unpackhi_epi32(t[4 * h], t[4 * h + 2]);
+      r[4 * h + 2] = _mm_unpacklo_epi32(t[4 * h + 1], t[4 * h + 3]);
+      r[4 * h + 3] = _mm_unpackhi_epi32(t[4 * h + 1], t[4 * h + 3]);
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 4; j++) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + 2 * j * ly),
+                       _mm_unpacklo_epi64(r[j], r[j + 4]));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + (2 * j + 1) * ly),
+                       _mm_unpackhi_epi64(r[j], r[j + 4]));
+    }
+  }
+};
+
+#if CHIME_SIMD_BYTES >= 32
+// Each 128-bit half is transposed as a 4 x 4 block, then the halves of rows
+// i and i + 4 are swapped across lanes.
+template<>
+struct TransposeBlock<4> {
+  static constexpr utens_t kSize = 8;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    __m256 r[8], t[8];
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+      r[i] = _mm256_castsi256_ps(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i * lx)));
+    }
+#pragma GCC unroll 8
+    for (int i = 0; i < 4; i++) {
+      t[2 * i] = _mm256_unpacklo_ps(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm256_unpackhi_ps(r[2 * i], r[2 * i + 1]);
+    }
+#pragma GCC unroll 8
+    for (int h = 0; h < 2; h++) {
+      r[4 * h] = _mm256_shuffle_ps(t[4 * h], t[4 * h + 2], 0x44);
+      r[4 * h + 1] = _mm256_shuffle_ps(t[4 * h], t[4 * h + 2], 0xee);
+      r[4 * h + 2] = _mm256_shuffle_ps(t[4 * h + 1], t[4 * h + 3], 0x44);
+      r[4 * h + 3] = _mm256_shuffle_ps(t[4 * h + 1], t[4 * h + 3], 0xee);
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 4; j++) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(y + j * ly),
+          _mm256_castps_si256(_mm256_permute2f128_ps(r[j], r[j + 4], 0x20)));
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(y + (j + 4) * ly),
+          _mm256_castps_si256(_mm256_permute2f128_ps(r[j], r[j + 4], 0x31)));
+    }
+  }
+};
+
+template<>
+struct TransposeBlock<8> {
+  static constexpr utens_t kSize = 4;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    __m256d r[4], t[4];
+#pragma GCC unroll 8
+    for (int i = 0; i < 4; i++) {
+      r[i] = _mm256_castsi256_pd(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i * lx)));
+    }
+#pragma GCC unroll 8
+    for (int i = 0; i < 2; i++) {
+      t[2 * i] = _mm256_unpacklo_pd(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm256_unpackhi_pd(r[2 * i], r[2 * i + 1]);
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 2; j++) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(y + j * ly),
+          _mm256_castpd_si256(_mm256_permute2f128_pd(t[j], t[j + 2], 0x20)));
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(y + (j + 2) * ly),
+          _mm256_castpd_si256(_mm256_permute2f128_pd(t[j], t[j + 2], 0x31)));
+    }
+  }
+};
+#else
+template<>
+struct TransposeBlock<4> {
+  static constexpr utens_t kSize = 4;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    __m128 r[4];
+#pragma GCC unroll 8
+    for (int i = 0; i < 4; i++) {
+      r[i] = _mm_castsi128_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i * lx)));
+    }
+    _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+#pragma GCC unroll 8
+    for (int j = 0; j < 4; j++) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + j * ly),
+                       _mm_castps_si128(r[j]));
+    }
+  }
+};
+
+template<>
+struct TransposeBlock<8> {
+  static constexpr utens_t kSize = 2;
+  static void Run(const char *x, utens_t lx, char *y, utens_t ly) {
+    const __m128i r0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(x));
+    const __m128i r1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + lx));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y),
+                     _mm_unpacklo_epi64(r0, r1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y + ly),
+                     _mm_unpackhi_epi64(r0, r1));
+  }
+};
+#endif  // CHIME_SIMD_BYTES >= 32
+#endif  // CHIME_SIMD_BYTES > 0
+
+// See `TransposeKernels`.
+template<int kBytes>
+void transpose_kernel(utens_t rows, utens_t cols, const void *x, utens_t ldx,
+                      void *y, utens_t ldy) {
+  typedef TransposeBlock<kBytes> B;
+  const char *src = static_cast<const char *>(x);
+  char *dst = static_cast<char *>(y);
+  const utens_t lx = ldx * kBytes, ly = ldy * kBytes;
+  utens_t i = 0;
+  for (; i + B::kSize <= rows; i += B::kSize) {
+    utens_t j = 0;
+    for (; j + B::kSize <= cols; j += B::kSize) {
+      B::Run(src + i * lx + j * kBytes, lx, dst + j * ly + i * kBytes, ly);
+    }
+    transpose_scalar<kBytes>(B::kSize, cols - j, src + i * lx + j * kBytes,
+                             lx, dst + j * ly + i * kBytes, ly);
+  }
+  transpose_scalar<kBytes>(rows - i, cols, src + i * lx, lx, dst + i * kBytes,
+                           ly);
+}
+
+}  // namespace
+
+template<typename Dtype>
+const ElementwiseKernels<Dtype> &ElementwiseKernelTable() {
+  static const ElementwiseKernels<Dtype> table = {
+      &binary_kernel<Dtype, AddFunctor<Dtype>>,
+      &binary_kernel<Dtype, SubFunctor<Dtype>>,
+      &binary_kernel<Dtype, MulFunctor<Dtype>>,
+      &binary_kernel<Dtype, DivFunctor<Dtype>>,
+      &sign_kernel<Dtype>,
+      &scal_kernel<Dtype>,
+  };
+  return table;
+}
+
+template const ElementwiseKernels<int8> &ElementwiseKernelTable<int8>();
+template const ElementwiseKernels<int16> &ElementwiseKernelTable<int16>();
+template const ElementwiseKernels<int32> &ElementwiseKernelTable<int32>();
+template const ElementwiseKernels<int64> &ElementwiseKernelTable<int64>();
+template const ElementwiseKernels<uint8> &ElementwiseKernelTable<uint8>();
+template const ElementwiseKernels<uint16> &ElementwiseKernelTable<uint16>();
+template const ElementwiseKernels<uint32> &ElementwiseKernelTable<uint32>();
+template const ElementwiseKernels<uint64> &ElementwiseKernelTable<uint64>();
+template const ElementwiseKernels<float32> &ElementwiseKernelTable<float32>();
+template const ElementwiseKernels<float64> &ElementwiseKernelTable<float64>();
+template const ElementwiseKernels<float128>
+    &ElementwiseKernelTable<float128>();
+
+template<>
+const ElementwiseKernels<float16> &ElementwiseKernelTable<float16>() {
+  return HalfElementwiseKernelTable<float16>();
+}
+
+template<>
+const ElementwiseKernels<bfloat16> &ElementwiseKernelTable<bfloat16>() {
+  return HalfElementwiseKernelTable<bfloat16>();
+}
+
+template<typename Dtype>
+const BroadcastKernels<Dtype> &BroadcastKernelTable() {
+  static const BroadcastKernels<Dtype> table = {
+      &rhs_kernel<Dtype, AddFunctor<Dtype>>,
+      &rhs_kernel<Dtype, SubFunctor<Dtype>>,
+      &rhs_kernel<Dtype, MulFunctor<Dtype>>,
+      &rhs_kernel<Dtype, DivFunctor<Dtype>>,
+      &lhs_kernel<Dtype, AddFunctor<Dtype>>,
+      &lhs_kernel<Dtype, SubFunctor<Dtype>>,
+      &lhs_kernel<Dtype, MulFunctor<Dtype>>,
+      &lhs_kernel<Dtype, DivFunctor<Dtype>>,
+  };
+  return table;
+}
+
+template const BroadcastKernels<int8> &BroadcastKernelTable<int8>();
+template const BroadcastKernels<int16> &BroadcastKernelTable<int16>();
+template const BroadcastKernels<int32> &BroadcastKernelTable<int32>();
+template const BroadcastKernels<int64> &BroadcastKernelTable<int64>();
+template const BroadcastKernels<uint8> &BroadcastKernelTable<uint8>();
+template const BroadcastKernels<uint16> &BroadcastKernelTable<uint16>();
+template const BroadcastKernels<uint32> &BroadcastKernelTable<uint32>();
+template const BroadcastKernels<uint64> &BroadcastKernelTable<uint64>();
+template const BroadcastKernels<float32> &BroadcastKernelTable<float32>();
+template const BroadcastKernels<float64> &BroadcastKernelTable<float64>();
+template const BroadcastKernels<float128> &BroadcastKernelTable<float128>();
+
+template<typename Htype>
+const HalfKernels<Htype> &HalfKernelTable() {
+  static const HalfKernels<Htype> table = {
+      &half_to_float_kernel<Htype>,
+      &float_to_half_kernel<Htype>,
+      &half_dot_kernel<Htype>,
+      &half_axpy_kernel<Htype>,
+  };
+  return table;
+}
+
+template const HalfKernels<float16> &HalfKernelTable<float16>();
+template const HalfKernels<bfloat16> &HalfKernelTable<bfloat16>();
+
+template<typename Dtype>
+const TranscendentalKernels<Dtype> &TranscendentalKernelTable() {
+  static const TranscendentalKernels<Dtype> table = {
+      &padded_unary_kernel<Dtype, ExpFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, LogFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, TanhFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, SigmoidFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, ErfFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, GeluFunctor<Dtype>>,
+      &padded_unary_kernel<Dtype, SoftplusFunctor<Dtype>>,
+  };
+  return table;
+}
+
+template const TranscendentalKernels<float32>
+    &TranscendentalKernelTable<float32>();
+template const TranscendentalKernels<float64>
+    &TranscendentalKernelTable<float64>();
+
+template<typename Dtype>
+const ReduceKernels<Dtype> &ReduceKernelTable() {
+  static const ReduceKernels<Dtype> table = {
+      &sum_kernel<Dtype>,
+      &sum_sq_dev_kernel<Dtype>,
+      &extremum_kernel<Dtype, true>,
+      &extremum_kernel<Dtype, false>,
+      &add_col_kernel<Dtype>,
+      &sq_dev_col_kernel<Dtype>,
+      &extremum_col_kernel<Dtype, true>,
+      &extremum_col_kernel<Dtype, false>,
+  };
+  return table;
+}
+
+template const ReduceKernels<float32> &ReduceKernelTable<float32>();
+template const ReduceKernels<float64> &ReduceKernelTable<float64>();
+
+template<typename Dtype>
+const SoftmaxKernels<Dtype> &SoftmaxKernelTable() {
+  static const SoftmaxKernels<Dtype> table = {
+      &softmax_kernel<Dtype, false>,
+      &softmax_kernel<Dtype, true>,
+      &softmax_col_kernel<Dtype, false>,
+      &softmax_col_kernel<Dtype, true>,
+      &cross_entropy_kernel<Dtype>,
+  };
+  return table;
+}
+
+template const SoftmaxKernels<float32> &SoftmaxKernelTable<float32>();
+template const SoftmaxKernels<float64> &SoftmaxKernelTable<float64>();
+
+template<typename Dtype>
+const WinogradKernels<Dtype> &WinogradKernelTable() {
+  static const WinogradKernels<Dtype> table = {
+      {&winograd_filter_kernel<Dtype, 2>, &winograd_filter_kernel<Dtype, 4>},
+      {&winograd_input_kernel<Dtype, 2>, &winograd_input_kernel<Dtype, 4>},
+      {&winograd_output_kernel<Dtype, 2>, &winograd_output_kernel<Dtype, 4>},
+  };
+  return table;
+}
+
+template const WinogradKernels<float32> &WinogradKernelTable<float32>();
+template const WinogradKernels<float64> &WinogradKernelTable<float64>();
+
+template<typename Dtype>
+const GroupedConvKernels<Dtype> &GroupedConvKernelTable() {
+  static const GroupedConvKernels<Dtype> table = {
+      &depthwise_kernel<Dtype>,
+      &group_kernel<Dtype>,
+      &depthwise_filter_kernel<Dtype>,
+      &group_filter_kernel<Dtype>,
+  };
+  return table;
+}
+
+template const GroupedConvKernels<float32> &GroupedConvKernelTable<float32>();
+template const GroupedConvKernels<float64> &GroupedConvKernelTable<float64>();
+
+template<typename Dtype>
+const PoolKernels<Dtype> &PoolKernelTable() {
+  static const PoolKernels<Dtype> table = {
+      &max_pool_kernel<Dtype>,
+      &average_pool_kernel<Dtype>,
+      &average_pool_backward_kernel<Dtype>,
+  };
+  return table;
+}
+
+template const PoolKernels<float32> &PoolKernelTable<float32>();
+template const PoolKernels<float64> &PoolKernelTable<float64>();
+
+template<typename Dtype>
+const RandomKernels<Dtype> &RandomKernelTable() {
+  static const RandomKernels<Dtype> table = {
+      &philox_bits_kernel,
+      &uniform_kernel<Dtype>,
+      &gaussian_kernel<Dtype>,
+      &dropout_kernel<Dtype>,
+      &masked_scale_kernel<Dtype>,
+  };
+  return table;
+}
+
+template const RandomKernels<float32> &RandomKernelTable<float32>();
+template const RandomKernels<float64> &RandomKernelTable<float64>();
+
+template<typename Dtype>
+const GemmKernels<Dtype> &GemmKernelTable() {
+  static const GemmKernels<Dtype> table = {
+      GemmTile<Dtype>::kMR,
+      GemmTile<Dtype>::kNV * simd::Vec<Dtype>::kLanes,
+      &gemm_micro_kernel<Dtype, GemmTile<Dtype>::kMR, GemmTile<Dtype>::kNV>,
+      &gemm_micro_kernel<Dtype, 1, GemmTile<Dtype>::kNV>,
+      {
+#define CHIME_FIXED_GEMM_K(M, N)                                           \
+  &gemm_fixed_kernel<Dtype, M, N, 4>, &gemm_fixed_kernel<Dtype, M, N, 8>,  \
+      &gemm_fixed_kernel<Dtype, M, N, 16>, &gemm_fixed_kernel<Dtype, M, N, 32>
+#define CHIME_FIXED_GEMM_N(M)                                              \
+  CHIME_FIXED_GEMM_K(M, 4), CHIME_FIXED_GEMM_K(M, 8),                      \
+      CHIME_FIXED_GEMM_K(M, 16), CHIME_FIXED_GEMM_K(M, 32)
+          CHIME_FIXED_GEMM_N(4),
+          CHIME_FIXED_GEMM_N(8),
+          CHIME_FIXED_GEMM_N(16),
+          CHIME_FIXED_GEMM_N(32),
+#undef CHIME_FIXED_GEMM_N
+#undef CHIME_FIXED_GEMM_K
+      },
+  };
+  return table;
+}
+
+template const GemmKernels<float32> &GemmKernelTable<float32>();
+template const GemmKernels<float64> &GemmKernelTable<float64>();
+template const GemmKernels<float128> &GemmKernelTable<float128>();
+
+const TransposeKernels &TransposeKernelTable() {
+  static const TransposeKernels table = {
+      {
+          &transpose_kernel<1>,
+          &transpose_kernel<2>,
+          &transpose_kernel<4>,
+          &transpose_kernel<8>,
+          &transpose_kernel<16>,
+      },
+  };
+  return table;
+}
+
+const QuantizedGemmKernels &QuantizedGemmKernelTable() {
+#if defined(__AVX512VNNI__)
+  static const QuantizedGemmKernels table = {
+      8,
+      32,
+      &quantized_gemm_vnni_kernel<8, 2>,
+  };
+#else
+  static const QuantizedGemmKernels table = {
+      kQuantizedGemmMR,
+      kQuantizedGemmNV * Int8Dot::kCols,
+      &quantized_gemm_micro_kernel<kQuantizedGemmMR, kQuantizedGemmNV>,
+  };
+#endif  // __AVX512VNNI__
+  return table;
+}
+
+const Int4GemmKernels &Int4GemmKernelTable() {
+  static const Int4GemmKernels table = {
+      kInt4GemmMR,
+      kInt4GemmNR,
+      &int4_gemm_micro_kernel<kInt4GemmMR, kInt4GemmNR>,
+      &int4_gemm_micro_kernel<1, kInt4GemmNR>,
+  };
+  return table;
+}
+
+}  // namespace CHIME_CPU_CAPABILITY
+}  // namespace kernels
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_MATH_KERNELS_IMPL_H_
@@ -0,0 +1,6 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+// Must be compiled with `-msse4.2`.
+#define CHIME_CPU_CAPABILITY cpu_sse4_2
+#include "chime/core/framework/math_kernels_impl.h"
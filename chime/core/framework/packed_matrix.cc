@@ -0,0 +1,353 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/packed_matrix.h"
+
+#include <algorithm>
+
+#include "chime/core/framework/intra_op_parallel.h"
+
+namespace chime {
+
+namespace {
+
+// Cache blocking of the GEMM driver: a kGemmMC x kGemmKC block of packed A is
+// reused from L2 across a column block of C, while each kGemmKC x nr panel of
+// B stays in L1 across the rows of the block. kGemmMC is a multiple of every
+// `mr`.
+constexpr utens_t kGemmKC = 256;
+constexpr utens_t kGemmMC = 96;
+constexpr utens_t kGemmNC = 1024;
+
+// Smallest number of multiply-adds worth handing to another thread.
+constexpr int64_t kGemmMinShardWork = 1 << 20;
+
+// Packs rows [i0, i0 + mc) and columns [p0, p0 + kc) of op(A) into panels of
+// `mr` rows, each stored column after column and padded with zeros. A last
+// panel of a single row is stored without padding, for `row_kernel`.
+template<typename Dtype>
+void pack_a(CBLAS_TRANSPOSE transA, const Dtype *A, utens_t lda, utens_t i0,
+            utens_t mc, utens_t p0, utens_t kc, utens_t mr, Dtype *dst) {
+  for (utens_t ir = 0; ir < mc; ir += mr) {
+    const utens_t rows = std::min(mr, mc - ir);
+    const utens_t height = rows == 1 ? 1 : mr;
+    for (utens_t p = 0; p < kc; p++, dst += height) {
+      for (utens_t r = 0; r < rows; r++) {
+        const utens_t i = i0 + ir + r;
+        dst[r] = transA == CblasNoTrans ? A[i * lda + p0 + p]
+                                        : A[(p0 + p) * lda + i];
+      }
+      for (utens_t r = rows; r < height; r++) dst[r] = Dtype(0);
+    }
+  }
+}
+
+// Packs `cols` columns of a kc x nr panel of op(B), stored row after row and
+// padded with zeros. `B` points to the first element of the panel: row p0,
+// column j0 of op(B).
+template<typename Dtype>
+void pack_b_panel(CBLAS_TRANSPOSE transB, const Dtype *B, utens_t ldb,
+                  utens_t kc, utens_t cols, utens_t nr, Dtype *dst) {
+  for (utens_t p = 0; p < kc; p++, dst += nr) {
+    if (transB == CblasNoTrans) {
+      const Dtype *row = B + p * ldb;
+      for (utens_t c = 0; c < cols; c++) dst[c] = row[c];
+    } else {
+      const Dtype *col = B + p;
+      for (utens_t c = 0; c < cols; c++) dst[c] = col[c * ldb];
+    }
+    for (utens_t c = cols; c < nr; c++) dst[c] = Dtype(0);
+  }
+}
+
+// Widens `rows` rows of `cols` 16-bit elements, `ld` apart, to a contiguous
+// float32 block.
+template<typename Htype>
+void widen_rows(const kernels::HalfKernels<Htype> &half, utens_t rows,
+                utens_t cols, const Htype *src, utens_t ld, float32 *dst) {
+  for (utens_t r = 0; r < rows; r++) {
+    half.to_float(cols, src + r * ld, dst + r * cols);
+  }
+}
+
+}  // namespace
+
+namespace internal {
+
+template<typename Dtype>
+void PackGemmB(CBLAS_TRANSPOSE transB, utens_t k, utens_t n, const Dtype *B,
+               utens_t ldb, utens_t nr, Dtype *dst) {
+  const utens_t panels = (n + nr - 1) / nr;
+  const int64_t panel_size = static_cast<int64_t>(std::max<utens_t>(k * nr, 1));
+  const int64_t grain_size =
+      std::max<int64_t>(1, kIntraOpGrainSize / panel_size);
+  ParallelFor(static_cast<int64_t>(panels), grain_size,
+              [&](int64_t begin, int64_t end) {
+                for (utens_t j = begin; j < static_cast<utens_t>(end); j++) {
+                  const utens_t j0 = j * nr;
+                  pack_b_panel(transB,
+                               transB == CblasNoTrans ? B + j0 : B + j0 * ldb,
+                               ldb, k, std::min(nr, n - j0), nr,
+                               dst + j * k * nr);
+                }
+              });
+}
+
+template<typename Dtype>
+void GemmPackedB(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, utens_t k,
+                 Dtype alpha, const Dtype *A, utens_t lda,
+                 const Dtype *packed_b,
+                 const kernels::GemmKernels<Dtype> &gemm, Dtype beta,
+                 Dtype *C, utens_t ldc) {
+  if (m == 0 || n == 0) return;
+  if (k == 0) {
+    for (utens_t i = 0; i < m; i++) {
+      for (utens_t j = 0; j < n; j++) {
+        C[i * ldc + j] = beta == Dtype(0) ? Dtype(0) : beta * C[i * ldc + j];
+      }
+    }
+    return;
+  }
+
+  const utens_t mr = static_cast<utens_t>(gemm.mr);
+  const utens_t nr = static_cast<utens_t>(gemm.nr);
+
+  // Tasks are blocks of rows times blocks of panels of C. When there are too
+  // few row blocks to go around, e.g. for a single row, the columns are split
+  // further.
+  const utens_t row_blocks = (m + kGemmMC - 1) / kGemmMC;
+  const utens_t panels = (n + nr - 1) / nr;
+  utens_t col_blocks = (n + kGemmNC - 1) / kGemmNC;
+  const utens_t num_threads = static_cast<utens_t>(GetIntraOpNumThreads());
+  if (row_blocks * col_blocks < num_threads) {
+    col_blocks = std::min(panels, (num_threads + row_blocks - 1) / row_blocks);
+  }
+  const utens_t block_panels = (panels + col_blocks - 1) / col_blocks;
+  col_blocks = (panels + block_panels - 1) / block_panels;
+
+  const int64_t task_work =
+      static_cast<int64_t>(std::min(m, kGemmMC) * block_panels * nr * k);
+  const int64_t grain_size =
+      std::max<int64_t>(1, kGemmMinShardWork / task_work);
+  ParallelFor(
+      static_cast<int64_t>(row_blocks * col_blocks), grain_size,
+      [&](int64_t begin, int64_t end) {
+        std::vector<Dtype> a_pack(kGemmMC * std::min(k, kGemmKC));
+        for (utens_t t = begin; t < static_cast<utens_t>(end); t++) {
+          const utens_t i0 = t / col_blocks * kGemmMC;
+          const utens_t mc = std::min(kGemmMC, m - i0);
+          const utens_t first_panel = t % col_blocks * block_panels;
+          const utens_t last_panel =
+              std::min(panels, first_panel + block_panels);
+          for (utens_t p0 = 0; p0 < k; p0 += kGemmKC) {
+            const utens_t kc = std::min(kGemmKC, k - p0);
+            // Later slices of k add to what the first one stored.
+            const Dtype beta_k = p0 == 0 ? beta : Dtype(1);
+            pack_a(transA, A, lda, i0, mc, p0, kc, mr, a_pack.data());
+            for (utens_t j = first_panel; j < last_panel; j++) {
+              const Dtype *b = packed_b + (j * k + p0) * nr;
+              const utens_t cols = std::min(nr, n - j * nr);
+              for (utens_t ir = 0; ir < mc; ir += mr) {
+                const utens_t rows = std::min(mr, mc - ir);
+                (rows == 1 ? gemm.row_kernel : gemm.micro_kernel)(
+                    kc, alpha, a_pack.data() + ir * kc, b, beta_k,
+                    C + (i0 + ir) * ldc + j * nr, ldc, rows, cols);
+              }
+            }
+          }
+        }
+      });
+}
+
+template<typename Htype>
+void GemmHalf(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+              utens_t n, utens_t k, float32 alpha, const Htype *A,
+              utens_t lda, const Htype *B, utens_t ldb, float32 beta,
+              Htype *C, utens_t ldc) {
+  if (m == 0 || n == 0) return;
+  if (k == 0) {
+    for (utens_t i = 0; i < m; i++) {
+      for (utens_t j = 0; j < n; j++) {
+        C[i * ldc + j] = Htype(
+            beta == 0.f ? 0.f : beta * static_cast<float32>(C[i * ldc + j]));
+      }
+    }
+    return;
+  }
+
+  const kernels::GemmKernels<float32> &gemm =
+      kernels::GetGemmKernels<float32>();
+  const kernels::HalfKernels<Htype> &half = kernels::GetHalfKernels<Htype>();
+  const utens_t mr = static_cast<utens_t>(gemm.mr);
+  const utens_t nr = static_cast<utens_t>(gemm.nr);
+
+  // Same split as `GemmPackedB`. Each task packs its own panels of B, so that
+  // a panel is widened once per block of rows of C instead of all of B up
+  // front.
+  const utens_t row_blocks = (m + kGemmMC - 1) / kGemmMC;
+  const utens_t panels = (n + nr - 1) / nr;
+  utens_t col_blocks = (n + kGemmNC - 1) / kGemmNC;
+  const utens_t num_threads = static_cast<utens_t>(GetIntraOpNumThreads());
+  if (row_blocks * col_blocks < num_threads) {
+    col_blocks = std::min(panels, (num_threads + row_blocks - 1) / row_blocks);
+  }
+  const utens_t block_panels = (panels + col_blocks - 1) / col_blocks;
+  col_blocks = (panels + block_panels - 1) / block_panels;
+
+  const int64_t task_work =
+      static_cast<int64_t>(std::min(m, kGemmMC) * block_panels * nr * k);
+  const int64_t grain_size =
+      std::max<int64_t>(1, kGemmMinShardWork / task_work);
+  ParallelFor(
+      static_cast<int64_t>(row_blocks * col_blocks), grain_size,
+      [&](int64_t begin, int64_t end) {
+        const utens_t kc_max = std::min(k, kGemmKC);
+        std::vector<float32> a_rows(kGemmMC * kc_max), a_pack(a_rows.size());
+        std::vector<float32> b_rows(kc_max * nr), b_pack(b_rows.size());
+        std::vector<float32> c_tile(kGemmMC * block_panels * nr);
+        for (utens_t t = begin; t < static_cast<utens_t>(end); t++) {
+          const utens_t i0 = t / col_blocks * kGemmMC;
+          const utens_t mc = std::min(kGemmMC, m - i0);
+          const utens_t first_panel = t % col_blocks * block_panels;
+          const utens_t last_panel =
+              std::min(panels, first_panel + block_panels);
+          const utens_t j0 = first_panel * nr;
+          const utens_t nc = std::min(n, last_panel * nr) - j0;
+
+          // The tile of C is summed in float32 and rounded once at the end.
+          if (beta != 0.f) {
+            widen_rows(half, mc, nc, C + i0 * ldc + j0, ldc, c_tile.data());
+          }
+          for (utens_t p0 = 0; p0 < k; p0 += kGemmKC) {
+            const utens_t kc = std::min(kGemmKC, k - p0);
+            const float32 beta_k = p0 == 0 ? beta : 1.f;
+            // Widens the stored rows of the block of op(A), then packs them.
+            if (transA == CblasNoTrans) {
+              widen_rows(half, mc, kc, A + i0 * lda + p0, lda, a_rows.data());
+              pack_a(transA, a_rows.data(), kc, 0, mc, 0, kc, mr,
+                     a_pack.data());
+            } else {
+              widen_rows(half, kc, mc, A + p0 * lda + i0, lda, a_rows.data());
+              pack_a(transA, a_rows.data(), mc, 0, mc, 0, kc, mr,
+                     a_pack.data());
+            }
+            for (utens_t j = first_panel; j < last_panel; j++) {
+              const utens_t cols = std::min(nr, n - j * nr);
+              if (transB == CblasNoTrans) {
+                widen_rows(half, kc, cols, B + p0 * ldb + j * nr, ldb,
+                           b_rows.data());
+                pack_b_panel(transB, b_rows.data(), cols, kc, cols, nr,
+                             b_pack.data());
+              } else {
+                widen_rows(half, cols, kc, B + j * nr * ldb + p0, ldb,
+                           b_rows.data());
+                pack_b_panel(transB, b_rows.data(), kc, kc, cols, nr,
+                             b_pack.data());
+              }
+              for (utens_t ir = 0; ir < mc; ir += mr) {
+                const utens_t rows = std::min(mr, mc - ir);
+                (rows == 1 ? gemm.row_kernel : gemm.micro_kernel)(
+                    kc, alpha, a_pack.data() + ir * kc, b_pack.data(), beta_k,
+                    c_tile.data() + ir * nc + (j * nr - j0), nc, rows, cols);
+              }
+            }
+          }
+          for (utens_t i = 0; i < mc; i++) {
+            half.from_float(nc, c_tile.data() + i * nc,
+                            C + (i0 + i) * ldc + j0);
+          }
+        }
+      });
+}
+
+}  // namespace internal
+
+template<typename Dtype>
+PackedMatrix<Dtype>::PackedMatrix(CBLAS_TRANSPOSE transB, utens_t k, utens_t n,
+                                  const Dtype *B, utens_t ldb)
+    : _k(k), _n(n), _kernels(&kernels::GetGemmKernels<Dtype>()) {
+  CHECK_GE(ldb, std::max<utens_t>(transB == CblasNoTrans ? n : k, 1));
+  _data.resize(num_panels() * k * nr());
+  internal::PackGemmB(transB, k, n, B, ldb, nr(), _data.data());
+}
+
+template<typename Dtype>
+void chime_cpu_gemm_packed(CBLAS_TRANSPOSE transA, utens_t m, Dtype alpha,
+                           const Dtype *A, utens_t lda,
+                           const PackedMatrix<Dtype> &B, Dtype beta, Dtype *C,
+                           utens_t ldc) {
+  CHECK_GE(lda, std::max<utens_t>(transA == CblasNoTrans ? B.k() : m, 1));
+  CHECK_GE(ldc, std::max<utens_t>(B.n(), 1));
+  internal::GemmPackedB(transA, m, B.n(), B.k(), alpha, A, lda, B.panel(0),
+                        B.gemm_kernels(), beta, C, ldc);
+}
+
+template<typename Dtype>
+std::shared_ptr<const PackedMatrix<Dtype>> PackedMatrixCache<Dtype>::Get(
+    CBLAS_TRANSPOSE transB, utens_t k, utens_t n, const Dtype *B,
+    utens_t ldb) {
+  const Key key(B, transB, k, n, ldb);
+  {
+    mutex_lock lock(_mu);
+    auto it = _cache.find(key);
+    if (it != _cache.end()) return it->second;
+  }
+  // Packs outside of the lock, a racing thread may pack the same matrix.
+  std::shared_ptr<const PackedMatrix<Dtype>> packed(
+      new PackedMatrix<Dtype>(transB, k, n, B, ldb));
+  mutex_lock lock(_mu);
+  return _cache.emplace(key, std::move(packed)).first->second;
+}
+
+template<typename Dtype>
+void PackedMatrixCache<Dtype>::Erase(const Dtype *B) {
+  mutex_lock lock(_mu);
+  for (auto it = _cache.begin(); it != _cache.end();) {
+    it = std::get<0>(it->first) == B ? _cache.erase(it) : std::next(it);
+  }
+}
+
+template<typename Dtype>
+void PackedMatrixCache<Dtype>::Clear() {
+  mutex_lock lock(_mu);
+  _cache.clear();
+}
+
+template<typename Dtype>
+size_t PackedMatrixCache<Dtype>::Size() const {
+  mutex_lock lock(_mu);
+  return _cache.size();
+}
+
+#define INSTANTIATE_PACKED_MATRIX(Dtype)                                      \
+  template void internal::PackGemmB<Dtype>(CBLAS_TRANSPOSE, utens_t, utens_t, \
+                                           const Dtype *, utens_t, utens_t,   \
+                                           Dtype *);                          \
+  template void internal::GemmPackedB<Dtype>(                                 \
+      CBLAS_TRANSPOSE, utens_t, utens_t, utens_t, Dtype, const Dtype *,       \
+      utens_t, const Dtype *, const kernels::GemmKernels<Dtype> &, Dtype,     \
+      Dtype *, utens_t);                                                      \
+  template class PackedMatrix<Dtype>;                                         \
+  template class PackedMatrixCache<Dtype>;                                    \
+  template void chime_cpu_gemm_packed<Dtype>(                                 \
+      CBLAS_TRANSPOSE, utens_t, Dtype, const Dtype *, utens_t,                \
+      const PackedMatrix<Dtype> &, Dtype, Dtype *, utens_t)
+
+INSTANTIATE_PACKED_MATRIX(float32);
+INSTANTIATE_PACKED_MATRIX(float64);
+INSTANTIATE_PACKED_MATRIX(float128);
+
+#undef INSTANTIATE_PACKED_MATRIX
+
+#define INSTANTIATE_GEMM_HALF(Htype)                                          \
+  template void internal::GemmHalf<Htype>(                                    \
+      CBLAS_TRANSPOSE, CBLAS_TRANSPOSE, utens_t, utens_t, utens_t, float32,   \
+      const Htype *, utens_t, const Htype *, utens_t, float32, Htype *,       \
+      utens_t)
+
+INSTANTIATE_GEMM_HALF(float16);
+INSTANTIATE_GEMM_HALF(bfloat16);
+
+#undef INSTANTIATE_GEMM_HALF
+
+}  // namespace chime
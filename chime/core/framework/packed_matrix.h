@@ -0,0 +1,140 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_PACKED_MATRIX_H_
+#define CHIME_CORE_FRAMEWORK_PACKED_MATRIX_H_
+
+#include <openblas/cblas.h>
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/platform/macros.h"
+#include "chime/core/platform/mutex.h"
+#include "chime/core/platform/thread_annotations.h"
+
+namespace chime {
+
+/// Right-hand operand of a GEMM, packed once into the panel layout of the
+/// built-in microkernel (see `kernels::GemmKernels`): op(B) is cut into
+/// column panels `nr()` wide, and each panel is stored row after row, padded
+/// with zeros. Multiplying by the same weights many times then skips the
+/// repacking every `chime_cpu_gemm` call does:
+///
+///   PackedMatrix<float32> w(CblasNoTrans, k, n, weights, n);
+///   for (...) chime_cpu_gemm_packed<float32>(CblasNoTrans, m, 1.f, x, k, w,
+///                                            0.f, y, n);
+///
+/// The layout depends on the instruction set, so a packed matrix is only
+/// meant for the process that packed it. Supports float32, float64 and
+/// float128.
+template<typename Dtype>
+class PackedMatrix {
+ public:
+  /// Packs op(B), a k x n matrix. B is row-major with `ldb` elements between
+  /// rows: k x n when `transB` is CblasNoTrans, n x k otherwise.
+  PackedMatrix(CBLAS_TRANSPOSE transB, utens_t k, utens_t n, const Dtype *B,
+               utens_t ldb);
+
+  utens_t k() const { return _k; }
+  utens_t n() const { return _n; }
+  utens_t nr() const { return static_cast<utens_t>(_kernels->nr); }
+
+  /// Number of panels, the last one may be partly padding.
+  utens_t num_panels() const { return (_n + nr() - 1) / nr(); }
+
+  /// The k x `nr()` panel holding columns [j * nr(), (j + 1) * nr()).
+  const Dtype *panel(utens_t j) const { return _data.data() + j * _k * nr(); }
+
+  /// Kernels the matrix was packed for.
+  const kernels::GemmKernels<Dtype> &gemm_kernels() const { return *_kernels; }
+
+ private:
+  utens_t _k;
+  utens_t _n;
+  const kernels::GemmKernels<Dtype> *_kernels;
+  std::vector<Dtype> _data;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(PackedMatrix);
+};
+
+/// C = alpha * op(A) * B + beta * C with B packed, where op(A) is m x k and
+/// C is m x `B.n()`. A and C are row-major with `lda` and `ldc` elements
+/// between rows. Work is split over the intra-op thread pool by blocks of rows
+/// and columns of C.
+template<typename Dtype>
+void chime_cpu_gemm_packed(CBLAS_TRANSPOSE transA, utens_t m, Dtype alpha,
+                           const Dtype *A, utens_t lda,
+                           const PackedMatrix<Dtype> &B, Dtype beta, Dtype *C,
+                           utens_t ldc);
+
+namespace internal {
+
+/// Packs op(B), k x n, into `dst` in the layout of `PackedMatrix`, i.e.
+/// ceil(n / nr) panels of k x nr elements.
+template<typename Dtype>
+void PackGemmB(CBLAS_TRANSPOSE transB, utens_t k, utens_t n, const Dtype *B,
+               utens_t ldb, utens_t nr, Dtype *dst);
+
+/// The GEMM driver behind `chime_cpu_gemm_packed`, with B packed by
+/// `PackGemmB` with `gemm.nr`. Arguments are not checked.
+template<typename Dtype>
+void GemmPackedB(CBLAS_TRANSPOSE transA, utens_t m, utens_t n, utens_t k,
+                 Dtype alpha, const Dtype *A, utens_t lda,
+                 const Dtype *packed_b,
+                 const kernels::GemmKernels<Dtype> &gemm, Dtype beta,
+                 Dtype *C, utens_t ldc);
+
+/// C = alpha * op(A) * op(B) + beta * C for float16 and bfloat16 operands
+/// on the float32 microkernel. Blocks of A and panels of B are widened to
+/// float32 as they are packed and every tile of C is summed in float32 and
+/// rounded once, so that no operand is ever converted as a whole. Arguments
+/// are not checked.
+template<typename Htype>
+void GemmHalf(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+              utens_t n, utens_t k, float32 alpha, const Htype *A,
+              utens_t lda, const Htype *B, utens_t ldb, float32 beta,
+              Htype *C, utens_t ldc);
+
+}  // namespace internal
+
+/// Packed weights keyed by the host buffer they were packed from, e.g.
+/// `tensor.host_data<DT_FLOAT32>()`, so that each weight tensor is packed on
+/// first use only. The cache does not see writes to a buffer: `Erase` it once
+/// the weights change. Thread-safe.
+template<typename Dtype>
+class PackedMatrixCache {
+ public:
+  PackedMatrixCache() {}
+
+  /// Returns the packed op(B), packing it if it is not cached yet. The
+  /// arguments are those of the `PackedMatrix` constructor.
+  std::shared_ptr<const PackedMatrix<Dtype>> Get(CBLAS_TRANSPOSE transB,
+                                                 utens_t k, utens_t n,
+                                                 const Dtype *B, utens_t ldb);
+
+  /// Drops every matrix packed from the buffer starting at `B`.
+  void Erase(const Dtype *B);
+
+  void Clear();
+
+  size_t Size() const;
+
+ private:
+  typedef std::tuple<const Dtype *, CBLAS_TRANSPOSE, utens_t, utens_t, utens_t>
+      Key;
+
+  mutable mutex _mu;
+  std::map<Key, std::shared_ptr<const PackedMatrix<Dtype>>> _cache
+      CHIME_GUARDED_BY(_mu);
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(PackedMatrixCache);
+};
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_PACKED_MATRIX_H_
@@ -0,0 +1,149 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/packed_matrix.h"
+
+#include <cmath>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+// C = alpha * op(A) * op(B) + beta * C, computed in double.
+template<typename Dtype>
+void ReferenceGemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, utens_t m,
+                   utens_t n, utens_t k, Dtype alpha, const Dtype *A,
+                   utens_t lda, const Dtype *B, utens_t ldb, Dtype beta,
+                   Dtype *C, utens_t ldc) {
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      double sum = 0.;
+      for (utens_t p = 0; p < k; p++) {
+        const Dtype a =
+            transA == CblasNoTrans ? A[i * lda + p] : A[p * lda + i];
+        const Dtype b =
+            transB == CblasNoTrans ? B[p * ldb + j] : B[j * ldb + p];
+        sum += static_cast<double>(a) * static_cast<double>(b);
+      }
+      double c = static_cast<double>(alpha) * sum;
+      if (beta != Dtype(0)) c += static_cast<double>(beta * C[i * ldc + j]);
+      C[i * ldc + j] = static_cast<Dtype>(c);
+    }
+  }
+}
+
+template<typename Dtype>
+void CheckPackedGemm(CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB,
+                     utens_t m, utens_t n, utens_t k, Dtype beta) {
+  const utens_t lda = (transA == CblasNoTrans ? k : m) + 3;
+  const utens_t ldb = (transB == CblasNoTrans ? n : k) + 1;
+  const utens_t ldc = n + 2;
+  std::vector<Dtype> a(std::max<utens_t>(m, k) * lda);
+  std::vector<Dtype> b(std::max<utens_t>(n, k) * ldb);
+  std::vector<Dtype> c(m * ldc);
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<Dtype>(static_cast<int>(i % 11) - 5) / Dtype(4);
+  }
+  for (utens_t i = 0; i < b.size(); i++) {
+    b[i] = static_cast<Dtype>(static_cast<int>(i % 7) - 3) / Dtype(2);
+  }
+  for (utens_t i = 0; i < c.size(); i++) c[i] = static_cast<Dtype>(i % 3);
+
+  std::vector<Dtype> ref(c), y(c);
+  ReferenceGemm<Dtype>(transA, transB, m, n, k, Dtype(1.5), a.data(), lda,
+                       b.data(), ldb, beta, ref.data(), ldc);
+  PackedMatrix<Dtype> packed(transB, k, n, b.data(), ldb);
+  chime_cpu_gemm_packed<Dtype>(transA, m, Dtype(1.5), a.data(), lda, packed,
+                               beta, y.data(), ldc);
+  // Inputs are multiples of 1/8, so sums of up to a few hundred products are
+  // exact in float32 as well.
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < ldc; j++) {
+      ASSERT_EQ(y[i * ldc + j], ref[i * ldc + j])
+          << m << "x" << n << "x" << k << " at " << i << ", " << j;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PackedMatrixTest, MatchesReference) {
+  for (int64_t num_threads : {1, 4}) {
+    ScopedIntraOpNumThreads threads(num_threads);
+    for (utens_t m : {1, 5, 97, 200}) {
+      for (utens_t n : {1, 13, 40}) {
+        for (utens_t k : {0, 1, 7, 300}) {
+          CheckPackedGemm<float32>(CblasNoTrans, CblasNoTrans, m, n, k, 0.f);
+          CheckPackedGemm<float64>(CblasTrans, CblasTrans, m, n, k, 0.5);
+        }
+      }
+    }
+    CheckPackedGemm<float32>(CblasTrans, CblasNoTrans, 33, 1100, 20, 2.f);
+    CheckPackedGemm<float64>(CblasNoTrans, CblasTrans, 1, 600, 520, 1.);
+  }
+}
+
+// Every instruction set computes the same tiles.
+TEST(PackedMatrixTest, MicroKernelsAgree) {
+  const CPUCapability detected = DetectCPUCapability();
+  for (int cap = 0; cap <= static_cast<int>(detected); cap++) {
+    const kernels::GemmKernels<float64> &gemm =
+        kernels::GetGemmKernels<float64>(static_cast<CPUCapability>(cap));
+    const utens_t mr = gemm.mr, nr = gemm.nr, k = 9;
+    std::vector<float64> a(mr * k), b(k * nr), c(mr * nr, 1.), ref(mr * nr);
+    for (utens_t i = 0; i < a.size(); i++) a[i] = static_cast<float64>(i % 5);
+    for (utens_t i = 0; i < b.size(); i++) b[i] = static_cast<float64>(i % 3);
+    for (utens_t i = 0; i < mr; i++) {
+      for (utens_t j = 0; j < nr; j++) {
+        float64 sum = 0.;
+        for (utens_t p = 0; p < k; p++) sum += a[p * mr + i] * b[p * nr + j];
+        ref[i * nr + j] = 2. * sum + 3.;
+      }
+    }
+    gemm.micro_kernel(k, 2., a.data(), b.data(), 3., c.data(), nr, mr, nr);
+    EXPECT_EQ(c, ref) << CPUCapabilityToString(static_cast<CPUCapability>(cap));
+
+    // An edge tile leaves everything outside of its corner alone.
+    std::vector<float64> edge(mr * nr, -1.);
+    gemm.micro_kernel(k, 2., a.data(), b.data(), 0., edge.data(), nr, mr - 1,
+                      nr - 1);
+    for (utens_t i = 0; i < mr; i++) {
+      for (utens_t j = 0; j < nr; j++) {
+        const bool inside = i + 1 < mr && j + 1 < nr;
+        EXPECT_EQ(edge[i * nr + j], inside ? ref[i * nr + j] - 3. : -1.);
+      }
+    }
+
+    // The row kernel reads one element of A per step.
+    std::vector<float64> a_row(k), row(nr, 1.);
+    for (utens_t p = 0; p < k; p++) a_row[p] = a[p * mr];
+    gemm.row_kernel(k, 2., a_row.data(), b.data(), 3., row.data(), nr, 1, nr);
+    for (utens_t j = 0; j < nr; j++) EXPECT_EQ(row[j], ref[j]);
+  }
+}
+
+TEST(PackedMatrixTest, Cache) {
+  std::vector<float32> w(64 * 32, 1.f), w2(64 * 32, 2.f);
+  PackedMatrixCache<float32> cache;
+  auto p1 = cache.Get(CblasNoTrans, 64, 32, w.data(), 32);
+  EXPECT_EQ(cache.Get(CblasNoTrans, 64, 32, w.data(), 32), p1);
+  auto p2 = cache.Get(CblasTrans, 32, 64, w.data(), 32);
+  EXPECT_NE(p2, p1);
+  cache.Get(CblasNoTrans, 64, 32, w2.data(), 32);
+  EXPECT_EQ(cache.Size(), 3);
+
+  cache.Erase(w.data());
+  EXPECT_EQ(cache.Size(), 1);
+  // Handed out matrices outlive their entry.
+  EXPECT_EQ(p1->k(), 64);
+  EXPECT_EQ(p1->n(), 32);
+  EXPECT_NE(cache.Get(CblasNoTrans, 64, 32, w.data(), 32), p1);
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+}  // namespace chime
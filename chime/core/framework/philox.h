@@ -0,0 +1,60 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_PHILOX_H_
+#define CHIME_CORE_FRAMEWORK_PHILOX_H_
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Philox4x32-10, the counter-based generator of Salmon et al., "Parallel
+/// Random Numbers: As Easy as 1, 2, 3" (SC 2011). Ten rounds of multiplies
+/// and xors map a 128-bit counter and a 64-bit key to four 32-bit words, so
+/// any part of a stream can be computed without going through the rest of it.
+constexpr uint32 kPhiloxM0 = 0xD2511F53;
+constexpr uint32 kPhiloxM1 = 0xCD9E8D57;
+constexpr uint32 kPhiloxW0 = 0x9E3779B9;
+constexpr uint32 kPhiloxW1 = 0xBB67AE85;
+constexpr int kPhiloxRounds = 10;
+
+inline void Philox4x32(const uint32 counter[4], const uint32 key[2],
+                       uint32 out[4]) {
+  uint32 c[4] = {counter[0], counter[1], counter[2], counter[3]};
+  uint32 k[2] = {key[0], key[1]};
+  for (int round = 0; round < kPhiloxRounds; round++) {
+    const uint64 p0 = static_cast<uint64>(kPhiloxM0) * c[0];
+    const uint64 p1 = static_cast<uint64>(kPhiloxM1) * c[2];
+    c[0] = static_cast<uint32>(p1 >> 32) ^ c[1] ^ k[0];
+    c[1] = static_cast<uint32>(p1);
+    c[2] = static_cast<uint32>(p0 >> 32) ^ c[3] ^ k[1];
+    c[3] = static_cast<uint32>(p0);
+    k[0] += kPhiloxW0;
+    k[1] += kPhiloxW1;
+  }
+  for (int i = 0; i < 4; i++) out[i] = c[i];
+}
+
+/// Number of words of a stream computed together, see `PhiloxWord`.
+constexpr uint64 kPhiloxGroupWords = 64;
+
+/// Word i of the stream of `seed`, behind `chime_cpu_rng_*`. The key is the
+/// seed, and the stream is cut into groups of 64 words that come from 16
+/// consecutive counters: word 64 g + 16 j + l is word j of the output for
+/// counter 16 g + l. Counters of a group fill the lanes of SIMD registers,
+/// which can then be stored as they are, on every instruction set.
+inline uint32 PhiloxWord(uint64 seed, uint64 i) {
+  const uint64 group = i / kPhiloxGroupWords;
+  const uint64 counter = group * 16 + i % 16;
+  const uint32 ctr[4] = {static_cast<uint32>(counter),
+                         static_cast<uint32>(counter >> 32), 0, 0};
+  const uint32 key[2] = {static_cast<uint32>(seed),
+                         static_cast<uint32>(seed >> 32)};
+  uint32 out[4];
+  Philox4x32(ctr, key, out);
+  return out[i % kPhiloxGroupWords / 16];
+}
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_PHILOX_H_
@@ -0,0 +1,415 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/pool.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/reduction.h"
+
+namespace chime {
+
+namespace {
+
+// Channels of an NHWC image whose gradient one thread owns, so that images
+// are split even when the batch is small.
+constexpr utens_t kPoolChannelBlock = 64;
+
+// Outputs [out, out + lanes) of y, whose windows hold `count` pixels each.
+// The window of the first output is `pixels`, as ih * in_w + iw; the element
+// of tap t for lane i is at in + pixels[t] * pixel_stride + i in x. NCHW
+// runs are neighbouring outputs of a row, with windows shifted by one pixel
+// per lane and a pixel stride of 1, NHWC runs the channels of one output.
+struct PoolRun {
+  utens_t lanes;
+  utens_t count;
+  const utens_t *pixels;
+  utens_t pixel_stride;
+  utens_t in;
+  utens_t out;
+};
+
+// Pixels of the window of output (oh, ow) that lie inside the image.
+// Returns how many there are.
+utens_t WindowPixels(const Pool2DParams &p, utens_t oh, utens_t ow,
+                     utens_t *pixels) {
+  const int64 h0 = static_cast<int64>(oh * p.stride_h) -
+                   static_cast<int64>(p.pad_h);
+  const int64 w0 = static_cast<int64>(ow * p.stride_w) -
+                   static_cast<int64>(p.pad_w);
+  const utens_t h_begin = std::max<int64>(h0, 0);
+  const utens_t h_end =
+      std::min<int64>(h0 + p.kernel_h, static_cast<int64>(p.in_h));
+  const utens_t w_begin = std::max<int64>(w0, 0);
+  const utens_t w_end =
+      std::min<int64>(w0 + p.kernel_w, static_cast<int64>(p.in_w));
+  utens_t count = 0;
+  for (utens_t ih = h_begin; ih < h_end; ih++) {
+    for (utens_t iw = w_begin; iw < w_end; iw++) {
+      pixels[count++] = ih * p.in_w + iw;
+    }
+  }
+  return count;
+}
+
+// Calls fn(ow, lanes) for the runs of outputs of a NCHW row: with unit
+// stride, the outputs whose windows lie inside the image horizontally are
+// the same window shifted and go together, every other output alone.
+template<typename Fn>
+void ForEachColumnRun(const Pool2DParams &p, utens_t out_w, const Fn &fn) {
+  utens_t lo = out_w, hi = out_w;
+  if (p.stride_w == 1) {
+    lo = std::min(p.pad_w, out_w);
+    hi = std::max<int64>(
+        0, std::min<int64>(static_cast<int64>(p.in_w + p.pad_w + 1) -
+                               static_cast<int64>(p.kernel_w),
+                           out_w));
+    if (hi < lo + 2) lo = hi = out_w;
+  }
+  for (utens_t ow = 0; ow < out_w;) {
+    if (ow == lo) {
+      fn(lo, hi - lo);
+      ow = hi;
+    } else {
+      fn(ow, 1);
+      ow++;
+    }
+  }
+}
+
+// Per-thread buffers of the kernel calls: pointers to the taps of a run in
+// x or dx, and the taps holding the maxima of its lanes.
+template<typename Dtype>
+struct PoolScratch {
+  PoolScratch(utens_t taps, utens_t lanes) : x(taps), dx(taps), tap(lanes) {}
+
+  std::vector<const Dtype *> x;
+  std::vector<Dtype *> dx;
+  std::vector<Dtype> tap;
+};
+
+// Calls fn(run, scratch) for every output of a pooling, the threads owning
+// the outputs (`forward`) or the input pixels their windows read. NCHW batches
+// are split by planes either way; NHWC batches by rows of outputs forward,
+// and by images and blocks of channels backward.
+template<typename Dtype, typename Fn>
+void ForEachRun(const Pool2DParams &p, bool forward, const Fn &fn) {
+  const utens_t out_h = p.OutH(), out_w = p.OutW();
+  const utens_t taps = p.kernel_h * p.kernel_w;
+  const utens_t c = p.channels, image = p.in_h * p.in_w;
+  const utens_t lanes = std::max(out_w, c);
+  if (p.layout == ConvLayout::kNCHW) {
+    ParallelFor(
+        static_cast<int64_t>(p.batch * c),
+        std::max<int64_t>(1, kIntraOpGrainSize /
+                                 static_cast<int64_t>(out_h * out_w * taps)),
+        [&](int64_t begin, int64_t end) {
+          std::vector<utens_t> pixels(taps);
+          PoolScratch<Dtype> scratch(taps, lanes);
+          PoolRun run;
+          run.pixels = pixels.data();
+          run.pixel_stride = 1;
+          for (utens_t plane = begin; plane < static_cast<utens_t>(end);
+               plane++) {
+            run.in = plane * image;
+            for (utens_t oh = 0; oh < out_h; oh++) {
+              ForEachColumnRun(p, out_w, [&](utens_t ow, utens_t len) {
+                run.lanes = len;
+                run.count = WindowPixels(p, oh, ow, pixels.data());
+                run.out = (plane * out_h + oh) * out_w + ow;
+                fn(run, &scratch);
+              });
+            }
+          }
+        });
+    return;
+  }
+  if (forward) {
+    ParallelFor(
+        static_cast<int64_t>(p.batch * out_h),
+        std::max<int64_t>(1, kIntraOpGrainSize /
+                                 static_cast<int64_t>(out_w * c * taps)),
+        [&](int64_t begin, int64_t end) {
+          std::vector<utens_t> pixels(taps);
+          PoolScratch<Dtype> scratch(taps, lanes);
+          PoolRun run;
+          run.lanes = c;
+          run.pixels = pixels.data();
+          run.pixel_stride = c;
+          for (utens_t row = begin; row < static_cast<utens_t>(end); row++) {
+            run.in = row / out_h * image * c;
+            for (utens_t ow = 0; ow < out_w; ow++) {
+              run.count = WindowPixels(p, row % out_h, ow, pixels.data());
+              run.out = (row * out_w + ow) * c;
+              fn(run, &scratch);
+            }
+          }
+        });
+    return;
+  }
+  const utens_t blocks = (c + kPoolChannelBlock - 1) / kPoolChannelBlock;
+  ParallelFor(
+      static_cast<int64_t>(p.batch * blocks),
+      std::max<int64_t>(
+          1, kIntraOpGrainSize / static_cast<int64_t>(
+                                     out_h * out_w * kPoolChannelBlock * taps)),
+      [&](int64_t begin, int64_t end) {
+        std::vector<utens_t> pixels(taps);
+        PoolScratch<Dtype> scratch(taps, lanes);
+        PoolRun run;
+        run.pixels = pixels.data();
+        run.pixel_stride = c;
+        for (utens_t unit = begin; unit < static_cast<utens_t>(end); unit++) {
+          const utens_t n = unit / blocks;
+          const utens_t c0 = unit % blocks * kPoolChannelBlock;
+          run.lanes = std::min(kPoolChannelBlock, c - c0);
+          run.in = n * image * c + c0;
+          for (utens_t o = 0; o < out_h * out_w; o++) {
+            run.count = WindowPixels(p, o / out_w, o % out_w, pixels.data());
+            run.out = (n * out_h * out_w + o) * c + c0;
+            fn(run, &scratch);
+          }
+        }
+      });
+}
+
+// Pointers to the lanes of every tap of `run` in the array at `base`.
+template<typename Ptr>
+void TapPointers(const PoolRun &run, Ptr base, std::vector<Ptr> *taps) {
+  for (utens_t t = 0; t < run.count; t++) {
+    (*taps)[t] = base + run.in + run.pixels[t] * run.pixel_stride;
+  }
+}
+
+// Scatters dy to the maxima at `index`, the threads owning the same pixels
+// of dx as those of `ForEachRun`.
+template<typename Dtype>
+void MaxPoolScatter(const Pool2DParams &p, const utens_t *index,
+                    const Dtype *dy, Dtype *dx) {
+  const utens_t outputs = p.OutH() * p.OutW();
+  const utens_t c = p.channels, image = p.in_h * p.in_w;
+  if (p.layout == ConvLayout::kNCHW) {
+    ParallelFor(static_cast<int64_t>(p.batch * c),
+                std::max<int64_t>(1, kIntraOpGrainSize /
+                                         static_cast<int64_t>(outputs)),
+                [&](int64_t begin, int64_t end) {
+                  for (utens_t plane = begin;
+                       plane < static_cast<utens_t>(end); plane++) {
+                    Dtype *in = dx + plane * image;
+                    const utens_t first = plane * outputs;
+                    for (utens_t o = first; o < first + outputs; o++) {
+                      in[index[o]] += dy[o];
+                    }
+                  }
+                });
+    return;
+  }
+  const utens_t blocks = (c + kPoolChannelBlock - 1) / kPoolChannelBlock;
+  ParallelFor(
+      static_cast<int64_t>(p.batch * blocks),
+      std::max<int64_t>(1, kIntraOpGrainSize /
+                               static_cast<int64_t>(outputs *
+                                                    kPoolChannelBlock)),
+      [&](int64_t begin, int64_t end) {
+        for (utens_t unit = begin; unit < static_cast<utens_t>(end); unit++) {
+          const utens_t n = unit / blocks;
+          const utens_t c0 = unit % blocks * kPoolChannelBlock;
+          const utens_t c1 = std::min(c0 + kPoolChannelBlock, c);
+          Dtype *in = dx + n * image * c;
+          for (utens_t o = n * outputs; o < (n + 1) * outputs; o++) {
+            for (utens_t i = o * c + c0; i < o * c + c1; i++) {
+              in[index[i] * c + i % c] += dy[i];
+            }
+          }
+        }
+      });
+}
+
+}  // namespace
+
+utens_t Pool2DParams::OutH() const {
+  CHECK_GT(stride_h, 0u);
+  CHECK_GT(kernel_h, 0u);
+  CHECK_LT(pad_h, kernel_h) << "Padding of " << pad_h
+                            << " rows leaves windows of height " << kernel_h
+                            << " outside the image";
+  CHECK_GE(in_h + 2 * pad_h, kernel_h)
+      << "Window of height " << kernel_h << " does not fit in an input of "
+      << "height " << in_h << " padded by " << pad_h;
+  return (in_h + 2 * pad_h - kernel_h) / stride_h + 1;
+}
+
+utens_t Pool2DParams::OutW() const {
+  CHECK_GT(stride_w, 0u);
+  CHECK_GT(kernel_w, 0u);
+  CHECK_LT(pad_w, kernel_w) << "Padding of " << pad_w
+                            << " columns leaves windows of width " << kernel_w
+                            << " outside the image";
+  CHECK_GE(in_w + 2 * pad_w, kernel_w)
+      << "Window of width " << kernel_w << " does not fit in an input of "
+      << "width " << in_w << " padded by " << pad_w;
+  return (in_w + 2 * pad_w - kernel_w) / stride_w + 1;
+}
+
+template<typename Dtype>
+void chime_cpu_max_pool2d(const Pool2DParams &params, const Dtype *x,
+                          Dtype *y, utens_t *index) {
+  DCHECK(x);
+  DCHECK(y);
+  const utens_t outputs = params.OutH() * params.OutW();
+  if (params.batch * params.channels * outputs == 0) return;
+  const kernels::PoolKernels<Dtype> &k = kernels::GetPoolKernels<Dtype>();
+  const bool nchw = params.layout == ConvLayout::kNCHW;
+  ForEachRun<Dtype>(
+      params, true,
+      [&](const PoolRun &run, PoolScratch<Dtype> *scratch) {
+        TapPointers(run, x, &scratch->x);
+        Dtype *tap = scratch->tap.data();
+        k.max(run.lanes, run.count, scratch->x.data(), y + run.out,
+              index ? tap : nullptr);
+        if (!index) return;
+        for (utens_t i = 0; i < run.lanes; i++) {
+          index[run.out + i] =
+              run.pixels[static_cast<utens_t>(tap[i])] + (nchw ? i : 0);
+        }
+      });
+}
+
+template<typename Dtype>
+void chime_cpu_max_pool2d_backward(const Pool2DParams &params, const Dtype *x,
+                                   const utens_t *index, const Dtype *dy,
+                                   Dtype *dx) {
+  DCHECK(dy);
+  DCHECK(dx);
+  const utens_t inputs =
+      params.batch * params.channels * params.in_h * params.in_w;
+  const utens_t outputs =
+      params.batch * params.channels * params.OutH() * params.OutW();
+  chime_cpu_set(dx, Dtype(0), inputs);
+  if (outputs == 0) return;
+  std::vector<utens_t> found;
+  if (!index) {
+    DCHECK(x);
+    std::vector<Dtype> y(outputs);
+    found.resize(outputs);
+    chime_cpu_max_pool2d(params, x, y.data(), found.data());
+    index = found.data();
+  }
+  MaxPoolScatter(params, index, dy, dx);
+}
+
+template<typename Dtype>
+void chime_cpu_avg_pool2d(const Pool2DParams &params, const Dtype *x,
+                          Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const utens_t outputs = params.OutH() * params.OutW();
+  if (params.batch * params.channels * outputs == 0) return;
+  const kernels::PoolKernels<Dtype> &k = kernels::GetPoolKernels<Dtype>();
+  const utens_t taps = params.kernel_h * params.kernel_w;
+  ForEachRun<Dtype>(
+      params, true,
+      [&](const PoolRun &run, PoolScratch<Dtype> *scratch) {
+        TapPointers(run, x, &scratch->x);
+        const utens_t divisor = params.count_padding ? taps : run.count;
+        k.average(run.lanes, run.count, scratch->x.data(), Dtype(1) / divisor,
+                  y + run.out);
+      });
+}
+
+template<typename Dtype>
+void chime_cpu_avg_pool2d_backward(const Pool2DParams &params,
+                                   const Dtype *dy, Dtype *dx) {
+  DCHECK(dy);
+  DCHECK(dx);
+  const utens_t outputs = params.OutH() * params.OutW();
+  chime_cpu_set(dx, Dtype(0),
+                params.batch * params.channels * params.in_h * params.in_w);
+  if (params.batch * params.channels * outputs == 0) return;
+  const kernels::PoolKernels<Dtype> &k = kernels::GetPoolKernels<Dtype>();
+  const utens_t taps = params.kernel_h * params.kernel_w;
+  ForEachRun<Dtype>(
+      params, false,
+      [&](const PoolRun &run, PoolScratch<Dtype> *scratch) {
+        TapPointers(run, dx, &scratch->dx);
+        const utens_t divisor = params.count_padding ? taps : run.count;
+        k.average_backward(run.lanes, run.count, dy + run.out,
+                           Dtype(1) / divisor, scratch->dx.data());
+      });
+}
+
+template<typename Dtype>
+void chime_cpu_global_avg_pool2d(const Pool2DParams &params, const Dtype *x,
+                                 Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const utens_t image = params.in_h * params.in_w;
+  CHECK_GT(image, 0u) << "Global pooling of an empty image";
+  if (params.layout == ConvLayout::kNCHW) {
+    chime_cpu_reduce_mean<Dtype>({params.batch * params.channels, image},
+                                 {1}, x, y);
+  } else {
+    chime_cpu_reduce_mean<Dtype>({params.batch, image, params.channels}, {1},
+                                 x, y);
+  }
+}
+
+template<typename Dtype>
+void chime_cpu_global_avg_pool2d_backward(const Pool2DParams &params,
+                                          const Dtype *dy, Dtype *dx) {
+  DCHECK(dy);
+  DCHECK(dx);
+  const utens_t image = params.in_h * params.in_w;
+  const utens_t c = params.channels;
+  CHECK_GT(image, 0u) << "Global pooling of an empty image";
+  const Dtype scale = Dtype(1) / image;
+  if (params.layout == ConvLayout::kNCHW) {
+    ParallelFor(static_cast<int64_t>(params.batch * c),
+                std::max<int64_t>(1, kIntraOpGrainSize /
+                                         static_cast<int64_t>(image)),
+                [&](int64_t begin, int64_t end) {
+                  for (utens_t plane = begin;
+                       plane < static_cast<utens_t>(end); plane++) {
+                    chime_cpu_set(dx + plane * image, dy[plane] * scale,
+                                  image);
+                  }
+                });
+    return;
+  }
+  ParallelFor(static_cast<int64_t>(params.batch * image),
+              std::max<int64_t>(1, kIntraOpGrainSize /
+                                       static_cast<int64_t>(std::max<utens_t>(
+                                           c, 1))),
+              [&](int64_t begin, int64_t end) {
+                for (utens_t pixel = begin;
+                     pixel < static_cast<utens_t>(end); pixel++) {
+                  chime_cpu_scal(c, scale, dy + pixel / image * c,
+                                 dx + pixel * c);
+                }
+              });
+}
+
+#define INSTANTIATE_POOL(Dtype)                                               \
+  template void chime_cpu_max_pool2d<Dtype>(const Pool2DParams &,             \
+                                            const Dtype *, Dtype *,           \
+                                            utens_t *);                       \
+  template void chime_cpu_max_pool2d_backward<Dtype>(                         \
+      const Pool2DParams &, const Dtype *, const utens_t *, const Dtype *,    \
+      Dtype *);                                                               \
+  template void chime_cpu_avg_pool2d<Dtype>(const Pool2DParams &,             \
+                                            const Dtype *, Dtype *);          \
+  template void chime_cpu_avg_pool2d_backward<Dtype>(const Pool2DParams &,    \
+                                                     const Dtype *, Dtype *); \
+  template void chime_cpu_global_avg_pool2d<Dtype>(const Pool2DParams &,      \
+                                                   const Dtype *, Dtype *);   \
+  template void chime_cpu_global_avg_pool2d_backward<Dtype>(                  \
+      const Pool2DParams &, const Dtype *, Dtype *)
+
+INSTANTIATE_POOL(float32);
+INSTANTIATE_POOL(float64);
+
+}  // namespace chime
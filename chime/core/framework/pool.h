@@ -0,0 +1,86 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_POOL_H_
+#define CHIME_CORE_FRAMEWORK_POOL_H_
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/conv.h"
+
+namespace chime {
+
+/// Geometry of a 2-D pooling over batches of NCHW or NHWC images (see
+/// `ConvLayout`). Windows of `kernel_h` x `kernel_w` pixels move by
+/// `stride_*` pixels between outputs over the input with `pad_*` rows and
+/// columns of padding on each side, which is never the maximum and, unless
+/// `count_padding` is set, not counted by averages either.
+struct Pool2DParams {
+  ConvLayout layout = ConvLayout::kNCHW;
+  utens_t batch = 1;
+  utens_t channels = 1;
+  utens_t in_h = 1;
+  utens_t in_w = 1;
+  utens_t kernel_h = 1;
+  utens_t kernel_w = 1;
+  utens_t stride_h = 1;
+  utens_t stride_w = 1;
+  utens_t pad_h = 0;
+  utens_t pad_w = 0;
+  bool count_padding = false;
+
+  /// REQUIRES: the padding is smaller than the window, so that every window
+  /// sees the image, and the padded input is at least as large.
+  utens_t OutH() const;
+  utens_t OutW() const;
+};
+
+/// Max pooling, from x to y, and its gradient from dy to dx. `index`, unless
+/// null, gets the position of the maximum of every output in its image
+/// plane, ih * in_w + iw, the first one in row-major order when several are
+/// equal; it has the layout and size of y. The backward pass scatters dy to
+/// these positions, from the `index` of the forward pass, or from the maxima
+/// of x found again when it is null; x is only read then. NaN is not handled.
+///
+/// Windows are reduced by kernels vectorized over the channels of NHWC
+/// pixels, or over neighbouring outputs of NCHW rows with unit stride,
+/// whose windows are the same shifted by one column. The forward pass splits
+/// rows of outputs of NHWC batches over the intra-op threads, and NCHW
+/// batches a batch x channel plane at a time; the backward pass splits the
+/// planes, or images and blocks of channels for NHWC, whose outputs write to
+/// the same pixels.
+///
+/// Only float32 and float64 are supported. Gradients are written, not
+/// accumulated.
+template<typename Dtype>
+void chime_cpu_max_pool2d(const Pool2DParams &params, const Dtype *x,
+                          Dtype *y, utens_t *index);
+
+template<typename Dtype>
+void chime_cpu_max_pool2d_backward(const Pool2DParams &params, const Dtype *x,
+                                   const utens_t *index, const Dtype *dy,
+                                   Dtype *dx);
+
+/// Average pooling and its gradient, split like max pooling.
+template<typename Dtype>
+void chime_cpu_avg_pool2d(const Pool2DParams &params, const Dtype *x,
+                          Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_avg_pool2d_backward(const Pool2DParams &params,
+                                   const Dtype *dy, Dtype *dx);
+
+/// Average over the whole image, from x to a batch x channels y, and its
+/// gradient. Only the layout, batch, channels and size of the input of
+/// `params` are read. The forward pass is a `chime_cpu_reduce_mean` over the
+/// pixels, with no windows to build.
+template<typename Dtype>
+void chime_cpu_global_avg_pool2d(const Pool2DParams &params, const Dtype *x,
+                                 Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_global_avg_pool2d_backward(const Pool2DParams &params,
+                                          const Dtype *dy, Dtype *dx);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_POOL_H_
@@ -0,0 +1,247 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/pool.h"
+
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+Pool2DParams Params(ConvLayout layout, utens_t channels, utens_t kernel,
+                    utens_t stride, utens_t pad) {
+  Pool2DParams p;
+  p.layout = layout;
+  p.batch = 2;
+  p.channels = channels;
+  p.in_h = 9;
+  p.in_w = 11;
+  p.kernel_h = p.kernel_w = kernel;
+  p.stride_h = p.stride_w = stride;
+  p.pad_h = p.pad_w = pad;
+  return p;
+}
+
+// Levels of the test data: more than any input has elements, so that every
+// window has a single maximum.
+constexpr utens_t kLevels = 100003;
+
+utens_t InputSize(const Pool2DParams &p) {
+  return p.batch * p.channels * p.in_h * p.in_w;
+}
+
+utens_t OutputSize(const Pool2DParams &p) {
+  return p.batch * p.channels * p.OutH() * p.OutW();
+}
+
+// Poolings from their definition, in float64.
+template<typename Dtype>
+struct Reference {
+  Reference(const Pool2DParams &p, const std::vector<Dtype> &x,
+            const std::vector<Dtype> &dy)
+      : max(OutputSize(p)),
+        index(OutputSize(p)),
+        average(OutputSize(p)),
+        dmax(InputSize(p)),
+        daverage(InputSize(p)) {
+    const bool nchw = p.layout == ConvLayout::kNCHW;
+    const utens_t c = p.channels, out_h = p.OutH(), out_w = p.OutW();
+    for (utens_t n = 0; n < p.batch; n++) {
+      for (utens_t ch = 0; ch < c; ch++) {
+        for (utens_t oh = 0; oh < out_h; oh++) {
+          for (utens_t ow = 0; ow < out_w; ow++) {
+            const utens_t o =
+                nchw ? ((n * c + ch) * out_h + oh) * out_w + ow
+                     : ((n * out_h + oh) * out_w + ow) * c + ch;
+            std::vector<utens_t> window;
+            for (utens_t kh = 0; kh < p.kernel_h; kh++) {
+              for (utens_t kw = 0; kw < p.kernel_w; kw++) {
+                const int64 ih = static_cast<int64>(oh * p.stride_h + kh) -
+                                 static_cast<int64>(p.pad_h);
+                const int64 iw = static_cast<int64>(ow * p.stride_w + kw) -
+                                 static_cast<int64>(p.pad_w);
+                if (ih < 0 || iw < 0 || ih >= static_cast<int64>(p.in_h) ||
+                    iw >= static_cast<int64>(p.in_w)) {
+                  continue;
+                }
+                window.push_back(ih * p.in_w + iw);
+              }
+            }
+            const utens_t divisor = p.count_padding
+                                        ? p.kernel_h * p.kernel_w
+                                        : window.size();
+            float64 sum = 0;
+            utens_t best = window[0];
+            for (utens_t pixel : window) {
+              sum += x[Input(p, n, ch, pixel)];
+              if (x[Input(p, n, ch, pixel)] > x[Input(p, n, ch, best)]) {
+                best = pixel;
+              }
+            }
+            max[o] = x[Input(p, n, ch, best)];
+            index[o] = best;
+            average[o] = sum / divisor;
+            dmax[Input(p, n, ch, best)] += dy[o];
+            for (utens_t pixel : window) {
+              daverage[Input(p, n, ch, pixel)] +=
+                  static_cast<float64>(dy[o]) / divisor;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  static utens_t Input(const Pool2DParams &p, utens_t n, utens_t ch,
+                       utens_t pixel) {
+    const utens_t image = p.in_h * p.in_w;
+    return p.layout == ConvLayout::kNCHW ? (n * p.channels + ch) * image + pixel
+                                         : (n * image + pixel) * p.channels +
+                                               ch;
+  }
+
+  std::vector<float64> max;
+  std::vector<utens_t> index;
+  std::vector<float64> average;
+  std::vector<float64> dmax;
+  std::vector<float64> daverage;
+};
+
+template<typename Dtype>
+void ExpectNear(const std::vector<Dtype> &actual,
+                const std::vector<float64> &expected, float64 tolerance) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (utens_t i = 0; i < actual.size(); i++) {
+    EXPECT_NEAR(actual[i], expected[i], tolerance) << i;
+  }
+}
+
+template<typename Dtype>
+void CheckAgainstReference(const Pool2DParams &p, float64 tolerance) {
+  const std::vector<Dtype> x =
+      Pattern<Dtype>(InputSize(p), 1, kLevels, 1. / 4096, -12);
+  const std::vector<Dtype> dy =
+      Pattern<Dtype>(OutputSize(p), 2, kLevels, 1. / 4096, -12);
+  const Reference<Dtype> expected(p, x, dy);
+
+  std::vector<Dtype> y(OutputSize(p));
+  std::vector<utens_t> index(OutputSize(p));
+  chime_cpu_max_pool2d<Dtype>(p, x.data(), y.data(), index.data());
+  ExpectNear(y, expected.max, 0);
+  EXPECT_EQ(index, expected.index);
+  chime_cpu_max_pool2d<Dtype>(p, x.data(), y.data(), nullptr);
+  ExpectNear(y, expected.max, 0);
+
+  std::vector<Dtype> dx(InputSize(p));
+  chime_cpu_max_pool2d_backward<Dtype>(p, nullptr, index.data(), dy.data(),
+                                       dx.data());
+  ExpectNear(dx, expected.dmax, tolerance);
+  chime_cpu_max_pool2d_backward<Dtype>(p, x.data(), nullptr, dy.data(),
+                                       dx.data());
+  ExpectNear(dx, expected.dmax, tolerance);
+
+  chime_cpu_avg_pool2d<Dtype>(p, x.data(), y.data());
+  ExpectNear(y, expected.average, tolerance);
+  chime_cpu_avg_pool2d_backward<Dtype>(p, dy.data(), dx.data());
+  ExpectNear(dx, expected.daverage, tolerance);
+}
+
+}  // namespace
+
+// Windows with and without padding or overlap, channel counts that do and
+// do not fill a register, in both layouts.
+TEST(PoolTest, TestAgainstReference) {
+  std::vector<Pool2DParams> cases = {
+      Params(ConvLayout::kNCHW, 3, 2, 2, 0),
+      Params(ConvLayout::kNCHW, 5, 3, 1, 1),
+      Params(ConvLayout::kNCHW, 17, 3, 2, 1),
+      Params(ConvLayout::kNCHW, 2, 5, 1, 2),
+      Params(ConvLayout::kNCHW, 70, 3, 3, 0),
+      Params(ConvLayout::kNCHW, 4, 1, 1, 0),
+  };
+  Pool2DParams wide = Params(ConvLayout::kNCHW, 3, 4, 1, 1);
+  wide.kernel_h = 2;
+  wide.count_padding = true;
+  cases.push_back(wide);
+  for (Pool2DParams p : cases) {
+    CheckAgainstReference<float64>(p, 1e-12);
+    p.layout = ConvLayout::kNHWC;
+    CheckAgainstReference<float64>(p, 1e-12);
+  }
+}
+
+TEST(PoolTest, TestFloat) {
+  CheckAgainstReference<float32>(Params(ConvLayout::kNHWC, 32, 3, 2, 1),
+                                 1e-5);
+  CheckAgainstReference<float32>(Params(ConvLayout::kNCHW, 8, 3, 1, 1),
+                                 1e-5);
+}
+
+// Windows must see the image.
+TEST(PoolTest, TestPaddingSmallerThanWindow) {
+  Pool2DParams p = Params(ConvLayout::kNCHW, 1, 2, 1, 2);
+  EXPECT_DEATH(p.OutH(), "outside the image");
+}
+
+TEST(PoolTest, TestGlobalAverage) {
+  for (ConvLayout layout : {ConvLayout::kNCHW, ConvLayout::kNHWC}) {
+    Pool2DParams p = Params(layout, 19, 1, 1, 0);
+    const std::vector<float64> x =
+        Pattern<float64>(InputSize(p), 1, kLevels, 1. / 4096, -12);
+    const std::vector<float64> dy =
+        Pattern<float64>(p.batch * p.channels, 2, kLevels, 1. / 4096, -12);
+    // The window of the whole image.
+    Pool2DParams whole = p;
+    whole.kernel_h = p.in_h;
+    whole.kernel_w = p.in_w;
+    const Reference<float64> expected(whole, x, dy);
+
+    std::vector<float64> y(p.batch * p.channels);
+    chime_cpu_global_avg_pool2d<float64>(p, x.data(), y.data());
+    ExpectNear(y, expected.average, 1e-12);
+    std::vector<float64> dx(InputSize(p));
+    chime_cpu_global_avg_pool2d_backward<float64>(p, dy.data(), dx.data());
+    ExpectNear(dx, expected.daverage, 1e-12);
+  }
+}
+
+// Planes, rows and blocks of channels are split over the threads without
+// changing the result.
+TEST(PoolTest, TestIntraOpParallel) {
+  for (ConvLayout layout : {ConvLayout::kNCHW, ConvLayout::kNHWC}) {
+    Pool2DParams p = Params(layout, 150, 3, 2, 1);
+    p.in_h = p.in_w = 28;
+    const std::vector<float32> x =
+        Pattern<float32>(InputSize(p), 1, kLevels, 1. / 4096, -12);
+    const std::vector<float32> dy =
+        Pattern<float32>(OutputSize(p), 2, kLevels, 1. / 4096, -12);
+    std::vector<std::vector<float32>> y(2), dx(2), avg(2), davg(2);
+    std::vector<std::vector<utens_t>> index(2);
+    for (int run = 0; run < 2; run++) {
+      ScopedIntraOpNumThreads threads(run == 0 ? 1 : 4);
+      y[run].resize(OutputSize(p));
+      avg[run].resize(OutputSize(p));
+      index[run].resize(OutputSize(p));
+      dx[run].resize(InputSize(p));
+      davg[run].resize(InputSize(p));
+      chime_cpu_max_pool2d<float32>(p, x.data(), y[run].data(),
+                                    index[run].data());
+      chime_cpu_max_pool2d_backward<float32>(p, nullptr, index[run].data(),
+                                             dy.data(), dx[run].data());
+      chime_cpu_avg_pool2d<float32>(p, x.data(), avg[run].data());
+      chime_cpu_avg_pool2d_backward<float32>(p, dy.data(), davg[run].data());
+    }
+    EXPECT_EQ(y[0], y[1]);
+    EXPECT_EQ(index[0], index[1]);
+    EXPECT_EQ(dx[0], dx[1]);
+    EXPECT_EQ(avg[0], avg[1]);
+    EXPECT_EQ(davg[0], davg[1]);
+  }
+}
+
+}  // namespace chime
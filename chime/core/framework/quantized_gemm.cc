@@ -0,0 +1,494 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/quantized_gemm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "chime/core/framework/intra_op_parallel.h"
+
+namespace chime {
+
+namespace {
+
+// Cache blocking of the int8 driver, as in packed_matrix.cc. kQuantizedGemmKC
+// is a multiple of 4 and kQuantizedGemmMC of every `mr`.
+constexpr utens_t kQuantizedGemmKC = 1024;
+constexpr utens_t kQuantizedGemmMC = 96;
+constexpr utens_t kQuantizedGemmNC = 1024;
+
+// Smallest number of multiply-adds worth handing to another thread.
+constexpr int64_t kQuantizedGemmMinShardWork = 1 << 21;
+
+// Blocking of the int4 driver. kInt4GemmKC is rounded down to whole groups.
+constexpr utens_t kInt4GemmKC = 2048;
+constexpr utens_t kInt4GemmMC = 48;
+constexpr utens_t kInt4GemmNC = 256;
+
+// Packs rows [i0, i0 + mc) and columns [p0, p0 + kc) of A into panels of `mr`
+// rows in the layout of `QuantizedGemmKernels`, padded with zeros.
+void pack_a_u8(const uint8 *A, utens_t lda, utens_t i0, utens_t mc,
+               utens_t p0, utens_t kc, utens_t mr, uint8 *dst) {
+  const utens_t k4 = (kc + 3) / 4;
+  for (utens_t ir = 0; ir < mc; ir += mr) {
+    const utens_t rows = std::min(mr, mc - ir);
+    for (utens_t q = 0; q < k4; q++) {
+      const utens_t width = std::min<utens_t>(4, kc - q * 4);
+      for (utens_t r = 0; r < mr; r++, dst += 4) {
+        const uint8 *src = A + (i0 + ir + r) * lda + p0 + q * 4;
+        for (utens_t t = 0; t < 4; t++) {
+          dst[t] = r < rows && t < width ? src[t] : uint8(0);
+        }
+      }
+    }
+  }
+}
+
+// Writes a row of zero-point corrected sums, columns [j0, j0 + n), to C.
+void store_row(const QuantizedGemmParams &, utens_t, utens_t n,
+               const int32 *sums, int32 *dst) {
+  std::copy(sums, sums + n, dst);
+}
+
+void store_row(const QuantizedGemmParams &params, utens_t j0, utens_t n,
+               const int32 *sums, float32 *dst) {
+  for (utens_t j = 0; j < n; j++) {
+    const float32 b_scale = params.b_scale[params.per_channel ? j0 + j : 0];
+    const float32 bias = params.bias == nullptr ? 0.f : params.bias[j0 + j];
+    dst[j] = params.a_scale * b_scale * static_cast<float32>(sums[j]) + bias;
+  }
+}
+
+template<typename Otype>
+void requantize_row(const QuantizedGemmParams &params, utens_t j0, utens_t n,
+                    const int32 *sums, Otype *dst) {
+  const float32 lo = static_cast<float32>(std::numeric_limits<Otype>::min());
+  const float32 hi = static_cast<float32>(std::numeric_limits<Otype>::max());
+  const float32 inv_c_scale = 1.f / params.c_scale;
+  for (utens_t j = 0; j < n; j++) {
+    const float32 b_scale = params.b_scale[params.per_channel ? j0 + j : 0];
+    const float32 bias = params.bias == nullptr ? 0.f : params.bias[j0 + j];
+    const float32 real =
+        params.a_scale * b_scale * static_cast<float32>(sums[j]) + bias;
+    const float32 q = std::nearbyint(real * inv_c_scale) +
+                      static_cast<float32>(params.c_zero_point);
+    dst[j] = static_cast<Otype>(std::min(std::max(q, lo), hi));
+  }
+}
+
+void store_row(const QuantizedGemmParams &params, utens_t j0, utens_t n,
+               const int32 *sums, int8 *dst) {
+  requantize_row(params, j0, n, sums, dst);
+}
+
+void store_row(const QuantizedGemmParams &params, utens_t j0, utens_t n,
+               const int32 *sums, uint8 *dst) {
+  requantize_row(params, j0, n, sums, dst);
+}
+
+// float32 activations are read in place, bfloat16 ones are widened into
+// `buf`, rows [i0, i0 + mc) and columns [p0, p0 + kc) at a time.
+const float32 *int4_gemm_rows(const float32 *A, utens_t lda, utens_t i0,
+                              utens_t, utens_t p0, utens_t,
+                              std::vector<float32> *, utens_t *ld) {
+  *ld = lda;
+  return A + i0 * lda + p0;
+}
+
+const float32 *int4_gemm_rows(const bfloat16 *A, utens_t lda, utens_t i0,
+                              utens_t mc, utens_t p0, utens_t kc,
+                              std::vector<float32> *buf, utens_t *ld) {
+  const kernels::HalfKernels<bfloat16> &half =
+      kernels::GetHalfKernels<bfloat16>();
+  for (utens_t i = 0; i < mc; i++) {
+    half.to_float(kc, A + (i0 + i) * lda + p0, buf->data() + i * kc);
+  }
+  *ld = kc;
+  return buf->data();
+}
+
+// Same for the tile of C at rows [i0, i0 + mc) and columns [j0, j0 + nc):
+// float32 outputs are summed in place, bfloat16 ones in `buf` and rounded by
+// `int4_gemm_store`.
+float32 *int4_gemm_tile(float32 *C, utens_t ldc, utens_t i0, utens_t j0,
+                        utens_t, std::vector<float32> *, utens_t *ld) {
+  *ld = ldc;
+  return C + i0 * ldc + j0;
+}
+
+float32 *int4_gemm_tile(bfloat16 *, utens_t, utens_t, utens_t, utens_t nc,
+                        std::vector<float32> *buf, utens_t *ld) {
+  *ld = nc;
+  return buf->data();
+}
+
+void int4_gemm_store(const float32 *, utens_t, utens_t, float32 *, utens_t) {}
+
+void int4_gemm_store(const float32 *tile, utens_t mc, utens_t nc, bfloat16 *C,
+                     utens_t ldc) {
+  const kernels::HalfKernels<bfloat16> &half =
+      kernels::GetHalfKernels<bfloat16>();
+  for (utens_t i = 0; i < mc; i++) {
+    half.from_float(nc, tile + i * nc, C + i * ldc);
+  }
+}
+
+}  // namespace
+
+PackedMatrixS8::PackedMatrixS8(CBLAS_TRANSPOSE transB, utens_t k, utens_t n,
+                               const int8 *B, utens_t ldb)
+    : _k(k), _n(n), _kernels(&kernels::GetQuantizedGemmKernels()) {
+  CHECK_GE(ldb, std::max<utens_t>(transB == CblasNoTrans ? n : k, 1));
+  const utens_t nr = this->nr();
+  const utens_t k4 = this->k4();
+  _data.resize(num_panels() * k4 * nr * 4);
+  _col_sums.assign(n, 0);
+  const int64_t panel_size = static_cast<int64_t>(std::max<utens_t>(k, 1) * nr);
+  const int64_t grain_size =
+      std::max<int64_t>(1, kIntraOpGrainSize / panel_size);
+  ParallelFor(
+      static_cast<int64_t>(num_panels()), grain_size,
+      [&](int64_t begin, int64_t end) {
+        for (utens_t j = begin; j < static_cast<utens_t>(end); j++) {
+          int8 *dst = _data.data() + j * k4 * nr * 4;
+          const utens_t j0 = j * nr;
+          const utens_t cols = std::min(nr, n - j0);
+          for (utens_t q = 0; q < k4; q++) {
+            for (utens_t c = 0; c < nr; c++, dst += 4) {
+              for (utens_t t = 0; t < 4; t++) {
+                const utens_t p = q * 4 + t;
+                if (c >= cols || p >= k) {
+                  dst[t] = 0;
+                  continue;
+                }
+                dst[t] = transB == CblasNoTrans ? B[p * ldb + j0 + c]
+                                                : B[(j0 + c) * ldb + p];
+                _col_sums[j0 + c] += dst[t];
+              }
+            }
+          }
+        }
+      });
+}
+
+template<typename Otype>
+void chime_cpu_gemm_u8s8(utens_t m, const uint8 *A, utens_t lda,
+                         const PackedMatrixS8 &B,
+                         const QuantizedGemmParams &params, Otype *C,
+                         utens_t ldc) {
+  const utens_t k = B.k();
+  const utens_t n = B.n();
+  CHECK_GE(lda, std::max<utens_t>(k, 1));
+  CHECK_GE(ldc, std::max<utens_t>(n, 1));
+  CHECK((std::numeric_limits<Otype>::is_integer &&
+         sizeof(Otype) == sizeof(int32)) ||
+        params.b_scale != nullptr)
+      << "Dequantized or requantized outputs need the scale of B";
+  if (m == 0 || n == 0) return;
+
+  const kernels::QuantizedGemmKernels &gemm = B.gemm_kernels();
+  const utens_t mr = static_cast<utens_t>(gemm.mr);
+  const utens_t nr = B.nr();
+  const int32 za = params.a_zero_point;
+  bool has_b_zero_point = false;
+  if (params.b_zero_point != nullptr) {
+    const utens_t count = params.per_channel ? n : 1;
+    for (utens_t j = 0; j < count; j++) {
+      has_b_zero_point |= params.b_zero_point[j] != 0;
+    }
+  }
+
+  // Same split as the floating point driver, see packed_matrix.cc.
+  const utens_t row_blocks = (m + kQuantizedGemmMC - 1) / kQuantizedGemmMC;
+  const utens_t panels = B.num_panels();
+  utens_t col_blocks = (n + kQuantizedGemmNC - 1) / kQuantizedGemmNC;
+  const utens_t num_threads = static_cast<utens_t>(GetIntraOpNumThreads());
+  if (row_blocks * col_blocks < num_threads) {
+    col_blocks = std::min(panels, (num_threads + row_blocks - 1) / row_blocks);
+  }
+  const utens_t block_panels = (panels + col_blocks - 1) / col_blocks;
+  col_blocks = (panels + block_panels - 1) / block_panels;
+
+  const int64_t task_work = static_cast<int64_t>(
+      std::min(m, kQuantizedGemmMC) * block_panels * nr *
+      std::max<utens_t>(k, 1));
+  const int64_t grain_size =
+      std::max<int64_t>(1, kQuantizedGemmMinShardWork / task_work);
+  ParallelFor(
+      static_cast<int64_t>(row_blocks * col_blocks), grain_size,
+      [&](int64_t begin, int64_t end) {
+        const utens_t kc_max = std::min(k, kQuantizedGemmKC);
+        std::vector<uint8> a_pack(kQuantizedGemmMC * ((kc_max + 3) / 4 * 4));
+        std::vector<int32> sums(kQuantizedGemmMC * block_panels * nr);
+        std::vector<int32> row_sums(kQuantizedGemmMC);
+        for (utens_t t = begin; t < static_cast<utens_t>(end); t++) {
+          const utens_t i0 = t / col_blocks * kQuantizedGemmMC;
+          const utens_t mc = std::min(kQuantizedGemmMC, m - i0);
+          const utens_t first_panel = t % col_blocks * block_panels;
+          const utens_t last_panel =
+              std::min(panels, first_panel + block_panels);
+          const utens_t j0 = first_panel * nr;
+          const utens_t nc = std::min(n, last_panel * nr) - j0;
+          const utens_t ld = block_panels * nr;
+
+          if (k == 0) std::fill(sums.begin(), sums.end(), 0);
+          for (utens_t p0 = 0; p0 < k; p0 += kQuantizedGemmKC) {
+            const utens_t kc = std::min(kQuantizedGemmKC, k - p0);
+            const utens_t k4 = (kc + 3) / 4;
+            pack_a_u8(A, lda, i0, mc, p0, kc, mr, a_pack.data());
+            for (utens_t j = first_panel; j < last_panel; j++) {
+              const int8 *b = B.panel(j) + p0 * nr;
+              const utens_t cols = std::min(nr, n - j * nr);
+              for (utens_t ir = 0; ir < mc; ir += mr) {
+                int32 *c = sums.data() + ir * ld + (j - first_panel) * nr;
+                gemm.micro_kernel(k4, a_pack.data() + ir * k4 * 4, b, p0 > 0,
+                                  c, ld, std::min(mr, mc - ir), cols);
+              }
+            }
+          }
+
+          if (has_b_zero_point) {
+            for (utens_t i = 0; i < mc; i++) {
+              const uint8 *a = A + (i0 + i) * lda;
+              int32 sum = 0;
+              for (utens_t p = 0; p < k; p++) sum += a[p];
+              row_sums[i] = sum - static_cast<int32>(k) * za;
+            }
+          }
+          for (utens_t i = 0; i < mc; i++) {
+            int32 *row = sums.data() + i * ld;
+            for (utens_t j = 0; j < nc; j++) {
+              int32 correction = za * B.col_sums()[j0 + j];
+              if (has_b_zero_point) {
+                correction +=
+                    params.b_zero_point[params.per_channel ? j0 + j : 0] *
+                    row_sums[i];
+              }
+              row[j] -= correction;
+            }
+            store_row(params, j0, nc, row, C + (i0 + i) * ldc + j0);
+          }
+        }
+      });
+}
+
+template void chime_cpu_gemm_u8s8<int32>(utens_t, const uint8 *, utens_t,
+                                         const PackedMatrixS8 &,
+                                         const QuantizedGemmParams &, int32 *,
+                                         utens_t);
+template void chime_cpu_gemm_u8s8<float32>(utens_t, const uint8 *, utens_t,
+                                           const PackedMatrixS8 &,
+                                           const QuantizedGemmParams &,
+                                           float32 *, utens_t);
+template void chime_cpu_gemm_u8s8<int8>(utens_t, const uint8 *, utens_t,
+                                        const PackedMatrixS8 &,
+                                        const QuantizedGemmParams &, int8 *,
+                                        utens_t);
+template void chime_cpu_gemm_u8s8<uint8>(utens_t, const uint8 *, utens_t,
+                                         const PackedMatrixS8 &,
+                                         const QuantizedGemmParams &, uint8 *,
+                                         utens_t);
+
+PackedMatrixS4::PackedMatrixS4() : _k(0), _n(0), _group_size(0) {}
+
+PackedMatrixS4::PackedMatrixS4(CBLAS_TRANSPOSE transB, utens_t k, utens_t n,
+                               const float32 *B, utens_t ldb,
+                               utens_t group_size)
+    : _k(k), _n(n), _group_size(group_size) {
+  CHECK_GE(ldb, std::max<utens_t>(transB == CblasNoTrans ? n : k, 1));
+  CHECK(group_size == k || (group_size > 0 &&
+                            group_size % kernels::kInt4BlockSize == 0 &&
+                            k % group_size == 0))
+      << "Groups of " << group_size << " do not tile " << k << " elements";
+  const utens_t ld = this->ld();
+  const utens_t groups = num_groups();
+  // Padding holds q = 0.
+  _data.assign(n * ld, 0x88);
+  _scales.resize(n * groups);
+  const int64_t grain_size =
+      std::max<int64_t>(1, kIntraOpGrainSize / std::max<utens_t>(k, 1));
+  ParallelFor(
+      static_cast<int64_t>(n), grain_size, [&](int64_t begin, int64_t end) {
+        for (utens_t j = begin; j < static_cast<utens_t>(end); j++) {
+          const float32 *src = transB == CblasNoTrans ? B + j : B + j * ldb;
+          const utens_t stride = transB == CblasNoTrans ? ldb : 1;
+          uint8 *dst = _data.data() + j * ld;
+          for (utens_t g = 0; g < groups; g++) {
+            const utens_t p0 = g * group_size;
+            float32 max_abs = 0.f;
+            for (utens_t p = p0; p < p0 + group_size; p++) {
+              max_abs = std::max(max_abs, std::fabs(src[p * stride]));
+            }
+            const float32 scale = max_abs / 7.f;
+            const float32 inv_scale = scale > 0.f ? 1.f / scale : 0.f;
+            _scales[j * groups + g] = scale;
+            for (utens_t p = p0; p < p0 + group_size; p++) {
+              const float32 q = std::min(
+                  std::max(std::nearbyint(src[p * stride] * inv_scale), -8.f),
+                  7.f);
+              const uint8 nibble = static_cast<uint8>(static_cast<int>(q) + 8);
+              const utens_t t = p % kernels::kInt4BlockSize;
+              uint8 &byte = dst[p / kernels::kInt4BlockSize *
+                                    (kernels::kInt4BlockSize / 2) +
+                                t % (kernels::kInt4BlockSize / 2)];
+              byte = t < kernels::kInt4BlockSize / 2
+                         ? static_cast<uint8>((byte & 0xF0) | nibble)
+                         : static_cast<uint8>((byte & 0x0F) | nibble << 4);
+            }
+          }
+        }
+      });
+}
+
+void PackedMatrixS4::Dequantize(float32 *B, utens_t ldb) const {
+  CHECK_GE(ldb, std::max<utens_t>(_n, 1));
+  constexpr utens_t kHalf = kernels::kInt4BlockSize / 2;
+  for (utens_t j = 0; j < _n; j++) {
+    const uint8 *col = column(j);
+    for (utens_t p = 0; p < _k; p++) {
+      const utens_t t = p % kernels::kInt4BlockSize;
+      const uint8 byte = col[p / kernels::kInt4BlockSize * kHalf + t % kHalf];
+      const int q = (t < kHalf ? byte & 0x0F : byte >> 4) - 8;
+      B[p * ldb + j] = scales(j)[p / _group_size] * static_cast<float32>(q);
+    }
+  }
+}
+
+bool PackedMatrixS4::from_proto(const TensorProto &proto) {
+  if (proto.dtype() != DT_INT4 || proto.tensor_shape().dims_size() != 2) {
+    return false;
+  }
+  const utens_t n = proto.tensor_shape().dims(0).size();
+  const utens_t k = proto.tensor_shape().dims(1).size();
+  const utens_t num_scales = static_cast<utens_t>(proto.float32_val_size());
+  // The number of scales per column gives the size of the groups.
+  utens_t group_size = k;
+  if (n == 0 || k == 0) {
+    if (num_scales != 0) return false;
+  } else {
+    if (num_scales == 0 || num_scales % n != 0) return false;
+    const utens_t groups = num_scales / n;
+    if (groups > 1) {
+      if (k % groups != 0) return false;
+      group_size = k / groups;
+      if (group_size % kernels::kInt4BlockSize != 0) return false;
+    }
+  }
+
+  const utens_t ld = (k + kernels::kInt4BlockSize - 1) /
+                     kernels::kInt4BlockSize * (kernels::kInt4BlockSize / 2);
+  const std::string &content = proto.tensor_content();
+  if (content.size() != n * ld) return false;
+
+  _k = k;
+  _n = n;
+  _group_size = group_size;
+  _data.assign(content.begin(), content.end());
+  _scales.assign(proto.float32_val().begin(), proto.float32_val().end());
+  return true;
+}
+
+void PackedMatrixS4::as_proto(TensorProto *proto) const {
+  proto->Clear();
+  proto->set_dtype(DT_INT4);
+  proto->mutable_tensor_shape()->add_dims()->set_size(_n);
+  proto->mutable_tensor_shape()->add_dims()->set_size(_k);
+  proto->set_tensor_content(reinterpret_cast<const char *>(_data.data()),
+                            _data.size());
+  proto->mutable_float32_val()->Add(_scales.begin(), _scales.end());
+}
+
+template<typename Dtype>
+void chime_cpu_gemm_s4(utens_t m, const Dtype *A, utens_t lda,
+                       const PackedMatrixS4 &B, Dtype *C, utens_t ldc) {
+  const utens_t k = B.k();
+  const utens_t n = B.n();
+  CHECK_GE(lda, std::max<utens_t>(k, 1));
+  CHECK_GE(ldc, std::max<utens_t>(n, 1));
+  if (m == 0 || n == 0) return;
+  if (k == 0) {
+    for (utens_t i = 0; i < m; i++) {
+      std::fill(C + i * ldc, C + i * ldc + n, Dtype(0.f));
+    }
+    return;
+  }
+
+  const kernels::Int4GemmKernels &gemm = kernels::GetInt4GemmKernels();
+  const utens_t mr = static_cast<utens_t>(gemm.mr);
+  const utens_t nr = static_cast<utens_t>(gemm.nr);
+  const utens_t group_size = B.group_size();
+  const utens_t group_blocks =
+      (group_size + kernels::kInt4BlockSize - 1) / kernels::kInt4BlockSize;
+  const utens_t kc_max =
+      std::max(group_size, kInt4GemmKC / group_size * group_size);
+
+  // Same split as the other drivers, see packed_matrix.cc, with blocks of nr
+  // columns in place of packed panels.
+  const utens_t row_blocks = (m + kInt4GemmMC - 1) / kInt4GemmMC;
+  const utens_t panels = (n + nr - 1) / nr;
+  utens_t col_blocks = (n + kInt4GemmNC - 1) / kInt4GemmNC;
+  const utens_t num_threads = static_cast<utens_t>(GetIntraOpNumThreads());
+  if (row_blocks * col_blocks < num_threads) {
+    col_blocks = std::min(panels, (num_threads + row_blocks - 1) / row_blocks);
+  }
+  const utens_t block_panels = (panels + col_blocks - 1) / col_blocks;
+  col_blocks = (panels + block_panels - 1) / block_panels;
+
+  const int64_t task_work = static_cast<int64_t>(
+      std::min(m, kInt4GemmMC) * block_panels * nr * k);
+  const int64_t grain_size =
+      std::max<int64_t>(1, kQuantizedGemmMinShardWork / task_work);
+  ParallelFor(
+      static_cast<int64_t>(row_blocks * col_blocks), grain_size,
+      [&](int64_t begin, int64_t end) {
+        std::vector<float32> a_buf, c_buf;
+        if (!std::is_same<Dtype, float32>::value) {
+          a_buf.resize(kInt4GemmMC * std::min(k, kc_max));
+          c_buf.resize(kInt4GemmMC * block_panels * nr);
+        }
+        for (utens_t t = begin; t < static_cast<utens_t>(end); t++) {
+          const utens_t i0 = t / col_blocks * kInt4GemmMC;
+          const utens_t mc = std::min(kInt4GemmMC, m - i0);
+          const utens_t first_panel = t % col_blocks * block_panels;
+          const utens_t last_panel =
+              std::min(panels, first_panel + block_panels);
+          const utens_t j0 = first_panel * nr;
+          const utens_t nc = std::min(n, last_panel * nr) - j0;
+
+          utens_t ld_c;
+          float32 *c = int4_gemm_tile(C, ldc, i0, j0, nc, &c_buf, &ld_c);
+          for (utens_t p0 = 0; p0 < k; p0 += kc_max) {
+            const utens_t kc = std::min(kc_max, k - p0);
+            utens_t ld_a;
+            const float32 *a =
+                int4_gemm_rows(A, lda, i0, mc, p0, kc, &a_buf, &ld_a);
+            for (utens_t j = first_panel; j < last_panel; j++) {
+              const uint8 *b = B.column(j * nr) + p0 / 2;
+              const float32 *scales = B.scales(j * nr) + p0 / group_size;
+              const utens_t cols = std::min(nr, n - j * nr);
+              for (utens_t ir = 0; ir < mc; ir += mr) {
+                const utens_t rows = std::min(mr, mc - ir);
+                (rows == 1 ? gemm.row_kernel : gemm.micro_kernel)(
+                    kc, a + ir * ld_a, ld_a, b, B.ld(), scales,
+                    B.num_groups(), group_blocks, p0 > 0,
+                    c + ir * ld_c + (j * nr - j0), ld_c, rows, cols);
+              }
+            }
+          }
+          int4_gemm_store(c, mc, nc, C + i0 * ldc + j0, ldc);
+        }
+      });
+}
+
+template void chime_cpu_gemm_s4<float32>(utens_t, const float32 *, utens_t,
+                                         const PackedMatrixS4 &, float32 *,
+                                         utens_t);
+template void chime_cpu_gemm_s4<bfloat16>(utens_t, const bfloat16 *, utens_t,
+                                          const PackedMatrixS4 &, bfloat16 *,
+                                          utens_t);
+
+}  // namespace chime
@@ -0,0 +1,171 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_QUANTIZED_GEMM_H_
+#define CHIME_CORE_FRAMEWORK_QUANTIZED_GEMM_H_
+
+#include <openblas/cblas.h>
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/platform/macros.h"
+#include "chime/core/schema/tensor.pb.h"
+
+namespace chime {
+
+/// int8 right-hand operand of `chime_cpu_gemm_u8s8`, typically weights,
+/// packed once into the panel layout of the int8 microkernel (see
+/// `kernels::QuantizedGemmKernels`). The sums of its columns are kept along,
+/// they fold the zero point of A into the result.
+class PackedMatrixS8 {
+ public:
+  /// Packs op(B), a k x n matrix. B is row-major with `ldb` elements between
+  /// rows: k x n when `transB` is CblasNoTrans, n x k otherwise.
+  PackedMatrixS8(CBLAS_TRANSPOSE transB, utens_t k, utens_t n, const int8 *B,
+                 utens_t ldb);
+
+  utens_t k() const { return _k; }
+  utens_t n() const { return _n; }
+  utens_t nr() const { return static_cast<utens_t>(_kernels->nr); }
+
+  /// Number of groups of four rows, the last one may be partly padding.
+  utens_t k4() const { return (_k + 3) / 4; }
+
+  utens_t num_panels() const { return (_n + nr() - 1) / nr(); }
+
+  /// The panel holding columns [j * nr(), (j + 1) * nr()).
+  const int8 *panel(utens_t j) const {
+    return _data.data() + j * k4() * nr() * 4;
+  }
+
+  /// Sum of the k elements of each column.
+  const int32 *col_sums() const { return _col_sums.data(); }
+
+  /// Kernels the matrix was packed for.
+  const kernels::QuantizedGemmKernels &gemm_kernels() const {
+    return *_kernels;
+  }
+
+ private:
+  utens_t _k;
+  utens_t _n;
+  const kernels::QuantizedGemmKernels *_kernels;
+  std::vector<int8> _data;
+  std::vector<int32> _col_sums;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(PackedMatrixS8);
+};
+
+/// Affine quantization of the operands of `chime_cpu_gemm_u8s8`, where a
+/// quantized value q stands for scale * (q - zero_point).
+struct QuantizedGemmParams {
+  float32 a_scale = 1.f;
+  int32 a_zero_point = 0;
+
+  /// Quantization of B: one scale and zero point for the whole matrix, or one
+  /// per column, i.e. per output channel, when `per_channel` is set. A null
+  /// `b_zero_point` stands for zeros, as with symmetric weights.
+  const float32 *b_scale = nullptr;
+  const int32 *b_zero_point = nullptr;
+  bool per_channel = false;
+
+  /// Optional real-valued bias of each column of C.
+  const float32 *bias = nullptr;
+
+  /// Quantization of C, for int8 and uint8 outputs.
+  float32 c_scale = 1.f;
+  int32 c_zero_point = 0;
+};
+
+/// Quantized C = A * B, with A an m x k uint8 matrix, row-major with `lda`
+/// elements between rows, and C m x `B.n()` with `ldc`. Products are summed
+/// in int32 with the zero points of A and B taken out, then the output type
+/// picks the epilogue fused into the kernel:
+///
+///   int32     the exact sums, scales and bias are ignored;
+///   float32   dequantized, a_scale * b_scale * sum + bias;
+///   int8,     requantized to the scale and zero point of C, rounding to
+///   uint8     nearest even and saturating.
+///
+/// Work is split over the intra-op thread pool by blocks of rows and columns
+/// of C. REQUIRES: `b_scale` is set unless C is int32.
+template<typename Otype>
+void chime_cpu_gemm_u8s8(utens_t m, const uint8 *A, utens_t lda,
+                         const PackedMatrixS8 &B,
+                         const QuantizedGemmParams &params, Otype *C,
+                         utens_t ldc);
+
+/// 4-bit weights for weight-only quantization: op(B) is k x n, and every
+/// `group_size` consecutive elements of a column share one float32 scale.
+/// Values are symmetric, scale * q with q in [-8, 7]. The scale of a group is
+/// its largest magnitude over 7, and q its elements over the scale, rounded to
+/// nearest even. `chime_cpu_gemm_s4` widens the weights in registers, so they
+/// stream from memory at 4 bits each.
+///
+/// The layout is that of `kernels::Int4GemmKernels`, the same for every
+/// instruction set, so a matrix can be saved and loaded as is: `as_proto`
+/// writes a DT_INT4 TensorProto of shape [n, k], with the packed columns in
+/// `tensor_content` and the n x `num_groups()` scales in `float32_val`.
+class PackedMatrixS4 {
+ public:
+  /// An empty matrix, e.g. to be read by `from_proto`.
+  PackedMatrixS4();
+
+  /// Quantizes op(B), a k x n matrix. B is row-major with `ldb` elements
+  /// between rows: k x n when `transB` is CblasNoTrans, n x k otherwise.
+  /// REQUIRES: `group_size` is k, or a multiple of `kernels::kInt4BlockSize`
+  /// that divides k.
+  PackedMatrixS4(CBLAS_TRANSPOSE transB, utens_t k, utens_t n,
+                 const float32 *B, utens_t ldb, utens_t group_size);
+
+  utens_t k() const { return _k; }
+  utens_t n() const { return _n; }
+  utens_t group_size() const { return _group_size; }
+  utens_t num_groups() const { return _k == 0 ? 0 : _k / _group_size; }
+
+  /// Bytes between consecutive columns, whole blocks of weights.
+  utens_t ld() const {
+    return (_k + kernels::kInt4BlockSize - 1) / kernels::kInt4BlockSize *
+           (kernels::kInt4BlockSize / 2);
+  }
+
+  /// The packed elements of column j, and their `num_groups()` scales.
+  const uint8 *column(utens_t j) const { return _data.data() + j * ld(); }
+  const float32 *scales(utens_t j) const {
+    return _scales.data() + j * num_groups();
+  }
+
+  /// Writes the dequantized op(B), k x n, to B with `ldb` elements between
+  /// rows.
+  void Dequantize(float32 *B, utens_t ldb) const;
+
+  /// Reads a TensorProto written by `as_proto`. Returns false, leaving the
+  /// matrix as it is, if the proto does not hold a valid matrix.
+  bool from_proto(const TensorProto &proto);
+  void as_proto(TensorProto *proto) const;
+
+ private:
+  utens_t _k;
+  utens_t _n;
+  utens_t _group_size;
+  std::vector<uint8> _data;
+  std::vector<float32> _scales;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(PackedMatrixS4);
+};
+
+/// C = A * B with int4 weights, where A is m x `B.k()` and C m x `B.n()`, both
+/// row-major with `lda` and `ldc` elements between rows. Supports float32 and
+/// bfloat16 activations: products are summed in float32, bfloat16 operands
+/// are widened as they are read and C is rounded once. With m = 1 this is a
+/// matrix-vector product reading every weight once. Work is split over the
+/// intra-op thread pool by blocks of rows and columns of C.
+template<typename Dtype>
+void chime_cpu_gemm_s4(utens_t m, const Dtype *A, utens_t lda,
+                       const PackedMatrixS4 &B, Dtype *C, utens_t ldc);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_QUANTIZED_GEMM_H_
@@ -0,0 +1,417 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/quantized_gemm.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+struct Operands {
+  Operands(utens_t m, utens_t n, utens_t k, utens_t pad)
+      : m(m), n(n), k(k), lda(k + pad), ldb(n + pad), a(m * lda),
+        b(k * ldb), b_scale(n), b_zero_point(n), bias(n) {
+    for (utens_t i = 0; i < a.size(); i++) a[i] = uint8((i * 37 + 11) % 256);
+    for (utens_t i = 0; i < b.size(); i++) {
+      b[i] = static_cast<int8>(static_cast<int>((i * 53 + 7) % 256) - 128);
+    }
+    for (utens_t j = 0; j < n; j++) {
+      b_scale[j] = 0.01f * static_cast<float32>(j % 5 + 1);
+      b_zero_point[j] = static_cast<int32>(j % 7) - 3;
+      bias[j] = 0.5f * static_cast<float32>(static_cast<int>(j % 9) - 4);
+    }
+  }
+
+  // Zero-point corrected sum of row i of A times column j of B.
+  int64 Sum(utens_t i, utens_t j, int32 za, int32 zb) const {
+    int64 sum = 0;
+    for (utens_t p = 0; p < k; p++) {
+      sum += (static_cast<int64>(a[i * lda + p]) - za) *
+             (static_cast<int64>(b[p * ldb + j]) - zb);
+    }
+    return sum;
+  }
+
+  utens_t m, n, k, lda, ldb;
+  std::vector<uint8> a;
+  std::vector<int8> b;
+  std::vector<float32> b_scale;
+  std::vector<int32> b_zero_point;
+  std::vector<float32> bias;
+};
+
+}  // namespace
+
+TEST(QuantizedGemmTest, Int32MatchesReference) {
+  for (int64_t num_threads : {1, 4}) {
+    ScopedIntraOpNumThreads threads(num_threads);
+    for (utens_t m : {1, 7, 100}) {
+      for (utens_t n : {1, 19, 70}) {
+        for (utens_t k : {0, 3, 64, 1030}) {
+          Operands op(m, n, k, 3);
+          PackedMatrixS8 packed(CblasNoTrans, k, n, op.b.data(), op.ldb);
+          QuantizedGemmParams params;
+          params.a_zero_point = 128;
+          params.b_zero_point = op.b_zero_point.data();
+          params.per_channel = true;
+          const utens_t ldc = n + 1;
+          std::vector<int32> c(m * ldc, -1);
+          chime_cpu_gemm_u8s8<int32>(m, op.a.data(), op.lda, packed, params,
+                                     c.data(), ldc);
+          for (utens_t i = 0; i < m; i++) {
+            for (utens_t j = 0; j < n; j++) {
+              ASSERT_EQ(c[i * ldc + j], op.Sum(i, j, 128, op.b_zero_point[j]))
+                  << m << "x" << n << "x" << k << " at " << i << ", " << j;
+            }
+            ASSERT_EQ(c[i * ldc + n], -1);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(QuantizedGemmTest, TransposedWeights) {
+  const utens_t m = 5, n = 40, k = 37;
+  Operands op(m, n, k, 0);
+  std::vector<int8> bt(n * k);
+  for (utens_t p = 0; p < k; p++) {
+    for (utens_t j = 0; j < n; j++) bt[j * k + p] = op.b[p * n + j];
+  }
+  PackedMatrixS8 packed(CblasNoTrans, k, n, op.b.data(), n);
+  PackedMatrixS8 packed_t(CblasTrans, k, n, bt.data(), k);
+  QuantizedGemmParams params;
+  params.a_zero_point = 3;
+  std::vector<int32> c(m * n), ct(m * n);
+  chime_cpu_gemm_u8s8<int32>(m, op.a.data(), k, packed, params, c.data(), n);
+  chime_cpu_gemm_u8s8<int32>(m, op.a.data(), k, packed_t, params, ct.data(),
+                             n);
+  EXPECT_EQ(c, ct);
+}
+
+TEST(QuantizedGemmTest, Dequantize) {
+  const utens_t m = 9, n = 33, k = 100;
+  Operands op(m, n, k, 2);
+  PackedMatrixS8 packed(CblasNoTrans, k, n, op.b.data(), op.ldb);
+  for (bool per_channel : {false, true}) {
+    QuantizedGemmParams params;
+    params.a_scale = 0.02f;
+    params.a_zero_point = 100;
+    params.b_scale = op.b_scale.data();
+    params.b_zero_point = op.b_zero_point.data();
+    params.per_channel = per_channel;
+    params.bias = op.bias.data();
+    std::vector<float32> c(m * n);
+    chime_cpu_gemm_u8s8<float32>(m, op.a.data(), op.lda, packed, params,
+                                 c.data(), n);
+    for (utens_t i = 0; i < m; i++) {
+      for (utens_t j = 0; j < n; j++) {
+        const utens_t ch = per_channel ? j : 0;
+        const double ref = 0.02 * op.b_scale[ch] *
+                               op.Sum(i, j, 100, op.b_zero_point[ch]) +
+                           op.bias[j];
+        EXPECT_NEAR(c[i * n + j], ref, 1e-5 * (1. + std::fabs(ref)));
+      }
+    }
+  }
+}
+
+TEST(QuantizedGemmTest, Requantize) {
+  const utens_t m = 6, n = 21, k = 50;
+  Operands op(m, n, k, 0);
+  PackedMatrixS8 packed(CblasNoTrans, k, n, op.b.data(), n);
+  QuantizedGemmParams params;
+  params.a_scale = 0.2f;
+  params.a_zero_point = 120;
+  params.b_scale = op.b_scale.data();
+  params.per_channel = true;
+  params.bias = op.bias.data();
+  params.c_scale = 2.f;
+  params.c_zero_point = 10;
+  std::vector<int8> c(m * n);
+  std::vector<uint8> cu(m * n);
+  chime_cpu_gemm_u8s8<int8>(m, op.a.data(), k, packed, params, c.data(), n);
+  chime_cpu_gemm_u8s8<uint8>(m, op.a.data(), k, packed, params, cu.data(), n);
+  int saturated = 0, inside = 0;
+  for (utens_t i = 0; i < m; i++) {
+    for (utens_t j = 0; j < n; j++) {
+      const double real =
+          0.2 * op.b_scale[j] * op.Sum(i, j, 120, 0) + op.bias[j];
+      const double q = real / 2. + 10.;
+      // Off by one at most, when float rounding lands on the other side of a
+      // halfway point.
+      EXPECT_NEAR(c[i * n + j], std::min(std::max(q, -128.), 127.), 1.);
+      EXPECT_NEAR(cu[i * n + j], std::min(std::max(q, 0.), 255.), 1.);
+      saturated += q < -128. || q > 127.;
+      inside += q > -127. && q < 126.;
+    }
+  }
+  EXPECT_GT(saturated, 0);
+  EXPECT_GT(inside, 0);
+}
+
+// Every instruction set computes the same tiles.
+TEST(QuantizedGemmTest, MicroKernelsAgree) {
+  const CPUCapability detected = DetectCPUCapability();
+  for (int cap = 0; cap <= static_cast<int>(detected); cap++) {
+    const kernels::QuantizedGemmKernels &gemm =
+        kernels::GetQuantizedGemmKernels(static_cast<CPUCapability>(cap));
+    const utens_t mr = gemm.mr, nr = gemm.nr, k4 = 5;
+    std::vector<uint8> a(mr * k4 * 4);
+    std::vector<int8> b(nr * k4 * 4);
+    for (utens_t i = 0; i < a.size(); i++) a[i] = uint8(255 - i % 256);
+    for (utens_t i = 0; i < b.size(); i++) b[i] = int8(i % 2 ? -128 : 127);
+    std::vector<int32> ref(mr * nr);
+    for (utens_t i = 0; i < mr; i++) {
+      for (utens_t j = 0; j < nr; j++) {
+        int32 sum = 0;
+        for (utens_t q = 0; q < k4; q++) {
+          for (utens_t t = 0; t < 4; t++) {
+            sum += a[(q * mr + i) * 4 + t] * b[(q * nr + j) * 4 + t];
+          }
+        }
+        ref[i * nr + j] = 2 * sum;
+      }
+    }
+    std::vector<int32> c(mr * nr, 7);
+    gemm.micro_kernel(k4, a.data(), b.data(), false, c.data(), nr, mr, nr);
+    gemm.micro_kernel(k4, a.data(), b.data(), true, c.data(), nr, mr, nr);
+    EXPECT_EQ(c, ref) << CPUCapabilityToString(static_cast<CPUCapability>(cap));
+
+    // An edge tile leaves everything outside of its corner alone.
+    std::vector<int32> edge(mr * nr, -1);
+    gemm.micro_kernel(k4, a.data(), b.data(), false, edge.data(), nr, mr - 1,
+                      nr - 1);
+    for (utens_t i = 0; i < mr; i++) {
+      for (utens_t j = 0; j < nr; j++) {
+        const bool inside = i + 1 < mr && j + 1 < nr;
+        EXPECT_EQ(edge[i * nr + j], inside ? ref[i * nr + j] / 2 : -1);
+      }
+    }
+  }
+}
+
+namespace {
+
+// Weights spread over a few magnitudes, so that groups get different scales.
+std::vector<float32> Int4Weights(utens_t k, utens_t n) {
+  std::vector<float32> w(k * n);
+  for (utens_t i = 0; i < w.size(); i++) {
+    w[i] = std::sin(0.37f * static_cast<float32>(i)) *
+           static_cast<float32>(1 + i / 97 % 4);
+  }
+  return w;
+}
+
+std::vector<float32> Int4Activations(utens_t m, utens_t lda) {
+  std::vector<float32> a(m * lda);
+  for (utens_t i = 0; i < a.size(); i++) {
+    a[i] = std::cos(0.11f * static_cast<float32>(i)) - 0.25f;
+  }
+  return a;
+}
+
+}  // namespace
+
+TEST(QuantizedGemmTest, Int4Quantization) {
+  const utens_t k = 96, n = 5, group_size = 32;
+  std::vector<float32> w = Int4Weights(k, n);
+  w[3 * n + 1] = 0.f;
+  for (utens_t p = 32; p < 64; p++) w[p * n + 2] = 0.f;
+  PackedMatrixS4 packed(CblasNoTrans, k, n, w.data(), n, group_size);
+  EXPECT_EQ(packed.num_groups(), 3u);
+  EXPECT_EQ(packed.ld(), 48u);
+
+  std::vector<float32> deq(k * n);
+  packed.Dequantize(deq.data(), n);
+  for (utens_t j = 0; j < n; j++) {
+    for (utens_t g = 0; g < 3; g++) {
+      float32 max_abs = 0.f;
+      for (utens_t p = g * 32; p < g * 32 + 32; p++) {
+        max_abs = std::max(max_abs, std::fabs(w[p * n + j]));
+      }
+      const float32 scale = packed.scales(j)[g];
+      EXPECT_FLOAT_EQ(scale, max_abs / 7.f);
+      for (utens_t p = g * 32; p < g * 32 + 32; p++) {
+        EXPECT_LE(std::fabs(deq[p * n + j] - w[p * n + j]),
+                  0.5f * scale * (1.f + 1e-5f));
+      }
+    }
+  }
+  EXPECT_EQ(deq[3 * n + 1], 0.f);
+  for (utens_t p = 32; p < 64; p++) EXPECT_EQ(deq[p * n + 2], 0.f);
+
+  // Packing the transpose gives the same bytes.
+  std::vector<float32> wt(n * (k + 1));
+  for (utens_t p = 0; p < k; p++) {
+    for (utens_t j = 0; j < n; j++) wt[j * (k + 1) + p] = w[p * n + j];
+  }
+  PackedMatrixS4 packed_t(CblasTrans, k, n, wt.data(), k + 1, group_size);
+  for (utens_t j = 0; j < n; j++) {
+    EXPECT_EQ(std::vector<uint8>(packed.column(j),
+                                 packed.column(j) + packed.ld()),
+              std::vector<uint8>(packed_t.column(j),
+                                 packed_t.column(j) + packed_t.ld()));
+  }
+}
+
+TEST(QuantizedGemmTest, Int4MatchesDequantized) {
+  struct Shape {
+    utens_t k, group_size;
+  };
+  // Whole groups, a single group ending inside a block, and enough groups to
+  // be cut into several blocks of k.
+  const Shape shapes[] = {{32, 32}, {100, 100}, {256, 64}, {4160, 64}};
+  for (int64_t num_threads : {1, 4}) {
+    ScopedIntraOpNumThreads threads(num_threads);
+    for (const Shape &shape : shapes) {
+      for (utens_t n : {1, 7, 70}) {
+        const utens_t k = shape.k;
+        const std::vector<float32> w = Int4Weights(k, n);
+        PackedMatrixS4 packed(CblasNoTrans, k, n, w.data(), n,
+                              shape.group_size);
+        std::vector<float32> deq(k * n);
+        packed.Dequantize(deq.data(), n);
+        for (utens_t m : {1, 5, 50}) {
+          const utens_t lda = k + 3, ldc = n + 1;
+          const std::vector<float32> a = Int4Activations(m, lda);
+          std::vector<float32> c(m * ldc, -1.f);
+          chime_cpu_gemm_s4<float32>(m, a.data(), lda, packed, c.data(), ldc);
+          for (utens_t i = 0; i < m; i++) {
+            for (utens_t j = 0; j < n; j++) {
+              double ref = 0., mag = 0.;
+              for (utens_t p = 0; p < k; p++) {
+                ref += static_cast<double>(a[i * lda + p]) * deq[p * n + j];
+                mag += std::fabs(static_cast<double>(a[i * lda + p]) *
+                                 deq[p * n + j]);
+              }
+              ASSERT_NEAR(c[i * ldc + j], ref, 1e-5 * (1. + mag))
+                  << m << "x" << n << "x" << k << " at " << i << ", " << j;
+            }
+            ASSERT_EQ(c[i * ldc + n], -1.f);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(QuantizedGemmTest, Int4BFloat16Activations) {
+  const utens_t m = 3, n = 19, k = 128;
+  const std::vector<float32> w = Int4Weights(k, n);
+  PackedMatrixS4 packed(CblasNoTrans, k, n, w.data(), n, 64);
+  std::vector<float32> a = Int4Activations(m, k);
+  std::vector<bfloat16> a_bf16(m * k);
+  for (utens_t i = 0; i < a.size(); i++) {
+    a_bf16[i] = bfloat16(a[i]);
+    a[i] = static_cast<float32>(a_bf16[i]);
+  }
+  std::vector<float32> c(m * n);
+  std::vector<bfloat16> c_bf16(m * n);
+  chime_cpu_gemm_s4<float32>(m, a.data(), k, packed, c.data(), n);
+  chime_cpu_gemm_s4<bfloat16>(m, a_bf16.data(), k, packed, c_bf16.data(), n);
+  for (utens_t i = 0; i < m * n; i++) {
+    EXPECT_EQ(c_bf16[i].bits, bfloat16(c[i]).bits) << i;
+  }
+}
+
+TEST(QuantizedGemmTest, Int4ProtoRoundTrip) {
+  const utens_t m = 4, n = 9, k = 192;
+  const std::vector<float32> w = Int4Weights(k, n);
+  PackedMatrixS4 packed(CblasNoTrans, k, n, w.data(), n, 64);
+  TensorProto proto;
+  packed.as_proto(&proto);
+  EXPECT_EQ(proto.dtype(), DT_INT4);
+  EXPECT_EQ(proto.tensor_content().size(), n * k / 2);
+  EXPECT_EQ(proto.float32_val_size(), static_cast<int>(n * 3));
+
+  std::string bytes;
+  ASSERT_TRUE(proto.SerializeToString(&bytes));
+  TensorProto parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bytes));
+  PackedMatrixS4 loaded;
+  ASSERT_TRUE(loaded.from_proto(parsed));
+  EXPECT_EQ(loaded.k(), k);
+  EXPECT_EQ(loaded.n(), n);
+  EXPECT_EQ(loaded.group_size(), 64u);
+
+  const std::vector<float32> a = Int4Activations(m, k);
+  std::vector<float32> c(m * n), c_loaded(m * n);
+  chime_cpu_gemm_s4<float32>(m, a.data(), k, packed, c.data(), n);
+  chime_cpu_gemm_s4<float32>(m, a.data(), k, loaded, c_loaded.data(), n);
+  EXPECT_EQ(c, c_loaded);
+
+  // One scale per column when the group spans all of k.
+  PackedMatrixS4 per_column(CblasNoTrans, 50, n, w.data(), n, 50);
+  per_column.as_proto(&proto);
+  ASSERT_TRUE(loaded.from_proto(proto));
+  EXPECT_EQ(loaded.group_size(), 50u);
+  EXPECT_EQ(loaded.num_groups(), 1u);
+
+  TensorProto bad = parsed;
+  bad.set_dtype(DT_UINT8);
+  EXPECT_FALSE(loaded.from_proto(bad));
+  bad = parsed;
+  bad.mutable_tensor_content()->pop_back();
+  EXPECT_FALSE(loaded.from_proto(bad));
+  bad = parsed;
+  bad.add_float32_val(1.f);
+  EXPECT_FALSE(loaded.from_proto(bad));
+  // 5 groups of 192 / 5 elements do not exist.
+  bad = parsed;
+  bad.clear_float32_val();
+  for (utens_t i = 0; i < 5 * n; i++) bad.add_float32_val(1.f);
+  EXPECT_FALSE(loaded.from_proto(bad));
+  // A failed read leaves the matrix alone.
+  EXPECT_EQ(loaded.k(), 50u);
+}
+
+// Every instruction set computes the same tiles, including the block cut
+// short by k and the corners of edge tiles.
+TEST(QuantizedGemmTest, Int4MicroKernelsAgree) {
+  const utens_t k = 80, n = 8;
+  const std::vector<float32> w = Int4Weights(k, n);
+  PackedMatrixS4 packed(CblasNoTrans, k, n, w.data(), n, k);
+  std::vector<float32> deq(k * n);
+  packed.Dequantize(deq.data(), n);
+  const CPUCapability detected = DetectCPUCapability();
+  for (int cap = 0; cap <= static_cast<int>(detected); cap++) {
+    const kernels::Int4GemmKernels &gemm =
+        kernels::GetInt4GemmKernels(static_cast<CPUCapability>(cap));
+    const utens_t mr = gemm.mr, nr = gemm.nr;
+    const std::vector<float32> a = Int4Activations(mr, k);
+    for (utens_t kk : {utens_t(64), utens_t(75)}) {
+      for (utens_t rows : {mr, mr - 1, utens_t(1)}) {
+        std::vector<float32> c(mr * nr, 7.f);
+        const auto kernel = rows == 1 ? gemm.row_kernel : gemm.micro_kernel;
+        kernel(kk, a.data(), k, packed.column(0), packed.ld(),
+               packed.scales(0), packed.num_groups(), 3, true, c.data(), nr,
+               rows, nr - 1);
+        for (utens_t i = 0; i < mr; i++) {
+          for (utens_t j = 0; j < nr; j++) {
+            if (i >= rows || j + 1 >= nr) {
+              EXPECT_EQ(c[i * nr + j], 7.f);
+              continue;
+            }
+            double ref = 7.;
+            for (utens_t p = 0; p < kk; p++) {
+              ref += static_cast<double>(a[i * k + p]) * deq[p * n + j];
+            }
+            EXPECT_NEAR(c[i * nr + j], ref, 1e-4)
+                << CPUCapabilityToString(static_cast<CPUCapability>(cap))
+                << " " << kk << " " << rows << " at " << i << ", " << j;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace chime
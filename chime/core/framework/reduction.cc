@@ -0,0 +1,509 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/reduction.h"
+
+#include <algorithm>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+
+namespace {
+
+// Leaves of the reduction trees: a piece of at most kLeafElements elements of
+// a row, or a single row of the column form. Up to kLeafRows leaves are
+// reduced in order, larger ranges are cut in halves.
+constexpr utens_t kLeafElements = 4096;
+constexpr utens_t kLeafRows = 8;
+
+// Columns reduced together by the column form, so that the accumulators of
+// every level of a tree stay in cache.
+constexpr utens_t kColumnTile = 256;
+
+// Levels of a tree whose subtrees run in parallel when there are fewer
+// results than groups of leaves.
+constexpr int kParallelTreeLevels = 6;
+
+enum class ReduceOp { kSum, kSquaredDeviation, kMax, kMin };
+
+std::vector<bool> ReducedAxes(size_t num_dims, const std::vector<int> &axes) {
+  std::vector<bool> reduced(num_dims, false);
+  const int n = static_cast<int>(num_dims);
+  for (int axis : axes) {
+    CHECK(axis >= -n && axis < n)
+        << "Axis " << axis << " out of range for " << n << " dimensions";
+    const int d = axis < 0 ? axis + n : axis;
+    CHECK(!reduced[d]) << "Axis " << axis << " is reduced twice";
+    reduced[d] = true;
+  }
+  return reduced;
+}
+
+// Dimensions of the same kind, reduced or kept, merged into one.
+struct Group {
+  utens_t size;
+  utens_t stride;
+};
+
+// Offset of element `index` of the row-major space of `groups`.
+utens_t GroupOffset(const std::vector<Group> &groups, utens_t index) {
+  utens_t offset = 0;
+  for (auto g = groups.rbegin(); g != groups.rend(); ++g) {
+    offset += index % g->size * g->stride;
+    index /= g->size;
+  }
+  return offset;
+}
+
+// How the input is walked. Unit dimensions are dropped and neighbouring
+// dimensions of the same kind merged, then the innermost group decides:
+// - reduced, `rows` is set and every result reduces `num_rows` rows of
+//   `width` contiguous elements;
+// - kept, every `width` consecutive results fold `num_rows` rows of `width`
+//   contiguous elements, which is the column form.
+// The rows of a result are the space of `reduced`, and results or groups of
+// `width` results the space of `kept`, outermost groups first.
+struct ReducePlan {
+  ReducePlan(const std::vector<utens_t> &dims, const std::vector<int> &axes);
+
+  utens_t num_results() const { return rows ? num_outer : num_outer * width; }
+
+  bool rows;
+  utens_t width;
+  std::vector<Group> kept;
+  std::vector<Group> reduced;
+  utens_t num_outer;
+  utens_t num_rows;
+  // Reduced elements per result.
+  utens_t count;
+};
+
+ReducePlan::ReducePlan(const std::vector<utens_t> &dims,
+                       const std::vector<int> &axes)
+    : rows(true), width(1), num_outer(1), num_rows(1) {
+  const std::vector<bool> is_reduced = ReducedAxes(dims.size(), axes);
+  std::vector<Group> groups;
+  std::vector<bool> kinds;
+  utens_t stride = 1;
+  for (size_t d = dims.size(); d-- > 0;) {
+    if (dims[d] != 1) {
+      if (!groups.empty() && kinds.back() == is_reduced[d]) {
+        groups.back().size *= dims[d];
+      } else {
+        groups.push_back({dims[d], stride});
+        kinds.push_back(is_reduced[d]);
+      }
+    }
+    stride *= dims[d];
+  }
+  for (size_t g = 0; g < groups.size(); g++) {
+    if (g == 0) {
+      rows = kinds[0];
+      width = groups[0].size;
+    } else if (kinds[g]) {
+      reduced.insert(reduced.begin(), groups[g]);
+      num_rows *= groups[g].size;
+    } else {
+      kept.insert(kept.begin(), groups[g]);
+      num_outer *= groups[g].size;
+    }
+  }
+  count = rows ? num_rows * width : num_rows;
+}
+
+// Levels of scratch values needed by `ReduceTree` over n leaves.
+int TreeDepth(utens_t n) {
+  int depth = 1;
+  for (; n > kLeafRows; n -= n / 2) depth++;
+  return depth;
+}
+
+// Pairwise reduction of leaves [lo, hi) into the `p.width` values at `out`.
+// `Policy` sets `out` to a leaf, accumulates a leaf into it, and merges the
+// values of another subtree into it.
+template<typename Dtype, typename Policy>
+void ReduceTree(const Policy &p, utens_t lo, utens_t hi, Dtype *out,
+                Dtype *scratch) {
+  if (hi - lo <= kLeafRows) {
+    p.Init(lo, out);
+    for (utens_t l = lo + 1; l < hi; l++) p.Accumulate(l, out);
+    return;
+  }
+  const utens_t mid = lo + (hi - lo) / 2;
+  ReduceTree(p, lo, mid, out, scratch);
+  ReduceTree(p, mid, hi, scratch, scratch + p.width);
+  p.Merge(scratch, out);
+}
+
+// Subtrees of the top `kParallelTreeLevels` levels of `ReduceTree`.
+void CollectSubtrees(utens_t lo, utens_t hi, int level,
+                     std::vector<std::pair<utens_t, utens_t>> *subtrees) {
+  if (level == kParallelTreeLevels || hi - lo <= kLeafRows) {
+    subtrees->emplace_back(lo, hi);
+    return;
+  }
+  const utens_t mid = lo + (hi - lo) / 2;
+  CollectSubtrees(lo, mid, level + 1, subtrees);
+  CollectSubtrees(mid, hi, level + 1, subtrees);
+}
+
+// Merges the values of the subtrees like `ReduceTree` would have.
+template<typename Dtype, typename Policy>
+void MergeSubtrees(const Policy &p, utens_t lo, utens_t hi, int level,
+                   const Dtype *partials, size_t *next, Dtype *out,
+                   Dtype *scratch) {
+  if (level == kParallelTreeLevels || hi - lo <= kLeafRows) {
+    std::copy(partials + *next * p.width, partials + (*next + 1) * p.width,
+              out);
+    ++*next;
+    return;
+  }
+  const utens_t mid = lo + (hi - lo) / 2;
+  MergeSubtrees(p, lo, mid, level + 1, partials, next, out, scratch);
+  MergeSubtrees(p, mid, hi, level + 1, partials, next, scratch,
+                scratch + p.width);
+  p.Merge(scratch, out);
+}
+
+// `ReduceTree` over [0, num_leaves) with the subtrees on the intra-op pool.
+// The tree is the same, and so is the result.
+template<typename Dtype, typename Policy>
+void ParallelReduceTree(const Policy &p, utens_t num_leaves, Dtype *out) {
+  std::vector<std::pair<utens_t, utens_t>> subtrees;
+  CollectSubtrees(0, num_leaves, 0, &subtrees);
+  std::vector<Dtype> partials(subtrees.size() * p.width);
+  const int depth = TreeDepth(num_leaves);
+  ParallelFor(static_cast<int64_t>(subtrees.size()), 1,
+              [&](int64_t first, int64_t last) {
+                std::vector<Dtype> scratch(depth * p.width);
+                for (int64_t s = first; s < last; s++) {
+                  ReduceTree(p, subtrees[s].first, subtrees[s].second,
+                             partials.data() + s * p.width, scratch.data());
+                }
+              });
+  std::vector<Dtype> scratch(kParallelTreeLevels * p.width);
+  size_t next = 0;
+  MergeSubtrees(p, 0, num_leaves, 0, partials.data(), &next, out,
+                scratch.data());
+}
+
+// Leaves of one result when `rows` is set: row l / chunks, piece l % chunks.
+template<typename Dtype>
+struct RowLeaves {
+  Dtype Leaf(utens_t l) const {
+    const utens_t piece = l % chunks * kLeafElements;
+    const Dtype *row = x + GroupOffset(plan->reduced, l / chunks) + piece;
+    const utens_t n = std::min(kLeafElements, plan->width - piece);
+    switch (op) {
+      case ReduceOp::kSum:
+        return k->sum(n, row);
+      case ReduceOp::kSquaredDeviation:
+        return k->sum_sq_dev(n, row, mean);
+      case ReduceOp::kMax:
+        return k->max(n, row);
+      default:
+        return k->min(n, row);
+    }
+  }
+
+  void Combine(Dtype v, Dtype *out) const {
+    switch (op) {
+      case ReduceOp::kMax:
+        if (v > *out) *out = v;
+        break;
+      case ReduceOp::kMin:
+        if (v < *out) *out = v;
+        break;
+      default:
+        *out += v;
+    }
+  }
+
+  void Init(utens_t l, Dtype *out) const { *out = Leaf(l); }
+  void Accumulate(utens_t l, Dtype *out) const { Combine(Leaf(l), out); }
+  void Merge(const Dtype *in, Dtype *out) const { Combine(*in, out); }
+
+  const kernels::ReduceKernels<Dtype> *k;
+  const ReducePlan *plan;
+  ReduceOp op;
+  // First element of the rows of the result.
+  const Dtype *x;
+  Dtype mean;
+  utens_t chunks;
+  utens_t width;
+};
+
+// Leaves of a tile of `width` results of the column form: row l.
+template<typename Dtype>
+struct ColumnLeaves {
+  const Dtype *Row(utens_t l) const {
+    return x + GroupOffset(plan->reduced, l);
+  }
+
+  void Init(utens_t l, Dtype *out) const {
+    if (op == ReduceOp::kSquaredDeviation) {
+      std::fill(out, out + width, Dtype(0));
+      k->sq_dev_col(width, Row(l), mean, out);
+    } else {
+      std::copy(Row(l), Row(l) + width, out);
+    }
+  }
+
+  void Accumulate(utens_t l, Dtype *out) const {
+    if (op == ReduceOp::kSquaredDeviation) {
+      k->sq_dev_col(width, Row(l), mean, out);
+    } else {
+      Merge(Row(l), out);
+    }
+  }
+
+  void Merge(const Dtype *in, Dtype *out) const {
+    switch (op) {
+      case ReduceOp::kMax:
+        k->max_col(width, in, out);
+        break;
+      case ReduceOp::kMin:
+        k->min_col(width, in, out);
+        break;
+      default:
+        k->add_col(width, in, out);
+    }
+  }
+
+  const kernels::ReduceKernels<Dtype> *k;
+  const ReducePlan *plan;
+  ReduceOp op;
+  // First column of the tile in the rows of the results.
+  const Dtype *x;
+  // Means of the tile for kSquaredDeviation.
+  const Dtype *mean;
+  utens_t width;
+};
+
+// Writes the `plan.num_results()` reductions of x to y. `mean` holds the
+// means for kSquaredDeviation, laid out like y.
+// REQUIRES: plan.count > 0
+template<typename Dtype>
+void Reduce(const ReducePlan &plan, ReduceOp op, const Dtype *x,
+            const Dtype *mean, Dtype *y) {
+  const kernels::ReduceKernels<Dtype> *k = &kernels::GetReduceKernels<Dtype>();
+  if (plan.rows) {
+    const utens_t chunks = (plan.width + kLeafElements - 1) / kLeafElements;
+    const utens_t num_leaves = plan.num_rows * chunks;
+    auto leaves = [&](utens_t u) {
+      return RowLeaves<Dtype>{k, &plan, op, x + GroupOffset(plan.kept, u),
+                              mean ? mean[u] : Dtype(0), chunks, 1};
+    };
+    if (plan.num_outer >= num_leaves / kLeafRows) {
+      const int depth = TreeDepth(num_leaves);
+      const int64_t grain = std::max<int64_t>(
+          1, kIntraOpGrainSize / static_cast<int64_t>(plan.count));
+      ParallelFor(static_cast<int64_t>(plan.num_outer), grain,
+                  [&](int64_t first, int64_t last) {
+                    std::vector<Dtype> scratch(depth);
+                    for (int64_t u = first; u < last; u++) {
+                      ReduceTree(leaves(u), 0, num_leaves, y + u,
+                                 scratch.data());
+                    }
+                  });
+    } else {
+      for (utens_t u = 0; u < plan.num_outer; u++) {
+        ParallelReduceTree(leaves(u), num_leaves, y + u);
+      }
+    }
+    return;
+  }
+
+  const utens_t tiles = (plan.width + kColumnTile - 1) / kColumnTile;
+  const utens_t num_items = plan.num_outer * tiles;
+  auto leaves = [&](utens_t item) {
+    const utens_t u = item / tiles;
+    const utens_t column = item % tiles * kColumnTile;
+    return ColumnLeaves<Dtype>{
+        k, &plan, op, x + GroupOffset(plan.kept, u) + column,
+        mean ? mean + u * plan.width + column : nullptr,
+        std::min(kColumnTile, plan.width - column)};
+  };
+  auto result = [&](utens_t item) {
+    return y + item / tiles * plan.width + item % tiles * kColumnTile;
+  };
+  if (num_items >= plan.num_rows / kLeafRows) {
+    const int depth = TreeDepth(plan.num_rows);
+    const int64_t grain = std::max<int64_t>(
+        1, kIntraOpGrainSize / static_cast<int64_t>(plan.count * kColumnTile));
+    ParallelFor(static_cast<int64_t>(num_items), grain,
+                [&](int64_t first, int64_t last) {
+                  std::vector<Dtype> scratch(depth * kColumnTile);
+                  for (int64_t item = first; item < last; item++) {
+                    ReduceTree(leaves(item), 0, plan.num_rows, result(item),
+                               scratch.data());
+                  }
+                });
+  } else {
+    for (utens_t item = 0; item < num_items; item++) {
+      ParallelReduceTree(leaves(item), plan.num_rows, result(item));
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<utens_t> ReducedDims(const std::vector<utens_t> &dims,
+                                 const std::vector<int> &axes,
+                                 bool keep_dims) {
+  const std::vector<bool> reduced = ReducedAxes(dims.size(), axes);
+  std::vector<utens_t> result;
+  for (size_t d = 0; d < dims.size(); d++) {
+    if (!reduced[d]) {
+      result.push_back(dims[d]);
+    } else if (keep_dims) {
+      result.push_back(1);
+    }
+  }
+  return result;
+}
+
+template<typename Dtype>
+void chime_cpu_reduce_sum(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const ReducePlan plan(dims, axes);
+  if (plan.count == 0) {
+    std::fill(y, y + plan.num_results(), Dtype(0));
+    return;
+  }
+  Reduce(plan, ReduceOp::kSum, x, static_cast<const Dtype *>(nullptr), y);
+}
+
+template<typename Dtype>
+void chime_cpu_reduce_mean(const std::vector<utens_t> &dims,
+                           const std::vector<int> &axes, const Dtype *x,
+                           Dtype *y) {
+  const ReducePlan plan(dims, axes);
+  chime_cpu_reduce_sum(dims, axes, x, y);
+  const Dtype count = static_cast<Dtype>(plan.count);
+  for (utens_t i = 0; i < plan.num_results(); i++) y[i] /= count;
+}
+
+template<typename Dtype>
+void chime_cpu_reduce_max(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const ReducePlan plan(dims, axes);
+  CHECK_GT(plan.count, 0u) << "max of no element";
+  Reduce(plan, ReduceOp::kMax, x, static_cast<const Dtype *>(nullptr), y);
+}
+
+template<typename Dtype>
+void chime_cpu_reduce_min(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const ReducePlan plan(dims, axes);
+  CHECK_GT(plan.count, 0u) << "min of no element";
+  Reduce(plan, ReduceOp::kMin, x, static_cast<const Dtype *>(nullptr), y);
+}
+
+// The maximum first, then its first position: a result stops reading at it.
+template<typename Dtype>
+void chime_cpu_reduce_argmax(const std::vector<utens_t> &dims,
+                             const std::vector<int> &axes, const Dtype *x,
+                             utens_t *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const ReducePlan plan(dims, axes);
+  CHECK_GT(plan.count, 0u) << "argmax of no element";
+  std::vector<Dtype> best(plan.num_results());
+  Reduce(plan, ReduceOp::kMax, x, static_cast<const Dtype *>(nullptr),
+         best.data());
+  const int64_t grain = std::max<int64_t>(
+      1, kIntraOpGrainSize / static_cast<int64_t>(plan.count));
+  if (plan.rows) {
+    ParallelFor(static_cast<int64_t>(plan.num_outer), grain,
+                [&](int64_t first, int64_t last) {
+                  for (int64_t u = first; u < last; u++) {
+                    const Dtype *base = x + GroupOffset(plan.kept, u);
+                    for (utens_t r = 0; r < plan.num_rows; r++) {
+                      const Dtype *row = base + GroupOffset(plan.reduced, r);
+                      const utens_t i =
+                          std::find(row, row + plan.width, best[u]) - row;
+                      if (i < plan.width) {
+                        y[u] = r * plan.width + i;
+                        break;
+                      }
+                    }
+                  }
+                });
+    return;
+  }
+  ParallelFor(static_cast<int64_t>(plan.num_outer), grain,
+              [&](int64_t first, int64_t last) {
+                for (int64_t u = first; u < last; u++) {
+                  const Dtype *base = x + GroupOffset(plan.kept, u);
+                  const Dtype *max = best.data() + u * plan.width;
+                  utens_t *index = y + u * plan.width;
+                  std::fill(index, index + plan.width, plan.count);
+                  utens_t missing = plan.width;
+                  for (utens_t r = 0; r < plan.num_rows && missing > 0; r++) {
+                    const Dtype *row = base + GroupOffset(plan.reduced, r);
+                    for (utens_t i = 0; i < plan.width; i++) {
+                      if (index[i] == plan.count && row[i] == max[i]) {
+                        index[i] = r;
+                        missing--;
+                      }
+                    }
+                  }
+                }
+              });
+}
+
+template<typename Dtype>
+void chime_cpu_reduce_variance(const std::vector<utens_t> &dims,
+                               const std::vector<int> &axes, int correction,
+                               const Dtype *x, Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const ReducePlan plan(dims, axes);
+  std::vector<Dtype> mean(plan.num_results());
+  chime_cpu_reduce_mean(dims, axes, x, mean.data());
+  if (plan.count == 0) {
+    std::copy(mean.begin(), mean.end(), y);
+    return;
+  }
+  Reduce(plan, ReduceOp::kSquaredDeviation, x,
+         static_cast<const Dtype *>(mean.data()), y);
+  const Dtype divisor = static_cast<Dtype>(plan.count) - correction;
+  for (utens_t i = 0; i < plan.num_results(); i++) y[i] /= divisor;
+}
+
+#define INSTANTIATE_REDUCTION(Dtype)                                          \
+  template void chime_cpu_reduce_sum<Dtype>(const std::vector<utens_t> &,     \
+                                            const std::vector<int> &,         \
+                                            const Dtype *, Dtype *);          \
+  template void chime_cpu_reduce_mean<Dtype>(const std::vector<utens_t> &,    \
+                                             const std::vector<int> &,        \
+                                             const Dtype *, Dtype *);         \
+  template void chime_cpu_reduce_max<Dtype>(const std::vector<utens_t> &,     \
+                                            const std::vector<int> &,         \
+                                            const Dtype *, Dtype *);          \
+  template void chime_cpu_reduce_min<Dtype>(const std::vector<utens_t> &,     \
+                                            const std::vector<int> &,         \
+                                            const Dtype *, Dtype *);          \
+  template void chime_cpu_reduce_argmax<Dtype>(const std::vector<utens_t> &,  \
+                                               const std::vector<int> &,      \
+                                               const Dtype *, utens_t *);     \
+  template void chime_cpu_reduce_variance<Dtype>(                             \
+      const std::vector<utens_t> &, const std::vector<int> &, int,            \
+      const Dtype *, Dtype *)
+
+INSTANTIATE_REDUCTION(float32);
+INSTANTIATE_REDUCTION(float64);
+
+}  // namespace chime
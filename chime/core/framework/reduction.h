@@ -0,0 +1,71 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_REDUCTION_H_
+#define CHIME_CORE_FRAMEWORK_REDUCTION_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Reductions over any set of axes of a row-major array of dimensions `dims`,
+/// such as the host data of a Tensor with the dimensions of its TensorShape.
+/// Axes may be given in any order and counted from the end when negative, but
+/// not repeated. The input is read in place, without transposing the reduced
+/// axes to the end first, and the result has the dimensions of `ReducedDims`.
+///
+/// Sums are pairwise, so that their rounding error grows with the logarithm
+/// of the number of reduced elements, and the order of the additions only
+/// depends on the dimensions: results are the same for any number of intra-op
+/// threads. The work is split over the results or over the reduced elements,
+/// whichever are more.
+///
+/// Only float32 and float64 are supported. `max`, `min` and `argmax` need at
+/// least one reduced element and do not handle NaN. `argmax` gives the first
+/// position of the maximum, counted over the reduced elements in row-major
+/// order, which is the index along the axis when only one is reduced.
+///
+/// `ReducedDims` drops the reduced dimensions, or keeps them with size 1 when
+/// `keep_dims` is set; the layout of the result is the same either way.
+std::vector<utens_t> ReducedDims(const std::vector<utens_t> &dims,
+                                 const std::vector<int> &axes,
+                                 bool keep_dims);
+
+template<typename Dtype>
+void chime_cpu_reduce_sum(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_reduce_mean(const std::vector<utens_t> &dims,
+                           const std::vector<int> &axes, const Dtype *x,
+                           Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_reduce_max(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_reduce_min(const std::vector<utens_t> &dims,
+                          const std::vector<int> &axes, const Dtype *x,
+                          Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_reduce_argmax(const std::vector<utens_t> &dims,
+                             const std::vector<int> &axes, const Dtype *x,
+                             utens_t *y);
+
+/// The sum of the squared deviations from the mean, computed first, over
+/// N - `correction` for N reduced elements: 0 gives the population variance
+/// and 1 the unbiased sample variance.
+template<typename Dtype>
+void chime_cpu_reduce_variance(const std::vector<utens_t> &dims,
+                               const std::vector<int> &axes, int correction,
+                               const Dtype *x, Dtype *y);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_REDUCTION_H_
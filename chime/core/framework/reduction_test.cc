@@ -0,0 +1,203 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/reduction.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+// Reductions of every result computed element by element, in long double.
+struct Reference {
+  Reference(const std::vector<utens_t> &dims, const std::vector<int> &axes,
+            const std::vector<float64> &x) {
+    const int n = static_cast<int>(dims.size());
+    std::vector<bool> reduced(n, false);
+    for (int axis : axes) reduced[axis < 0 ? axis + n : axis] = true;
+    utens_t num_results = 1;
+    for (int d = 0; d < n; d++) {
+      if (!reduced[d]) num_results *= dims[d];
+    }
+    sum.assign(num_results, 0);
+    sum_sq.assign(num_results, 0);
+    max.assign(num_results, -INFINITY);
+    min.assign(num_results, INFINITY);
+    argmax.assign(num_results, 0);
+    count.assign(num_results, 0);
+    std::vector<utens_t> index(n, 0);
+    for (utens_t e = 0; e < x.size(); e++) {
+      utens_t rest = e;
+      for (int d = n - 1; d >= 0; d--) {
+        index[d] = rest % dims[d];
+        rest /= dims[d];
+      }
+      utens_t r = 0, position = 0;
+      for (int d = 0; d < n; d++) {
+        if (reduced[d]) {
+          position = position * dims[d] + index[d];
+        } else {
+          r = r * dims[d] + index[d];
+        }
+      }
+      sum[r] += x[e];
+      sum_sq[r] += static_cast<long double>(x[e]) * x[e];
+      if (x[e] > max[r]) {
+        max[r] = x[e];
+        argmax[r] = position;
+      }
+      if (x[e] < min[r]) min[r] = x[e];
+      count[r]++;
+    }
+  }
+
+  std::vector<long double> sum, sum_sq;
+  std::vector<float64> max, min;
+  std::vector<utens_t> argmax, count;
+};
+
+}  // namespace
+
+TEST(ReductionTest, TestReducedDims) {
+  const std::vector<utens_t> dims = {2, 3, 4, 5};
+  EXPECT_EQ(ReducedDims(dims, {1, 3}, false), std::vector<utens_t>({2, 4}));
+  EXPECT_EQ(ReducedDims(dims, {-1, 1}, true),
+            std::vector<utens_t>({2, 1, 4, 1}));
+  EXPECT_EQ(ReducedDims(dims, {}, false), dims);
+  EXPECT_EQ(ReducedDims(dims, {0, 1, 2, 3}, false), std::vector<utens_t>());
+  EXPECT_DEATH(ReducedDims(dims, {4}, false), "out of range");
+  EXPECT_DEATH(ReducedDims(dims, {1, -3}, false), "reduced twice");
+}
+
+// Every subset of the axes of a few shapes, with unit dimensions and rows
+// longer than a leaf.
+TEST(ReductionTest, TestAgainstReference) {
+  const std::vector<std::vector<utens_t>> shapes = {
+      {3, 4, 5}, {2, 1, 7, 3}, {5, 1}, {9000}, {3, 2, 9000}, {700, 3, 2}};
+  for (const auto &dims : shapes) {
+    const utens_t total = NumElements(dims);
+    const std::vector<float64> x = Pattern<float64>(total, 0, 1013, 0.01, -3.);
+    const int n = static_cast<int>(dims.size());
+    for (int subset = 0; subset < (1 << n); subset++) {
+      std::vector<int> axes;
+      for (int d = 0; d < n; d++) {
+        if (subset >> d & 1) axes.push_back(d % 2 ? d - n : d);
+      }
+      const Reference ref(dims, axes, x);
+      const utens_t num_results = ref.sum.size();
+      std::vector<float64> sum(num_results), mean(num_results),
+          max(num_results), min(num_results), var(num_results);
+      std::vector<utens_t> argmax(num_results);
+      chime_cpu_reduce_sum(dims, axes, x.data(), sum.data());
+      chime_cpu_reduce_mean(dims, axes, x.data(), mean.data());
+      chime_cpu_reduce_max(dims, axes, x.data(), max.data());
+      chime_cpu_reduce_min(dims, axes, x.data(), min.data());
+      chime_cpu_reduce_argmax(dims, axes, x.data(), argmax.data());
+      chime_cpu_reduce_variance(dims, axes, 1, x.data(), var.data());
+      for (utens_t r = 0; r < num_results; r++) {
+        const long double c = ref.count[r];
+        const long double ref_mean = ref.sum[r] / c;
+        const long double ref_var =
+            c > 1 ? (ref.sum_sq[r] - c * ref_mean * ref_mean) / (c - 1) : NAN;
+        EXPECT_NEAR(sum[r], ref.sum[r], 1e-12 * (1 + std::fabs(ref.sum[r])))
+            << subset << " " << r;
+        EXPECT_NEAR(mean[r], ref_mean, 1e-12) << subset << " " << r;
+        EXPECT_EQ(max[r], ref.max[r]) << subset << " " << r;
+        EXPECT_EQ(min[r], ref.min[r]) << subset << " " << r;
+        EXPECT_EQ(argmax[r], ref.argmax[r]) << subset << " " << r;
+        if (c > 1) {
+          EXPECT_NEAR(var[r], ref_var, 1e-9) << subset << " " << r;
+        }
+      }
+    }
+  }
+}
+
+TEST(ReductionTest, TestPairwiseSum) {
+  // 0.1f is not a power of two, so adding it in order loses about seven
+  // digits over 2^24 elements.
+  const utens_t n = 1 << 24;
+  std::vector<float32> x(n, 0.1f);
+  float32 sum;
+  chime_cpu_reduce_sum<float32>({n}, {0}, x.data(), &sum);
+  EXPECT_NEAR(sum, n * static_cast<float64>(0.1f), n * 1e-7);
+
+  // The column form adds rows pairwise as well.
+  std::vector<float32> columns(4);
+  chime_cpu_reduce_sum<float32>({n / 4, 4}, {0}, x.data(), columns.data());
+  for (float32 v : columns) {
+    EXPECT_NEAR(v, n / 4 * static_cast<float64>(0.1f), n * 1e-7);
+  }
+}
+
+// Sharding over the results and over the reduced elements gives the same
+// result for any number of threads.
+TEST(ReductionTest, TestIntraOpParallel) {
+  const std::vector<std::pair<std::vector<utens_t>, std::vector<int>>> cases =
+      {{{1 << 20}, {0}},
+       {{4096, 64}, {0}},
+       {{64, 4096}, {1}},
+       {{3000, 3, 200}, {0, 2}},
+       {{20, 5000, 7}, {1}}};
+  for (const auto &c : cases) {
+    const utens_t total = NumElements(c.first);
+    std::vector<float32> x(total);
+    for (utens_t i = 0; i < total; i++) {
+      x[i] = static_cast<float32>((i * 7919) % 1013) * 0.01f - 3.f;
+    }
+    const utens_t num_results = [&] {
+      utens_t r = 1;
+      for (utens_t d : ReducedDims(c.first, c.second, false)) r *= d;
+      return r;
+    }();
+    std::vector<float32> sum_ref(num_results), var_ref(num_results);
+    std::vector<float32> sum(num_results), var(num_results);
+    std::vector<utens_t> argmax_ref(num_results), argmax(num_results);
+    ScopedIntraOpNumThreads threads(1);
+    chime_cpu_reduce_sum(c.first, c.second, x.data(), sum_ref.data());
+    chime_cpu_reduce_variance(c.first, c.second, 0, x.data(), var_ref.data());
+    chime_cpu_reduce_argmax(c.first, c.second, x.data(), argmax_ref.data());
+    SetIntraOpNumThreads(4);
+    chime_cpu_reduce_sum(c.first, c.second, x.data(), sum.data());
+    chime_cpu_reduce_variance(c.first, c.second, 0, x.data(), var.data());
+    chime_cpu_reduce_argmax(c.first, c.second, x.data(), argmax.data());
+    EXPECT_EQ(sum, sum_ref);
+    EXPECT_EQ(var, var_ref);
+    EXPECT_EQ(argmax, argmax_ref);
+  }
+}
+
+TEST(ReductionTest, TestEdgeCases) {
+  // Ties give the first position.
+  const std::vector<float32> x = {1.f, 5.f, 5.f, 2.f, 5.f, 0.f};
+  std::vector<utens_t> argmax(2);
+  chime_cpu_reduce_argmax<float32>({2, 3}, {1}, x.data(), argmax.data());
+  EXPECT_EQ(argmax, std::vector<utens_t>({1, 1}));
+  std::vector<utens_t> column_argmax(3);
+  chime_cpu_reduce_argmax<float32>({2, 3}, {0}, x.data(),
+                                   column_argmax.data());
+  EXPECT_EQ(column_argmax, std::vector<utens_t>({1, 0, 0}));
+
+  // Empty reductions.
+  std::vector<float32> y(6, -1.f);
+  chime_cpu_reduce_sum<float32>({2, 0, 3}, {1}, x.data(), y.data());
+  EXPECT_EQ(y, std::vector<float32>(6, 0.f));
+  chime_cpu_reduce_mean<float32>({2, 0, 3}, {1}, x.data(), y.data());
+  EXPECT_TRUE(std::isnan(y[0]));
+
+  // No axis copies, a scalar is its own sum.
+  chime_cpu_reduce_sum<float32>({2, 3}, {}, x.data(), y.data());
+  EXPECT_EQ(y, x);
+  float32 s;
+  chime_cpu_reduce_sum<float32>({}, {}, x.data() + 1, &s);
+  EXPECT_EQ(s, 5.f);
+}
+
+}  // namespace chime
@@ -0,0 +1,552 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_SIMD_H_
+#define CHIME_CORE_FRAMEWORK_SIMD_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif  // __SSE2__
+
+/// Width in bytes of the widest vector register enabled at compile time.
+/// Zero means no vector unit is available and every kernel runs scalar.
+#if defined(__AVX512F__)
+#define CHIME_SIMD_BYTES 64
+#elif defined(__AVX2__)
+#define CHIME_SIMD_BYTES 32
+#elif defined(__SSE2__)
+#define CHIME_SIMD_BYTES 16
+#else
+#define CHIME_SIMD_BYTES 0
+#endif
+
+/// Namespace that everything compiled against the current instruction set
+/// lives in. Translation units built with extra `-m` flags (see
+/// math_kernels_impl.h) define it to something else, so the same inline
+/// functions compiled for different targets never collide at link time.
+#ifndef CHIME_CPU_CAPABILITY
+#define CHIME_CPU_CAPABILITY cpu_default
+#endif  // CHIME_CPU_CAPABILITY
+
+namespace chime {
+namespace simd {
+inline namespace CHIME_CPU_CAPABILITY {
+
+/// Unsigned integer with the same width as `T`, used to manipulate the bit
+/// pattern of floating point lanes.
+template <typename T>
+struct BitsOf {
+  typedef T type;
+};
+
+template <>
+struct BitsOf<float> {
+  typedef uint32_t type;
+};
+
+template <>
+struct BitsOf<double> {
+  typedef uint64_t type;
+};
+
+/// `Vec<T>` is a thin wrapper over one SIMD register holding `kLanes`
+/// elements of type `T`. Kernels are written once against this interface and
+/// the widest instruction set enabled for the translation unit is picked up
+/// automatically.
+///
+/// float32/float64 use hand-written AVX-512/AVX2/SSE intrinsics. Integer types
+/// use GCC vector extensions of the same width, which lower to the matching
+/// integer instructions (or get scalarized, e.g. for division). Every other
+/// type falls back to a single-lane register.
+///
+/// Besides arithmetic, floating point vectors provide comparisons producing a
+/// `Mask`, `LaneMask(bits)` (lane i set where bit i of `bits` is),
+/// `Select(mask, a, b)` (lane-wise `mask ? a : b`) and integer
+/// operations on the raw bit pattern of each lane (`Bits`), which is what the
+/// polynomial math in simd_math.h is built from.
+template <typename T, int kBytes = CHIME_SIMD_BYTES>
+struct Vec {
+  typedef T Scalar;
+  typedef T Reg;
+  typedef bool Mask;
+  typedef typename BitsOf<T>::type Bits;
+  static constexpr int kLanes = 1;
+
+  static Reg Load(const T *p) { return *p; }
+  static void Store(T *p, Reg v) { *p = v; }
+  static Reg Set1(T v) { return v; }
+  static Reg Add(Reg a, Reg b) { return a + b; }
+  static Reg Sub(Reg a, Reg b) { return a - b; }
+  static Reg Mul(Reg a, Reg b) { return a * b; }
+  static Reg Div(Reg a, Reg b) { return a / b; }
+  static Reg MulAdd(Reg a, Reg b, Reg c) { return a * b + c; }
+  static Reg Max(Reg a, Reg b) { return a < b ? b : a; }
+  static Reg Min(Reg a, Reg b) { return b < a ? b : a; }
+  static Reg Sqrt(Reg a) { return std::sqrt(a); }
+  static Reg Abs(Reg a) { return a < T(0) ? -a : a; }
+  static Reg Neg(Reg a) { return -a; }
+  static Reg Sign(Reg a) {
+    return static_cast<T>((T(0) < a) - (a < T(0)));
+  }
+
+  static Mask Lt(Reg a, Reg b) { return a < b; }
+  static Mask Gt(Reg a, Reg b) { return a > b; }
+  static Mask IsNan(Reg a) { return a != a; }
+  static Reg Select(Mask m, Reg a, Reg b) { return m ? a : b; }
+  static Mask LaneMask(uint32_t bits) { return (bits & 1) != 0; }
+
+  static Bits AsBits(Reg a) {
+    Bits b;
+    std::memcpy(&b, &a, sizeof(b));
+    return b;
+  }
+  static Bits LoadBits(const void *p) {
+    Bits b;
+    std::memcpy(&b, p, sizeof(b));
+    return b;
+  }
+  static Reg FromBits(Bits b) {
+    Reg a;
+    std::memcpy(&a, &b, sizeof(a));
+    return a;
+  }
+  static Bits SetBits(uint64_t v) { return static_cast<Bits>(v); }
+  static Bits BitsAdd(Bits a, Bits b) { return a + b; }
+  static Bits BitsSub(Bits a, Bits b) { return a - b; }
+  static Bits BitsAnd(Bits a, Bits b) { return a & b; }
+  static Bits BitsOr(Bits a, Bits b) { return a | b; }
+  static Bits BitsShl(Bits a, int n) { return a << n; }
+  static Bits BitsShr(Bits a, int n) { return a >> n; }
+};
+
+#if CHIME_SIMD_BYTES > 0
+
+/// Integer vectors built on GCC vector extensions.
+template <typename T, int kBytes>
+struct IntVec {
+  typedef T Reg __attribute__((vector_size(kBytes)));
+  static constexpr int kLanes = kBytes / sizeof(T);
+
+  static Reg Load(const T *p) {
+    Reg v;
+    std::memcpy(&v, p, sizeof(Reg));
+    return v;
+  }
+  static void Store(T *p, Reg v) { std::memcpy(p, &v, sizeof(Reg)); }
+  static Reg Set1(T v) { return Reg{} + v; }
+  static Reg Add(Reg a, Reg b) { return a + b; }
+  static Reg Sub(Reg a, Reg b) { return a - b; }
+  static Reg Mul(Reg a, Reg b) { return a * b; }
+  static Reg Div(Reg a, Reg b) { return a / b; }
+  /// Comparisons yield all-ones lanes, so `-(a > 0)` is 1 where `a` is
+  /// positive and `(a < 0)` is -1 where it is negative.
+  static Reg Sign(Reg a) {
+    const Reg zero = Reg{};
+    return (Reg)(-(a > zero)) + (Reg)(a < zero);
+  }
+};
+
+#define CHIME_SIMD_INT_VEC(T)                             \
+  template <>                                             \
+  struct Vec<T, CHIME_SIMD_BYTES>                         \
+      : public IntVec<T, CHIME_SIMD_BYTES> {}
+
+CHIME_SIMD_INT_VEC(int8_t);
+CHIME_SIMD_INT_VEC(int16_t);
+CHIME_SIMD_INT_VEC(int32_t);
+CHIME_SIMD_INT_VEC(int64_t);
+CHIME_SIMD_INT_VEC(uint8_t);
+CHIME_SIMD_INT_VEC(uint16_t);
+CHIME_SIMD_INT_VEC(uint32_t);
+CHIME_SIMD_INT_VEC(uint64_t);
+
+#undef CHIME_SIMD_INT_VEC
+
+#endif  // CHIME_SIMD_BYTES > 0
+
+#if defined(__AVX512F__)
+
+template <>
+struct Vec<float, 64> {
+  typedef float Scalar;
+  typedef __m512 Reg;
+  typedef __mmask16 Mask;
+  typedef __m512i Bits;
+  static constexpr int kLanes = 16;
+
+  static Reg Load(const float *p) { return _mm512_loadu_ps(p); }
+  static void Store(float *p, Reg v) { _mm512_storeu_ps(p, v); }
+  static Reg Set1(float v) { return _mm512_set1_ps(v); }
+  static Reg Add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm512_div_ps(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) { return _mm512_fmadd_ps(a, b, c); }
+  static Reg Max(Reg a, Reg b) { return _mm512_max_ps(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm512_min_ps(a, b); }
+  static Reg Sqrt(Reg a) { return _mm512_sqrt_ps(a); }
+  static Reg Abs(Reg a) { return _mm512_abs_ps(a); }
+  static Reg Neg(Reg a) {
+    return FromBits(_mm512_xor_si512(AsBits(a), SetBits(0x80000000u)));
+  }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm512_setzero_ps();
+    const Reg one = _mm512_set1_ps(1.f);
+    __mmask16 pos = _mm512_cmp_ps_mask(a, zero, _CMP_GT_OQ);
+    __mmask16 neg = _mm512_cmp_ps_mask(a, zero, _CMP_LT_OQ);
+    return _mm512_sub_ps(_mm512_maskz_mov_ps(pos, one),
+                         _mm512_maskz_mov_ps(neg, one));
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static Mask Gt(Reg a, Reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  static Mask IsNan(Reg a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+  static Reg Select(Mask m, Reg a, Reg b) {
+    return _mm512_mask_blend_ps(m, b, a);
+  }
+  static Mask LaneMask(uint32_t bits) { return static_cast<Mask>(bits); }
+
+  static Bits AsBits(Reg a) { return _mm512_castps_si512(a); }
+  static Bits LoadBits(const void *p) { return _mm512_loadu_si512(p); }
+  static Reg FromBits(Bits b) { return _mm512_castsi512_ps(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm512_set1_epi32(static_cast<int>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm512_add_epi32(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm512_sub_epi32(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm512_and_si512(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm512_or_si512(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm512_slli_epi32(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm512_srli_epi32(a, n); }
+};
+
+template <>
+struct Vec<double, 64> {
+  typedef double Scalar;
+  typedef __m512d Reg;
+  typedef __mmask8 Mask;
+  typedef __m512i Bits;
+  static constexpr int kLanes = 8;
+
+  static Reg Load(const double *p) { return _mm512_loadu_pd(p); }
+  static void Store(double *p, Reg v) { _mm512_storeu_pd(p, v); }
+  static Reg Set1(double v) { return _mm512_set1_pd(v); }
+  static Reg Add(Reg a, Reg b) { return _mm512_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm512_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm512_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm512_div_pd(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) { return _mm512_fmadd_pd(a, b, c); }
+  static Reg Max(Reg a, Reg b) { return _mm512_max_pd(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm512_min_pd(a, b); }
+  static Reg Sqrt(Reg a) { return _mm512_sqrt_pd(a); }
+  static Reg Abs(Reg a) { return _mm512_abs_pd(a); }
+  static Reg Neg(Reg a) {
+    return FromBits(_mm512_xor_si512(AsBits(a), SetBits(1ull << 63)));
+  }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm512_setzero_pd();
+    const Reg one = _mm512_set1_pd(1.);
+    __mmask8 pos = _mm512_cmp_pd_mask(a, zero, _CMP_GT_OQ);
+    __mmask8 neg = _mm512_cmp_pd_mask(a, zero, _CMP_LT_OQ);
+    return _mm512_sub_pd(_mm512_maskz_mov_pd(pos, one),
+                         _mm512_maskz_mov_pd(neg, one));
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static Mask Gt(Reg a, Reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+  static Mask IsNan(Reg a) { return _mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q); }
+  static Reg Select(Mask m, Reg a, Reg b) {
+    return _mm512_mask_blend_pd(m, b, a);
+  }
+  static Mask LaneMask(uint32_t bits) { return static_cast<Mask>(bits); }
+
+  static Bits AsBits(Reg a) { return _mm512_castpd_si512(a); }
+  static Bits LoadBits(const void *p) { return _mm512_loadu_si512(p); }
+  static Reg FromBits(Bits b) { return _mm512_castsi512_pd(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm512_set1_epi64(static_cast<long long>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm512_add_epi64(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm512_sub_epi64(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm512_and_si512(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm512_or_si512(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm512_slli_epi64(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm512_srli_epi64(a, n); }
+};
+
+#elif defined(__AVX2__)
+
+template <>
+struct Vec<float, 32> {
+  typedef float Scalar;
+  typedef __m256 Reg;
+  typedef __m256 Mask;
+  typedef __m256i Bits;
+  static constexpr int kLanes = 8;
+
+  static Reg Load(const float *p) { return _mm256_loadu_ps(p); }
+  static void Store(float *p, Reg v) { _mm256_storeu_ps(p, v); }
+  static Reg Set1(float v) { return _mm256_set1_ps(v); }
+  static Reg Add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif  // __FMA__
+  }
+  static Reg Max(Reg a, Reg b) { return _mm256_max_ps(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm256_min_ps(a, b); }
+  static Reg Sqrt(Reg a) { return _mm256_sqrt_ps(a); }
+  static Reg Abs(Reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+  static Reg Neg(Reg a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.f)); }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm256_setzero_ps();
+    const Reg one = _mm256_set1_ps(1.f);
+    Reg pos = _mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_GT_OQ), one);
+    Reg neg = _mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_LT_OQ), one);
+    return _mm256_sub_ps(pos, neg);
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static Mask Gt(Reg a, Reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static Mask IsNan(Reg a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+  static Reg Select(Mask m, Reg a, Reg b) { return _mm256_blendv_ps(b, a, m); }
+  static Mask LaneMask(uint32_t bits) {
+    const __m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i v = _mm256_and_si256(
+        _mm256_set1_epi32(static_cast<int>(bits)), lane);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, lane));
+  }
+
+  static Bits AsBits(Reg a) { return _mm256_castps_si256(a); }
+  static Bits LoadBits(const void *p) {
+    return _mm256_loadu_si256(static_cast<const __m256i *>(p));
+  }
+  static Reg FromBits(Bits b) { return _mm256_castsi256_ps(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm256_set1_epi32(static_cast<int>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm256_add_epi32(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm256_sub_epi32(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm256_and_si256(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm256_or_si256(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm256_slli_epi32(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm256_srli_epi32(a, n); }
+};
+
+template <>
+struct Vec<double, 32> {
+  typedef double Scalar;
+  typedef __m256d Reg;
+  typedef __m256d Mask;
+  typedef __m256i Bits;
+  static constexpr int kLanes = 4;
+
+  static Reg Load(const double *p) { return _mm256_loadu_pd(p); }
+  static void Store(double *p, Reg v) { _mm256_storeu_pd(p, v); }
+  static Reg Set1(double v) { return _mm256_set1_pd(v); }
+  static Reg Add(Reg a, Reg b) { return _mm256_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm256_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm256_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm256_div_pd(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(a, b, c);
+#else
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif  // __FMA__
+  }
+  static Reg Max(Reg a, Reg b) { return _mm256_max_pd(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm256_min_pd(a, b); }
+  static Reg Sqrt(Reg a) { return _mm256_sqrt_pd(a); }
+  static Reg Abs(Reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.), a); }
+  static Reg Neg(Reg a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.)); }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm256_setzero_pd();
+    const Reg one = _mm256_set1_pd(1.);
+    Reg pos = _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_GT_OQ), one);
+    Reg neg = _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_LT_OQ), one);
+    return _mm256_sub_pd(pos, neg);
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static Mask Gt(Reg a, Reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static Mask IsNan(Reg a) { return _mm256_cmp_pd(a, a, _CMP_UNORD_Q); }
+  static Reg Select(Mask m, Reg a, Reg b) { return _mm256_blendv_pd(b, a, m); }
+  static Mask LaneMask(uint32_t bits) {
+    const __m256i lane = _mm256_setr_epi64x(1, 2, 4, 8);
+    const __m256i v = _mm256_and_si256(
+        _mm256_set1_epi64x(static_cast<int64_t>(bits)), lane);
+    return _mm256_castsi256_pd(_mm256_cmpeq_epi64(v, lane));
+  }
+
+  static Bits AsBits(Reg a) { return _mm256_castpd_si256(a); }
+  static Bits LoadBits(const void *p) {
+    return _mm256_loadu_si256(static_cast<const __m256i *>(p));
+  }
+  static Reg FromBits(Bits b) { return _mm256_castsi256_pd(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm256_set1_epi64x(static_cast<long long>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm256_add_epi64(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm256_sub_epi64(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm256_and_si256(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm256_or_si256(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm256_slli_epi64(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm256_srli_epi64(a, n); }
+};
+
+#elif defined(__SSE2__)
+
+template <>
+struct Vec<float, 16> {
+  typedef float Scalar;
+  typedef __m128 Reg;
+  typedef __m128 Mask;
+  typedef __m128i Bits;
+  static constexpr int kLanes = 4;
+
+  static Reg Load(const float *p) { return _mm_loadu_ps(p); }
+  static void Store(float *p, Reg v) { _mm_storeu_ps(p, v); }
+  static Reg Set1(float v) { return _mm_set1_ps(v); }
+  static Reg Add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm_div_ps(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) {
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif  // __FMA__
+  }
+  static Reg Max(Reg a, Reg b) { return _mm_max_ps(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm_min_ps(a, b); }
+  static Reg Sqrt(Reg a) { return _mm_sqrt_ps(a); }
+  static Reg Abs(Reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+  static Reg Neg(Reg a) { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm_setzero_ps();
+    const Reg one = _mm_set1_ps(1.f);
+    Reg pos = _mm_and_ps(_mm_cmpgt_ps(a, zero), one);
+    Reg neg = _mm_and_ps(_mm_cmplt_ps(a, zero), one);
+    return _mm_sub_ps(pos, neg);
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm_cmplt_ps(a, b); }
+  static Mask Gt(Reg a, Reg b) { return _mm_cmpgt_ps(a, b); }
+  static Mask IsNan(Reg a) { return _mm_cmpunord_ps(a, a); }
+  static Reg Select(Mask m, Reg a, Reg b) {
+#if defined(__SSE4_1__)
+    return _mm_blendv_ps(b, a, m);
+#else
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+#endif  // __SSE4_1__
+  }
+  static Mask LaneMask(uint32_t bits) {
+    const __m128i lane = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128i v =
+        _mm_and_si128(_mm_set1_epi32(static_cast<int>(bits)), lane);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(v, lane));
+  }
+
+  static Bits AsBits(Reg a) { return _mm_castps_si128(a); }
+  static Bits LoadBits(const void *p) {
+    return _mm_loadu_si128(static_cast<const __m128i *>(p));
+  }
+  static Reg FromBits(Bits b) { return _mm_castsi128_ps(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm_set1_epi32(static_cast<int>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm_add_epi32(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm_sub_epi32(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm_and_si128(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm_or_si128(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm_slli_epi32(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm_srli_epi32(a, n); }
+};
+
+template <>
+struct Vec<double, 16> {
+  typedef double Scalar;
+  typedef __m128d Reg;
+  typedef __m128d Mask;
+  typedef __m128i Bits;
+  static constexpr int kLanes = 2;
+
+  static Reg Load(const double *p) { return _mm_loadu_pd(p); }
+  static void Store(double *p, Reg v) { _mm_storeu_pd(p, v); }
+  static Reg Set1(double v) { return _mm_set1_pd(v); }
+  static Reg Add(Reg a, Reg b) { return _mm_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b) { return _mm_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b) { return _mm_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b) { return _mm_div_pd(a, b); }
+  static Reg MulAdd(Reg a, Reg b, Reg c) {
+#if defined(__FMA__)
+    return _mm_fmadd_pd(a, b, c);
+#else
+    return _mm_add_pd(_mm_mul_pd(a, b), c);
+#endif  // __FMA__
+  }
+  static Reg Max(Reg a, Reg b) { return _mm_max_pd(a, b); }
+  static Reg Min(Reg a, Reg b) { return _mm_min_pd(a, b); }
+  static Reg Sqrt(Reg a) { return _mm_sqrt_pd(a); }
+  static Reg Abs(Reg a) { return _mm_andnot_pd(_mm_set1_pd(-0.), a); }
+  static Reg Neg(Reg a) { return _mm_xor_pd(a, _mm_set1_pd(-0.)); }
+  static Reg Sign(Reg a) {
+    const Reg zero = _mm_setzero_pd();
+    const Reg one = _mm_set1_pd(1.);
+    Reg pos = _mm_and_pd(_mm_cmpgt_pd(a, zero), one);
+    Reg neg = _mm_and_pd(_mm_cmplt_pd(a, zero), one);
+    return _mm_sub_pd(pos, neg);
+  }
+
+  static Mask Lt(Reg a, Reg b) { return _mm_cmplt_pd(a, b); }
+  static Mask Gt(Reg a, Reg b) { return _mm_cmpgt_pd(a, b); }
+  static Mask IsNan(Reg a) { return _mm_cmpunord_pd(a, a); }
+  static Reg Select(Mask m, Reg a, Reg b) {
+#if defined(__SSE4_1__)
+    return _mm_blendv_pd(b, a, m);
+#else
+    return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+#endif  // __SSE4_1__
+  }
+  // Both halves of a lane hold its bit, so 32-bit compares fill the lane.
+  static Mask LaneMask(uint32_t bits) {
+    const __m128i lane = _mm_setr_epi32(1, 1, 2, 2);
+    const __m128i v =
+        _mm_and_si128(_mm_set1_epi32(static_cast<int>(bits)), lane);
+    return _mm_castsi128_pd(_mm_cmpeq_epi32(v, lane));
+  }
+
+  static Bits AsBits(Reg a) { return _mm_castpd_si128(a); }
+  static Bits LoadBits(const void *p) {
+    return _mm_loadu_si128(static_cast<const __m128i *>(p));
+  }
+  static Reg FromBits(Bits b) { return _mm_castsi128_pd(b); }
+  static Bits SetBits(uint64_t v) {
+    return _mm_set1_epi64x(static_cast<long long>(v));
+  }
+  static Bits BitsAdd(Bits a, Bits b) { return _mm_add_epi64(a, b); }
+  static Bits BitsSub(Bits a, Bits b) { return _mm_sub_epi64(a, b); }
+  static Bits BitsAnd(Bits a, Bits b) { return _mm_and_si128(a, b); }
+  static Bits BitsOr(Bits a, Bits b) { return _mm_or_si128(a, b); }
+  static Bits BitsShl(Bits a, int n) { return _mm_slli_epi64(a, n); }
+  static Bits BitsShr(Bits a, int n) { return _mm_srli_epi64(a, n); }
+};
+
+#endif  // __AVX512F__
+
+}  // namespace CHIME_CPU_CAPABILITY
+}  // namespace simd
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_SIMD_H_
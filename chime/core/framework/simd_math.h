@@ -0,0 +1,373 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_SIMD_MATH_H_
+#define CHIME_CORE_FRAMEWORK_SIMD_MATH_H_
+
+#include <limits>
+
+#include "chime/core/framework/simd.h"
+
+namespace chime {
+namespace simd {
+inline namespace CHIME_CPU_CAPABILITY {
+
+/// Vectorized transcendental functions on `Vec<float>` and `Vec<double>`.
+///
+/// Every function is branch free: special inputs (NaN, infinities, zeros,
+/// subnormals) are fixed up with `Select` so that a register mixing ordinary
+/// and special lanes is handled in one pass. Accuracy is measured against
+/// the C library in math_functions_test.cc and documented next to the
+/// matching `chime_cpu_*` routine in math_functions.hpp.
+
+/// Evaluates `c0 + c1 * x + c2 * x^2 + ...` with Horner's scheme.
+template <typename V>
+inline typename V::Reg Horner(typename V::Reg, double c0) {
+  return V::Set1(static_cast<typename V::Scalar>(c0));
+}
+
+template <typename V, typename... Rest>
+inline typename V::Reg Horner(typename V::Reg x, double c0, Rest... rest) {
+  return V::MulAdd(Horner<V>(x, rest...), x,
+                   V::Set1(static_cast<typename V::Scalar>(c0)));
+}
+
+/// Bit-level constants and the polynomials that depend on the precision.
+template <typename T>
+struct MathTraits;
+
+template <>
+struct MathTraits<float> {
+  static constexpr int kMantissaBits = 23;
+  static constexpr uint64_t kExponentBias = 127;
+  static constexpr uint64_t kMantissaMask = 0x007fffffu;
+  static constexpr uint64_t kOneBits = 0x3f800000u;
+  static constexpr uint64_t kSqrtHalfBits = 0x3f3504f3u;
+  // Adding 1.5 * 2^23 rounds a float of magnitude < 2^22 to an integer.
+  static constexpr float kRoundMagic = 12582912.f;
+  static constexpr float kTwoPowMantissa = 8388608.f;
+  static constexpr float kMinNormal = 1.17549435e-38f;
+  // exp(x) is +inf above and 0 below; the bounds leave room for the
+  // two-step scaling by 2^n in `Exp`.
+  static constexpr float kExpMax = 89.f;
+  static constexpr float kExpMin = -110.f;
+  // ln(2) split so that n * kLn2Hi is exact for the n `Exp` produces.
+  static constexpr float kLn2Hi = 0.693359375f;
+  static constexpr float kLn2Lo = -2.12194440e-4f;
+  static constexpr float kLog2e = 1.44269504088896341f;
+  static constexpr float kLogLn2Hi = 6.9313812256e-01f;
+  static constexpr float kLogLn2Lo = 9.0580006145e-06f;
+  // erfc(x) underflows to zero beyond this.
+  static constexpr float kErfcMaxArg = 11.f;
+
+  // (e^r - 1 - r) / r^2 on |r| <= ln(2) / 2, Cephes expf.
+  template <typename V>
+  static typename V::Reg ExpPoly(typename V::Reg r) {
+    return Horner<V>(r, 5.0000001201E-1, 1.6666665459E-1, 4.1665795894E-2,
+                     8.3334519073E-3, 1.3981999507E-3, 1.9875691500E-4);
+  }
+
+  // (log((1 + s) / (1 - s)) - 2s) / s^3 as a polynomial in z = s^2, from
+  // the FreeBSD logf.
+  template <typename V>
+  static typename V::Reg LogPoly(typename V::Reg z) {
+    return Horner<V>(z, 0.66666662693, 0.40000972152, 0.28498786688,
+                     0.24279078841);
+  }
+
+  // (tanh(x) - x) / x^3 as a polynomial in z = x^2 on |x| < 0.625,
+  // Chebyshev fit.
+  template <typename V>
+  static typename V::Reg TanhPoly(typename V::Reg z) {
+    return Horner<V>(z, -0.33333328944134254565, 0.13332769736976327858,
+                     -0.053850909578513580828, 0.020997178999074750572,
+                     -0.0060967141659081975745);
+  }
+};
+
+template <>
+struct MathTraits<double> {
+  static constexpr int kMantissaBits = 52;
+  static constexpr uint64_t kExponentBias = 1023;
+  static constexpr uint64_t kMantissaMask = 0x000fffffffffffffull;
+  static constexpr uint64_t kOneBits = 0x3ff0000000000000ull;
+  static constexpr uint64_t kSqrtHalfBits = 0x3fe6a09e00000000ull;
+  static constexpr double kRoundMagic = 6755399441055744.;
+  static constexpr double kTwoPowMantissa = 4503599627370496.;
+  static constexpr double kMinNormal = 2.2250738585072014e-308;
+  static constexpr double kExpMax = 710.;
+  static constexpr double kExpMin = -750.;
+  static constexpr double kLn2Hi = 6.93145751953125E-1;
+  static constexpr double kLn2Lo = 1.42860682030941723212E-6;
+  static constexpr double kLog2e = 1.44269504088896341;
+  static constexpr double kLogLn2Hi = 6.93147180369123816490e-01;
+  static constexpr double kLogLn2Lo = 1.90821492927058770002e-10;
+  static constexpr double kErfcMaxArg = 28.;
+
+  // Taylor series, the truncation error is below 2^-60 on |r| <= ln(2) / 2.
+  template <typename V>
+  static typename V::Reg ExpPoly(typename V::Reg r) {
+    return Horner<V>(r, 1. / 2, 1. / 6, 1. / 24, 1. / 120, 1. / 720,
+                     1. / 5040, 1. / 40320, 1. / 362880, 1. / 3628800,
+                     1. / 39916800, 1. / 479001600, 1. / 6227020800.);
+  }
+
+  // FreeBSD log.
+  template <typename V>
+  static typename V::Reg LogPoly(typename V::Reg z) {
+    return Horner<V>(z, 6.666666666666735130e-01, 3.999999999940941908e-01,
+                     2.857142874366239149e-01, 2.222219843214978396e-01,
+                     1.818357216161805012e-01, 1.531383769920937332e-01,
+                     1.479819860511658591e-01);
+  }
+
+  template <typename V>
+  static typename V::Reg TanhPoly(typename V::Reg z) {
+    return Horner<V>(z, -0.33333333333333322565, 0.13333333333326657736,
+                     -0.053968253961395570821, 0.021869488260559114645,
+                     -0.0088632298309257087457, 0.0035920589774734553151,
+                     -0.001455309297534642025, 0.00058743728600943818973,
+                     -0.000230776162695198579, 0.000079599557352648080002,
+                     -0.000017244874494844330172);
+  }
+};
+
+/// 2^k for integral `k` within the normal exponent range.
+template <typename V>
+inline typename V::Reg Pow2(typename V::Reg k) {
+  typedef MathTraits<typename V::Scalar> C;
+  const typename V::Scalar bias =
+      C::kRoundMagic + static_cast<typename V::Scalar>(C::kExponentBias);
+  // The low mantissa bits of `k + 1.5 * 2^m + bias` hold `k + bias`.
+  typename V::Bits b = V::AsBits(V::Add(k, V::Set1(bias)));
+  return V::FromBits(V::BitsShl(b, C::kMantissaBits));
+}
+
+/// hi + lo == a * a exactly.
+template <typename V>
+inline void TwoSquare(typename V::Reg a, typename V::Reg *hi,
+                      typename V::Reg *lo) {
+  *hi = V::Mul(a, a);
+#if defined(__FMA__)
+  *lo = V::MulAdd(a, a, V::Neg(*hi));
+#else
+  // Dekker's product. Without FMA hardware the compiler cannot contract the
+  // operations below, so every rounding happens where it is written.
+  typedef typename V::Scalar T;
+  const T splitter = static_cast<T>(
+      (uint64_t(1) << ((MathTraits<T>::kMantissaBits + 2) / 2)) + 1);
+  typename V::Reg c = V::Mul(a, V::Set1(splitter));
+  typename V::Reg ah = V::Sub(c, V::Sub(c, a));
+  typename V::Reg al = V::Sub(a, ah);
+  typename V::Reg t = V::Sub(V::Mul(ah, ah), *hi);
+  t = V::Add(t, V::Mul(V::Add(ah, ah), al));
+  *lo = V::Add(t, V::Mul(al, al));
+#endif  // __FMA__
+}
+
+template <typename V>
+inline typename V::Reg Exp(typename V::Reg x) {
+  typedef MathTraits<typename V::Scalar> C;
+  typedef typename V::Reg Reg;
+  const Reg magic = V::Set1(C::kRoundMagic);
+  Reg xc = V::Min(V::Max(x, V::Set1(C::kExpMin)), V::Set1(C::kExpMax));
+
+  // x = n * ln(2) + r with |r| <= ln(2) / 2.
+  Reg n = V::Sub(V::MulAdd(xc, V::Set1(C::kLog2e), magic), magic);
+  Reg r = V::MulAdd(n, V::Set1(-C::kLn2Hi), xc);
+  r = V::MulAdd(n, V::Set1(-C::kLn2Lo), r);
+
+  Reg p = V::Add(V::MulAdd(V::Mul(r, r), C::template ExpPoly<V>(r), r),
+                 V::Set1(1));
+
+  // Scale by 2^n in two steps so that overflow saturates to +inf and the
+  // subnormal range is reached without underflowing an intermediate.
+  Reg n1 = V::Sub(V::MulAdd(n, V::Set1(0.5), magic), magic);
+  Reg n2 = V::Sub(n, n1);
+  Reg y = V::Mul(V::Mul(p, Pow2<V>(n1)), Pow2<V>(n2));
+  return V::Select(V::IsNan(x), x, y);
+}
+
+template <typename V>
+inline typename V::Reg Log(typename V::Reg x) {
+  typedef typename V::Scalar T;
+  typedef MathTraits<T> C;
+  typedef typename V::Reg Reg;
+  typedef typename V::Bits Bits;
+  const Reg one = V::Set1(1);
+
+  // Scale subnormals into the normal range first.
+  typename V::Mask tiny = V::Lt(x, V::Set1(C::kMinNormal));
+  Reg xs = V::Select(tiny, V::Mul(x, V::Set1(C::kTwoPowMantissa)), x);
+  Reg e = V::Select(tiny, V::Set1(-C::kMantissaBits), V::Set1(0));
+
+  // x = 2^k * m with m in [sqrt(1/2), sqrt(2)). Adding `1 - sqrt(1/2)` to the
+  // bit pattern carries into the exponent exactly when m >= sqrt(2).
+  Bits u = V::BitsAdd(V::AsBits(xs),
+                      V::SetBits(C::kOneBits - C::kSqrtHalfBits));
+  Bits k = V::BitsShr(u, C::kMantissaBits);
+  // The biased exponent converted to floating point by planting it in the
+  // mantissa of 2^kMantissaBits.
+  Reg kf = V::FromBits(V::BitsOr(k, V::AsBits(V::Set1(C::kTwoPowMantissa))));
+  e = V::Add(e, V::Sub(kf, V::Set1(C::kTwoPowMantissa +
+                                   static_cast<T>(C::kExponentBias))));
+  Reg m = V::FromBits(V::BitsAdd(V::BitsAnd(u, V::SetBits(C::kMantissaMask)),
+                                 V::SetBits(C::kSqrtHalfBits)));
+
+  // log(m) = log((1 + s) / (1 - s)) with s = f / (2 + f) and f = m - 1.
+  Reg f = V::Sub(m, one);
+  Reg s = V::Div(f, V::Add(f, V::Set1(2)));
+  Reg z = V::Mul(s, s);
+  Reg r = V::Mul(z, C::template LogPoly<V>(z));
+  Reg hfsq = V::Mul(V::Set1(0.5), V::Mul(f, f));
+  Reg y = V::MulAdd(s, V::Add(hfsq, r), V::Mul(e, V::Set1(C::kLogLn2Lo)));
+  y = V::Add(V::Sub(y, hfsq), f);
+  y = V::MulAdd(e, V::Set1(C::kLogLn2Hi), y);
+
+  y = V::Select(V::Gt(x, V::Set1(0)), y,
+                V::Set1(-std::numeric_limits<T>::infinity()));
+  y = V::Select(V::Lt(x, V::Set1(0)),
+                V::Set1(std::numeric_limits<T>::quiet_NaN()), y);
+  y = V::Select(V::Gt(x, V::Set1(std::numeric_limits<T>::max())), x, y);
+  return V::Select(V::IsNan(x), x, y);
+}
+
+template <typename V>
+inline typename V::Reg Tanh(typename V::Reg x) {
+  typedef MathTraits<typename V::Scalar> C;
+  typedef typename V::Reg Reg;
+  const Reg one = V::Set1(1);
+  Reg ax = V::Abs(x);
+
+  Reg z = V::Mul(x, x);
+  Reg small = V::MulAdd(V::Mul(x, z), C::template TanhPoly<V>(z), x);
+
+  // tanh(|x|) = (1 - e^-2|x|) / (1 + e^-2|x|), exact in the limit.
+  Reg e = Exp<V>(V::Mul(ax, V::Set1(-2)));
+  Reg large = V::Div(V::Sub(one, e), V::Add(one, e));
+  large = V::Select(V::Lt(x, V::Set1(0)), V::Neg(large), large);
+  return V::Select(V::Lt(ax, V::Set1(0.625)), small, large);
+}
+
+template <typename V>
+inline typename V::Reg Sigmoid(typename V::Reg x) {
+  typedef typename V::Reg Reg;
+  const Reg one = V::Set1(1);
+  // e^x / (1 + e^x) for negative x keeps the result accurate down to the
+  // subnormal range.
+  Reg e = Exp<V>(V::Neg(V::Abs(x)));
+  Reg num = V::Select(V::Lt(x, V::Set1(0)), e, one);
+  return V::Div(num, V::Add(one, e));
+}
+
+/// erf(x) for |x| < 0.5. Rational approximations of erf/erfc below are W. J.
+/// Cody's (Math. Comp. 23, 1969), accurate to double precision.
+template <typename V>
+inline typename V::Reg ErfSmall(typename V::Reg x) {
+  typename V::Reg z = V::Mul(x, x);
+  typename V::Reg num = Horner<V>(
+      z, 3.20937758913846947e03, 3.77485237685302021e02,
+      1.13864154151050156e02, 3.16112374387056560e00, 1.85777706184603153e-1);
+  typename V::Reg den = Horner<V>(
+      z, 2.84423683343917062e03, 1.28261652607737228e03,
+      2.44024637934444173e02, 2.36012909523441209e01, 1.);
+  return V::Mul(x, V::Div(num, den));
+}
+
+/// erfc(y) for y >= 0.5, given y^2 = sq_hi + sq_lo split exactly. Passing the
+/// square in is what keeps the result accurate for large y, where a rounding
+/// error in y^2 is magnified by the exponential.
+template <typename V>
+inline typename V::Reg ErfcLarge(typename V::Reg y, typename V::Reg sq_hi,
+                                 typename V::Reg sq_lo) {
+  typedef typename V::Reg Reg;
+  const Reg one = V::Set1(1);
+  // exp(-hi - lo) = exp(-hi) * (1 - lo) as |lo| is below half an ulp of hi.
+  Reg e = V::Mul(Exp<V>(V::Neg(sq_hi)), V::Sub(one, sq_lo));
+
+  // 0.5 <= y < 4.
+  Reg mid = V::Div(
+      Horner<V>(y, 1.23033935479799725e03, 2.05107837782607147e03,
+                1.71204761263407058e03, 8.81952221241769090e02,
+                2.98635138197400131e02, 6.61191906371416295e01,
+                8.88314979438837594e00, 5.64188496988670089e-1,
+                2.15311535474403846e-8),
+      Horner<V>(y, 1.23033935480374942e03, 3.43936767414372164e03,
+                4.36261909014324716e03, 3.29079923573345963e03,
+                1.62138957456669019e03, 5.37181101862009858e02,
+                1.17693950891312499e02, 1.57449261107098347e01, 1.));
+
+  // y >= 4, asymptotic in z = 1 / y^2.
+  Reg z = V::Div(one, sq_hi);
+  Reg r = V::Div(
+      Horner<V>(z, 6.58749161529837803e-4, 1.60837851487422766e-2,
+                1.25781726111229246e-1, 3.60344899949804439e-1,
+                3.05326634961232344e-1, 1.63153871373020978e-2),
+      Horner<V>(z, 2.33520497626869185e-3, 6.05183413124413191e-2,
+                5.27905102951428412e-1, 1.87295284992346725e00,
+                2.56852019228982242e00, 1.));
+  Reg tail = V::Div(V::Sub(V::Set1(0.56418958354775628695), V::Mul(z, r)), y);
+
+  return V::Mul(e, V::Select(V::Lt(y, V::Set1(4)), mid, tail));
+}
+
+template <typename V>
+inline typename V::Reg Erf(typename V::Reg x) {
+  typedef MathTraits<typename V::Scalar> C;
+  typedef typename V::Reg Reg;
+  Reg ax = V::Min(V::Abs(x), V::Set1(C::kErfcMaxArg));
+  Reg sq_hi, sq_lo;
+  TwoSquare<V>(ax, &sq_hi, &sq_lo);
+
+  Reg large = V::Sub(V::Set1(1), ErfcLarge<V>(ax, sq_hi, sq_lo));
+  large = V::Select(V::Lt(x, V::Set1(0)), V::Neg(large), large);
+  Reg y = V::Select(V::Lt(ax, V::Set1(0.5)), ErfSmall<V>(x), large);
+  return V::Select(V::IsNan(x), x, y);
+}
+
+/// gelu(x) = x * Phi(x) = x / 2 * erfc(-x / sqrt(2)). Going through erfc
+/// rather than 1 + erf keeps the relative error small for negative x.
+template <typename V>
+inline typename V::Reg Gelu(typename V::Reg x) {
+  typedef typename V::Scalar T;
+  typedef MathTraits<T> C;
+  typedef typename V::Reg Reg;
+  const Reg one = V::Set1(1);
+  const Reg half = V::Set1(0.5);
+  const T limit = C::kErfcMaxArg * static_cast<T>(1.41421356237309504880);
+
+  Reg u = V::Mul(x, V::Set1(-0.70710678118654752440));
+  Reg xc = V::Min(V::Abs(x), V::Set1(limit));
+  Reg au = V::Mul(xc, V::Set1(0.70710678118654752440));
+  // u^2 = x^2 / 2, halving keeps the split exact.
+  Reg sq_hi, sq_lo;
+  TwoSquare<V>(xc, &sq_hi, &sq_lo);
+  sq_hi = V::Mul(sq_hi, half);
+  sq_lo = V::Mul(sq_lo, half);
+
+  Reg large = ErfcLarge<V>(au, sq_hi, sq_lo);
+  large = V::Select(V::Lt(u, V::Set1(0)), V::Sub(V::Set1(2), large), large);
+  Reg erfc_u = V::Select(V::Lt(au, half), V::Sub(one, ErfSmall<V>(u)), large);
+
+  Reg y = V::Mul(V::Mul(x, half), erfc_u);
+  // erfc(-x / sqrt(2)) is exactly zero here, and -inf * 0 would be NaN.
+  return V::Select(V::Lt(x, V::Set1(-limit)), V::Set1(T(-0.)), y);
+}
+
+/// softplus(x) = log(1 + e^x) = max(x, 0) + log1p(e^-|x|).
+template <typename V>
+inline typename V::Reg Softplus(typename V::Reg x) {
+  typedef typename V::Reg Reg;
+  const Reg one = V::Set1(1);
+  Reg u = Exp<V>(V::Neg(V::Abs(x)));
+  Reg w = V::Add(one, u);
+  // log1p(u) = log(w) - ((w - 1) - u) / w corrects the rounding of 1 + u.
+  Reg l = V::Sub(Log<V>(w), V::Div(V::Sub(V::Sub(w, one), u), w));
+  return V::Add(V::Max(x, V::Set1(0)), l);
+}
+
+}  // namespace CHIME_CPU_CAPABILITY
+}  // namespace simd
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_SIMD_MATH_H_
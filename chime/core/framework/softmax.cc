@@ -0,0 +1,142 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/softmax.h"
+
+#include <algorithm>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+
+namespace {
+
+// Columns of the slices handed to a thread at once when the axis is not the
+// last one.
+constexpr utens_t kColumnShard = 256;
+
+// x seen as [outer, n, inner] around the axis.
+struct AxisView {
+  AxisView(const std::vector<utens_t> &dims, int axis)
+      : outer(1), n(1), inner(1) {
+    const int num_dims = static_cast<int>(dims.size());
+    CHECK(axis >= -num_dims && axis < num_dims)
+        << "Axis " << axis << " out of range for " << num_dims
+        << " dimensions";
+    const int a = axis < 0 ? axis + num_dims : axis;
+    for (int d = 0; d < num_dims; d++) {
+      if (d < a) {
+        outer *= dims[d];
+      } else if (d == a) {
+        n = dims[d];
+      } else {
+        inner *= dims[d];
+      }
+    }
+  }
+
+  utens_t outer;
+  utens_t n;
+  utens_t inner;
+};
+
+template<typename Dtype>
+void Softmax(const std::vector<utens_t> &dims, int axis, bool log,
+             const Dtype *x, Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  const AxisView v(dims, axis);
+  if (v.outer == 0 || v.n == 0 || v.inner == 0) return;
+  const kernels::SoftmaxKernels<Dtype> &k =
+      kernels::GetSoftmaxKernels<Dtype>();
+  if (v.inner == 1) {
+    const auto row = log ? k.log_softmax : k.softmax;
+    const int64_t grain = std::max<int64_t>(
+        1, kIntraOpComputeGrainSize / static_cast<int64_t>(v.n));
+    ParallelFor(static_cast<int64_t>(v.outer), grain,
+                [&](int64_t first, int64_t last) {
+                  for (int64_t u = first; u < last; u++) {
+                    row(v.n, x + u * v.n, y + u * v.n);
+                  }
+                });
+    return;
+  }
+  const auto col = log ? k.log_softmax_col : k.softmax_col;
+  const utens_t shards = (v.inner + kColumnShard - 1) / kColumnShard;
+  const int64_t grain = std::max<int64_t>(
+      1, kIntraOpComputeGrainSize /
+             static_cast<int64_t>(v.n * std::min(kColumnShard, v.inner)));
+  ParallelFor(static_cast<int64_t>(v.outer * shards), grain,
+              [&](int64_t first, int64_t last) {
+                for (int64_t item = first; item < last; item++) {
+                  const utens_t column = item % shards * kColumnShard;
+                  const utens_t offset = item / shards * v.n * v.inner + column;
+                  col(v.n, std::min(kColumnShard, v.inner - column), v.inner,
+                      x + offset, y + offset);
+                }
+              });
+}
+
+}  // namespace
+
+template<typename Dtype>
+void chime_cpu_softmax(const std::vector<utens_t> &dims, int axis,
+                       const Dtype *x, Dtype *y) {
+  Softmax(dims, axis, false, x, y);
+}
+
+template<typename Dtype>
+void chime_cpu_log_softmax(const std::vector<utens_t> &dims, int axis,
+                           const Dtype *x, Dtype *y) {
+  Softmax(dims, axis, true, x, y);
+}
+
+template<typename Dtype>
+void chime_cpu_softmax_cross_entropy(utens_t batch, utens_t classes,
+                                     const Dtype *logits, const int64 *labels,
+                                     Dtype label_smoothing, int64 ignore_index,
+                                     Dtype *loss, Dtype *dlogits) {
+  DCHECK(logits);
+  DCHECK(labels);
+  DCHECK(loss);
+  CHECK(label_smoothing >= 0 && label_smoothing <= 1)
+      << "Label smoothing " << label_smoothing << " out of [0, 1]";
+  if (batch == 0) return;
+  CHECK_GT(classes, 0u) << "cross-entropy over no class";
+  const typename kernels::SoftmaxKernels<Dtype>::CrossEntropyFn cross_entropy =
+      kernels::GetSoftmaxKernels<Dtype>().cross_entropy;
+  const int64_t grain = std::max<int64_t>(
+      1, kIntraOpComputeGrainSize / static_cast<int64_t>(classes));
+  ParallelFor(
+      static_cast<int64_t>(batch), grain, [&](int64_t first, int64_t last) {
+        for (int64_t b = first; b < last; b++) {
+          Dtype *dx = dlogits ? dlogits + b * classes : nullptr;
+          if (labels[b] == ignore_index) {
+            loss[b] = 0;
+            if (dx) std::fill(dx, dx + classes, Dtype(0));
+            continue;
+          }
+          CHECK(labels[b] >= 0 && static_cast<utens_t>(labels[b]) < classes)
+              << "Label " << labels[b] << " of row " << b
+              << " out of range for " << classes << " classes";
+          loss[b] = cross_entropy(classes, logits + b * classes,
+                                  static_cast<utens_t>(labels[b]),
+                                  label_smoothing, dx);
+        }
+      });
+}
+
+#define INSTANTIATE_SOFTMAX(Dtype)                                         \
+  template void chime_cpu_softmax<Dtype>(const std::vector<utens_t> &,     \
+                                         int, const Dtype *, Dtype *);     \
+  template void chime_cpu_log_softmax<Dtype>(const std::vector<utens_t> &, \
+                                             int, const Dtype *, Dtype *); \
+  template void chime_cpu_softmax_cross_entropy<Dtype>(                    \
+      utens_t, utens_t, const Dtype *, const int64 *, Dtype, int64,        \
+      Dtype *, Dtype *)
+
+INSTANTIATE_SOFTMAX(float32);
+INSTANTIATE_SOFTMAX(float64);
+
+}  // namespace chime
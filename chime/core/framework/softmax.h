@@ -0,0 +1,55 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_SOFTMAX_H_
+#define CHIME_CORE_FRAMEWORK_SOFTMAX_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Softmax and log-softmax along one axis of a row-major array of dimensions
+/// `dims`, counted from the end when negative. Every slice along the axis is
+/// normalized in two passes over x: the first finds its maximum and the sum
+/// of exp(x - maximum) at once, rescaling the sum whenever the maximum grows,
+/// the second writes y, so no element is exponentiated with a positive
+/// argument and nothing but y is written. y may alias x.
+///
+/// Slices are split over the intra-op threads, contiguous ones when the axis
+/// is the last one and tiles of neighbouring slices otherwise, which are
+/// normalized together with one slice per SIMD lane.
+///
+/// Only float32 and float64 are supported. A slice of -inf only gives NaN, as
+/// does +inf or NaN anywhere in it.
+template<typename Dtype>
+void chime_cpu_softmax(const std::vector<utens_t> &dims, int axis,
+                       const Dtype *x, Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_log_softmax(const std::vector<utens_t> &dims, int axis,
+                           const Dtype *x, Dtype *y);
+
+/// Softmax cross-entropy of `batch` rows of `classes` logits against integer
+/// labels, fused with its gradient. loss[b] is the cross-entropy between
+/// softmax(logits[b]) and the target putting 1 - label_smoothing on
+/// labels[b] and label_smoothing / classes on every class, and dlogits[b],
+/// unless dlogits is null, is its gradient softmax(logits[b]) - target. No
+/// probability is stored: each row is read once for its maximum and sum, and
+/// once more to write the gradient. Rows labelled `ignore_index` get a loss
+/// and a gradient of 0. Rows are split over the intra-op threads.
+///
+/// The gradient is that of each loss[b]: scale it by the incoming gradient,
+/// e.g. by 1 / (number of rows not ignored) for a mean.
+/// REQUIRES: 0 <= label_smoothing <= 1, every label in [0, classes) or
+/// equal to `ignore_index`.
+template<typename Dtype>
+void chime_cpu_softmax_cross_entropy(utens_t batch, utens_t classes,
+                                     const Dtype *logits, const int64 *labels,
+                                     Dtype label_smoothing, int64 ignore_index,
+                                     Dtype *loss, Dtype *dlogits);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_SOFTMAX_H_
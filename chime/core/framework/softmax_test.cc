@@ -0,0 +1,245 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/softmax.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+// Log-softmax of every slice computed element by element, in long double.
+std::vector<long double> ReferenceLogSoftmax(const std::vector<utens_t> &dims,
+                                             int axis,
+                                             const std::vector<float64> &x) {
+  utens_t outer = 1, inner = 1;
+  for (int d = 0; d < axis; d++) outer *= dims[d];
+  for (size_t d = axis + 1; d < dims.size(); d++) inner *= dims[d];
+  const utens_t n = dims[axis];
+  std::vector<long double> y(x.size());
+  for (utens_t u = 0; u < outer; u++) {
+    for (utens_t c = 0; c < inner; c++) {
+      const utens_t base = u * n * inner + c;
+      long double max = -INFINITY, sum = 0;
+      for (utens_t j = 0; j < n; j++) {
+        max = std::max<long double>(max, x[base + j * inner]);
+      }
+      for (utens_t j = 0; j < n; j++) {
+        sum += std::exp(static_cast<long double>(x[base + j * inner]) - max);
+      }
+      for (utens_t j = 0; j < n; j++) {
+        y[base + j * inner] = x[base + j * inner] - max - std::log(sum);
+      }
+    }
+  }
+  return y;
+}
+
+}  // namespace
+
+// Every axis of a few shapes, with slices shorter and longer than a register
+// and tiles of columns, on values spread over [-20, 20).
+TEST(SoftmaxTest, TestAgainstReference) {
+  const std::vector<std::vector<utens_t>> shapes = {
+      {7}, {1, 100}, {3, 5, 4}, {2, 37, 300}, {1000, 3}, {4, 1, 129}};
+  for (const auto &dims : shapes) {
+    const utens_t total = NumElements(dims);
+    const std::vector<float64> x =
+        Pattern<float64>(total, 0, 1013, 40. / 1013, -20.);
+    const std::vector<float32> xf(x.begin(), x.end());
+    const int num_dims = static_cast<int>(dims.size());
+    for (int axis = 0; axis < num_dims; axis++) {
+      const std::vector<long double> ref = ReferenceLogSoftmax(dims, axis, x);
+      const std::vector<long double> ref_f = ReferenceLogSoftmax(
+          dims, axis, std::vector<float64>(xf.begin(), xf.end()));
+      const int arg = axis % 2 ? axis - num_dims : axis;
+      std::vector<float64> y(total), log_y(total);
+      std::vector<float32> yf(total), log_yf(total);
+      chime_cpu_softmax(dims, arg, x.data(), y.data());
+      chime_cpu_log_softmax(dims, arg, x.data(), log_y.data());
+      chime_cpu_softmax(dims, arg, xf.data(), yf.data());
+      chime_cpu_log_softmax(dims, arg, xf.data(), log_yf.data());
+      for (utens_t i = 0; i < total; i++) {
+        const long double p = std::exp(ref[i]);
+        const long double p_f = std::exp(ref_f[i]);
+        EXPECT_NEAR(y[i], p, 1e-13 * p) << axis << " " << i;
+        EXPECT_NEAR(log_y[i], ref[i], 1e-13) << axis << " " << i;
+        EXPECT_NEAR(yf[i], p_f, 1e-5 * p_f) << axis << " " << i;
+        EXPECT_NEAR(log_yf[i], ref_f[i], 2e-5) << axis << " " << i;
+      }
+    }
+  }
+}
+
+// Large inputs do not overflow, -inf drops out, and a slice of -inf only is
+// not a number.
+TEST(SoftmaxTest, TestSpecialValues) {
+  const float32 inf = std::numeric_limits<float32>::infinity();
+  std::vector<float32> x = {1000.f, 1000.f, 999.f, -inf, 88.f, -1000.f,
+                            -inf,   -inf,   -inf,  -inf, -inf, -inf};
+  std::vector<float32> y(x.size()), log_y(x.size());
+  chime_cpu_softmax<float32>({2, 6}, 1, x.data(), y.data());
+  chime_cpu_log_softmax<float32>({2, 6}, 1, x.data(), log_y.data());
+  const float32 e = std::exp(-1.f);
+  EXPECT_FLOAT_EQ(y[0], 1 / (2 + e));
+  EXPECT_FLOAT_EQ(y[2], e / (2 + e));
+  EXPECT_EQ(y[3], 0.f);
+  EXPECT_EQ(y[4], 0.f);
+  EXPECT_FLOAT_EQ(log_y[0], -std::log(2 + e));
+  EXPECT_EQ(log_y[3], -inf);
+  EXPECT_EQ(y[5], 0.f);
+  EXPECT_FLOAT_EQ(log_y[5], -2000.f - std::log(2 + e));
+  for (int i = 6; i < 12; i++) {
+    EXPECT_TRUE(std::isnan(y[i])) << i;
+    EXPECT_TRUE(std::isnan(log_y[i])) << i;
+  }
+
+  // The same along the first axis, where the slices are columns.
+  std::vector<float32> xt(12), yt(12);
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 6; j++) xt[j * 2 + i] = x[i * 6 + j];
+  }
+  chime_cpu_softmax<float32>({6, 2}, 0, xt.data(), yt.data());
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 6; j++) {
+      if (i == 0) {
+        EXPECT_EQ(yt[j * 2 + i], y[i * 6 + j]) << j;
+      } else {
+        EXPECT_TRUE(std::isnan(yt[j * 2 + i])) << j;
+      }
+    }
+  }
+}
+
+TEST(SoftmaxTest, TestInPlace) {
+  const std::vector<utens_t> dims = {5, 33, 9};
+  std::vector<float64> x =
+      Pattern<float64>(5 * 33 * 9, 0, 1013, 10. / 1013, -5.);
+  for (int axis : {1, 2}) {
+    std::vector<float64> y(x.size()), z = x;
+    chime_cpu_softmax(dims, axis, x.data(), y.data());
+    chime_cpu_softmax(dims, axis, z.data(), z.data());
+    EXPECT_EQ(z, y);
+    z = x;
+    chime_cpu_log_softmax(dims, axis, x.data(), y.data());
+    chime_cpu_log_softmax(dims, axis, z.data(), z.data());
+    EXPECT_EQ(z, y);
+  }
+}
+
+// Rows and tiles of columns are normalized the same way on any number of
+// threads.
+TEST(SoftmaxTest, TestIntraOpParallel) {
+  const std::vector<utens_t> dims = {64, 300, 70};
+  const std::vector<float64> x64 =
+      Pattern<float64>(64 * 300 * 70, 0, 1013, 30. / 1013, -15.);
+  const std::vector<float32> x(x64.begin(), x64.end());
+  for (int axis : {0, 1, 2}) {
+    std::vector<float32> ref(x.size()), y(x.size());
+    ScopedIntraOpNumThreads threads(1);
+    chime_cpu_softmax(dims, axis, x.data(), ref.data());
+    SetIntraOpNumThreads(4);
+    chime_cpu_softmax(dims, axis, x.data(), y.data());
+    EXPECT_EQ(y, ref) << axis;
+  }
+}
+
+TEST(SoftmaxTest, TestCrossEntropy) {
+  const utens_t batch = 6, classes = 37;
+  const std::vector<float64> x =
+      Pattern<float64>(batch * classes, 0, 1013, 50. / 1013, -25.);
+  const std::vector<float32> xf(x.begin(), x.end());
+  const std::vector<int64> labels = {0, 36, -100, 5, 17, 36};
+  const std::vector<long double> log_p =
+      ReferenceLogSoftmax({batch, classes}, 1, x);
+  const std::vector<long double> log_pf = ReferenceLogSoftmax(
+      {batch, classes}, 1, std::vector<float64>(xf.begin(), xf.end()));
+  for (float64 smoothing : {0., 0.1, 1.}) {
+    std::vector<float64> loss(batch), dx(batch * classes, -1.);
+    std::vector<float32> lossf(batch), dxf(batch * classes, -1.f);
+    std::vector<float64> forward_only(batch);
+    chime_cpu_softmax_cross_entropy(batch, classes, x.data(), labels.data(),
+                                    smoothing, int64(-100), loss.data(),
+                                    dx.data());
+    chime_cpu_softmax_cross_entropy(batch, classes, xf.data(), labels.data(),
+                                    static_cast<float32>(smoothing),
+                                    int64(-100), lossf.data(), dxf.data());
+    chime_cpu_softmax_cross_entropy(batch, classes, x.data(), labels.data(),
+                                    smoothing, int64(-100),
+                                    forward_only.data(),
+                                    static_cast<float64 *>(nullptr));
+    EXPECT_EQ(forward_only, loss);
+    for (utens_t b = 0; b < batch; b++) {
+      if (labels[b] == -100) {
+        EXPECT_EQ(loss[b], 0.);
+        EXPECT_EQ(lossf[b], 0.f);
+        for (utens_t j = 0; j < classes; j++) {
+          EXPECT_EQ(dx[b * classes + j], 0.);
+          EXPECT_EQ(dxf[b * classes + j], 0.f);
+        }
+        continue;
+      }
+      long double ref = 0, ref_f = 0;
+      for (utens_t j = 0; j < classes; j++) {
+        const long double target =
+            (j == static_cast<utens_t>(labels[b]) ? 1 - smoothing : 0) +
+            smoothing / classes;
+        const utens_t i = b * classes + j;
+        ref -= target * log_p[i];
+        ref_f -= target * log_pf[i];
+        EXPECT_NEAR(dx[i], std::exp(log_p[i]) - target, 1e-15)
+            << smoothing << " " << i;
+        EXPECT_NEAR(dxf[i], std::exp(log_pf[i]) - target, 1e-7)
+            << smoothing << " " << i;
+      }
+      EXPECT_NEAR(loss[b], ref, 1e-13 * (1 + ref)) << smoothing << " " << b;
+      EXPECT_NEAR(lossf[b], ref_f, 1e-6 * (1 + ref_f))
+          << smoothing << " " << b;
+    }
+  }
+
+  std::vector<float32> loss(batch);
+  std::vector<int64> bad = labels;
+  bad[3] = classes;
+  EXPECT_DEATH(chime_cpu_softmax_cross_entropy(
+                   batch, classes, xf.data(), bad.data(), 0.f, int64(-100),
+                   loss.data(), static_cast<float32 *>(nullptr)),
+               "out of range");
+}
+
+TEST(SoftmaxTest, TestCrossEntropyIntraOpParallel) {
+  const utens_t batch = 512, classes = 1000;
+  const std::vector<float64> x64 =
+      Pattern<float64>(batch * classes, 0, 1013, 30. / 1013, -15.);
+  const std::vector<float32> x(x64.begin(), x64.end());
+  std::vector<int64> labels(batch);
+  for (utens_t b = 0; b < batch; b++) labels[b] = (b * 389) % classes;
+  std::vector<float32> loss_ref(batch), dx_ref(x.size());
+  std::vector<float32> loss(batch), dx(x.size());
+  ScopedIntraOpNumThreads threads(1);
+  chime_cpu_softmax_cross_entropy(batch, classes, x.data(), labels.data(),
+                                  0.1f, int64(-1), loss_ref.data(),
+                                  dx_ref.data());
+  SetIntraOpNumThreads(4);
+  chime_cpu_softmax_cross_entropy(batch, classes, x.data(), labels.data(),
+                                  0.1f, int64(-1), loss.data(), dx.data());
+  EXPECT_EQ(loss, loss_ref);
+  EXPECT_EQ(dx, dx_ref);
+}
+
+TEST(SoftmaxTest, TestAxisOutOfRange) {
+  std::vector<float32> x(6), y(6);
+  EXPECT_DEATH(chime_cpu_softmax<float32>({2, 3}, 2, x.data(), y.data()),
+               "out of range");
+  EXPECT_DEATH(chime_cpu_softmax<float32>({2, 3}, -3, x.data(), y.data()),
+               "out of range");
+}
+
+}  // namespace chime
@@ -38,6 +38,9 @@ class TensorShape {
   size_t NumDims() const { return _dim_vec.size(); }
   void AddDim(int64_t size);
   size_t At(uint8_t index) const { return _dim_vec.at(index); }
+  /// All the dimensions, outermost first, for the routines that take the
+  /// dimensions of their operands rather than a TensorShape.
+  const DimVector &Dims() const { return _dim_vec; }
 
   void AppendShape(const TensorShape &shape);
   void AppendShape(TensorShape &&shape);
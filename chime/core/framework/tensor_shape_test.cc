@@ -43,6 +43,7 @@ TEST(TensorShape, TestConstruct) {
     TensorShape ts(dim_vec);
     EXPECT_EQ(ts.NumElements(), 6);
     EXPECT_EQ(ts.NumDims(), 3);
+    EXPECT_EQ(ts.Dims(), dim_vec);
   }
   {  // TensorShape(DimVector &&dim_vec)
     TensorShape ts(DimVector({3, 4, 5, 6}));
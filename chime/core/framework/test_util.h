@@ -0,0 +1,39 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_TEST_UTIL_H_
+#define CHIME_CORE_FRAMEWORK_TEST_UTIL_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Helpers shared by the tests of the `chime_cpu_*` routines.
+
+/// Number of elements of a row-major array of dimensions `dims`.
+inline utens_t NumElements(const std::vector<utens_t> &dims) {
+  utens_t n = 1;
+  for (utens_t d : dims) n *= d;
+  return n;
+}
+
+/// `n` deterministic values in no particular order: element i is
+/// step * ((i * 7919 + seed * 104729) % levels) + offset, so that the first
+/// `levels` elements are all distinct. The defaults give multiples of 1/64
+/// in [-1.5, 1.8], exact in every floating point type.
+template<typename Dtype>
+std::vector<Dtype> Pattern(utens_t n, int seed, utens_t levels = 211,
+                           float64 step = 1. / 64, float64 offset = -1.5) {
+  std::vector<Dtype> x(n);
+  for (utens_t i = 0; i < n; i++) {
+    const utens_t level = (i * 7919 + seed * 104729) % levels;
+    x[i] = static_cast<Dtype>(static_cast<float64>(level) * step + offset);
+  }
+  return x;
+}
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_TEST_UTIL_H_
@@ -0,0 +1,274 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/transpose.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_kernels.h"
+
+namespace chime {
+
+namespace {
+
+// Tiles of the transposed plane are one cache line wide in x and
+// `kTransposeTileRows` long, so that every line of x is read whole, at once,
+// and y is written in runs of as many elements. Square tiles leave lines of x
+// half read for the next tile, which large arrays evict first.
+constexpr utens_t kCacheLineBytes = 64;
+constexpr utens_t kTransposeTileRows = 128;
+
+// Index into `TransposeKernels::tile` of elements of `bytes` bytes.
+constexpr int TileKernelIndex(size_t bytes) {
+  return bytes == 1 ? 0 : bytes == 2 ? 1 : bytes == 4 ? 2 : bytes == 8 ? 3 : 4;
+}
+
+// Dimension of x, as a position in `perm`, for every dimension of y.
+std::vector<size_t> PermutedAxes(size_t num_dims,
+                                 const std::vector<int> &perm) {
+  const int n = static_cast<int>(num_dims);
+  CHECK_EQ(perm.size(), num_dims)
+      << "Permutation of " << perm.size() << " axes for " << n
+      << " dimensions";
+  std::vector<bool> seen(num_dims, false);
+  std::vector<size_t> axes(num_dims);
+  for (size_t d = 0; d < num_dims; d++) {
+    const int axis = perm[d];
+    CHECK(axis >= -n && axis < n)
+        << "Axis " << axis << " out of range for " << n << " dimensions";
+    axes[d] = axis < 0 ? axis + n : axis;
+    CHECK(!seen[axes[d]]) << "Axis " << axis << " is permuted twice";
+    seen[axes[d]] = true;
+  }
+  return axes;
+}
+
+// The dimensions of y with unit ones dropped and neighbours merged, and the
+// strides of x along them; y is contiguous. Neighbours merge when x steps
+// over them as one block, so at least one dimension has an x stride of 1. A
+// scalar result is a single dimension of 1.
+struct PermutePlan {
+  PermutePlan(const std::vector<utens_t> &x_dims,
+              const std::vector<int> &perm);
+
+  std::vector<utens_t> dims;
+  std::vector<utens_t> x_strides;
+  utens_t num_elements;
+};
+
+PermutePlan::PermutePlan(const std::vector<utens_t> &x_dims,
+                         const std::vector<int> &perm)
+    : num_elements(1) {
+  const std::vector<size_t> axes = PermutedAxes(x_dims.size(), perm);
+  std::vector<utens_t> strides(x_dims.size());
+  for (size_t d = x_dims.size(); d-- > 0;) {
+    strides[d] = num_elements;
+    num_elements *= x_dims[d];
+  }
+  for (size_t axis : axes) {
+    const utens_t size = x_dims[axis];
+    if (size == 1) continue;
+    if (!dims.empty() && x_strides.back() == strides[axis] * size) {
+      dims.back() *= size;
+      x_strides.back() = strides[axis];
+    } else {
+      dims.push_back(size);
+      x_strides.push_back(strides[axis]);
+    }
+  }
+  if (dims.empty()) {
+    dims.push_back(1);
+    x_strides.push_back(1);
+  }
+}
+
+// Offsets in x and y of a position over a subset of the dimensions of a plan,
+// given in row-major order. `Next` moves to the following position.
+struct Offsets {
+  Offsets(const std::vector<utens_t> &dims,
+          const std::vector<utens_t> &x_strides,
+          const std::vector<utens_t> &y_strides, utens_t position)
+      : dims(dims),
+        x_strides(x_strides),
+        y_strides(y_strides),
+        index(dims.size()),
+        x(0),
+        y(0) {
+    for (size_t d = dims.size(); d-- > 0;) {
+      index[d] = position % dims[d];
+      position /= dims[d];
+      x += index[d] * x_strides[d];
+      y += index[d] * y_strides[d];
+    }
+  }
+
+  void Next() {
+    for (size_t d = dims.size(); d-- > 0;) {
+      x += x_strides[d];
+      y += y_strides[d];
+      if (++index[d] < dims[d]) return;
+      x -= dims[d] * x_strides[d];
+      y -= dims[d] * y_strides[d];
+      index[d] = 0;
+    }
+  }
+
+  const std::vector<utens_t> &dims;
+  const std::vector<utens_t> &x_strides;
+  const std::vector<utens_t> &y_strides;
+  std::vector<utens_t> index;
+  utens_t x;
+  utens_t y;
+};
+
+// The innermost dimension of x stays innermost: y is a gather of rows of x.
+// Rows longer than a shard are cut in pieces, as in broadcast.cc.
+void CopyRows(const PermutePlan &plan, size_t bytes, const char *x, char *y) {
+  const std::vector<utens_t> outer(plan.dims.begin(), plan.dims.end() - 1);
+  const std::vector<utens_t> x_strides(plan.x_strides.begin(),
+                                       plan.x_strides.end() - 1);
+  std::vector<utens_t> y_strides(outer.size());
+  const utens_t n = plan.dims.back();
+  for (size_t d = outer.size(), s = n; d-- > 0; s *= outer[d]) {
+    y_strides[d] = s;
+  }
+  const utens_t piece = std::min<utens_t>(n, kIntraOpGrainSize);
+  const utens_t pieces = (n + piece - 1) / piece;
+  const int64_t grain =
+      std::max<int64_t>(1, kIntraOpGrainSize / static_cast<int64_t>(piece));
+  ParallelFor(static_cast<int64_t>(plan.num_elements / n * pieces), grain,
+              [&](int64_t first, int64_t last) {
+                Offsets row(outer, x_strides, y_strides, first / pieces);
+                for (int64_t item = first; item < last; item++) {
+                  if (item > first && item % pieces == 0) row.Next();
+                  const utens_t begin = item % pieces * piece;
+                  const utens_t len = std::min(piece, n - begin);
+                  std::memcpy(y + (row.y + begin) * bytes,
+                              x + (row.x + begin) * bytes, len * bytes);
+                }
+              });
+}
+
+// Otherwise the dimension q of y along which x is contiguous is transposed
+// with the innermost one, along which y is contiguous, for every position
+// over the other dimensions. The plane is cut into tiles, grown along one
+// side when the other is short, and the tiles of every plane are split over
+// the threads.
+void TransposePlanes(const PermutePlan &plan, size_t bytes, const char *x,
+                     char *y) {
+  const size_t rank = plan.dims.size();
+  std::vector<utens_t> y_strides(rank);
+  for (size_t d = rank, s = 1; d-- > 0; s *= plan.dims[d]) y_strides[d] = s;
+  const size_t q = std::find(plan.x_strides.begin(), plan.x_strides.end(), 1) -
+                   plan.x_strides.begin();
+  DCHECK_LT(q, rank - 1);
+  std::vector<utens_t> outer, outer_x_strides, outer_y_strides;
+  for (size_t d = 0; d + 1 < rank; d++) {
+    if (d == q) continue;
+    outer.push_back(plan.dims[d]);
+    outer_x_strides.push_back(plan.x_strides[d]);
+    outer_y_strides.push_back(y_strides[d]);
+  }
+
+  // Rows of the plane run along the innermost dimension of y, columns along
+  // dimension q, so x holds it row-major and y column-major.
+  const utens_t rows = plan.dims.back(), cols = plan.dims[q];
+  const utens_t ldx = plan.x_strides.back(), ldy = y_strides[q];
+  const utens_t line = std::max<utens_t>(1, kCacheLineBytes / bytes);
+  const utens_t area = kTransposeTileRows * line;
+  utens_t tile_rows = std::min(rows, kTransposeTileRows);
+  utens_t tile_cols = std::min(cols, line);
+  if (tile_rows < kTransposeTileRows) {
+    tile_cols = std::min(cols, area / tile_rows / line * line);
+  } else if (tile_cols < line) {
+    tile_rows = std::min(rows, area / tile_cols);
+  }
+  const utens_t row_tiles = (rows + tile_rows - 1) / tile_rows;
+  const utens_t col_tiles = (cols + tile_cols - 1) / tile_cols;
+  const utens_t tiles = row_tiles * col_tiles;
+  const auto tile = kernels::GetTransposeKernels().tile[TileKernelIndex(bytes)];
+  const int64_t grain = std::max<int64_t>(
+      1, kIntraOpGrainSize / static_cast<int64_t>(tile_rows * tile_cols));
+  ParallelFor(static_cast<int64_t>(plan.num_elements / (rows * cols) * tiles),
+              grain, [&](int64_t first, int64_t last) {
+                Offsets plane(outer, outer_x_strides, outer_y_strides,
+                              first / tiles);
+                for (int64_t item = first; item < last; item++) {
+                  if (item > first && item % tiles == 0) plane.Next();
+                  const utens_t r = item % tiles / col_tiles * tile_rows;
+                  const utens_t c = item % tiles % col_tiles * tile_cols;
+                  tile(std::min(tile_rows, rows - r),
+                       std::min(tile_cols, cols - c),
+                       x + (plane.x + r * ldx + c) * bytes, ldx,
+                       y + (plane.y + c * ldy + r) * bytes, ldy);
+                }
+              });
+}
+
+template<typename Dtype>
+void Permute(const std::vector<utens_t> &dims, const std::vector<int> &perm,
+             const Dtype *x, Dtype *y) {
+  static_assert(sizeof(Dtype) == 1 || sizeof(Dtype) == 2 ||
+                    sizeof(Dtype) == 4 || sizeof(Dtype) == 8 ||
+                    sizeof(Dtype) == 16,
+                "Transpose kernels move elements of 1, 2, 4, 8 or 16 bytes");
+  DCHECK(x);
+  DCHECK(y);
+  const PermutePlan plan(dims, perm);
+  if (plan.num_elements == 0) return;
+  const char *src = reinterpret_cast<const char *>(x);
+  char *dst = reinterpret_cast<char *>(y);
+  if (plan.x_strides.back() == 1) {
+    CopyRows(plan, sizeof(Dtype), src, dst);
+  } else {
+    TransposePlanes(plan, sizeof(Dtype), src, dst);
+  }
+}
+
+}  // namespace
+
+std::vector<utens_t> PermutedDims(const std::vector<utens_t> &dims,
+                                  const std::vector<int> &perm) {
+  const std::vector<size_t> axes = PermutedAxes(dims.size(), perm);
+  std::vector<utens_t> y_dims(dims.size());
+  for (size_t d = 0; d < dims.size(); d++) y_dims[d] = dims[axes[d]];
+  return y_dims;
+}
+
+template<typename Dtype>
+void chime_cpu_permute(const std::vector<utens_t> &dims,
+                       const std::vector<int> &perm, const Dtype *x,
+                       Dtype *y) {
+  Permute(dims, perm, x, y);
+}
+
+template<typename Dtype>
+void chime_cpu_transpose(utens_t rows, utens_t cols, const Dtype *x,
+                         Dtype *y) {
+  Permute<Dtype>({rows, cols}, {1, 0}, x, y);
+}
+
+#define INSTANTIATE_TRANSPOSE(Dtype)                                          \
+  template void chime_cpu_permute<Dtype>(const std::vector<utens_t> &,        \
+                                         const std::vector<int> &,            \
+                                         const Dtype *, Dtype *);             \
+  template void chime_cpu_transpose<Dtype>(utens_t, utens_t, const Dtype *,   \
+                                           Dtype *)
+
+INSTANTIATE_TRANSPOSE(int8);
+INSTANTIATE_TRANSPOSE(int16);
+INSTANTIATE_TRANSPOSE(int32);
+INSTANTIATE_TRANSPOSE(int64);
+INSTANTIATE_TRANSPOSE(uint8);
+INSTANTIATE_TRANSPOSE(uint16);
+INSTANTIATE_TRANSPOSE(uint32);
+INSTANTIATE_TRANSPOSE(uint64);
+INSTANTIATE_TRANSPOSE(float16);
+INSTANTIATE_TRANSPOSE(bfloat16);
+INSTANTIATE_TRANSPOSE(float32);
+INSTANTIATE_TRANSPOSE(float64);
+INSTANTIATE_TRANSPOSE(float128);
+
+}  // namespace chime
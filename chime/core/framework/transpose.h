@@ -0,0 +1,44 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_TRANSPOSE_H_
+#define CHIME_CORE_FRAMEWORK_TRANSPOSE_H_
+
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+
+namespace chime {
+
+/// Layout changes of row-major arrays, such as NCHW to NHWC or splitting the
+/// heads of an attention projection. y must not overlap x.
+///
+/// `chime_cpu_permute` reorders the dimensions `dims` of x so that dimension
+/// d of y is dimension `perm[d]` of x, with axes counted from the end when
+/// negative. Unit dimensions are dropped and the runs of axes that stay
+/// neighbours merged first, so that {N, C, H, W} to {N, H, W, C} is a batch of
+/// C x HW transposes. When the innermost dimension of x stays innermost, whole
+/// rows are copied with memcpy, otherwise the plane of the two innermost
+/// dimensions of x and y is transposed in cache-sized tiles, with register
+/// shuffles. Rows or tiles are split over the intra-op threads.
+///
+/// `chime_cpu_transpose` is the 2-D case, x of `rows` x `cols` to y of
+/// `cols` x `rows`. Elements are moved as raw bits, so every type of 1, 2, 4,
+/// 8 or 16 bytes is supported.
+///
+/// `PermutedDims` gives the dimensions of y.
+std::vector<utens_t> PermutedDims(const std::vector<utens_t> &dims,
+                                  const std::vector<int> &perm);
+
+template<typename Dtype>
+void chime_cpu_permute(const std::vector<utens_t> &dims,
+                       const std::vector<int> &perm, const Dtype *x,
+                       Dtype *y);
+
+template<typename Dtype>
+void chime_cpu_transpose(utens_t rows, utens_t cols, const Dtype *x,
+                         Dtype *y);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_TRANSPOSE_H_
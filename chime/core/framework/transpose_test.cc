@@ -0,0 +1,134 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/transpose.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+// Permutes element by element, walking y in order.
+template<typename Dtype>
+std::vector<Dtype> Reference(const std::vector<utens_t> &dims,
+                             const std::vector<int> &perm,
+                             const std::vector<Dtype> &x) {
+  const size_t rank = dims.size();
+  std::vector<utens_t> strides(rank);
+  for (size_t d = rank, s = 1; d-- > 0; s *= dims[d]) strides[d] = s;
+  std::vector<Dtype> y(x.size());
+  for (utens_t i = 0; i < y.size(); i++) {
+    utens_t rest = i, offset = 0;
+    for (size_t d = rank; d-- > 0;) {
+      const int axis = perm[d] < 0 ? perm[d] + static_cast<int>(rank)
+                                   : perm[d];
+      offset += rest % dims[axis] * strides[axis];
+      rest /= dims[axis];
+    }
+    y[i] = x[offset];
+  }
+  return y;
+}
+
+template<typename Dtype>
+void CheckEveryPermutation(const std::vector<utens_t> &dims) {
+  const std::vector<Dtype> x = Pattern<Dtype>(NumElements(dims), 0, 127, 1, 0);
+  std::vector<int> perm(dims.size());
+  for (size_t d = 0; d < perm.size(); d++) perm[d] = static_cast<int>(d);
+  do {
+    std::vector<Dtype> y(x.size());
+    chime_cpu_permute(dims, perm, x.data(), y.data());
+    EXPECT_EQ(y, Reference(dims, perm, x));
+  } while (std::next_permutation(perm.begin(), perm.end()));
+}
+
+}  // namespace
+
+TEST(TransposeTest, TestPermutedDims) {
+  const std::vector<utens_t> dims = {2, 3, 4, 5};
+  EXPECT_EQ(PermutedDims(dims, {0, 2, 3, 1}),
+            std::vector<utens_t>({2, 4, 5, 3}));
+  EXPECT_EQ(PermutedDims(dims, {-1, 0, -2, 1}),
+            std::vector<utens_t>({5, 2, 4, 3}));
+  EXPECT_EQ(PermutedDims({}, {}), std::vector<utens_t>());
+  EXPECT_DEATH(PermutedDims(dims, {0, 1, 2}), "Permutation of 3 axes");
+  EXPECT_DEATH(PermutedDims(dims, {0, 1, 2, 4}), "out of range");
+  EXPECT_DEATH(PermutedDims(dims, {0, 1, 3, -1}), "permuted twice");
+}
+
+// Every permutation of a few shapes, with unit dimensions, edges that do not
+// fill a register block and planes larger than a tile, for every element
+// size.
+TEST(TransposeTest, TestAgainstReference) {
+  const std::vector<std::vector<utens_t>> shapes = {
+      {3, 5, 7}, {2, 1, 9, 4}, {2, 3, 4, 5}, {67, 130}, {3, 70, 1, 66}};
+  for (const auto &dims : shapes) {
+    CheckEveryPermutation<uint8>(dims);
+    CheckEveryPermutation<int16>(dims);
+    CheckEveryPermutation<float32>(dims);
+    CheckEveryPermutation<float64>(dims);
+    CheckEveryPermutation<float128>(dims);
+  }
+}
+
+TEST(TransposeTest, TestTranspose) {
+  const std::vector<std::pair<utens_t, utens_t>> sizes = {
+      {1, 1}, {1, 9}, {9, 1}, {8, 8}, {16, 4}, {31, 33}, {500, 3}, {300, 257}};
+  for (const auto &size : sizes) {
+    const utens_t rows = size.first, cols = size.second;
+    const std::vector<float32> x = Pattern<float32>(rows * cols, 0, 127, 1, 0);
+    std::vector<float32> y(x.size());
+    chime_cpu_transpose(rows, cols, x.data(), y.data());
+    for (utens_t i = 0; i < rows; i++) {
+      for (utens_t j = 0; j < cols; j++) {
+        EXPECT_EQ(y[j * rows + i], x[i * cols + j]) << i << " " << j;
+      }
+    }
+    const std::vector<uint16> h = Pattern<uint16>(rows * cols, 0, 127, 1, 0);
+    std::vector<uint16> g(h.size());
+    chime_cpu_transpose(rows, cols, h.data(), g.data());
+    EXPECT_EQ(g, Reference<uint16>({rows, cols}, {1, 0}, h));
+  }
+}
+
+// NCHW to NHWC and back, and splitting the heads of an attention projection,
+// with the planes split over the threads.
+TEST(TransposeTest, TestIntraOpParallel) {
+  const std::vector<std::pair<std::vector<utens_t>, std::vector<int>>> cases =
+      {{{4, 3, 224, 224}, {0, 2, 3, 1}},
+       {{4, 224, 224, 3}, {0, 3, 1, 2}},
+       {{8, 256, 12, 64}, {0, 2, 1, 3}},
+       {{1024, 1000}, {1, 0}}};
+  for (const auto &c : cases) {
+    const std::vector<float32> x =
+        Pattern<float32>(NumElements(c.first), 0, 127, 1, 0);
+    std::vector<float32> y(x.size());
+    ScopedIntraOpNumThreads threads(4);
+    chime_cpu_permute(c.first, c.second, x.data(), y.data());
+    EXPECT_EQ(y, Reference(c.first, c.second, x));
+  }
+}
+
+TEST(TransposeTest, TestEdgeCases) {
+  // Empty arrays write nothing, scalars and identities copy.
+  std::vector<float32> y(4, -1.f);
+  const std::vector<float32> x = {1.f, 2.f, 3.f, 4.f};
+  chime_cpu_permute<float32>({2, 0, 3}, {2, 0, 1}, x.data(), y.data());
+  EXPECT_EQ(y, std::vector<float32>(4, -1.f));
+  chime_cpu_permute<float32>({}, {}, x.data() + 1, y.data());
+  EXPECT_EQ(y[0], 2.f);
+  chime_cpu_permute<float32>({2, 2}, {0, 1}, x.data(), y.data());
+  EXPECT_EQ(y, x);
+  // Unit dimensions move freely.
+  chime_cpu_permute<float32>({1, 4, 1}, {2, 1, 0}, x.data(), y.data());
+  EXPECT_EQ(y, x);
+}
+
+}  // namespace chime
@@ -37,10 +37,11 @@ struct is_complex<std::complex<double>> : true_type {};
 /// without running T() and ~T(). We do not use std::is_trivial<T>
 /// directly because std::complex<float> and std::complex<double> are
 /// not trivial, but their arrays can be constructed and destructed
-/// without running their default ctors and dtors.
+/// without running their default ctors and dtors. The same goes for float16.
 template <typename T>
 struct is_simple_type {
   static constexpr bool value = std::is_trivial<T>::value ||
+                                std::is_same<T, float16>::value ||
                                 std::is_same<T, complex64>::value ||
                                 std::is_same<T, complex128>::value;
 };
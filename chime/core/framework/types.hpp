@@ -6,6 +6,7 @@
 
 #include <complex>
 
+#include "chime/core/framework/float16.h"
 #include "chime/core/platform/logging.hpp"
 #include "chime/core/schema/types.pb.h"
 
@@ -39,7 +40,9 @@ static const size_t DT_INT32_SIZE = sizeof(int32);
 static const size_t DT_UINT32_SIZE = sizeof(uint32);
 static const size_t DT_INT64_SIZE = sizeof(int64);
 static const size_t DT_UINT64_SIZE = sizeof(uint64);
-static const size_t DT_HALF_SIZE = static_cast<size_t>(2ull);
+static const size_t DT_HALF_SIZE = sizeof(float16);
+static const size_t DT_FLOAT16_SIZE = sizeof(float16);
+static const size_t DT_BFLOAT16_SIZE = sizeof(bfloat16);
 static const size_t DT_FLOAT32_SIZE = sizeof(float32);
 static const size_t DT_FLOAT64_SIZE = sizeof(float64);
 static const size_t DT_FLOAT128_SIZE = sizeof(float128);
@@ -101,6 +104,8 @@ MATCH_TYPE_AND_ENUM(int32, DT_INT32);
 MATCH_TYPE_AND_ENUM(uint32, DT_UINT32);
 MATCH_TYPE_AND_ENUM(int64, DT_INT64);
 MATCH_TYPE_AND_ENUM(uint64, DT_UINT64);
+MATCH_TYPE_AND_ENUM(float16, DT_HALF);
+MATCH_TYPE_AND_ENUM(bfloat16, DT_BFLOAT16);
 MATCH_TYPE_AND_ENUM(float32, DT_FLOAT32);
 MATCH_TYPE_AND_ENUM(float64, DT_FLOAT64);
 MATCH_TYPE_AND_ENUM(float128, DT_FLOAT128);
@@ -128,14 +133,20 @@ struct EnumHasSize<DT_STRING> {
   static constexpr bool value = false;
 };
 
+/// DT_FLOAT16 is another name of DT_HALF, float16 maps back to DT_HALF.
 template <>
-struct EnumHasSize<DT_HALF> {
+struct EnumToDataType<DT_FLOAT16> {
+  typedef float16 type;
+};
+
+template <>
+struct EnumHasSize<DT_FLOAT16> {
   static constexpr bool value = true;
 };
 
 template <>
-struct DtypeSize<DT_HALF> {
-  static constexpr size_t size = DT_HALF_SIZE;
+struct DtypeSize<DT_FLOAT16> {
+  static constexpr size_t size = DT_FLOAT16_SIZE;
 };
 
 template <class T>
@@ -167,7 +178,10 @@ inline size_t GetDtypeSize(DataType dtype) {
     case DT_UINT64:
       return sizeof(uint64);
     case DT_HALF:
-      CHIME_NOT_IMPLEMENTED;
+    case DT_FLOAT16:
+      return sizeof(float16);
+    case DT_BFLOAT16:
+      return sizeof(bfloat16);
     case DT_FLOAT32:
       return sizeof(float32);
     case DT_FLOAT64:
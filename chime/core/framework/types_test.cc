@@ -2,6 +2,9 @@
 // author: yatorho
 
 #include "chime/core/framework/types.hpp"
+
+#include <type_traits>
+
 #include "chime/core/platform/test.hpp"
 
 namespace chime {
@@ -23,4 +26,19 @@ TEST_F(TypeTest, TestDtypSize) {
   EXPECT_TRUE(DtypeSize<DT_INT32>::size == 4);
 }
 
+TEST_F(TypeTest, TestHalfTypes) {
+  EXPECT_TRUE(DataTypeToEnum<float16>::value == DT_HALF);
+  EXPECT_TRUE(DataTypeToEnum<bfloat16>::v() == DT_BFLOAT16);
+  EXPECT_TRUE((std::is_same<EnumToDataType<DT_HALF>::type, float16>::value));
+  EXPECT_TRUE(
+      (std::is_same<EnumToDataType<DT_FLOAT16>::type, float16>::value));
+  EXPECT_TRUE(
+      (std::is_same<EnumToDataType<DT_BFLOAT16>::type, bfloat16>::value));
+  EXPECT_TRUE(DtypeSize<DT_FLOAT16>::size == 2);
+  EXPECT_TRUE(DtypeSize<DT_BFLOAT16>::size == 2);
+  EXPECT_EQ(GetDtypeSize(DT_HALF), 2);
+  EXPECT_EQ(GetDtypeSize(DT_FLOAT16), 2);
+  EXPECT_EQ(GetDtypeSize(DT_BFLOAT16), 2);
+}
+
 }  // namespace chime
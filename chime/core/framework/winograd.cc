@@ -0,0 +1,317 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/winograd.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/math_functions.hpp"
+#include "chime/core/framework/math_kernels.h"
+#include "chime/core/framework/transpose.h"
+
+namespace chime {
+
+namespace {
+
+// Bytes of transformed input and products held for a block of tiles, so
+// that a block stays in L2 between the transforms and the GEMMs.
+constexpr utens_t kWinogradBlockBytes = 1024 * 1024;
+
+// Fewest tiles per block, so that the GEMMs are not too thin to run well
+// when the channels are many.
+constexpr utens_t kWinogradMinBlock = 32;
+
+// Position of the output tiles over a batch: tile `t` covers outputs
+// [oh, oh + m) x [ow, ow + m) of image n, clipped to the output, and reads
+// the input tile from (oh - pad_h, ow - pad_w).
+struct TileGrid {
+  TileGrid(const Conv2DParams &p, utens_t m)
+      : m(m),
+        out_h(p.OutH()),
+        out_w(p.OutW()),
+        cols((out_w + m - 1) / m),
+        per_image((out_h + m - 1) / m * cols),
+        total(p.batch * per_image) {}
+
+  void Locate(utens_t t, utens_t *n, utens_t *oh, utens_t *ow) const {
+    *n = t / per_image;
+    *oh = t % per_image / cols * m;
+    *ow = t % per_image % cols * m;
+  }
+
+  utens_t m;
+  utens_t out_h;
+  utens_t out_w;
+  utens_t cols;
+  utens_t per_image;
+  utens_t total;
+};
+
+// Gathers the input tile of output (oh, ow) of image n into d, alpha x alpha
+// rows of `in_channels` elements, zero outside the image.
+template<typename Dtype>
+void GatherTile(const Conv2DParams &p, utens_t alpha, const Dtype *x,
+                utens_t n, utens_t oh, utens_t ow, Dtype *d) {
+  const utens_t c = p.in_channels;
+  const int64 ih0 = static_cast<int64>(oh) - static_cast<int64>(p.pad_h);
+  const int64 iw0 = static_cast<int64>(ow) - static_cast<int64>(p.pad_w);
+  const int64 h = static_cast<int64>(p.in_h), w = static_cast<int64>(p.in_w);
+  // Columns [jlo, jhi) of the tile are inside the image.
+  const utens_t jlo = static_cast<utens_t>(
+      std::min<int64>(std::max<int64>(-iw0, 0), alpha));
+  const utens_t jhi = static_cast<utens_t>(
+      std::max<int64>(jlo, std::min<int64>(w - iw0, alpha)));
+  for (utens_t i = 0; i < alpha; i++) {
+    Dtype *row = d + i * alpha * c;
+    const int64 ih = ih0 + static_cast<int64>(i);
+    if (ih < 0 || ih >= h || jlo == jhi) {
+      std::fill(row, row + alpha * c, Dtype(0));
+      continue;
+    }
+    std::fill(row, row + jlo * c, Dtype(0));
+    std::fill(row + jhi * c, row + alpha * c, Dtype(0));
+    if (p.layout == ConvLayout::kNHWC) {
+      const Dtype *src = x + ((n * p.in_h + ih) * p.in_w + iw0 + jlo) * c;
+      std::memcpy(row + jlo * c, src, (jhi - jlo) * c * sizeof(Dtype));
+    } else {
+      const utens_t plane = p.in_h * p.in_w;
+      const Dtype *src = x + n * c * plane + ih * p.in_w + iw0;
+      for (utens_t k = 0; k < c; k++) {
+        for (utens_t j = jlo; j < jhi; j++) {
+          row[j * c + k] = src[k * plane + j];
+        }
+      }
+    }
+  }
+}
+
+// Writes the m x m rows of `out_channels` outputs of tile (n, oh, ow) into
+// y, dropping those past the edge of the output.
+template<typename Dtype>
+void ScatterTile(const Conv2DParams &p, const TileGrid &grid,
+                 const Dtype *out, utens_t n, utens_t oh, utens_t ow,
+                 Dtype *y) {
+  const utens_t oc = p.out_channels;
+  const utens_t rows = std::min(grid.m, grid.out_h - oh);
+  const utens_t cols = std::min(grid.m, grid.out_w - ow);
+  for (utens_t a = 0; a < rows; a++) {
+    const Dtype *row = out + a * grid.m * oc;
+    if (p.layout == ConvLayout::kNHWC) {
+      Dtype *dst = y + ((n * grid.out_h + oh + a) * grid.out_w + ow) * oc;
+      std::memcpy(dst, row, cols * oc * sizeof(Dtype));
+    } else {
+      const utens_t plane = grid.out_h * grid.out_w;
+      Dtype *dst = y + n * oc * plane + (oh + a) * grid.out_w + ow;
+      for (utens_t k = 0; k < oc; k++) {
+        for (utens_t b = 0; b < cols; b++) dst[k * plane + b] = row[b * oc + k];
+      }
+    }
+  }
+}
+
+// The convolution for one output tile size. Per block of `block` tiles, the
+// transformed input v holds one block x in_channels matrix per tile point,
+// the products one block x out_channels matrix per point. NHWC tiles inside
+// the image are transformed straight from x and into y, the others go
+// through a gathered copy.
+template<typename Dtype, int kM>
+void WinogradConv(const Conv2DParams &p, const Dtype *x,
+                  const WinogradFilter<Dtype> &filter, const Dtype *bias,
+                  Dtype *y) {
+  constexpr utens_t alpha = kM + 2, points = alpha * alpha;
+  const kernels::WinogradKernels<Dtype> &transforms =
+      kernels::GetWinogradKernels<Dtype>();
+  const auto input = transforms.input[kM / 4];
+  const auto output = transforms.output[kM / 4];
+  const utens_t ic = p.in_channels, oc = p.out_channels;
+  const bool nhwc = p.layout == ConvLayout::kNHWC;
+  const TileGrid grid(p, kM);
+  const utens_t block = std::min(
+      grid.total,
+      std::max(kWinogradMinBlock,
+               kWinogradBlockBytes / (points * (ic + oc) * sizeof(Dtype))));
+  std::vector<Dtype> v(points * block * ic), products(points * block * oc);
+
+  for (utens_t first = 0; first < grid.total; first += block) {
+    const utens_t count = std::min(block, grid.total - first);
+    ParallelFor(
+        static_cast<int64_t>(count),
+        std::max<int64_t>(
+            1, kIntraOpGrainSize / static_cast<int64_t>(points * ic)),
+        [&](int64_t begin, int64_t end) {
+          std::vector<Dtype> d;
+          for (utens_t q = begin; q < static_cast<utens_t>(end); q++) {
+            utens_t n, oh, ow;
+            grid.Locate(first + q, &n, &oh, &ow);
+            if (nhwc && oh >= p.pad_h && ow >= p.pad_w &&
+                oh - p.pad_h + alpha <= p.in_h &&
+                ow - p.pad_w + alpha <= p.in_w) {
+              const utens_t ih = oh - p.pad_h, iw = ow - p.pad_w;
+              input(ic, x + ((n * p.in_h + ih) * p.in_w + iw) * ic,
+                    p.in_w * ic, ic, v.data() + q * ic, block * ic);
+              continue;
+            }
+            d.resize(points * ic);
+            GatherTile(p, alpha, x, n, oh, ow, d.data());
+            input(ic, d.data(), alpha * ic, ic, v.data() + q * ic,
+                  block * ic);
+          }
+        });
+
+    for (utens_t xi = 0; xi < points; xi++) {
+      chime_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, count, oc, ic,
+                            Dtype(1), v.data() + xi * block * ic, ic,
+                            filter.matrix(xi), oc, Dtype(0),
+                            products.data() + xi * block * oc, oc);
+    }
+
+    ParallelFor(
+        static_cast<int64_t>(count),
+        std::max<int64_t>(
+            1, kIntraOpGrainSize / static_cast<int64_t>(points * oc)),
+        [&](int64_t begin, int64_t end) {
+          std::vector<Dtype> out;
+          for (utens_t q = begin; q < static_cast<utens_t>(end); q++) {
+            utens_t n, oh, ow;
+            grid.Locate(first + q, &n, &oh, &ow);
+            if (nhwc && oh + kM <= grid.out_h && ow + kM <= grid.out_w) {
+              output(oc, products.data() + q * oc, block * oc, bias,
+                     y + ((n * grid.out_h + oh) * grid.out_w + ow) * oc,
+                     grid.out_w * oc, oc);
+              continue;
+            }
+            out.resize(kM * kM * oc);
+            output(oc, products.data() + q * oc, block * oc, bias,
+                   out.data(), kM * oc, oc);
+            ScatterTile(p, grid, out.data(), n, oh, ow, y);
+          }
+        });
+  }
+}
+
+}  // namespace
+
+bool WinogradApplies(const Conv2DParams &params) {
+  return params.kernel_h == 3 && params.kernel_w == 3 &&
+         params.stride_h == 1 && params.stride_w == 1 &&
+         params.dilation_h == 1 && params.dilation_w == 1 &&
+         params.groups == 1;
+}
+
+// Tiles times their multiplies, the smaller wins: F(4x4) needs 36 per 16
+// outputs against 16 per 4, unless the output is mostly covered by padding.
+WinogradTile PreferredWinogradTile(const Conv2DParams &params) {
+  const utens_t out_h = params.OutH(), out_w = params.OutW();
+  const utens_t f2 = (out_h + 1) / 2 * ((out_w + 1) / 2) * 16;
+  const utens_t f4 = (out_h + 3) / 4 * ((out_w + 3) / 4) * 36;
+  return f4 <= f2 ? WinogradTile::kF4x4 : WinogradTile::kF2x2;
+}
+
+template<typename Dtype>
+WinogradFilter<Dtype>::WinogradFilter(const Conv2DParams &params,
+                                      const Dtype *filter, WinogradTile tile)
+    : _tile(tile),
+      _in_channels(params.in_channels),
+      _out_channels(params.out_channels) {
+  CHECK(WinogradApplies(params))
+      << "Winograd needs a 3x3 kernel with stride 1 and no dilation, got "
+      << params.kernel_h << "x" << params.kernel_w;
+  DCHECK(filter);
+  const utens_t ic = _in_channels, oc = _out_channels;
+  // NCHW filters are permuted to HWIO first, so that the kernel reads the
+  // output channels of every tap contiguously.
+  std::vector<Dtype> hwio;
+  if (params.layout == ConvLayout::kNCHW) {
+    hwio.resize(oc * ic * 9);
+    chime_cpu_permute<Dtype>({oc, ic, 3, 3}, {2, 3, 1, 0}, filter,
+                             hwio.data());
+    filter = hwio.data();
+  }
+  _data.resize(alpha() * alpha() * ic * oc);
+  const auto transform =
+      kernels::GetWinogradKernels<Dtype>().filter[m() / 4];
+  ParallelFor(
+      static_cast<int64_t>(ic),
+      std::max<int64_t>(1, kIntraOpGrainSize /
+                               static_cast<int64_t>(alpha() * alpha() * oc)),
+      [&](int64_t begin, int64_t end) {
+        for (utens_t c = begin; c < static_cast<utens_t>(end); c++) {
+          transform(oc, filter + c * oc, ic * oc, _data.data() + c * oc,
+                    ic * oc);
+        }
+      });
+}
+
+template<typename Dtype>
+void chime_cpu_conv2d_winograd(const Conv2DParams &params, const Dtype *x,
+                               const WinogradFilter<Dtype> &filter,
+                               const Dtype *bias, Dtype *y) {
+  DCHECK(x);
+  DCHECK(y);
+  CHECK(WinogradApplies(params))
+      << "Winograd needs a 3x3 kernel with stride 1 and no dilation, got "
+      << params.kernel_h << "x" << params.kernel_w;
+  CHECK_EQ(filter.in_channels(), params.in_channels);
+  CHECK_EQ(filter.out_channels(), params.out_channels);
+  if (params.batch * params.OutH() * params.OutW() * params.out_channels ==
+      0) {
+    return;
+  }
+  if (filter.tile() == WinogradTile::kF2x2) {
+    WinogradConv<Dtype, 2>(params, x, filter, bias, y);
+  } else {
+    WinogradConv<Dtype, 4>(params, x, filter, bias, y);
+  }
+}
+
+template<typename Dtype>
+std::shared_ptr<const WinogradFilter<Dtype>> WinogradFilterCache<Dtype>::Get(
+    const Conv2DParams &params, const Dtype *filter, WinogradTile tile) {
+  const Key key(filter, params.layout, params.in_channels,
+                params.out_channels, tile);
+  {
+    mutex_lock lock(_mu);
+    auto it = _cache.find(key);
+    if (it != _cache.end()) return it->second;
+  }
+  // Transforms outside of the lock, a racing thread may transform the same
+  // filter.
+  std::shared_ptr<const WinogradFilter<Dtype>> transformed(
+      new WinogradFilter<Dtype>(params, filter, tile));
+  mutex_lock lock(_mu);
+  return _cache.emplace(key, std::move(transformed)).first->second;
+}
+
+template<typename Dtype>
+void WinogradFilterCache<Dtype>::Erase(const Dtype *filter) {
+  mutex_lock lock(_mu);
+  for (auto it = _cache.begin(); it != _cache.end();) {
+    it = std::get<0>(it->first) == filter ? _cache.erase(it) : std::next(it);
+  }
+}
+
+template<typename Dtype>
+void WinogradFilterCache<Dtype>::Clear() {
+  mutex_lock lock(_mu);
+  _cache.clear();
+}
+
+template<typename Dtype>
+size_t WinogradFilterCache<Dtype>::Size() const {
+  mutex_lock lock(_mu);
+  return _cache.size();
+}
+
+#define INSTANTIATE_WINOGRAD(Dtype)                                           \
+  template class WinogradFilter<Dtype>;                                       \
+  template class WinogradFilterCache<Dtype>;                                  \
+  template void chime_cpu_conv2d_winograd<Dtype>(                             \
+      const Conv2DParams &, const Dtype *, const WinogradFilter<Dtype> &,     \
+      const Dtype *, Dtype *)
+
+INSTANTIATE_WINOGRAD(float32);
+INSTANTIATE_WINOGRAD(float64);
+
+}  // namespace chime
@@ -0,0 +1,126 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_FRAMEWORK_WINOGRAD_H_
+#define CHIME_CORE_FRAMEWORK_WINOGRAD_H_
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "chime/core/framework/common.hpp"
+#include "chime/core/framework/conv.h"
+#include "chime/core/platform/macros.h"
+#include "chime/core/platform/mutex.h"
+#include "chime/core/platform/thread_annotations.h"
+
+namespace chime {
+
+/// Output tile of a Winograd convolution F(m x m, 3 x 3), which computes
+/// m x m outputs from an (m + 2) x (m + 2) input tile with (m + 2)^2
+/// multiplies per channel pair instead of 9 m^2: 2.25x fewer for F(2x2),
+/// 4x fewer for F(4x4), whose transforms are larger and round off more.
+enum class WinogradTile { kF2x2, kF4x4 };
+
+/// Whether a convolution can go through Winograd: a 3 x 3 kernel, stride 1,
+/// no dilation and no groups, any padding.
+bool WinogradApplies(const Conv2DParams &params);
+
+/// The tile `chime_cpu_conv2d` picks for `params`: F(4x4) unless the output
+/// is too small for its tiles not to be mostly padding.
+WinogradTile PreferredWinogradTile(const Conv2DParams &params);
+
+/// Filters of a convolution transformed for Winograd, one in_channels x
+/// out_channels matrix per point of the transformed tile. Transforming is
+/// linear in the filter size but not free, so a model keeps the transformed
+/// filter alongside its weights and passes it to every call:
+///
+///   WinogradFilter<float32> w(params, filter, PreferredWinogradTile(params));
+///   for (...) chime_cpu_conv2d_winograd<float32>(params, x, w, bias, y);
+///
+/// `params` only needs the layout, channels and kernel of the convolution;
+/// the transformed filter serves every image size and padding.
+/// Supports float32 and float64.
+template<typename Dtype>
+class WinogradFilter {
+ public:
+  /// Transforms `filter`, laid out as `params.layout` requires (see
+  /// `ConvLayout`). REQUIRES: WinogradApplies(params).
+  WinogradFilter(const Conv2DParams &params, const Dtype *filter,
+                 WinogradTile tile);
+
+  WinogradTile tile() const { return _tile; }
+  utens_t in_channels() const { return _in_channels; }
+  utens_t out_channels() const { return _out_channels; }
+
+  /// Side of the output tile, 2 or 4, and of the transformed tile.
+  utens_t m() const { return _tile == WinogradTile::kF2x2 ? 2 : 4; }
+  utens_t alpha() const { return m() + 2; }
+
+  /// The in_channels x out_channels matrix of transformed tile point `xi`,
+  /// row-major, for xi in [0, alpha()^2).
+  const Dtype *matrix(utens_t xi) const {
+    return _data.data() + xi * _in_channels * _out_channels;
+  }
+
+ private:
+  WinogradTile _tile;
+  utens_t _in_channels;
+  utens_t _out_channels;
+  std::vector<Dtype> _data;
+};
+
+/// Transformed filters keyed by the host buffer they were transformed from,
+/// as `PackedMatrixCache` does for GEMM weights, so that each filter is
+/// transformed on first use only:
+///
+///   WinogradFilterCache<float32> cache;
+///   for (...) chime_cpu_conv2d<float32>(params, x, filter, bias, y, &cache);
+///
+/// The cache does not see writes to a buffer: `Erase` it once the filter
+/// changes. Thread-safe.
+template<typename Dtype>
+class WinogradFilterCache {
+ public:
+  WinogradFilterCache() {}
+
+  /// Returns `filter` transformed for `tile`, transforming it if it is not
+  /// cached yet. The arguments are those of the `WinogradFilter`
+  /// constructor.
+  std::shared_ptr<const WinogradFilter<Dtype>> Get(const Conv2DParams &params,
+                                                   const Dtype *filter,
+                                                   WinogradTile tile);
+
+  /// Drops every transform of the buffer starting at `filter`.
+  void Erase(const Dtype *filter);
+
+  void Clear();
+
+  size_t Size() const;
+
+ private:
+  typedef std::tuple<const Dtype *, ConvLayout, utens_t, utens_t, WinogradTile>
+      Key;
+
+  mutable mutex _mu;
+  std::map<Key, std::shared_ptr<const WinogradFilter<Dtype>>> _cache
+      CHIME_GUARDED_BY(_mu);
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(WinogradFilterCache);
+};
+
+/// `chime_cpu_conv2d` with a transformed filter. Output tiles are processed
+/// a block at a time: the input tiles of a block are transformed, multiplied
+/// by the filter with one `chime_cpu_gemm` per transformed tile point, and
+/// transformed back into y with the bias, if not null, added.
+/// REQUIRES: WinogradApplies(params), and `filter` transformed for the
+/// channels of `params`.
+template<typename Dtype>
+void chime_cpu_conv2d_winograd(const Conv2DParams &params, const Dtype *x,
+                               const WinogradFilter<Dtype> &filter,
+                               const Dtype *bias, Dtype *y);
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_FRAMEWORK_WINOGRAD_H_
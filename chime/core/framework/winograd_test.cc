@@ -0,0 +1,221 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#include "chime/core/framework/winograd.h"
+
+#include <vector>
+
+#include "chime/core/framework/intra_op_parallel.h"
+#include "chime/core/framework/test_util.h"
+#include "chime/core/platform/test.hpp"
+
+namespace chime {
+
+namespace {
+
+Conv2DParams Params(ConvLayout layout, utens_t batch, utens_t in_channels,
+                    utens_t in_h, utens_t in_w, utens_t out_channels,
+                    utens_t pad) {
+  Conv2DParams p;
+  p.layout = layout;
+  p.batch = batch;
+  p.in_channels = in_channels;
+  p.in_h = in_h;
+  p.in_w = in_w;
+  p.out_channels = out_channels;
+  p.kernel_h = p.kernel_w = 3;
+  p.pad_h = p.pad_w = pad;
+  return p;
+}
+
+utens_t InputSize(const Conv2DParams &p) {
+  return p.batch * p.in_channels * p.in_h * p.in_w;
+}
+
+utens_t OutputSize(const Conv2DParams &p) {
+  return p.batch * p.out_channels * p.OutH() * p.OutW();
+}
+
+// The convolution from its definition, in float64.
+template<typename Dtype>
+std::vector<float64> Reference(const Conv2DParams &p,
+                               const std::vector<Dtype> &x,
+                               const std::vector<Dtype> &filter,
+                               const std::vector<Dtype> &bias) {
+  const bool nchw = p.layout == ConvLayout::kNCHW;
+  const utens_t ic = p.in_channels, oc = p.out_channels;
+  const utens_t out_h = p.OutH(), out_w = p.OutW();
+  std::vector<float64> y(OutputSize(p));
+  for (utens_t n = 0; n < p.batch; n++) {
+    for (utens_t o = 0; o < oc; o++) {
+      for (utens_t oh = 0; oh < out_h; oh++) {
+        for (utens_t ow = 0; ow < out_w; ow++) {
+          float64 sum = bias.empty() ? 0 : bias[o];
+          for (utens_t c = 0; c < ic; c++) {
+            for (utens_t kh = 0; kh < 3; kh++) {
+              for (utens_t kw = 0; kw < 3; kw++) {
+                const int64 ih = static_cast<int64>(oh + kh - p.pad_h);
+                const int64 iw = static_cast<int64>(ow + kw - p.pad_w);
+                if (ih < 0 || iw < 0 || ih >= static_cast<int64>(p.in_h) ||
+                    iw >= static_cast<int64>(p.in_w)) {
+                  continue;
+                }
+                const utens_t i =
+                    nchw ? ((n * ic + c) * p.in_h + ih) * p.in_w + iw
+                         : ((n * p.in_h + ih) * p.in_w + iw) * ic + c;
+                const utens_t f = nchw ? ((o * ic + c) * 3 + kh) * 3 + kw
+                                       : ((kh * 3 + kw) * ic + c) * oc + o;
+                sum += static_cast<float64>(x[i]) * filter[f];
+              }
+            }
+          }
+          y[nchw ? ((n * oc + o) * out_h + oh) * out_w + ow
+                 : ((n * out_h + oh) * out_w + ow) * oc + o] = sum;
+        }
+      }
+    }
+  }
+  return y;
+}
+
+template<typename Dtype>
+void CheckAgainstReference(const Conv2DParams &p, WinogradTile tile,
+                           float64 tolerance) {
+  const std::vector<Dtype> x = Pattern<Dtype>(InputSize(p), 1);
+  const std::vector<Dtype> filter =
+      Pattern<Dtype>(p.out_channels * p.in_channels * 9, 2);
+  const std::vector<Dtype> bias = Pattern<Dtype>(p.out_channels, 3);
+  const std::vector<float64> expected = Reference(p, x, filter, bias);
+  const WinogradFilter<Dtype> transformed(p, filter.data(), tile);
+  std::vector<Dtype> y(expected.size());
+  chime_cpu_conv2d_winograd(p, x.data(), transformed, bias.data(), y.data());
+  for (utens_t i = 0; i < y.size(); i++) {
+    EXPECT_NEAR(y[i], expected[i], tolerance) << i;
+  }
+}
+
+}  // namespace
+
+TEST(WinogradTest, TestSelection) {
+  Conv2DParams p = Params(ConvLayout::kNCHW, 1, 16, 56, 56, 16, 1);
+  EXPECT_TRUE(WinogradApplies(p));
+  EXPECT_EQ(PreferredWinogradTile(p), WinogradTile::kF4x4);
+  // A 2x2 output is half of a 4x4 tile.
+  p.in_h = p.in_w = 4;
+  p.pad_h = p.pad_w = 0;
+  EXPECT_EQ(PreferredWinogradTile(p), WinogradTile::kF2x2);
+  p.stride_w = 2;
+  EXPECT_FALSE(WinogradApplies(p));
+  p.stride_w = 1;
+  p.dilation_h = 2;
+  EXPECT_FALSE(WinogradApplies(p));
+  p.dilation_h = 1;
+  p.kernel_h = 5;
+  EXPECT_FALSE(WinogradApplies(p));
+  EXPECT_DEATH(WinogradFilter<float32>(p, nullptr, WinogradTile::kF2x2),
+               "3x3 kernel");
+}
+
+// Both tiles in both layouts, with outputs that do not fill the last tiles,
+// padding of 0 to 2 and more tiles than fit in a block.
+TEST(WinogradTest, TestAgainstReference) {
+  const std::vector<Conv2DParams> cases = {
+      Params(ConvLayout::kNCHW, 2, 3, 7, 9, 4, 1),
+      Params(ConvLayout::kNCHW, 1, 5, 10, 6, 2, 0),
+      Params(ConvLayout::kNCHW, 2, 2, 5, 5, 3, 2),
+      Params(ConvLayout::kNCHW, 1, 4, 3, 3, 3, 0),
+      Params(ConvLayout::kNCHW, 3, 16, 33, 31, 24, 1),
+  };
+  for (Conv2DParams p : cases) {
+    for (WinogradTile tile : {WinogradTile::kF2x2, WinogradTile::kF4x4}) {
+      CheckAgainstReference<float64>(p, tile, 1e-10);
+      p.layout = ConvLayout::kNHWC;
+      CheckAgainstReference<float64>(p, tile, 1e-10);
+      p.layout = ConvLayout::kNCHW;
+    }
+  }
+}
+
+TEST(WinogradTest, TestFloat) {
+  const Conv2DParams p = Params(ConvLayout::kNHWC, 2, 32, 14, 14, 16, 1);
+  CheckAgainstReference<float32>(p, WinogradTile::kF2x2, 1e-4);
+  CheckAgainstReference<float32>(p, WinogradTile::kF4x4, 1e-3);
+}
+
+// chime_cpu_conv2d goes through Winograd for enough channels and gives the
+// same result as the im2col path, up to rounding.
+TEST(WinogradTest, TestConvDispatch) {
+  for (ConvLayout layout : {ConvLayout::kNCHW, ConvLayout::kNHWC}) {
+    const Conv2DParams p = Params(layout, 2, 16, 12, 11, 16, 1);
+    const std::vector<float64> x = Pattern<float64>(InputSize(p), 1);
+    const std::vector<float64> filter = Pattern<float64>(16 * 16 * 9, 2);
+    const std::vector<float64> expected =
+        Reference(p, x, filter, std::vector<float64>());
+    std::vector<float64> y(expected.size());
+    chime_cpu_conv2d<float64>(p, x.data(), filter.data(), nullptr, y.data());
+    for (utens_t i = 0; i < y.size(); i++) {
+      EXPECT_NEAR(y[i], expected[i], 1e-10) << i;
+    }
+  }
+}
+
+// Each filter is transformed once per tile and layout, until it is erased.
+TEST(WinogradTest, TestFilterCache) {
+  const Conv2DParams p = Params(ConvLayout::kNHWC, 1, 16, 12, 11, 16, 1);
+  std::vector<float64> filter = Pattern<float64>(16 * 16 * 9, 2);
+  const std::vector<float64> filter2 = Pattern<float64>(16 * 16 * 9, 3);
+  WinogradFilterCache<float64> cache;
+  auto w1 = cache.Get(p, filter.data(), WinogradTile::kF4x4);
+  EXPECT_EQ(cache.Get(p, filter.data(), WinogradTile::kF4x4), w1);
+  EXPECT_NE(cache.Get(p, filter.data(), WinogradTile::kF2x2), w1);
+  cache.Get(p, filter2.data(), WinogradTile::kF4x4);
+  EXPECT_EQ(cache.Size(), 3);
+
+  cache.Erase(filter.data());
+  EXPECT_EQ(cache.Size(), 1);
+  // Handed out filters outlive their entry.
+  EXPECT_EQ(w1->tile(), WinogradTile::kF4x4);
+  EXPECT_EQ(w1->in_channels(), 16);
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+
+  // chime_cpu_conv2d fills the cache and reuses what it holds.
+  const std::vector<float64> x = Pattern<float64>(InputSize(p), 1);
+  std::vector<float64> y(OutputSize(p)), expected(y.size());
+  chime_cpu_conv2d<float64>(p, x.data(), filter.data(), nullptr,
+                            expected.data());
+  chime_cpu_conv2d<float64>(p, x.data(), filter.data(), nullptr, y.data(),
+                            &cache);
+  EXPECT_EQ(y, expected);
+  EXPECT_EQ(cache.Size(), 1);
+  // Writes to the filter are not seen until it is erased.
+  for (float64 &f : filter) f *= 2;
+  chime_cpu_conv2d<float64>(p, x.data(), filter.data(), nullptr, y.data(),
+                            &cache);
+  EXPECT_EQ(y, expected);
+  cache.Erase(filter.data());
+  chime_cpu_conv2d<float64>(p, x.data(), filter.data(), nullptr, y.data(),
+                            &cache);
+  for (utens_t i = 0; i < y.size(); i++) EXPECT_EQ(y[i], 2 * expected[i]);
+}
+
+// Tiles of a block are split over the threads without changing the result.
+TEST(WinogradTest, TestIntraOpParallel) {
+  for (ConvLayout layout : {ConvLayout::kNCHW, ConvLayout::kNHWC}) {
+    const Conv2DParams p = Params(layout, 2, 32, 28, 28, 32, 1);
+    const std::vector<float32> x = Pattern<float32>(InputSize(p), 1);
+    const std::vector<float32> filter = Pattern<float32>(32 * 32 * 9, 2);
+    const WinogradFilter<float32> transformed(p, filter.data(),
+                                              WinogradTile::kF4x4);
+    std::vector<std::vector<float32>> y(2,
+                                        std::vector<float32>(OutputSize(p)));
+    for (int run = 0; run < 2; run++) {
+      ScopedIntraOpNumThreads threads(run == 0 ? 1 : 4);
+      chime_cpu_conv2d_winograd<float32>(p, x.data(), transformed, nullptr,
+                                         y[run].data());
+    }
+    EXPECT_EQ(y[0], y[1]);
+  }
+}
+
+}  // namespace chime
@@ -0,0 +1,43 @@
+// Copyright by 2022.10 chime. All rights reserved.
+// author: yatorho
+
+#ifndef CHIME_CORE_PLATFORM_BLOCKING_COUNTER_H_
+#define CHIME_CORE_PLATFORM_BLOCKING_COUNTER_H_
+
+#include "chime/core/platform/logging.hpp"
+#include "chime/core/platform/macros.h"
+#include "chime/core/platform/mutex.h"
+
+namespace chime {
+
+/// Lets a thread wait until `initial_count` tasks have finished, without
+/// waiting on anything else scheduled on the same pool.
+class BlockingCounter {
+ public:
+  explicit BlockingCounter(int initial_count) : _count(initial_count) {
+    CHECK_GE(initial_count, 0);
+  }
+
+  void DecrementCount() {
+    mutex_lock lock(_mu);
+    DCHECK_GT(_count, 0);
+    if (--_count == 0) _cond.notify_all();
+  }
+
+  /// Blocks until the count reaches zero.
+  void Wait() {
+    mutex_lock lock(_mu);
+    _cond.wait(lock, [this]() { return _count == 0; });
+  }
+
+ private:
+  mutex _mu;
+  condition_variable _cond;
+  int _count;
+
+  CHIME_DISALLOW_COPY_AND_ASSIGN(BlockingCounter);
+};
+
+}  // namespace chime
+
+#endif  // CHIME_CORE_PLATFORM_BLOCKING_COUNTER_H_
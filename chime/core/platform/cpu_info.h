@@ -4,7 +4,6 @@
 #ifndef CHIME_CORE_PLATFORM_CPU_INFO_H_
 #define CHIME_CORE_PLATFORM_CPU_INFO_H_
 
-
 namespace chime {
 namespace port {
 
@@ -46,6 +45,34 @@ int NumHyperthreadsPerCore();
 /// Returns nominal CPU frequency in Hz of each processor.
 double NominalCPUFrequency();
 
+/// Mostly ISA related features that we care about when dispatching compute
+/// kernels at runtime.
+enum CPUFeature {
+  SSE = 0,
+  SSE2 = 1,
+  SSE3 = 2,
+  SSSE3 = 3,
+  SSE4_1 = 4,
+  SSE4_2 = 5,
+  AVX = 6,
+  AVX2 = 7,
+  FMA = 8,
+  F16C = 9,
+  AVX512F = 10,
+  AVX512DQ = 11,
+  AVX512BW = 12,
+  AVX512VL = 13,
+  AVX512_VNNI = 14,
+  AVX512_BF16 = 15,
+  AVX_VNNI = 16,
+};
+
+/// Checks whether the current processor supports one of the features above.
+/// Features whose register state is not enabled by the operating system (e.g.
+/// AVX when XSAVE does not cover the YMM registers) are reported as missing.
+/// Checks the CPU only once and caches the result, so it is cheap to call.
+bool TestCPUFeature(CPUFeature feature);
+
 }  // namespace port
 }  // namespace chime
 
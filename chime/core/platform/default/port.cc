@@ -110,6 +110,69 @@ int NumHyperthreadsPerCore() {
   return 1;
 }
 
+namespace {
+
+#if (__x86_64__ || __i386__)
+/// Reads the extended control register that tells which register files the
+/// operating system saves on context switch. Written with inline asm so that
+/// this file does not need to be compiled with `-mxsave`.
+uint64_t ReadXCR0() {
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+
+uint64_t DetectCPUFeatures() {
+  uint32_t eax, ebx, ecx, edx;
+  uint64_t features = 0;
+  auto set = [&features](CPUFeature feature, bool has) {
+    if (has) features |= (1ull << feature);
+  };
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+  set(SSE, edx & (1u << 25));
+  set(SSE2, edx & (1u << 26));
+  set(SSE3, ecx & (1u << 0));
+  set(SSSE3, ecx & (1u << 9));
+  set(SSE4_1, ecx & (1u << 19));
+  set(SSE4_2, ecx & (1u << 20));
+
+  // AVX family is only usable if the OS saves the XMM/YMM (and for AVX-512
+  // the opmask and ZMM) state.
+  const bool osxsave = ecx & (1u << 27);
+  const uint64_t xcr0 = osxsave ? ReadXCR0() : 0;
+  const bool os_avx = (xcr0 & 0x6) == 0x6;
+  const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+  set(AVX, os_avx && (ecx & (1u << 28)));
+  set(FMA, os_avx && (ecx & (1u << 12)));
+  set(F16C, os_avx && (ecx & (1u << 29)));
+
+  if (__get_cpuid_max(0, nullptr) < 7) return features;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  set(AVX2, os_avx && (ebx & (1u << 5)));
+  set(AVX512F, os_avx512 && (ebx & (1u << 16)));
+  set(AVX512DQ, os_avx512 && (ebx & (1u << 17)));
+  set(AVX512BW, os_avx512 && (ebx & (1u << 30)));
+  set(AVX512VL, os_avx512 && (ebx & (1u << 31)));
+  set(AVX512_VNNI, os_avx512 && (ecx & (1u << 11)));
+
+  __cpuid_count(7, 1, eax, ebx, ecx, edx);
+  set(AVX_VNNI, os_avx && (eax & (1u << 4)));
+  set(AVX512_BF16, os_avx512 && (eax & (1u << 5)));
+  return features;
+}
+#else
+uint64_t DetectCPUFeatures() { return 0; }
+#endif  // __x86_64__ || __i386__
+
+}  // namespace
+
+bool TestCPUFeature(CPUFeature feature) {
+  static const uint64_t features = DetectCPUFeatures();
+  return (features >> feature) & 1ull;
+}
+
 #if CHIME_USE_NUMA
 namespace {
 
@@ -27,6 +27,17 @@ TEST(Port, GetCurrentCPU) {
   EXPECT_LT(cpu, NumTotalCPUs());
 }
 
+TEST(Port, TestCPUFeature) {
+#if defined(__SSE2__)
+  EXPECT_TRUE(TestCPUFeature(SSE2));
+#endif  // __SSE2__
+  // Wider instruction sets imply the narrower ones they are built on.
+  if (TestCPUFeature(AVX512F)) EXPECT_TRUE(TestCPUFeature(AVX2));
+  if (TestCPUFeature(AVX2)) EXPECT_TRUE(TestCPUFeature(AVX));
+  if (TestCPUFeature(AVX)) EXPECT_TRUE(TestCPUFeature(SSE4_2));
+  if (TestCPUFeature(AVX512_VNNI)) EXPECT_TRUE(TestCPUFeature(AVX512F));
+}
+
 TEST(Port, NUMAMalloc) {
   const bool numa_enabled = NUMAEnabled();
   if (numa_enabled) {
@@ -45,19 +45,24 @@ void ThreadPoolImpl::Init() {
 
             {
               mutex_lock lock(_mutex);
-              if (_active_workers > 0) _active_workers--;
               _success_init_flags[i] = true;
               _cond.wait(lock, [this]() {
                 return _shutdown || !_tasks_queue.empty();
               });
-              _active_workers++;
               if (_shutdown && this->_tasks_queue.empty()) return;
 
+              // Counted as active in the same critical section that takes the
+              // task, so that `Wait` never sees an empty queue and no active
+              // worker while a task runs.
+              _active_workers++;
               task = std::move(_tasks_queue.front());
               _tasks_queue.pop();
             }
 
             task();
+
+            mutex_lock lock(_mutex);
+            _active_workers--;
           }
         }));
   }
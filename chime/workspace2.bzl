@@ -11,6 +11,7 @@ load("//third_party/grpc:workspace1.bzl", grpc_deps_1 = "repo")
 load("//third_party/pybind11:workspace0.bzl", pybind11 = "repo")
 load("//third_party/fp16:workspace.bzl", fp16 = "repo")
 load("//third_party/half:workspace.bzl", half = "repo")
+load("//third_party/eigen:workspace.bzl", eigen = "repo")
 
 def workspace():
     hwloc()
@@ -27,6 +28,7 @@ def workspace():
     pybind11()
     fp16()
     half()
+    eigen()
 
 ce_workspace2 = workspace
 chime_extra_deps1 = workspace
@@ -0,0 +1,12 @@
+# Copyright by 2022.10 chime. All rights reserved.
+
+load("//third_party:repo.bzl", "ce_http_archive")
+
+def repo():
+    ce_http_archive(
+        name = "eigen",
+        urls = ["https://gitlab.com/libeigen/eigen/-/archive/3.4.0/eigen-3.4.0.tar.gz"],
+        sha256 = "8586084f71f9bde545ee7fa6d00288b264a2b7ac3607b974e54d13e7162c1c72",
+        strip_prefix = "eigen-3.4.0",
+        build_file = "//third_party/eigen:eigen.BUILD",
+    )